@@ -1,4 +1,4 @@
-import os, time, json, boto3, logging
+import os, time, json, base64, struct, boto3, logging
 from decimal import Decimal
 
 logger = logging.getLogger()
@@ -22,6 +22,15 @@ iot            = boto3.client('iot')
 
 ok_cache = {}
 
+# Window statistics sent with aggregated samples (see MQTTClient/include/aggregator.h)
+SUMMARY_FIELDS = ('temperature_min', 'temperature_max', 'temperature_sd',
+                  'humidity_min', 'humidity_max', 'humidity_sd')
+
+# Packed telemetry layout (see MQTTClient/include/publisher.h)
+PACKED_VERSION = 1
+PACKED_HEADER  = struct.Struct('<BBI')   # version, count, base_ts
+PACKED_RECORD  = struct.Struct('<HHH')   # ts_offset, temperature_adc, humidity_adc
+
 def get_source_port(device, ip):
     """
     Query CloudWatch connect logs for the most recent
@@ -41,6 +50,65 @@ def get_source_port(device, ip):
     msg = json.loads(events[0]['message'])
     return msg.get('sourcePort')
 
+def decode_packed(raw):
+    """
+    Decode a data/sensor/packed payload into readings shaped like the JSON ones.
+    Raw HTU21 codes are converted the same way the device does (temperature in F).
+    """
+    version, count, base_ts = PACKED_HEADER.unpack_from(raw, 0)
+    if version != PACKED_VERSION:
+        raise ValueError(f"unsupported packed version {version}")
+    samples = []
+    for i in range(count):
+        offset, t_adc, rh_adc = PACKED_RECORD.unpack_from(
+            raw, PACKED_HEADER.size + i * PACKED_RECORD.size)
+        temp_c = t_adc * 175.72 / 65536 - 46.85
+        samples.append({
+            'ts'         : base_ts + offset,
+            'temperature': round(temp_c * 9 / 5 + 32, 2),
+            'humidity'   : round(rh_adc * 125 / 65536 - 6, 2)
+        })
+    return samples
+
+def get_samples(event):
+    """
+    Return the list of readings carried by the event.
+    Batched publishes carry a 'samples' list, each entry with its own ts.
+    Packed publishes arrive base64 encoded in 'b64'.
+    """
+    if 'b64' in event:
+        try:
+            return decode_packed(base64.b64decode(event['b64']))
+        except (ValueError, struct.error) as e:
+            logger.error("Bad packed payload: %s", e)
+            return []
+    if 'samples' in event:
+        return event.get('samples') or []
+    return [{
+        'ts'         : event.get('ts', int(time.time())),
+        'temperature': event.get('temperature'),
+        'humidity'   : event.get('humidity')
+    }]
+
+def store_samples(device, ip, port, samples):
+    with sensor_table.batch_writer() as batch:
+        for s in samples:
+            item = {
+                'deviceId'   : device,
+                'timestamp'  : int(s.get('ts', time.time())),
+                'ipAddr'     : ip,
+                'port'       : int(port),
+                'temperature': Decimal(str(s['temperature'])),
+                'humidity'   : Decimal(str(s['humidity']))
+            }
+            # Window summaries carry the sample count and spread next to the means
+            if 'n' in s:
+                item['samples'] = int(s['n'])
+                for f in SUMMARY_FIELDS:
+                    if f in s:
+                        item[f] = Decimal(str(s[f]))
+            batch.put_item(Item=item)
+
 def purge_cache():
     """Remove cache entries older than CHECK_INTERVAL."""
     cutoff = time.time() - CHECK_INTERVAL
@@ -50,7 +118,7 @@ def purge_cache():
 
 def lambda_handler(event, context):
     """
-    1) Extract deviceId, ipAddr, ts, temperature, humidity.
+    1) Extract deviceId, ipAddr and the samples (ts, temperature, humidity).
     2) Get sourcePort from CloudWatch.
     3) Fast‑path if in ok_cache.
     4) Else verify against DynamoDB.
@@ -59,12 +127,11 @@ def lambda_handler(event, context):
     """
     device   = event.get('deviceId')
     ip       = event.get('ipAddr')
-    ts       = event.get('ts', int(time.time()))
-    temp     = event.get('temperature')
-    hum      = event.get('humidity')
+    samples  = get_samples(event)
     now      = time.time()
 
-    if not all([device, ip, temp is not None, hum is not None]):
+    if not all([device, ip, samples]) or any(
+            s.get('temperature') is None or s.get('humidity') is None for s in samples):
         logger.error("Malformed event: %s", event)
         return
 
@@ -82,17 +149,8 @@ def lambda_handler(event, context):
     # 3) Fast‑path verification
     if key in ok_cache:
         ok_cache[key] = now
-        logger.info("Cache hit; storing data for %s", key)
-        sensor_table.put_item(
-            Item={
-                'deviceId'   : device,
-                'timestamp'  : int(ts),
-                'ipAddr'     : ip,
-                'port'       : int(port),
-                'temperature': Decimal(str(temp)),
-                'humidity'   : Decimal(str(hum))
-            }
-        )  
+        logger.info("Cache hit; storing %d samples for %s", len(samples), key)
+        store_samples(device, ip, port, samples)
         return
 
     # 4) DynamoDB verification
@@ -106,17 +164,8 @@ def lambda_handler(event, context):
     if item and item.get('ipAddr') == ip and int(item.get('port', -1)) == port:
         # Verified – cache & store
         ok_cache[key] = now
-        logger.info("Verified %s; storing data", key)
-        sensor_table.put_item(
-            Item={
-                'deviceId'   : device,
-                'timestamp'  : int(ts),
-                'ipAddr'     : ip,
-                'port'       : int(port),
-                'temperature': Decimal(str(temp)),
-                'humidity'   : Decimal(str(hum))
-            }
-        )  
+        logger.info("Verified %s; storing %d samples", key, len(samples))
+        store_samples(device, ip, port, samples)
         # Optionally update lastChecked
         verified_table.update_item(
             Key={'deviceId': device},
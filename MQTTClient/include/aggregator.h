@@ -0,0 +1,110 @@
+/**
+ * File Name:   aggregator.h
+ * Description: Windowed aggregation of environment samples.
+ *
+ * Every sample from the sensor task is filtered and folded into running statistics for the
+ * current publish window. Taking the window returns its summary and starts a new one.
+ */
+
+// Header Guard
+#ifndef __AGGREGATOR_H__
+#define __AGGREGATOR_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "htu21d.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Filter applied to each sample before it enters the window statistics, see aggregator_filter_t
+#ifndef AGGREGATOR_FILTER
+#define AGGREGATOR_FILTER                   aggregator_filter_median3
+#endif
+
+// EMA weight of a new sample is 1 / 2^AGGREGATOR_EMA_SHIFT
+#ifndef AGGREGATOR_EMA_SHIFT
+#define AGGREGATOR_EMA_SHIFT                2
+#endif
+
+#define AGGREGATOR_MEDIAN_LEN               3
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef enum {
+    aggregator_filter_none = 0,     /**< Samples enter the statistics as read */
+    aggregator_filter_median3,      /**< Median of the last three samples, removes single spikes */
+    aggregator_filter_ema           /**< Exponential moving average */
+} aggregator_filter_t;
+
+typedef enum {
+    aggregator_temperature = 0,
+    aggregator_humidity,
+    aggregator_channel_num
+} aggregator_channel_id_t;
+
+typedef struct {
+    float min;
+    float max;
+    float mean;
+    float stddev;           /**< Sample standard deviation, 0 for a single sample */
+} aggregator_stat_t;
+
+typedef struct {
+    uint16_t samples;       /**< Samples in the window, 0 when the summary is unused */
+    aggregator_stat_t temperature;
+    aggregator_stat_t humidity;
+} aggregator_summary_t;
+
+typedef struct {
+    uint16_t count;
+    float min;
+    float max;
+    float mean;
+    float m2;               /**< Sum of squared differences from the mean (Welford) */
+    uint32_t adc_sum;       /**< Sum of the filtered ADC codes, for the window's mean code */
+} aggregator_window_t;
+
+typedef struct {
+    aggregator_filter_t filter;
+    uint16_t history[aggregator_channel_num][AGGREGATOR_MEDIAN_LEN];
+    uint8_t history_len;
+    uint32_t ema[aggregator_channel_num];      /**< Filter state, ADC code in Q8 */
+    aggregator_window_t window[aggregator_channel_num];
+    uint32_t samples;       /**< Samples added since init */
+    uint32_t windows;       /**< Windows taken since init */
+    SemaphoreHandle_t mutex;
+} aggregator_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Initialize an aggregator
+ * @param agg Handle to the aggregator
+ * @param filter Filter applied to each sample
+ * @return 0 on success -1 on failure
+ */
+int aggregator_init(aggregator_t *agg, aggregator_filter_t filter);
+/**
+ * @brief Add a sample to the current window
+ * @param agg Handle to the aggregator
+ * @param data Sample as read by the sensor task, only the ADC codes are used
+ */
+void aggregator_add(aggregator_t *agg, const htu21_data_t *data);
+/**
+ * @brief Take the summary of the current window and start a new one
+ * @param agg Handle to the aggregator
+ * @param data Filled with the window means, ADC codes included
+ * @param summary Filled with the window statistics
+ * @return 0 on success -1 if the window is empty
+ */
+int aggregator_take(aggregator_t *agg, htu21_data_t *data, aggregator_summary_t *summary);
+
+#endif /* __AGGREGATOR_H__ */
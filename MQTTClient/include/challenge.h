@@ -0,0 +1,51 @@
+/**
+ * File Name:   challenge.h
+ * Description: Recent challenges of the control node, to tell stale responses from wrong ones.
+ *
+ * The control node sends a fresh nonce every CHALLENGE_INTERVAL_MS. A response that arrives late,
+ * e.g. replayed by the broker after an outage, answers an older nonce. It is neither proof of a
+ * valid node nor of an invalid one, so it must not produce a verdict.
+ */
+
+// Header Guard
+#ifndef __CHALLENGE_H__
+#define __CHALLENGE_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Challenges remembered, the newest one is the only one a response passes against
+#ifndef CHALLENGE_HISTORY
+#define CHALLENGE_HISTORY                   8
+#endif
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef enum {
+    challenge_match = 0,            /**< Answers the newest challenge */
+    challenge_stale,                /**< Answers an older challenge, ignore it */
+    challenge_mismatch              /**< Answers none of them */
+} challenge_result_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Remember a challenge that was sent
+ * @param expected Response the challenge expects, compute_nonce_xor() of its nonce
+ */
+void challenge_issued(uint32_t expected);
+/**
+ * @brief Check a response against the challenges sent
+ * @param response Response received
+ * @return How the response relates to the challenges sent
+ */
+challenge_result_t challenge_check(uint32_t response);
+
+#endif /* __CHALLENGE_H__ */
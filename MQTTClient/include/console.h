@@ -4,11 +4,19 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include "os.h"
 #include "log.h"
 
 #define CMD_SIZE_MAX                        1024
-#define CMD_NUM_MAX                         20
+#define CMD_NUM_MAX                         32
+#define CMD_ARGC_MAX                        8
+// Buckets of the command index, must be a power of two larger than CMD_NUM_MAX
+#define CMD_HASH_BUCKETS                    64
+// Input is read from the UART driver in chunks of up to CONSOLE_RX_CHUNK bytes, echo is written
+// back in chunks of up to CONSOLE_ECHO_SIZE
+#define CONSOLE_RX_CHUNK                    128
+#define CONSOLE_ECHO_SIZE                   64
 #define DEFAULT_CONSOLE_TASK_STACK          2048
 #define WAIT_FOREVER                        (0xFFFFFFFF)
 #define PRIORITY_DEFAULT 			        (-1)
@@ -35,8 +43,19 @@ typedef struct {
     TaskHandle_t thread;
     char cmd_buf[CMD_SIZE_MAX];
     SemaphoreHandle_t cmd_buf_mutex;//currently unused
-    bool echo;//unused
+    bool echo;                          /**< Echo input back, password characters as '*' */
     int uart_num;
+    QueueHandle_t uart_queue;           /**< UART driver events, NULL to read byte by byte */
+
+    // Line editor
+    uint8_t rx_buf[CONSOLE_RX_CHUNK];   /**< Bytes read from the driver, not yet edited */
+    int rx_len;
+    int rx_pos;
+    int cmd_len;                        /**< Length of the line being edited */
+    bool overlong;                      /**< The line did not fit in cmd_buf */
+    uint8_t esc;                        /**< State of an escape sequence being skipped */
+    char echo_buf[CONSOLE_ECHO_SIZE];
+    int echo_len;
 }console_t;
 
 /**
@@ -46,6 +65,12 @@ typedef struct {
  * @return 0 on success -1 on failure
  */
 int console_init(console_t *console, int uart_num);
+/**
+ * @brief Register a console command, usable before or after console_init
+ * @param cmd Command to add, must stay valid and its name must be unique
+ * @return 0 on success -1 if the table is full or the name is taken
+ */
+int console_register_cmd(const cmd_entry *cmd);
 /**
  * @brief Deinitialize a console
  * @param console Handle to console to deinitialize
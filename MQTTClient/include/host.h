@@ -11,6 +11,8 @@
 #include "htu21d.h"
 #include "driver/i2c.h"
 #include "i2c.h"
+#include "i2c_bus.h"
+#include "i2c_scan.h"
 // Console
 #include "driver/uart.h"
 #include "serial.h"
@@ -23,6 +25,16 @@
 #include "esp_log.h"
 
 #include "mqtt_client.h"
+#include "mqtt.h"
+#include "mqtt_conn.h"
+#include "mqtt_rx.h"
+#include "publisher.h"
+#include "sfq_store.h"
+#include "aggregator.h"
+#include "metrics.h"
+#include "puback.h"
+#include "outbox.h"
+#include "challenge.h"
 #define STR(s) #s
 #define XSTR(s) STR(s)
 
@@ -48,6 +60,12 @@ typedef struct {
     ssd1306_t ssd1306;
     wifi_creds_t wifi_creds;
     esp_mqtt_client_handle_t mqtt_client;
+    esp_mqtt_client_handle_t mqtt_control_client;   // mqtt_client unless MQTT_CONTROL_CONNECTION
+    aggregator_t aggregator;
+    publisher_t publisher;
+    sfq_store_t sfq;
+    TaskHandle_t sfq_drain_thread;
+    volatile bool mqtt_connected;
 } host_t;
 
 
@@ -72,6 +90,7 @@ void init_host(host_t* );
 void verify_challenge_response(const char* response_payload, host_t *host); 
 void respond_to_challenge(host_t* host, const char* challenge_payload); 
 void challenge_task(void *pvParameter);
+void sfq_drain_task(void *pvParameter);
 void publish_challenge(host_t* host); 
 uint32_t compute_nonce_xor(uint32_t nonce);
 
@@ -0,0 +1,96 @@
+/**
+ * File Name:   htu21_fixed.h
+ * Description: Integer math for the htu21d conversions and derived values.
+ *
+ * Temperatures are in hundredths of a degree (centi-degC / centi-degF) and relative humidity in
+ * hundredths of a percent (centi-%RH). Nothing here touches the FPU.
+ */
+
+// Header Guard
+#ifndef _HTU21_FIXED_H_
+#define _HTU21_FIXED_H_
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Fixed point versions of the htu21d.h processing constants
+#define HTU21_FIXED_TEMPERATURE_MUL							17572		// 175.72 degC * 100
+#define HTU21_FIXED_TEMPERATURE_ADD							(-4685)		// -46.85 degC * 100
+#define HTU21_FIXED_HUMIDITY_MUL							12500		// 125 %RH * 100
+#define HTU21_FIXED_HUMIDITY_ADD							(-600)		// -6 %RH * 100
+#define HTU21_FIXED_CONSTANT_B								176239		// 1762.39 * 100
+#define HTU21_FIXED_CONSTANT_C								23566		// 235.66 * 100
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Converts a temperature ADC code to centi-degC.
+ *        Rounded to nearest, within 0.005 degC of htu21_temperature_from_adc().
+ *
+ * @param[in] uint16_t - Temperature ADC code
+ *
+ * @return int32_t - Temperature (centi-degC)
+ */
+int32_t htu21_fixed_temperature(uint16_t);
+
+/**
+ * @brief Converts a relative humidity ADC code to centi-%RH.
+ *        Rounded to nearest, within 0.005 %RH of htu21_humidity_from_adc().
+ *
+ * @param[in] uint16_t - Relative humidity ADC code
+ *
+ * @return int32_t - Relative humidity (centi-%RH)
+ */
+int32_t htu21_fixed_humidity(uint16_t);
+
+/**
+ * @brief Converts centi-degC to centi-degF. Exact up to truncation (0.01 degF).
+ *
+ * @param[in] int32_t - Temperature (centi-degC)
+ *
+ * @return int32_t - Temperature (centi-degF)
+ */
+int32_t htu21_fixed_fahrenheit(int32_t);
+
+/**
+ * @brief Temperature compensated humidity, see htu21_compute_compensated_humidity().
+ *        Within 0.01 %RH of the float version.
+ *
+ * @param[in] int32_t - Temperature (centi-degC)
+ * @param[in] int32_t - Relative humidity (centi-%RH)
+ *
+ * @return int32_t - Compensated humidity (centi-%RH)
+ */
+int32_t htu21_fixed_compensated_humidity(int32_t, int32_t);
+
+/**
+ * @brief Dew point, see htu21_compute_dew_point().
+ *
+ * The datasheet formula reduces to Td = -B / (log10(RH/100) - B/(T+C)) - C, so only a log10 is
+ * needed. It is computed from a 33 entry log2 table with linear interpolation (log10 error below
+ * 8e-5). Over -40..125 degC and 1..100 %RH the result is within 0.02 degC of the
+ * double precision version. RH is clamped to 0.01..100 %RH.
+ *
+ * @param[in] int32_t - Temperature (centi-degC)
+ * @param[in] int32_t - Relative humidity (centi-%RH)
+ *
+ * @return int32_t - Dew point (centi-degC)
+ */
+int32_t htu21_fixed_dew_point(int32_t, int32_t);
+
+/**
+ * @brief log10 of an integer in Q16, from the same table as htu21_fixed_dew_point().
+ *
+ * @param[in] uint32_t - Value, must be non zero
+ *
+ * @return int32_t - log10 of the value (Q16)
+ */
+int32_t htu21_fixed_log10(uint32_t);
+
+#endif //End Header Guard
@@ -14,6 +14,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "esp_timer.h"
 #include "log.h"
 /***************************************************************************************************/
 /* Public Datatypes */
@@ -41,6 +42,7 @@ typedef enum {
 	htu21_resolution_t_13b_rh_10b,
 	htu21_resolution_t_11b_rh_11b
 } htu21_resolution_t;
+#define HTU21_RESOLUTION_NUM		4
 
 typedef enum {
 	htu21_battery_ok,
@@ -51,14 +53,47 @@ typedef enum {
 	htu21_heater_off,
 	htu21_heater_on
 } htu21_heater_status_t;
-typedef struct htu21 {
-	TaskHandle_t thread;
-	QueueHandle_t msg_queue;
-} htu21_t;
+typedef enum {
+	htu21_state_idle,			// Waiting for the next sample period
+	htu21_state_temperature,	// Temperature conversion in progress
+	htu21_state_humidity		// Humidity conversion in progress
+} htu21_state_t;
+
+// Acquisition latency, from issuing the temperature conversion to the humidity result
+typedef struct {
+	uint32_t samples;			// Completed acquisitions
+	uint32_t errors;			// Failed acquisitions
+	uint32_t polls;				// Read attempts NACKed because a conversion was still running
+	uint32_t last_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t total_us;
+} htu21_latency_t;
+
 typedef struct htu21_data {
 	float temperature;
 	float humidity;
+	uint16_t temperature_adc;	// Raw ADC code the temperature was computed from
+	uint16_t humidity_adc;		// Raw ADC code the humidity was computed from
 } htu21_data_t;
+
+// Called from the sensor task with every sample read
+typedef void (*htu21_sample_cb_t)(void* ctx, const htu21_data_t* data);
+
+typedef struct htu21 {
+	TaskHandle_t thread;
+	QueueHandle_t msg_queue;		// Latest sample only
+	htu21_sample_cb_t on_sample;	// Optional, sees every sample
+	void* on_sample_ctx;
+	uint32_t sample_period_ms;		// Time between samples, HTU21_SAMPLE_PERIOD_MS if 0
+	htu21_resolution_t resolution;	// Resolution selected when the sensor task starts
+	htu21_state_t state;
+	esp_timer_handle_t timer;		// Fires when a conversion is done or the next sample is due
+	int64_t next_sample_us;
+	int64_t acquire_start_us;
+	int64_t poll_deadline_us;		// Give up polling for a conversion result after this time
+	htu21_latency_t latency[HTU21_RESOLUTION_NUM];	// Indexed by htu21_resolution_t
+} htu21_t;
 /***************************************************************************************************/
 /* Public Constants */
 /***************************************************************************************************/
@@ -78,6 +113,22 @@ typedef struct htu21_data {
 
 #define RESET_TIME											15			// ms value
 
+// Fastest SCL clock in the datasheet
+#define HTU21_I2C_MAX_HZ									400000
+
+// Limit for one I2C transaction, covers the clock stretching of a 14 bit hold mode conversion
+#ifndef HTU21_I2C_TIMEOUT_MS
+#define HTU21_I2C_TIMEOUT_MS								100
+#endif
+
+// Default sampling configuration of the sensor task
+#ifndef HTU21_SAMPLE_PERIOD_MS
+#define HTU21_SAMPLE_PERIOD_MS								1000
+#endif
+#ifndef HTU21_RESOLUTION
+#define HTU21_RESOLUTION									htu21_resolution_t_13b_rh_10b
+#endif
+
 // Processing constants
 #define HTU21_TEMPERATURE_COEFFICIENT						(float)(-0.15)
 #define HTU21_CONSTANT_A									(float)(8.1332)
@@ -92,7 +143,20 @@ typedef struct htu21_data {
 #define HUMIDITY_COEFF_MUL									(125)
 #define HUMIDITY_COEFF_ADD									(-6)
 
-// Conversion timings
+// Results are polled for instead of waiting the worst case conversion time. The first read is
+// attempted at HTU21_POLL_FIRST_PERCENT of the conversion time, then every HTU21_POLL_INTERVAL_US
+// until the sensor ACKs or HTU21_POLL_TIMEOUT_PERCENT of the conversion time has passed.
+#ifndef HTU21_POLL_FIRST_PERCENT
+#define HTU21_POLL_FIRST_PERCENT							75
+#endif
+#ifndef HTU21_POLL_INTERVAL_US
+#define HTU21_POLL_INTERVAL_US								1000
+#endif
+#ifndef HTU21_POLL_TIMEOUT_PERCENT
+#define HTU21_POLL_TIMEOUT_PERCENT							150
+#endif
+
+// Conversion timings (us), the datasheet maximum for each resolution
 #define HTU21_TEMPERATURE_CONVERSION_TIME_T_14b_RH_12b		50000
 #define HTU21_TEMPERATURE_CONVERSION_TIME_T_13b_RH_10b		25000
 #define HTU21_TEMPERATURE_CONVERSION_TIME_T_12b_RH_8b		13000
@@ -209,6 +273,105 @@ void htu21_set_i2c_master_mode(htu21_i2c_master_mode_t);
  */
 htu21_status_t htu21_read_temperature_and_relative_humidity( float *, float*);
 
+/**
+ * @brief Reads the raw temperature and relative humidity ADC codes.
+ *
+ * @param[out] uint16_t* : Temperature ADC code
+ * @param[out] uint16_t* : Relative humidity ADC code
+ *
+ * @return htu21_status : status of HTU21
+ *       - htu21_status_ok : I2C transfer completed successfully
+ *       - htu21_status_i2c_transfer_error : Problem with i2c transfer
+ *       - htu21_status_no_i2c_acknowledge : I2C did not acknowledge
+ *       - htu21_status_crc_error : CRC check error
+ */
+htu21_status_t htu21_read_adc(uint16_t *, uint16_t *);
+
+/**
+ * @brief Starts a temperature conversion without holding the bus.
+ *        The result can be read with htu21_read_conversion once the conversion time has passed.
+ *
+ * @return htu21_status : status of HTU21
+ *       - htu21_status_ok : I2C transfer completed successfully
+ *       - htu21_status_i2c_transfer_error : Problem with i2c transfer
+ *       - htu21_status_no_i2c_acknowledge : I2C did not acknowledge
+ */
+htu21_status_t htu21_start_temperature_conversion(void);
+
+/**
+ * @brief Starts a relative humidity conversion without holding the bus.
+ *        The result can be read with htu21_read_conversion once the conversion time has passed.
+ *
+ * @return htu21_status : status of HTU21
+ *       - htu21_status_ok : I2C transfer completed successfully
+ *       - htu21_status_i2c_transfer_error : Problem with i2c transfer
+ *       - htu21_status_no_i2c_acknowledge : I2C did not acknowledge
+ */
+htu21_status_t htu21_start_humidity_conversion(void);
+
+/**
+ * @brief Reads back the result of the last conversion started.
+ *
+ * @param[out] uint16_t* : ADC code
+ *
+ * @return htu21_status : status of HTU21
+ *       - htu21_status_ok : I2C transfer completed successfully
+ *       - htu21_status_i2c_transfer_error : Problem with i2c transfer
+ *       - htu21_status_no_i2c_acknowledge : I2C did not acknowledge (conversion not finished)
+ *       - htu21_status_crc_error : CRC check error
+ */
+htu21_status_t htu21_read_conversion(uint16_t *);
+
+/**
+ * @brief Reads back the last conversion without checking it, so the next conversion can be
+ *        started before the CRC check. Use htu21_decode_conversion on the result.
+ *
+ * @param[out] uint8_t* : 3 byte buffer for the ADC code and CRC
+ *
+ * @return htu21_status : status of HTU21
+ *       - htu21_status_ok : I2C transfer completed successfully
+ *       - htu21_status_i2c_transfer_error : Problem with i2c transfer
+ *       - htu21_status_no_i2c_acknowledge : I2C did not acknowledge (conversion not finished)
+ */
+htu21_status_t htu21_read_conversion_raw(uint8_t *);
+
+/**
+ * @brief Checks the CRC of a result read with htu21_read_conversion_raw.
+ *
+ * @param[in] const uint8_t* : 3 byte buffer read from the sensor
+ * @param[out] uint16_t* : ADC code
+ *
+ * @return htu21_status : status of HTU21
+ *       - htu21_status_ok : CRC matched
+ *       - htu21_status_crc_error : CRC check error
+ */
+htu21_status_t htu21_decode_conversion(const uint8_t *, uint16_t *);
+
+/**
+ * @brief Prints the acquisition latency measured for each resolution used so far
+ *
+ * @param[in] const htu21_t* : Sensor handle
+ */
+void htu21_print_latency(const htu21_t *);
+
+/**
+ * @brief Converts a temperature ADC code to degC
+ *
+ * @param[in] uint16_t - Temperature ADC code
+ *
+ * @return float - Temperature (degC)
+ */
+float htu21_temperature_from_adc(uint16_t);
+
+/**
+ * @brief Converts a relative humidity ADC code to %RH
+ *
+ * @param[in] uint16_t - Relative humidity ADC code
+ *
+ * @return float - Relative humidity (%RH)
+ */
+float htu21_humidity_from_adc(uint16_t);
+
 /**
  * @brief Provide battery status
  *
@@ -3,7 +3,42 @@
 /**
  * Includes
  */
+#include <stddef.h>
 #include "driver/i2c.h"
+#include "i2c_bus.h"
+
+/**
+ * Constants
+ */
+// Command link storage of a device: up to two writes, or a write and a read, per transaction
+#define I2C_DEV_LINK_SIZE           I2C_LINK_RECOMMENDED_SIZE(2)
+
+// Clock of I2C_NUM_0 until the bus bring-up picked a faster one
+#ifndef I2C_DEFAULT_CLK_HZ
+#define I2C_DEFAULT_CLK_HZ          100000
+#endif
+
+/**
+ * Datatypes
+ */
+typedef enum {
+    i2c_status_ok = 0,
+    i2c_status_nack,            /**< The device did not acknowledge */
+    i2c_status_timeout,         /**< The transaction did not finish in time */
+    i2c_status_busy,            /**< The arbiter queue is full */
+    i2c_status_error            /**< Any other driver or bus error */
+} i2c_status_t;
+
+/**
+ * A device on an I2C port. Transactions are built in the device's own link buffer and run
+ * through the bus arbiter, so they allocate nothing. One transaction per device at a time.
+ */
+typedef struct {
+    i2c_bus_client_t client;
+    uint8_t addr;
+    TickType_t timeout;
+    uint8_t link[I2C_DEV_LINK_SIZE];
+} i2c_dev_t;
 
 /**
  * @brief Initilize a i2c peripheral
@@ -12,27 +47,102 @@
  */
 int i2c_init(int num);
 /**
- * @brief Initilize a i2c peripheral
+ * @brief Change the SCL clock of an initialized peripheral, only between transactions
+ * @param num The i2c peripheral
+ * @param clk_hz New clock in Hz
+ * @return 0 on success -1 on failure
+ */
+int i2c_set_clock(int num, uint32_t clk_hz);
+/**
+ * @brief Get the SCL clock of a peripheral
+ * @param num The i2c peripheral
+ * @return Clock in Hz, 0 if the peripheral is not initialized
+ */
+uint32_t i2c_get_clock(int num);
+/**
+ * @brief Read from a device
  * @param num The i2c peripheral to use
+ * @param addr 7 bit address of the device
  * @param buf Pointer to data to receive
  * @param len Length of buffer
- * @param timeout Maximum amount of time to receive
+ * @param timeout Maximum amount of time to receive in ms
  * @return 0 on success -1 on failure
  */
 int i2c_read(int num, uint8_t addr, unsigned char *buf, int len, int timeout);
 /**
- * @brief Initilize a i2c peripheral
+ * @brief Write to a device
  * @param num The i2c peripheral to use
+ * @param addr 7 bit address of the device
  * @param buf Pointer to data to send
  * @param len Length of buffer
+ * @param timeout Maximum amount of time to send in ms
  * @return 0 on success -1 on failure
  */
-void i2c_write(int num, uint8_t addr, const unsigned char *buf, int len);
+int i2c_write(int num, uint8_t addr, const unsigned char *buf, int len, int timeout);
 /**
  * @brief Uninstall i2c driver
  * @param num The peripheral to uninstall
  * @return 0 on success -1 on failure
  */
 int i2c_delete(int num);
+/**
+ * @brief Map an ESP-IDF error code to a transaction status
+ * @param err Result of i2c_master_cmd_begin()
+ * @return Transaction status
+ */
+i2c_status_t i2c_status_from_esp(esp_err_t err);
+/**
+ * @brief Set up a device and register it with the bus arbiter
+ * @param dev Handle to the device, must stay valid
+ * @param num The i2c peripheral the device is on
+ * @param addr 7 bit address of the device
+ * @param prio Bus priority of the device's transactions
+ * @param timeout_ms Limit for one transaction, and for the wait for the bus before it
+ * @param name Name shown in the bus statistics
+ * @return 0 on success -1 on failure, the device still works without the arbiter
+ */
+int i2c_dev_init(i2c_dev_t *dev, i2c_port_t num, uint8_t addr, i2c_bus_prio_t prio, uint32_t timeout_ms,
+    const char *name);
+/**
+ * @brief Address the device and stop, i2c_status_ok if it acknowledged
+ * @param dev Handle to the device
+ * @return Transaction status
+ */
+i2c_status_t i2c_dev_probe(i2c_dev_t *dev);
+/**
+ * @brief Write to the device
+ * @param dev Handle to the device
+ * @param buf Data to send
+ * @param len Length of data
+ * @return Transaction status
+ */
+i2c_status_t i2c_dev_write(i2c_dev_t *dev, const uint8_t *buf, size_t len);
+/**
+ * @brief Write a prefix byte, e.g. a register or control byte, then data in one transaction
+ * @param dev Handle to the device
+ * @param prefix First byte after the address
+ * @param buf Data to send after the prefix
+ * @param len Length of data
+ * @return Transaction status
+ */
+i2c_status_t i2c_dev_write_prefixed(i2c_dev_t *dev, uint8_t prefix, const uint8_t *buf, size_t len);
+/**
+ * @brief Read from the device, every byte is acknowledged but the last
+ * @param dev Handle to the device
+ * @param buf Data received
+ * @param len Number of bytes to read
+ * @return Transaction status
+ */
+i2c_status_t i2c_dev_read(i2c_dev_t *dev, uint8_t *buf, size_t len);
+/**
+ * @brief Write, then read after a repeated start
+ * @param dev Handle to the device
+ * @param wbuf Data to send
+ * @param wlen Length of data to send
+ * @param rbuf Data received
+ * @param rlen Number of bytes to read
+ * @return Transaction status
+ */
+i2c_status_t i2c_dev_write_read(i2c_dev_t *dev, const uint8_t *wbuf, size_t wlen, uint8_t *rbuf, size_t rlen);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,198 @@
+/**
+ * File Name:   i2c_bus.h
+ * Description: Prioritised arbiter for an I2C port shared by several drivers.
+ *
+ * Drivers register as clients with a priority and submit their command links instead of calling
+ * i2c_master_cmd_begin() themselves. A bus task runs one transaction at a time, always taking the
+ * oldest request of the highest priority waiting, so a sensor read waits for at most the
+ * transaction in progress, e.g. one display page. Wait and hold times are kept per client.
+ */
+
+// Header Guard
+#ifndef __I2C_BUS_H__
+#define __I2C_BUS_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include "driver/i2c.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Requests that can wait per priority level
+#ifndef I2C_BUS_QUEUE_LEN
+#define I2C_BUS_QUEUE_LEN                   8
+#endif
+
+#ifndef I2C_BUS_TASK_STACK
+#define I2C_BUS_TASK_STACK                  2048
+#endif
+// Above every client so a finished transfer is followed by the next one straight away
+#ifndef I2C_BUS_TASK_PRIORITY
+#define I2C_BUS_TASK_PRIORITY               10
+#endif
+
+// Wait and hold histograms: bucket i counts times below I2C_BUS_HIST_BASE_US << i, the last
+// bucket everything above
+#define I2C_BUS_HIST_BUCKETS                8
+#define I2C_BUS_HIST_BASE_US                100
+
+// Bus utilisation is measured over windows of I2C_BUS_UTIL_WINDOW_MS, in 10% buckets
+#define I2C_BUS_UTIL_WINDOW_MS              1000
+#define I2C_BUS_UTIL_BUCKETS                10
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef enum {
+    i2c_bus_prio_high = 0,          /**< Latency sensitive reads, e.g. the environment sensor */
+    i2c_bus_prio_normal,            /**< Short commands */
+    i2c_bus_prio_low,               /**< Bulk transfers, e.g. display flushes */
+    i2c_bus_prio_num
+} i2c_bus_prio_t;
+
+typedef enum {
+    i2c_bus_req_idle = 0,
+    i2c_bus_req_queued,
+    i2c_bus_req_running,
+    i2c_bus_req_cancelled           /**< Given up while queued, the bus task drops it */
+} i2c_bus_req_state_t;
+
+struct i2c_bus;
+struct i2c_bus_client;
+
+/**
+ * @brief Completion callback, runs in the bus task
+ * @param ctx Context given with the request
+ * @param status Result of i2c_master_cmd_begin()
+ */
+typedef void (*i2c_bus_done_cb_t)(void *ctx, esp_err_t status);
+
+typedef struct {
+    struct i2c_bus_client *client;
+    i2c_cmd_handle_t cmd;
+    TickType_t timeout;
+    i2c_bus_done_cb_t done;
+    void *ctx;
+    int64_t submit_us;              /**< Set by i2c_bus_submit */
+    volatile i2c_bus_req_state_t state;
+} i2c_bus_req_t;
+
+typedef struct i2c_bus_client {
+    const char *name;
+    i2c_port_t num;
+    i2c_bus_prio_t prio;
+    struct i2c_bus *bus;            /**< NULL if the port has no arbiter, transfers go direct */
+    SemaphoreHandle_t done;         /**< Given when a synchronous transfer completes */
+    struct i2c_bus_client *next;
+
+    // Request of i2c_bus_transfer(), kept here so a caller that timed out leaves nothing behind
+    // on its stack
+    i2c_bus_req_t sync;
+    esp_err_t sync_status;
+    uint32_t timeouts;              /**< Synchronous transfers that never started in time */
+
+    // Written by the bus task only
+    uint32_t transfers;
+    uint32_t errors;
+    uint32_t wait_us_max;
+    uint64_t wait_us_total;         /**< Submit to start of the transaction */
+    uint64_t hold_us_total;         /**< Start to end of the transaction */
+    uint32_t wait_hist[I2C_BUS_HIST_BUCKETS];
+    uint32_t hold_hist[I2C_BUS_HIST_BUCKETS];
+} i2c_bus_client_t;
+
+/**
+ * @brief Transaction monitor, runs in the bus task after every transaction and before the next
+ *        one, so it may reconfigure the port
+ * @param ctx Context given with the monitor
+ * @param client Client of the transaction
+ * @param status Result of i2c_master_cmd_begin()
+ */
+typedef void (*i2c_bus_monitor_t)(void *ctx, const i2c_bus_client_t *client, esp_err_t status);
+
+typedef struct i2c_bus {
+    i2c_port_t num;
+    QueueHandle_t queue[i2c_bus_prio_num];
+    SemaphoreHandle_t pending;      /**< Counts requests in all queues */
+    SemaphoreHandle_t lock;         /**< Protects the client list */
+    TaskHandle_t thread;
+    i2c_bus_client_t *clients;
+    i2c_bus_monitor_t monitor;
+    void *monitor_ctx;
+
+    // Utilisation, written by the bus task only
+    int64_t start_us;
+    uint64_t busy_us_total;
+    int64_t window_start_us;
+    uint32_t window_busy_us;
+    uint32_t util_hist[I2C_BUS_UTIL_BUCKETS];
+} i2c_bus_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Start the arbiter of an I2C port, the driver must be installed already
+ * @param num The i2c peripheral
+ * @return 0 on success -1 on failure
+ */
+int i2c_bus_start(i2c_port_t num);
+/**
+ * @brief Register a client of an I2C port, a client already registered is left as it is
+ * @param client Handle to the client, must stay valid and zeroed before the first call
+ * @param num The i2c peripheral
+ * @param prio Priority of every request of the client
+ * @param name Name shown in the statistics
+ * @return 0 on success -1 on failure. Without an arbiter on the port the client still works and
+ *         its transfers go straight to the driver.
+ */
+int i2c_bus_client_init(i2c_bus_client_t *client, i2c_port_t num, i2c_bus_prio_t prio, const char *name);
+/**
+ * @brief Queue a transaction, the callback reports the result
+ * @param req Request, must stay valid until the callback ran or, after it was cancelled, until
+ *        the bus task dropped it (state back to i2c_bus_req_idle)
+ * @return 0 on success -1 if the queue is full or the port has no arbiter
+ */
+int i2c_bus_submit(i2c_bus_req_t *req);
+/**
+ * @brief Run a transaction and wait for it
+ * @note One synchronous transfer per client at a time, give each task its own client
+ * @param client Handle to the client
+ * @param cmd Command link of the transaction
+ * @param timeout Longest wait for the bus, then the bus timeout once the transaction started as
+ *        for i2c_master_cmd_begin()
+ * @return Result of i2c_master_cmd_begin(), ESP_ERR_NO_MEM if the queue is full, ESP_ERR_TIMEOUT
+ *         if the transaction did not start in time. It is then cancelled, the bus task never
+ *         touches cmd or its buffers after the return.
+ */
+esp_err_t i2c_bus_transfer(i2c_bus_client_t *client, i2c_cmd_handle_t cmd, TickType_t timeout);
+/**
+ * @brief Get the number of requests waiting at a priority
+ * @param num The i2c peripheral
+ * @param prio Priority level
+ * @return Requests waiting, -1 if the port has no arbiter
+ */
+int i2c_bus_queue_depth(i2c_port_t num, i2c_bus_prio_t prio);
+/**
+ * @brief Set the transaction monitor of a port, replaces the previous one
+ * @param num The i2c peripheral
+ * @param monitor Monitor, NULL to remove it
+ * @param ctx Context passed to the monitor
+ * @return 0 on success -1 if the port has no arbiter
+ */
+int i2c_bus_set_monitor(i2c_port_t num, i2c_bus_monitor_t monitor, void *ctx);
+/**
+ * @brief Print the client and utilisation statistics of a port
+ * @param num The i2c peripheral
+ */
+void i2c_bus_print_stats(i2c_port_t num);
+
+#endif /* __I2C_BUS_H__ */
@@ -0,0 +1,127 @@
+/**
+ * File Name:   i2c_scan.h
+ * Description: Bring-up of an I2C port: device scan, clock selection and runtime fallback.
+ *
+ * At startup every 7 bit address is probed and the devices that acknowledge are recorded. The
+ * clock is then raised step by step up to the slowest present device's limit. At each step all
+ * devices are probed and, where the board supplies one, a device specific check such as a CRC
+ * protected read runs a number of rounds. The fastest step without a failure is kept. Afterwards
+ * the bus task reports every transaction and the clock drops one step when the error rate of a
+ * window of transactions gets too high.
+ */
+
+// Header Guard
+#ifndef __I2C_SCAN_H__
+#define __I2C_SCAN_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "driver/i2c.h"
+#include "i2c.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Devices recorded per port
+#ifndef I2C_SCAN_MAX_DEVICES
+#define I2C_SCAN_MAX_DEVICES                8
+#endif
+// Limit of a device that acknowledges but is not in the board's table, standard mode is safe
+#ifndef I2C_SCAN_UNKNOWN_MAX_HZ
+#define I2C_SCAN_UNKNOWN_MAX_HZ             100000
+#endif
+// Rounds of probes and checks each clock step must pass
+#ifndef I2C_SCAN_TEST_ROUNDS
+#define I2C_SCAN_TEST_ROUNDS                16
+#endif
+#define I2C_SCAN_PROBE_TIMEOUT_MS           10
+
+// Runtime fallback: one step down when I2C_SCAN_FALLBACK_PERCENT of the transactions of a window
+// of I2C_SCAN_WINDOW_TRANSFERS failed. NACKs do not count, the sensor NACKs while converting.
+#ifndef I2C_SCAN_WINDOW_TRANSFERS
+#define I2C_SCAN_WINDOW_TRANSFERS           100
+#endif
+#ifndef I2C_SCAN_FALLBACK_PERCENT
+#define I2C_SCAN_FALLBACK_PERCENT           5
+#endif
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+/**
+ * @brief Device specific reliability check, e.g. a CRC protected read
+ * @param num The i2c peripheral
+ * @param addr 7 bit address of the device
+ * @return true if the device answered correctly
+ */
+typedef bool (*i2c_scan_check_t)(i2c_port_t num, uint8_t addr);
+
+// What the board knows about a device that may be on the bus
+typedef struct {
+    uint8_t addr;
+    const char *name;
+    uint32_t max_hz;                /**< Datasheet limit of the SCL clock */
+    i2c_scan_check_t check;         /**< NULL to test with address probes only */
+} i2c_scan_dev_t;
+
+typedef struct {
+    uint8_t addr;
+    const i2c_scan_dev_t *info;     /**< NULL if the board does not know the device */
+    uint32_t max_hz;
+    uint32_t test_failures;         /**< Failed probes and checks during the clock selection */
+} i2c_scan_found_t;
+
+typedef struct {
+    i2c_port_t num;
+    i2c_scan_found_t devices[I2C_SCAN_MAX_DEVICES];
+    uint8_t found;
+    uint8_t rate;                   /**< Index of the clock in use */
+    uint8_t rate_max;               /**< Fastest clock that passed the test */
+    uint32_t rates_passed;          /**< Bit per clock step that passed */
+
+    // Written by the bus task only
+    uint32_t transfers;
+    uint32_t nacks;
+    uint32_t errors;                /**< Timeouts and other bus errors */
+    uint32_t fallbacks;
+    uint32_t window_transfers;
+    uint32_t window_errors;
+} i2c_scan_profile_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Scan the port, pick the clock and start watching the error rate
+ * @note Run before the drivers' tasks use the bus, the arbiter must be started already
+ * @param num The i2c peripheral
+ * @param devs Devices the board may have, checks and clock limits
+ * @param n Number of entries in devs
+ * @return 0 on success -1 on failure, the port then keeps its clock
+ */
+int i2c_scan_bringup(i2c_port_t num, const i2c_scan_dev_t *devs, size_t n);
+/**
+ * @brief Check whether a device acknowledged during the scan
+ * @param num The i2c peripheral
+ * @param addr 7 bit address of the device
+ * @return true if the device is present
+ */
+bool i2c_scan_present(i2c_port_t num, uint8_t addr);
+/**
+ * @brief Get the profile of a port
+ * @param num The i2c peripheral
+ * @return Pointer to the profile, NULL if the port was not brought up
+ */
+const i2c_scan_profile_t *i2c_scan_get(i2c_port_t num);
+/**
+ * @brief Print the devices, clock and error counters of a port
+ * @param num The i2c peripheral
+ */
+void i2c_scan_print(i2c_port_t num);
+
+#endif /* __I2C_SCAN_H__ */
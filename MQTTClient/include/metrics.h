@@ -0,0 +1,124 @@
+/**
+ * File Name:   metrics.h
+ * Description: Registry of performance counters and gauges, published periodically over MQTT.
+ *
+ * Modules register their metrics once at init and keep the returned handle. Updates are single
+ * atomic operations on the handle, so they are safe from any task or callback and never block.
+ * A low priority task takes a snapshot of the registry at a fixed interval and publishes it as
+ * compact JSON objects on the device's metrics topic, one unless it exceeds METRICS_PAYLOAD_MAX.
+ */
+
+// Header Guard
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Metrics the registry holds, registrations beyond this share a dummy entry that is not published
+#ifndef METRICS_MAX
+#define METRICS_MAX                         48
+#endif
+
+// Default publish interval, can be changed at runtime with metrics_set_interval()
+#ifndef METRICS_INTERVAL_MS
+#define METRICS_INTERVAL_MS                 60000
+#endif
+
+// The device id is appended, e.g. metrics/001
+#define METRICS_TOPIC_PREFIX                "metrics/"
+
+#define METRICS_PAYLOAD_MAX                 1536
+#define METRICS_TASK_STACK                  3072
+#define METRICS_TASK_PRIORITY               (tskIDLE_PRIORITY + 1)
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef enum {
+    metrics_counter = 0,            /**< Only goes up, receivers take the difference */
+    metrics_gauge,                  /**< Current value, e.g. a queue depth */
+    metrics_histogram               /**< Bucket counts owned by the module, published as an array */
+} metrics_type_t;
+
+typedef struct {
+    const char *name;               /**< Key in the published object, keep it short */
+    metrics_type_t type;
+    uint32_t value;                 /**< Only touched through the functions below */
+    const uint32_t *buckets;        /**< Histograms only */
+    uint8_t buckets_num;
+} metrics_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Register a metric, or get the one already registered under the name
+ * @param name Name of the metric, must stay valid
+ * @param type Counter or gauge
+ * @return Handle to the metric, never NULL
+ */
+metrics_t *metrics_register(const char *name, metrics_type_t type);
+/**
+ * @brief Register a histogram the module keeps itself, or get the one already registered
+ * @param name Name of the metric, must stay valid
+ * @param buckets Bucket counts, must stay valid, read without locking at snapshot time
+ * @param n Number of buckets
+ * @return Handle to the metric, never NULL
+ */
+metrics_t *metrics_register_hist(const char *name, const uint32_t *buckets, uint8_t n);
+/**
+ * @brief Find a registered metric
+ * @param name Name of the metric
+ * @return Handle to the metric, NULL if there is none with this name
+ */
+metrics_t *metrics_find(const char *name);
+/**
+ * @brief Start publishing snapshots through the outbox
+ * @param device_id Appended to METRICS_TOPIC_PREFIX, must stay valid
+ * @return 0 on success -1 on failure
+ */
+int metrics_start(const char *device_id);
+/**
+ * @brief Change the publish interval, takes effect after the next snapshot
+ * @param interval_ms Interval in ms
+ */
+void metrics_set_interval(uint32_t interval_ms);
+/**
+ * @brief Print every metric
+ */
+void metrics_print(void);
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline void metrics_add(metrics_t *m, uint32_t n)
+{
+    __atomic_fetch_add(&m->value, n, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_inc(metrics_t *m)
+{
+    metrics_add(m, 1);
+}
+
+static inline void metrics_set(metrics_t *m, uint32_t v)
+{
+    __atomic_store_n(&m->value, v, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t metrics_get(const metrics_t *m)
+{
+    return __atomic_load_n(&m->value, __ATOMIC_RELAXED);
+}
+
+#endif /* __METRICS_H__ */
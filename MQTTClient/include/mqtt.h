@@ -1,4 +1,31 @@
 #ifndef __MQTT_H_
 #define __MQTT_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "mqtt_client.h"
+
+// Control-plane traffic and subscriptions on a connection of their own, at the cost of a second
+// TLS session. Otherwise they share the telemetry connection and only get their own outbox lane.
+#ifndef MQTT_CONTROL_CONNECTION
+#define MQTT_CONTROL_CONNECTION             0
+#endif
+
+// Reconnect with a persistent session: the broker keeps the subscriptions and the QoS 1 messages
+// in flight, so a CONNACK with the session present needs no SUBSCRIBE round trips
+#ifndef MQTT_PERSISTENT_SESSION
+#define MQTT_PERSISTENT_SESSION             1
+#endif
+// Control topics are subscribed at QoS 0, so the broker does not queue them for a persistent
+// session while the node is offline. A challenge or verdict from before an outage is stale.
+#define MQTT_CONTROL_QOS                    0
+// Wait before the client reconnects after losing the connection, a new IP address cuts it short
+#ifndef MQTT_RECONNECT_MS
+#define MQTT_RECONNECT_MS                   2000
+#endif
+#define MQTT_CONN_NUM                       (1 + MQTT_CONTROL_CONNECTION)
+
+// Largest control-plane message (challenge, response, verdict) a route handler accepts
+#define MQTT_CONTROL_MSG_MAX                128
+
 #endif /* __MQTT_H_ */
@@ -0,0 +1,88 @@
+/**
+ * File Name:   mqtt_conn.h
+ * Description: Connect, resubscribe and outage bookkeeping of the MQTT connections.
+ *
+ * The MQTT event handler reports the events of each connection here. A CONNACK with the session
+ * present needs no SUBSCRIBE round trips when the connection is persistent, the broker kept the
+ * subscriptions, so the decision to resubscribe is made here together with the statistics.
+ */
+
+// Header Guard
+#ifndef __MQTT_CONN_H__
+#define __MQTT_CONN_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "mqtt.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Connect histogram: bucket i counts connects below MQTT_CONNECT_HIST_BASE_MS << i, the last is
+// open ended
+#define MQTT_CONNECT_HIST_BUCKETS           10
+#define MQTT_CONNECT_HIST_BASE_MS           64
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+/*
+ * Connect phases of a connection. The client reports the start of a connect attempt and the
+ * CONNACK, so the TCP connect and the TLS handshake are timed together with the CONNACK.
+ */
+typedef struct {
+    const char *name;
+    uint32_t connects;
+    uint32_t resumed;           /**< CONNACKs with the session present, nothing was resubscribed */
+    uint32_t connect_ms;        /**< Last attempt to its CONNACK: TCP connect, TLS handshake, CONNECT */
+    uint32_t connect_max_ms;
+    uint32_t suback_ms;         /**< Last CONNACK to the last SUBACK, 0 when the session was resumed */
+    uint32_t outage_ms;         /**< Last disconnect to the next CONNACK */
+    uint32_t connect_hist[MQTT_CONNECT_HIST_BUCKETS];
+    int64_t attempt_us;
+    int64_t connack_us;
+    int64_t down_us;
+    int subs_pending;
+} mqtt_conn_stats_t;
+
+extern mqtt_conn_stats_t mqtt_conn_stats[MQTT_CONN_NUM];
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Register the metrics of every connection
+ */
+void mqtt_conn_init(void);
+/**
+ * @brief Start timing a connect, call on MQTT_EVENT_BEFORE_CONNECT
+ * @param s Statistics of the connection
+ */
+void mqtt_conn_attempt(mqtt_conn_stats_t *s);
+/**
+ * @brief Account a CONNACK, call on MQTT_EVENT_CONNECTED
+ * @param s Statistics of the connection
+ * @param session_present Session present flag of the CONNACK
+ * @return true if the subscriptions have to be made, false if the broker kept them
+ */
+bool mqtt_conn_connected(mqtt_conn_stats_t *s, bool session_present);
+/**
+ * @brief Count a SUBSCRIBE sent after the CONNACK, the SUBACK of the last one ends the connect
+ * @param s Statistics of the connection
+ */
+void mqtt_conn_subscribing(mqtt_conn_stats_t *s);
+/**
+ * @brief Account a SUBACK, call on MQTT_EVENT_SUBSCRIBED
+ * @param s Statistics of the connection
+ */
+void mqtt_conn_subscribed(mqtt_conn_stats_t *s);
+/**
+ * @brief Start timing an outage, call on MQTT_EVENT_DISCONNECTED
+ * @param s Statistics of the connection
+ */
+void mqtt_conn_disconnected(mqtt_conn_stats_t *s);
+
+#endif /* __MQTT_CONN_H__ */
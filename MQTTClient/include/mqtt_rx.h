@@ -0,0 +1,85 @@
+/**
+ * File Name:   mqtt_rx.h
+ * Description: Routing and reassembly of the messages the MQTT client receives.
+ *
+ * Each subscribed topic has a route with a handler, found through a small hash index. A message
+ * the client delivers in one MQTT_EVENT_DATA goes straight to its handler. A larger one arrives in
+ * fragments and is reassembled in a slot of a fixed pool first. A client delivers one message at a
+ * time, so a slot belongs to a client until its message completes, the client starts another one
+ * or the connection drops.
+ */
+
+// Header Guard
+#ifndef __MQTT_RX_H__
+#define __MQTT_RX_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "mqtt_client.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Reassembly pool for payloads the client delivers in several MQTT_EVENT_DATA fragments
+#ifndef MQTT_RX_POOL_SIZE
+#define MQTT_RX_POOL_SIZE                   2
+#endif
+#ifndef MQTT_RX_BUF_LEN
+#define MQTT_RX_BUF_LEN                     1024
+#endif
+
+// Number of hash buckets in the route index, must be a power of two larger than the route count
+#define MQTT_ROUTE_BUCKETS                  16
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+/**
+ * @brief Handler for messages received on a routed topic
+ * @param ctx Context registered with the event handler (the host)
+ * @param data Payload, not NUL terminated
+ * @param len Payload length
+ */
+typedef void (*mqtt_route_handler_t)(void *ctx, const char *data, int len);
+
+typedef struct {
+    const char *topic;
+    int topic_len;
+    mqtt_route_handler_t handler;
+} mqtt_route_t;
+
+typedef struct {
+    uint32_t routed;            /**< Messages delivered to a route handler */
+    uint32_t unrouted;          /**< Messages on topics without a route */
+    uint32_t reassembled;       /**< Fragmented messages delivered from the pool */
+    uint32_t dropped;           /**< Fragmented messages dropped (too large, pool exhausted or cut off) */
+} mqtt_rx_stats_t;
+
+extern mqtt_rx_stats_t mqtt_rx_stats;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Build the route index
+ * @param routes Route table, must stay valid
+ * @param num Number of routes, less than MQTT_ROUTE_BUCKETS
+ */
+void mqtt_rx_init(const mqtt_route_t *routes, int num);
+/**
+ * @brief Route a fragment, call on MQTT_EVENT_DATA
+ * @param ctx Passed to the route handler
+ * @param event Event of the fragment
+ */
+void mqtt_rx_data(void *ctx, esp_mqtt_event_handle_t event);
+/**
+ * @brief Drop the messages a client was in the middle of delivering, call on
+ *        MQTT_EVENT_DISCONNECTED
+ * @param client Client that lost its connection
+ */
+void mqtt_rx_disconnected(esp_mqtt_client_handle_t client);
+
+#endif /* __MQTT_RX_H__ */
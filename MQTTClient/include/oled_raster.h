@@ -0,0 +1,402 @@
+/**
+ * File Name:   oled_raster.h
+ * Description: Framebuffers, drawing and the I2C protocol of the ssd1306 oled.
+ *
+ * Everything here is plain C: the back buffer is drawn into, ssd1306_frame_swap() hands its
+ * changes to the front buffer and ssd1306_frame_flush() sends them. The bytes go out through
+ * ssd1306_transfer(), which the driver (oled.h) implements on the I2C bus or the emulator.
+ */
+
+// Header Guard
+#ifndef _OLED_RASTER_H_
+#define _OLED_RASTER_H_
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <time.h>
+#include "log.h"
+//------------------------------ Definitions ---------------------------------//
+
+#if !defined SSD1306_128_32 && !defined SSD1306_96_16
+#define SSD1306_128_64
+#endif
+#if defined SSD1306_128_32 && defined SSD1306_96_16
+  #error "Only one SSD1306 display can be specified at once"
+#endif
+
+#if defined SSD1306_128_64
+  #define SSD1306_LCDWIDTH            128
+  #define SSD1306_LCDHEIGHT            64
+#endif
+#if defined SSD1306_128_32
+  #define SSD1306_LCDWIDTH            128
+  #define SSD1306_LCDHEIGHT            32
+#endif
+#if defined SSD1306_96_16
+  #define SSD1306_LCDWIDTH             96
+  #define SSD1306_LCDHEIGHT            16
+#endif
+
+#define SSD1306_SETCONTRAST          0x81
+#define SSD1306_DISPLAYALLON_RESUME  0xA4
+#define SSD1306_DISPLAYALLON         0xA5
+#define SSD1306_NORMALDISPLAY        0xA6
+#define SSD1306_INVERTDISPLAY_       0xA7
+#define SSD1306_DISPLAYOFF           0xAE
+#define SSD1306_DISPLAYON            0xAF
+#define SSD1306_SETDISPLAYOFFSET     0xD3
+#define SSD1306_SETCOMPINS           0xDA
+#define SSD1306_SETVCOMDETECT        0xDB
+#define SSD1306_SETDISPLAYCLOCKDIV   0xD5
+#define SSD1306_SETPRECHARGE         0xD9
+#define SSD1306_SETMULTIPLEX         0xA8
+#define SSD1306_SETLOWCOLUMN         0x00
+#define SSD1306_SETHIGHCOLUMN        0x10
+#define SSD1306_SETSTARTLINE         0x40
+#define SSD1306_MEMORYMODE           0x20
+#define SSD1306_COLUMNADDR           0x21
+#define SSD1306_PAGEADDR             0x22
+#define SSD1306_COMSCANINC           0xC0
+#define SSD1306_COMSCANDEC           0xC8
+#define SSD1306_SEGREMAP             0xA0
+#define SSD1306_CHARGEPUMP           0x8D
+#define SSD1306_EXTERNALVCC          0x01
+#define SSD1306_SWITCHCAPVCC         0x02
+
+// Scrolling #defines
+#define SSD1306_ACTIVATE_SCROLL                      0x2F
+#define SSD1306_DEACTIVATE_SCROLL                    0x2E
+#define SSD1306_SET_VERTICAL_SCROLL_AREA             0xA3
+#define SSD1306_RIGHT_HORIZONTAL_SCROLL              0x26
+#define SSD1306_LEFT_HORIZONTAL_SCROLL               0x27
+#define SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL 0x29
+#define SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL  0x2A
+
+// Largest text size whose scaled glyphs are cached, sizes up to 4 are blitted by column
+#ifndef SSD1306_GLYPH_CACHE_SIZE
+#define SSD1306_GLYPH_CACHE_SIZE    2
+#endif
+
+#define ssd1306_swap(a, b) { int16_t t = a; a = b; b = t; }
+
+typedef enum {
+  WELCOME = 0,
+  IP_INFO,
+  ENV_INFO
+} ssd1306_screen_t;
+
+/**
+ * @brief Send one transaction to the panel: the control byte, then commands (0x00) or display
+ *        data (0x40). Implemented by the driver, not by this file.
+ * 
+ * @param flush true for frame data sent by ssd1306_frame_flush, false for commands
+ * @param control Control byte
+ * @param buf Bytes following the control byte
+ * @param len Number of bytes
+ */
+void ssd1306_transfer(bool flush, uint8_t control, const uint8_t *buf, size_t len);
+/**
+ * @brief Send command to the SSD1306 over I2C
+ * 
+ * @param c Command to send
+ */
+void ssd1306_command(uint8_t c);
+/**
+ * @brief Send several commands to the SSD1306 in one I2C transaction
+ * 
+ * @param c Commands to send
+ * @param n Number of commands
+ */
+void ssd1306_commands(const uint8_t *c, uint8_t n);
+/**
+ * @brief Send the initialization sequence and mark the whole panel for the next flush
+ * 
+ * @param vccstate SSD1306_EXTERNALVCC or SSD1306_SWITCHCAPVCC
+ */
+void ssd1306_panel_init(uint8_t vccstate);
+/**
+ * @brief Check whether the back buffer differs from the last frame swapped. Columns drawn over
+ *        and back since the swap are dropped from the changes.
+ * 
+ * @return true if there is something to send
+ */
+bool ssd1306_frame_changed(void);
+/**
+ * @brief Hand the back buffer changes to the front buffer, the new back buffer is brought up to
+ *        date with them. The caller makes sure no flush is running.
+ */
+void ssd1306_frame_swap(void);
+/**
+ * @brief Send the front buffer changes of the last swap, as one window or a window per page
+ *        whichever costs fewer bytes on the bus
+ * 
+ * @return Display RAM bytes sent, 0 if nothing changed
+ */
+uint32_t ssd1306_frame_flush(void);
+/**
+ * @brief Draw the clock line at the top of the screen
+ * 
+ * @param info Local time to show
+ */
+void ssd1306_draw_clock(const struct tm *info);
+/**
+ * @brief Draw the body of a screen below the clock line
+ * 
+ * @param state Screen to draw
+ * @param env_valid true if temperature and humidity hold a reading
+ * @param temperature Temperature to show (F)
+ * @param humidity Humidity to show (%RH)
+ */
+void ssd1306_draw_body(ssd1306_screen_t state, bool env_valid, float temperature, float humidity);
+/**
+ * @brief Draw a pixel at the specified coordinates
+ * 
+ * @param x The x location on the OLED
+ * @param y The y location on the OLED
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_DrawPixel(uint8_t x, uint8_t y, bool color);
+/**
+ * @brief Have the OLED scroll to the right
+ * 
+ * @param start Starting point for scroll
+ * @param stop Stopping point for scroll
+ */
+void SSD1306_StartScrollRight(uint8_t start, uint8_t stop);
+/**
+ * @brief 
+ * 
+ * @param start Starting point for scroll
+ * @param stop Stopping point for scroll
+ */
+void SSD1306_StartScrollLeft(uint8_t start, uint8_t stop);
+/**
+ * @brief 
+ * 
+ * @param start Starting point for scroll
+ * @param stop Stopping point for scroll
+ */
+void SSD1306_StartScrollDiagRight(uint8_t start, uint8_t stop);
+/**
+ * @brief 
+ * 
+ * @param start Starting point for scroll
+ * @param stop Stopping point for scroll
+ */
+void SSD1306_StartScrollDiagLeft(uint8_t start, uint8_t stop);
+/**
+ * @brief Stop the OLED from scrolling
+ * 
+ */
+void SSD1306_StopScroll(void);
+/**
+ * @brief Dim the OLED display
+ * 
+ * @param dim Dim status
+ *            - true dim dipslay
+ *            - false set display to normal brightness
+ */
+void SSD1306_Dim(bool dim);
+/**
+ * @brief Clear the display
+ * Clears the whole framebuffer a word at a time
+ */
+void SSD1306_ClearDisplay(void);
+/**
+ * @brief Draw a line on the display
+ * 
+ * @param x0 Starting x coordinate for the line
+ * @param y0 Starting y coordinate for the line
+ * @param x1 Ending x coordinate for the line
+ * @param y1 Ending y coordinate for the line
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, bool color);
+/**
+ * @brief Draw a horizontal line as a span of one row
+ * 
+ * @param x X coordinate of the line
+ * @param y y coordinate of the line
+ * @param w horizontal width of the line
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_DrawFastHLine(uint8_t x, uint8_t y, uint8_t w, bool color);
+/**
+ * @brief Draw a verticel line, one masked byte per page
+ * 
+ * @param x x coordinate of the line
+ * @param y y coordinate of the line
+ * @param h verticle hight of the line
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_DrawFastVLine(uint8_t x, uint8_t y, uint8_t h, bool color);
+/**
+ * @brief Draw a filled in rectangle
+ * 
+ * @param x lower left x coordinate of the rectangle
+ * @param y lower left y coordinate of the rectangle
+ * @param w horizontal width of the rectangle
+ * @param h verticle height of the rectangle
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_FillRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, bool color);
+/**
+ * @brief Invert the pixels of a rectangle
+ * 
+ * @param x lower left x coordinate of the rectangle
+ * @param y lower left y coordinate of the rectangle
+ * @param w horizontal width of the rectangle
+ * @param h verticle height of the rectangle
+ */
+void SSD1306_InvertRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h);
+/**
+ * @brief Fill the screen of the OLED with one color
+ * 
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_FillScreen(bool color);
+/**
+ * @brief Draws a circle at the specified coordinates
+ * 
+ * @param x0 center point of the circle x value
+ * @param y0 center point of the circle y value
+ * @param r radius of the circle in pixels
+ */
+void SSD1306_DrawCircle(int16_t x0, int16_t y0, int16_t r);
+/**
+ * @brief Helper function for the draw circle function
+ * 
+ * @param x0 
+ * @param y0 
+ * @param r 
+ * @param cornername 
+ */
+void SSD1306_DrawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername);
+/**
+ * @brief Fill a circle
+ * 
+ * @param x0 center point of the circle x value
+ * @param y0 center point of the circle y value
+ * @param r radius of the circle in pixels
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_FillCircle(int16_t x0, int16_t y0, int16_t r, bool color);
+/**
+ * @brief Function for helping draw circle
+ * 
+ * @param x0 
+ * @param y0 
+ * @param r 
+ * @param cornername 
+ * @param delta 
+ * @param color 
+ */
+void SSD1306_FillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername, int16_t delta, bool color);
+/**
+ * @brief Draw rectangle
+ * 
+ * @param x lower left x coordinate of the rectangle
+ * @param y lower left y coordinate of the rectangle
+ * @param w horizontal width of the rectangle
+ * @param h verticle height of the rectangle
+ */
+void SSD1306_DrawRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h);
+/**
+ * @brief Draw a rectangle with rounded corners
+ * 
+ * @param x lower left x coordinate of the rectangle
+ * @param y lower left y coordinate of the rectangle
+ * @param w horizontal width of the rectangle
+ * @param h verticle height of the rectangle
+ * @param r radius of the corners
+ */
+void SSD1306_DrawRoundRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t r);
+/**
+ * @brief Draw filled rectangle with rounded corners
+ * 
+ * @param x lower left x coordinate of the rectangle
+ * @param y lower left y coordinate of the rectangle
+ * @param w horizontal width of the rectangle
+ * @param h verticle height of the rectangle
+ * @param r radius of the corners
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_FillRoundRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t r, bool color );
+/**
+ * @brief Draw triangle
+ * 
+ * @param x0 First vertex of the triangle x value
+ * @param y0 First vertex of the triangle y value
+ * @param x1 Second vertex of the triangle x value
+ * @param y1 Second vertex of the triangle y value
+ * @param x2 Third vertex of the triangle x value
+ * @param y2 Third vertex of the triangle y value
+ */
+void SSD1306_DrawTriangle(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2);
+/**
+ * @brief Fill the triangle
+ * 
+ * @param x0 First vertex of the triangle x value
+ * @param y0 First vertex of the triangle y value
+ * @param x1 Second vertex of the triangle x value
+ * @param y1 Second vertex of the triangle y value
+ * @param x2 Third vertex of the triangle x value
+ * @param y2 Third vertex of the triangle y value
+ * @param color true for white (draw) false for black (clear)
+ */
+void SSD1306_FillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, bool color);
+/**
+ * @brief Draw a single character on the oled
+ * 
+ * @param x X coordinate for the character
+ * @param y y coordinate for the character
+ * @param c The character to draw
+ * @param size Size of the character to draw (use 1 as default)
+ */
+void SSD1306_DrawChar(uint8_t x, uint8_t y, uint8_t c, uint8_t size);
+/**
+ * @brief Draw a null terminated string of characters to the oled
+ * 
+ * @param x X coordinate to start the string at
+ * @param y Y coordinate to start the string at
+ * @param _text A pointer to the string to draw
+ * @param size The size of each character
+ */
+void SSD1306_DrawText(uint8_t x, uint8_t y, char *_text, uint8_t size);
+/**
+ * @brief Set the text size on the oled
+ * 
+ * @param t_size Size of the text
+ */
+void SSD1306_TextSize(uint8_t t_size);
+/**
+ * @brief Set the next value to write to
+ * 
+ * @param x x coordinate
+ * @param y y coordinate
+ */
+void SSD1306_GotoXY(uint8_t x, uint8_t y);
+/**
+ * @brief print single char
+ * 
+ * @param c Character to print
+ */
+void SSD1306_Print(uint8_t c);
+/**
+ * @brief Set the text to wrap around the screen
+ * 
+ * @param w true to wrap false to not
+ */
+void SSD1306_SetTextWrap(bool w);
+/**
+ * @brief Set the display to be inverted
+ * 
+ * @param i true if inverted false if normal
+ */
+void SSD1306_InvertDisplay(bool i);
+
+#endif
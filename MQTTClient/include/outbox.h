@@ -0,0 +1,152 @@
+/**
+ * File Name:   outbox.h
+ * Description: Non-blocking publish path with backpressure and priority lanes.
+ *
+ * Callers copy their message into the bounded handoff buffer of its lane and return at once. A
+ * task per lane moves the messages into the MQTT client with esp_mqtt_client_enqueue(), so no
+ * application task ever waits for the client's lock while the MQTT task is writing to the network.
+ *
+ * Control-plane messages (challenges, responses, verdicts) and telemetry use separate lanes. The
+ * control lane runs at a higher priority and is never held back. The data lane only hands a
+ * message to the client while less than OUTBOX_DATA_WINDOW bytes are waiting there, so on a shared
+ * connection a control message queues behind at most that much telemetry. With
+ * MQTT_CONTROL_CONNECTION the control lane has a connection of its own.
+ *
+ * The data lane task also watches the client's outbox, the oldest unacknowledged QoS 1 publish and
+ * the free heap, and derives a backpressure state from them. Each publish names the policy that
+ * applies to it when the link cannot keep up:
+ *   drop        the message is discarded once the outbox is full
+ *   downsample  under pressure only one message in OUTBOX_DOWNSAMPLE goes through
+ *   spill       the message is refused once the outbox is full, the caller keeps it in storage
+ */
+
+// Header Guard
+#ifndef __OUTBOX_H__
+#define __OUTBOX_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/message_buffer.h"
+#include "mqtt_client.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Handoff buffers between the callers and the lane tasks, bound what waits outside the client
+#ifndef OUTBOX_BUFFER_SIZE
+#define OUTBOX_BUFFER_SIZE                  8192
+#endif
+#ifndef OUTBOX_CONTROL_BUFFER_SIZE
+#define OUTBOX_CONTROL_BUFFER_SIZE          1024
+#endif
+// Largest payload per lane, the telemetry batch is the biggest message
+#define OUTBOX_MSG_MAX                      3072
+#define OUTBOX_CONTROL_MSG_MAX              256
+
+// Bytes the client may hold before the data lane waits, bounds the control lane's queueing delay
+#ifndef OUTBOX_DATA_WINDOW
+#define OUTBOX_DATA_WINDOW                  6144
+#endif
+
+// Bytes in the client's outbox at which the state goes to pressure and to full
+#ifndef OUTBOX_PRESSURE_BYTES
+#define OUTBOX_PRESSURE_BYTES               4096
+#endif
+#ifndef OUTBOX_FULL_BYTES
+#define OUTBOX_FULL_BYTES                   12288
+#endif
+// Age of the oldest QoS 1 publish without a PUBACK at which the state goes to pressure
+#ifndef OUTBOX_LATENCY_MS
+#define OUTBOX_LATENCY_MS                   3000
+#endif
+// Free heap below which the state goes to full
+#ifndef OUTBOX_HEAP_MIN
+#define OUTBOX_HEAP_MIN                     24576
+#endif
+// Messages of the downsample policy let through under pressure, one in this many
+#ifndef OUTBOX_DOWNSAMPLE
+#define OUTBOX_DOWNSAMPLE                   4
+#endif
+
+// The state is refreshed at least this often and before every telemetry message
+#define OUTBOX_POLL_MS                      200
+// Longest a caller waits for another caller to finish copying its message
+#define OUTBOX_LOCK_MS                      10
+
+#define OUTBOX_TASK_STACK                   3072
+#define OUTBOX_TASK_PRIORITY                5
+#define OUTBOX_CONTROL_TASK_PRIORITY        (OUTBOX_TASK_PRIORITY + 1)
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef enum {
+    outbox_ok = 0,
+    outbox_pressure,                /**< The link is slow, low value traffic is thinned out */
+    outbox_full                     /**< Nothing new is accepted but what has to go out */
+} outbox_state_t;
+
+typedef enum {
+    outbox_lane_control = 0,        /**< Challenges, responses and verdicts */
+    outbox_lane_data,               /**< Telemetry and metrics */
+    outbox_lane_num
+} outbox_lane_t;
+
+typedef enum {
+    outbox_policy_drop = 0,
+    outbox_policy_downsample,
+    outbox_policy_spill
+} outbox_policy_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Start the lane tasks
+ * @param data_client MQTT client of the data lane
+ * @param control_client MQTT client of the control lane, may be the data lane's
+ * @return 0 on success -1 on failure
+ */
+int outbox_start(esp_mqtt_client_handle_t data_client, esp_mqtt_client_handle_t control_client);
+/**
+ * @brief Queue a message without blocking
+ * @param lane Lane of the message, the control lane only refuses a message when its buffer is full
+ * @param topic Topic to publish on, must stay valid until the message is sent
+ * @param data Payload, copied
+ * @param len Payload length, 0 to take the length of a string payload
+ * @param qos QoS of the publish, QoS 1 round trips are timed by the PUBACK tracker
+ * @param policy What happens to the message under backpressure
+ * @return 0 if the message was queued -1 if it was not
+ */
+int outbox_publish(outbox_lane_t lane, const char *topic, const char *data, int len, int qos,
+    outbox_policy_t policy);
+/**
+ * @brief Apply a policy to something that is not published yet, e.g. before producing it
+ * @param policy Policy of the traffic
+ * @return true if the traffic may go out now, refusals are counted like refused messages
+ */
+bool outbox_admit(outbox_policy_t policy);
+/**
+ * @brief Get the backpressure state
+ * @return State as of the last refresh by the outbox task
+ */
+outbox_state_t outbox_get_state(void);
+/**
+ * @brief Set the task woken with xTaskNotifyGive() when the state returns to ok, e.g. one that
+ *        holds back stored messages while the outbox is busy
+ * @param task Task to notify, NULL for none
+ */
+void outbox_set_listener(TaskHandle_t task);
+/**
+ * @brief Print the state, the inputs it is derived from and the counters
+ */
+void outbox_print(void);
+
+#endif /* __OUTBOX_H__ */
@@ -0,0 +1,94 @@
+/**
+ * File Name:   puback.h
+ * Description: Round-trip latency of QoS 1 publishes, from the PUBLISH to its PUBACK.
+ *
+ * Every QoS 1 publish is reported with puback_sent(), which records the msg_id the client returned
+ * with the time it was handed to the client. MQTT_EVENT_PUBLISHED closes the entry and the latency
+ * goes into a log-bucketed histogram of the message's topic. Entries without a PUBACK after
+ * PUBACK_TIMEOUT_MS are counted as timed out. The client does not report its resends, so they are
+ * not counted, a round trip includes any resends it took.
+ */
+
+// Header Guard
+#ifndef __PUBACK_H__
+#define __PUBACK_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include "mqtt_client.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Publishes waiting for their PUBACK, publishes beyond this are sent but not timed
+#ifndef PUBACK_OUTSTANDING_MAX
+#define PUBACK_OUTSTANDING_MAX              16
+#endif
+// Topics with their own histogram
+#ifndef PUBACK_TOPICS_MAX
+#define PUBACK_TOPICS_MAX                   8
+#endif
+#ifndef PUBACK_TIMEOUT_MS
+#define PUBACK_TIMEOUT_MS                   10000
+#endif
+// Resend interval of unacknowledged messages, handed to the client in its configuration
+#ifndef PUBACK_RETRANSMIT_MS
+#define PUBACK_RETRANSMIT_MS                1000
+#endif
+
+// Histogram: bucket i counts round trips below PUBACK_HIST_BASE_MS << i, the last is open ended
+#define PUBACK_HIST_BUCKETS                 12
+#define PUBACK_HIST_BASE_MS                 4
+
+// The topic is appended, e.g. ack:data/sensor
+#define PUBACK_METRIC_PREFIX                "ack:"
+#define PUBACK_METRIC_NAME_MAX              40
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef struct {
+    const char *topic;
+    char metric_name[PUBACK_METRIC_NAME_MAX];
+    uint32_t hist[PUBACK_HIST_BUCKETS];
+    uint32_t acked;
+    uint32_t timeouts;
+    uint32_t total_ms;              /**< Sum of the round trips, for the mean */
+    uint32_t max_ms;
+} puback_topic_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Register the tracker's metrics
+ */
+void puback_init(void);
+/**
+ * @brief Start timing the round trip of a QoS 1 publish
+ * @param client Client the message was enqueued with, msg_ids are per client
+ * @param topic Topic of the publish, must stay valid
+ * @param msg_id msg_id the client returned
+ * @param start_us esp_timer_get_time() just before the message was handed to the client
+ */
+void puback_sent(esp_mqtt_client_handle_t client, const char *topic, int msg_id, int64_t start_us);
+/**
+ * @brief Close the entry of a publish, call on MQTT_EVENT_PUBLISHED
+ * @param client Client of the event
+ * @param msg_id msg_id of the event
+ */
+void puback_acked(esp_mqtt_client_handle_t client, int msg_id);
+/**
+ * @brief Get how long the oldest publish has been waiting for its PUBACK
+ * @return Age in ms, 0 if nothing is outstanding
+ */
+uint32_t puback_oldest_ms(void);
+/**
+ * @brief Print the histogram and counters of every topic
+ */
+void puback_print(void);
+
+#endif /* __PUBACK_H__ */
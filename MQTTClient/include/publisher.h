@@ -0,0 +1,168 @@
+/**
+ * File Name:   publisher.h
+ * Description: Batching publisher for environment telemetry.
+ */
+
+// Header Guard
+#ifndef __PUBLISHER_H__
+#define __PUBLISHER_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mqtt_client.h"
+#include "htu21d.h"
+#include "aggregator.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+// Capacity of the sample ring, a batch can never hold more samples than this
+#ifndef PUBLISHER_RING_SIZE
+#define PUBLISHER_RING_SIZE                 32
+#endif
+
+// Default flush limits, both can be changed at runtime with publisher_set_limits()
+#ifndef PUBLISHER_MAX_SAMPLES
+#define PUBLISHER_MAX_SAMPLES               12
+#endif
+#ifndef PUBLISHER_MAX_AGE_MS
+#define PUBLISHER_MAX_AGE_MS                60000
+#endif
+
+// Largest payload a flush can build
+#define PUBLISHER_PAYLOAD_MAX               3072
+
+// Encoding used by the telemetry publisher, see publisher_encoding_t
+#ifndef PUBLISHER_ENCODING
+#define PUBLISHER_ENCODING                  publisher_encoding_json
+#endif
+
+#define PUBLISHER_TOPIC                     "data/sensor"
+#define PUBLISHER_PACKED_TOPIC              "data/sensor/packed"
+
+/*
+ * Packed encoding, version 1. All fields little-endian.
+ *
+ *   header  (6 bytes)
+ *     uint8_t  version         PUBLISHER_PACKED_VERSION
+ *     uint8_t  count           number of records that follow
+ *     uint32_t base_ts         capture time of the first record (seconds since epoch)
+ *   record  (6 bytes each)
+ *     uint16_t ts_offset       seconds since base_ts
+ *     uint16_t temperature_adc raw HTU21 temperature code
+ *     uint16_t humidity_adc    raw HTU21 relative humidity code
+ *
+ * Window summaries are sent with their mean ADC codes.
+ *
+ * The receiver applies the datasheet conversions (and the Fahrenheit conversion the JSON
+ * path uses) to the raw codes.
+ */
+#define PUBLISHER_PACKED_VERSION            1
+#define PUBLISHER_PACKED_HEADER_SIZE        6
+#define PUBLISHER_PACKED_RECORD_SIZE        6
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef enum {
+    publisher_encoding_json = 0,    /**< JSON text on PUBLISHER_TOPIC */
+    publisher_encoding_packed       /**< Versioned packed records on PUBLISHER_PACKED_TOPIC */
+} publisher_encoding_t;
+
+typedef struct {
+    uint32_t timestamp;     /**< Wall clock time of capture (seconds since epoch) */
+    TickType_t captured;    /**< Tick count at capture, used for the age limit */
+    htu21_data_t data;      /**< Reading, or the window means when summary.samples is set */
+    aggregator_summary_t summary;
+} publisher_sample_t;
+
+typedef struct {
+    uint32_t messages;      /**< Number of batches queued for publishing */
+    uint32_t samples;       /**< Number of samples sent in those batches */
+    uint32_t bytes;         /**< Payload bytes sent */
+    uint32_t dropped;       /**< Samples overwritten because the ring was full */
+    uint32_t flush_latency_ms;      /**< Age of the oldest sample at the last flush */
+    uint32_t flush_latency_max_ms;  /**< Worst age of the oldest sample seen at a flush */
+} publisher_stats_t;
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    publisher_encoding_t encoding;
+    const char *topic;
+    uint16_t max_samples;
+    uint32_t max_age_ms;
+    publisher_sample_t ring[PUBLISHER_RING_SIZE];
+    uint16_t head;          /**< Index of the oldest sample */
+    uint16_t count;
+    SemaphoreHandle_t mutex;
+    publisher_stats_t stats;
+} publisher_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Initialize a batching publisher
+ * @param pub Handle to the publisher to initialize
+ * @param client MQTT client the batches are published with
+ * @param encoding Payload encoding, also selects the topic the batches are published on
+ * @return 0 on success -1 on failure
+ */
+int publisher_init(publisher_t *pub, esp_mqtt_client_handle_t client, publisher_encoding_t encoding);
+/**
+ * @brief Change the flush limits
+ * @param pub Handle to the publisher
+ * @param max_samples Flush once this many samples are buffered (clamped to PUBLISHER_RING_SIZE)
+ * @param max_age_ms Flush once the oldest buffered sample is this old
+ */
+void publisher_set_limits(publisher_t *pub, uint16_t max_samples, uint32_t max_age_ms);
+/**
+ * @brief Buffer a sample captured now, flushing if a limit is reached
+ * @param pub Handle to the publisher
+ * @param data Sample to buffer
+ * @return Samples in the flushed batch, 0 if nothing was flushed, -1 on failure
+ */
+int publisher_push(publisher_t *pub, const htu21_data_t *data);
+/**
+ * @brief Buffer a window summary captured now, flushing if a limit is reached
+ * @param pub Handle to the publisher
+ * @param data Window means
+ * @param summary Window statistics, NULL to send data as a single reading
+ * @return Samples in the flushed batch, 0 if nothing was flushed, -1 on failure
+ */
+int publisher_push_window(publisher_t *pub, const htu21_data_t *data, const aggregator_summary_t *summary);
+/**
+ * @brief Buffer a sample with its original capture time, flushing if a limit is reached
+ * @param pub Handle to the publisher
+ * @param sample Sample to buffer
+ * @return Samples in the flushed batch, 0 if nothing was flushed, -1 on failure
+ */
+int publisher_push_sample(publisher_t *pub, const publisher_sample_t *sample);
+/**
+ * @brief Flush if the oldest buffered sample has reached the age limit
+ * @param pub Handle to the publisher
+ * @return Samples in the flushed batch, 0 if nothing was flushed, -1 on failure
+ */
+int publisher_poll(publisher_t *pub);
+/**
+ * @brief Publish every buffered sample as one message
+ * @param pub Handle to the publisher
+ * @return Samples in the flushed batch, 0 if nothing was buffered, -1 on failure
+ */
+int publisher_flush(publisher_t *pub);
+/**
+ * @brief Publish samples that are kept elsewhere as one message now, past the ring
+ * @param pub Handle to the publisher
+ * @param samples Samples to send, oldest first
+ * @param count Number of samples
+ * @return Samples from the front of the array in the message, the rest did not fit, 0 if count
+ *         is 0, -1 if the outbox refused the message
+ */
+int publisher_send(publisher_t *pub, const publisher_sample_t *samples, uint16_t count);
+
+#endif /* __PUBLISHER_H__ */
@@ -1,6 +1,16 @@
 #ifndef __SERIAL_H_
 #define __SERIAL_H_
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "driver/uart.h"
+
+// UART driver events queued for the reader, see serial_get_event_queue
+#define SERIAL_EVENT_QUEUE_LEN              16
+// End of line character, each one raises a UART_PATTERN_DET event
+#define SERIAL_PATTERN_CHR                  '\r'
+#define SERIAL_PATTERN_QUEUE_LEN            16
+
 /**
  * @brief Initilize a serial peripheral
  * @param num The peripheral to initialize
@@ -16,6 +26,23 @@ int serial_init(int num);
  * @return 0 on success -1 on failure
  */
 int serial_read(int num, unsigned char *buf, int len, int timeout);
+/**
+ * @brief Get the driver event queue of a serial peripheral
+ * @param num The serial peripheral
+ * @return Queue of uart_event_t, NULL if the peripheral has none
+ */
+QueueHandle_t serial_get_event_queue(int num);
+/**
+ * @brief Get the number of received bytes waiting in the driver
+ * @param num The serial peripheral
+ * @return Bytes that can be read without blocking
+ */
+int serial_buffered(int num);
+/**
+ * @brief Drop received data and pending events, e.g. after an overflow
+ * @param num The serial peripheral
+ */
+void serial_flush_input(int num);
 /**
  * @brief Initilize a serial peripheral
  * @param num The serial peripheral to use
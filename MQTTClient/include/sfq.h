@@ -0,0 +1,141 @@
+/**
+ * File Name:   sfq.h
+ * Description: Flash-backed store-and-forward queue for telemetry samples.
+ *
+ * Samples that cannot be published are appended to a ring of fixed-size records in a dedicated
+ * flash partition. Sectors are erased in turn as the write position reaches them, so every sector
+ * sees the same number of erase cycles. When the ring is full the oldest sector is reclaimed.
+ *
+ * Readers look at the oldest records with sfq_peek() and only mark them consumed with
+ * sfq_consume() once they are safely on their way, so a sample that is refused stays in flash.
+ *
+ * This is the queue core and the file backend, plain C so they run and are timed off-target. The
+ * partition backend, the locking and the publisher glue are in sfq_store.h.
+ */
+
+// Header Guard
+#ifndef __SFQ_H__
+#define __SFQ_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+#define SFQ_RECORD_SIZE                     16
+
+// Record states, each transition only clears bits so it can be written without an erase
+#define SFQ_STATE_EMPTY                     0xFF
+#define SFQ_STATE_VALID                     0xFE
+#define SFQ_STATE_CONSUMED                  0x00
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+/**
+ * Flash access used by the queue. Semantics follow NOR flash: erase sets bytes to 0xFF and a
+ * write can only clear bits.
+ */
+typedef struct sfq_flash {
+    int (*read)(struct sfq_flash *flash, uint32_t addr, void *buf, size_t len);
+    int (*write)(struct sfq_flash *flash, uint32_t addr, const void *buf, size_t len);
+    int (*erase)(struct sfq_flash *flash, uint32_t addr, size_t len);
+    uint32_t size;
+    uint32_t sector_size;
+    void *ctx;
+} sfq_flash_t;
+
+typedef struct {
+    uint8_t state;
+    uint8_t crc;
+    uint16_t reserved;
+    uint32_t seq;
+    uint32_t timestamp;
+    uint16_t temperature_adc;
+    uint16_t humidity_adc;
+} sfq_record_t;
+
+// What a record keeps of a sample
+typedef struct {
+    uint32_t timestamp;     /**< Capture time (seconds since epoch) */
+    uint16_t temperature_adc;
+    uint16_t humidity_adc;
+} sfq_entry_t;
+
+typedef struct {
+    uint32_t appended;      /**< Samples written to flash */
+    uint32_t drained;       /**< Samples consumed after they were sent */
+    uint32_t overwritten;   /**< Unsent samples lost when the oldest sector was reclaimed */
+    uint32_t erases;        /**< Sector erases */
+    uint32_t errors;        /**< Flash errors and corrupt records skipped */
+} sfq_stats_t;
+
+typedef struct {
+    sfq_flash_t *flash;
+    uint32_t head;          /**< Address the next record is written to */
+    uint32_t tail;          /**< Address of the oldest record not yet consumed */
+    uint32_t pending;       /**< Records between tail and head still to be consumed */
+    uint32_t seq;           /**< Sequence number of the next record */
+    sfq_stats_t stats;
+} sfq_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Open a file emulating the flash partition, for running the queue off-target
+ * @param flash Flash handle to fill in
+ * @param path File to use, created and erased if it does not have the requested size
+ * @param size Size of the emulated partition, a multiple of sector_size
+ * @param sector_size Erase unit
+ * @return 0 on success -1 on failure
+ */
+int sfq_flash_file_open(sfq_flash_t *flash, const char *path, uint32_t size, uint32_t sector_size);
+/**
+ * @brief Close a file opened with sfq_flash_file_open()
+ * @param flash Flash handle
+ */
+void sfq_flash_file_close(sfq_flash_t *flash);
+/**
+ * @brief Initialize a queue, recovering head and tail from the records already in flash
+ * @param sfq Handle to the queue, the caller serializes every call on it
+ * @param flash Flash the queue lives in
+ * @return 0 on success -1 on failure
+ */
+int sfq_init(sfq_t *sfq, sfq_flash_t *flash);
+/**
+ * @brief Append a sample
+ * @param sfq Handle to the queue
+ * @param entry Sample to store
+ * @return 0 on success -1 on failure
+ */
+int sfq_append(sfq_t *sfq, const sfq_entry_t *entry);
+/**
+ * @brief Read the oldest samples without consuming them, corrupt records are passed over
+ * @param sfq Handle to the queue
+ * @param entries Filled with up to max samples, oldest first
+ * @param max Maximum number of samples to read
+ * @return Number of samples read, -1 on failure
+ */
+int sfq_peek(sfq_t *sfq, sfq_entry_t *entries, uint16_t max);
+/**
+ * @brief Mark the oldest samples consumed, after the ones returned by sfq_peek() were sent
+ * @param sfq Handle to the queue
+ * @param n Number of samples to consume, corrupt records before them are consumed as well
+ * @return 0 on success -1 on failure
+ */
+int sfq_consume(sfq_t *sfq, uint16_t n);
+/**
+ * @brief Number of samples waiting to be consumed
+ * @param sfq Handle to the queue
+ * @return Pending sample count
+ */
+uint32_t sfq_pending(const sfq_t *sfq);
+
+#endif /* __SFQ_H__ */
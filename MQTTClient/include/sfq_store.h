@@ -0,0 +1,94 @@
+/**
+ * File Name:   sfq_store.h
+ * Description: Store-and-forward queue of the node, in its flash partition and drained into the
+ *              publisher.
+ *
+ * Wraps the queue core of sfq.h with the partition backend and a mutex, so the sampling task can
+ * append while the drain task sends. A drained batch goes to the outbox directly, past the
+ * publisher's ring, and its records are only consumed once the outbox accepted it. A refused
+ * batch stays in flash for the next drain.
+ */
+
+// Header Guard
+#ifndef __SFQ_STORE_H__
+#define __SFQ_STORE_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "publisher.h"
+#include "sfq.h"
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+#define SFQ_PARTITION_LABEL                 "sfq"
+#define SFQ_PARTITION_SUBTYPE               0x40
+
+// Drain limits: at most SFQ_DRAIN_BURST samples every SFQ_DRAIN_INTERVAL_MS
+#ifndef SFQ_DRAIN_BURST
+#define SFQ_DRAIN_BURST                     PUBLISHER_MAX_SAMPLES
+#endif
+#ifndef SFQ_DRAIN_INTERVAL_MS
+#define SFQ_DRAIN_INTERVAL_MS               1000
+#endif
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef struct {
+    sfq_flash_t flash;
+    sfq_t queue;
+    SemaphoreHandle_t mutex;
+} sfq_store_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Open the flash partition backing the queue
+ * @param flash Flash handle to fill in
+ * @param label Partition label
+ * @return 0 on success -1 on failure
+ */
+int sfq_flash_partition_open(sfq_flash_t *flash, const char *label);
+/**
+ * @brief Open the store in its flash partition
+ * @param store Handle to the store
+ * @param label Partition label
+ * @return 0 on success -1 on failure
+ */
+int sfq_store_open(sfq_store_t *store, const char *label);
+/**
+ * @brief Initialize the store on flash that is already open, e.g. a file
+ * @param store Handle to the store, store->flash must be filled in
+ * @return 0 on success -1 on failure
+ */
+int sfq_store_init(sfq_store_t *store);
+/**
+ * @brief Append a sample, only the capture time and the raw codes are kept
+ * @param store Handle to the store
+ * @param sample Sample to store
+ * @return 0 on success -1 on failure
+ */
+int sfq_store_append(sfq_store_t *store, const publisher_sample_t *sample);
+/**
+ * @brief Publish up to max stored samples as one batch, oldest first
+ * @param store Handle to the store
+ * @param pub Publisher the batch is encoded and queued by
+ * @param max Maximum number of samples to send, at most SFQ_DRAIN_BURST
+ * @return Number of samples sent and consumed, -1 if the outbox refused the batch or on failure
+ */
+int sfq_store_drain(sfq_store_t *store, publisher_t *pub, uint16_t max);
+/**
+ * @brief Number of samples waiting to be drained
+ * @param store Handle to the store
+ * @return Pending sample count
+ */
+uint32_t sfq_store_pending(sfq_store_t *store);
+
+#endif /* __SFQ_STORE_H__ */
@@ -0,0 +1,121 @@
+/**
+ * File Name:   ssd1306_emu.h
+ * Description: SSD1306 panel model fed with the driver's I2C byte stream.
+ *
+ * Built with SSD1306_EMULATOR the driver hands each transfer here instead of to the I2C driver.
+ * The decoder follows the control byte, the addressing commands (memory mode, COLUMNADDR,
+ * PAGEADDR and the page mode column/page commands) and the display RAM writes, so the virtual
+ * panel shows exactly what the real one would. Nothing here depends on ESP-IDF.
+ */
+
+// Header Guard
+#ifndef __SSD1306_EMU_H__
+#define __SSD1306_EMU_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "log.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+#define SSD1306_EMU_WIDTH                   128
+#define SSD1306_EMU_HEIGHT                  64
+#define SSD1306_EMU_PAGES                   (SSD1306_EMU_HEIGHT / 8)
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef struct {
+    uint32_t transactions;      /**< START..STOP transfers */
+    uint32_t bytes;             /**< Bytes after the address byte, control bytes included */
+    uint32_t command_bytes;
+    uint32_t data_bytes;        /**< Display RAM writes */
+} ssd1306_emu_stats_t;
+
+typedef struct {
+    uint8_t ram[SSD1306_EMU_PAGES][SSD1306_EMU_WIDTH];  /**< Display RAM, page organised */
+    uint8_t mode;               /**< Memory addressing mode, 0 horizontal 1 vertical 2 page */
+    uint8_t col, col_start, col_end;
+    uint8_t page, page_start, page_end;
+    bool display_on;
+    bool inverted;
+    bool all_on;
+
+    // Decoder state of the transfer in progress
+    bool in_transfer;
+    bool expect_control;        /**< Next byte is a control byte */
+    bool continuation;          /**< Co bit of the last control byte */
+    bool data;                  /**< D/C bit of the last control byte */
+    uint8_t cmd[7];             /**< Command being collected, opcode first */
+    uint8_t cmd_len;
+    uint8_t cmd_need;
+
+    ssd1306_emu_stats_t stats;
+} ssd1306_emu_t;
+
+/***************************************************************************************************/
+/* Public Function Prototypes */
+/***************************************************************************************************/
+/**
+ * @brief Get the emulated panel, reset to the power on state on first use
+ * @return Pointer to the panel
+ */
+ssd1306_emu_t *ssd1306_emu_get(void);
+/**
+ * @brief Reset a panel to the power on state, counters included
+ * @param emu Handle to the panel
+ */
+void ssd1306_emu_reset(ssd1306_emu_t *emu);
+/**
+ * @brief Start a transfer, the I2C START and address byte
+ * @param emu Handle to the panel
+ * @param addr 7 bit address the driver sent
+ */
+void ssd1306_emu_begin(ssd1306_emu_t *emu, uint8_t addr);
+/**
+ * @brief Feed bytes of the current transfer
+ * @param emu Handle to the panel
+ * @param buf Bytes as they would go on the bus
+ * @param len Number of bytes
+ */
+void ssd1306_emu_write(ssd1306_emu_t *emu, const uint8_t *buf, size_t len);
+/**
+ * @brief End the current transfer, the I2C STOP
+ * @param emu Handle to the panel
+ */
+void ssd1306_emu_end(ssd1306_emu_t *emu);
+/**
+ * @brief Get a pixel as the panel shows it, inversion and display on/off applied
+ * @param emu Handle to the panel
+ * @param x Column
+ * @param y Row
+ * @return true if the pixel is lit
+ */
+bool ssd1306_emu_pixel(const ssd1306_emu_t *emu, uint8_t x, uint8_t y);
+/**
+ * @brief Write what the panel shows to a binary PGM file
+ * @param emu Handle to the panel
+ * @param path File to write
+ * @return 0 on success -1 on failure
+ */
+int ssd1306_emu_dump_pgm(const ssd1306_emu_t *emu, const char *path);
+/**
+ * @brief Compare what the panel shows with a PGM file, e.g. a golden image from ssd1306_emu_dump_pgm
+ * @param emu Handle to the panel
+ * @param path File to compare with
+ * @return Number of differing pixels, -1 if the file can not be read
+ */
+int ssd1306_emu_compare_pgm(const ssd1306_emu_t *emu, const char *path);
+/**
+ * @brief Take the counters and clear them, call once per frame for per-frame figures
+ * @param emu Handle to the panel
+ * @param stats Filled with the counters since the last call
+ */
+void ssd1306_emu_take_stats(ssd1306_emu_t *emu, ssd1306_emu_stats_t *stats);
+
+#endif /* __SSD1306_EMU_H__ */
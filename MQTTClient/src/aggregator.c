@@ -0,0 +1,157 @@
+/**
+ * File Name:   aggregator.c
+ * Description: Windowed aggregation of environment samples.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <math.h>
+#include <string.h>
+#include "aggregator.h"
+#include "htu21_fixed.h"
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static uint16_t aggregator_filter(aggregator_t *agg, int ch, uint16_t adc);
+static float aggregator_value(int ch, uint16_t adc);
+static void aggregator_window_add(aggregator_window_t *w, float value, uint16_t adc);
+static void aggregator_window_stat(const aggregator_window_t *w, aggregator_stat_t *stat);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int aggregator_init(aggregator_t *agg, aggregator_filter_t filter)
+{
+    if(agg == NULL)
+    {
+        LOG_ERROR("Aggregator is NULL, init failed!");
+        return -1;
+    }
+
+    memset(agg, 0, sizeof(aggregator_t));
+    agg->filter = filter;
+    agg->mutex = xSemaphoreCreateMutex();
+    if(agg->mutex == NULL)
+    {
+        LOG_ERROR("Aggregator mutex create failed!");
+        return -1;
+    }
+    return 0;
+}
+
+void aggregator_add(aggregator_t *agg, const htu21_data_t *data)
+{
+    const uint16_t adc[aggregator_channel_num] = {
+        [aggregator_temperature] = data->temperature_adc,
+        [aggregator_humidity] = data->humidity_adc,
+    };
+
+    xSemaphoreTake(agg->mutex, portMAX_DELAY);
+
+    // Filter history is shared by both channels, shift it once per sample
+    if(agg->history_len < AGGREGATOR_MEDIAN_LEN)
+        agg->history_len++;
+    for(int ch = 0; ch < aggregator_channel_num; ch++)
+    {
+        uint16_t filtered = aggregator_filter(agg, ch, adc[ch]);
+        aggregator_window_add(&agg->window[ch], aggregator_value(ch, filtered), filtered);
+    }
+    agg->samples++;
+
+    xSemaphoreGive(agg->mutex);
+}
+
+int aggregator_take(aggregator_t *agg, htu21_data_t *data, aggregator_summary_t *summary)
+{
+    aggregator_window_t *t = &agg->window[aggregator_temperature];
+    aggregator_window_t *h = &agg->window[aggregator_humidity];
+
+    xSemaphoreTake(agg->mutex, portMAX_DELAY);
+
+    if(t->count == 0)
+    {
+        xSemaphoreGive(agg->mutex);
+        return -1;
+    }
+
+    summary->samples = t->count;
+    aggregator_window_stat(t, &summary->temperature);
+    aggregator_window_stat(h, &summary->humidity);
+
+    data->temperature = t->mean;
+    data->humidity = h->mean;
+    data->temperature_adc = (uint16_t)((t->adc_sum + t->count / 2) / t->count);
+    data->humidity_adc = (uint16_t)((h->adc_sum + h->count / 2) / h->count);
+
+    memset(agg->window, 0, sizeof(agg->window));
+    agg->windows++;
+
+    xSemaphoreGive(agg->mutex);
+    return 0;
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static uint16_t aggregator_filter(aggregator_t *agg, int ch, uint16_t adc)
+{
+    uint16_t *hist = agg->history[ch];
+    uint16_t lo, hi;
+
+    switch(agg->filter)
+    {
+    case aggregator_filter_median3:
+        hist[0] = hist[1];
+        hist[1] = hist[2];
+        hist[2] = adc;
+        if(agg->history_len < AGGREGATOR_MEDIAN_LEN)
+            return adc;
+        lo = hist[0] < hist[1] ? hist[0] : hist[1];
+        hi = hist[0] < hist[1] ? hist[1] : hist[0];
+        return hist[2] < lo ? lo : (hist[2] > hi ? hi : hist[2]);
+    case aggregator_filter_ema:
+        if(agg->samples == 0)
+            agg->ema[ch] = (uint32_t)adc << 8;
+        else
+            agg->ema[ch] += ((int32_t)((uint32_t)adc << 8) - (int32_t)agg->ema[ch]) >> AGGREGATOR_EMA_SHIFT;
+        return (uint16_t)((agg->ema[ch] + 0x80) >> 8);
+    case aggregator_filter_none:
+    default:
+        return adc;
+    }
+}
+
+static float aggregator_value(int ch, uint16_t adc)
+{
+    // Same units the sensor task reports: degF and %RH
+    if(ch == aggregator_temperature)
+        return htu21_fixed_fahrenheit(htu21_fixed_temperature(adc)) / 100.0f;
+    return htu21_fixed_humidity(adc) / 100.0f;
+}
+
+static void aggregator_window_add(aggregator_window_t *w, float value, uint16_t adc)
+{
+    float delta;
+
+    if(w->count == 0 || value < w->min)
+        w->min = value;
+    if(w->count == 0 || value > w->max)
+        w->max = value;
+
+    // Welford's update keeps the variance stable without storing the samples
+    w->count++;
+    delta = value - w->mean;
+    w->mean += delta / w->count;
+    w->m2 += delta * (value - w->mean);
+    w->adc_sum += adc;
+}
+
+static void aggregator_window_stat(const aggregator_window_t *w, aggregator_stat_t *stat)
+{
+    stat->min = w->min;
+    stat->max = w->max;
+    stat->mean = w->mean;
+    stat->stddev = w->count > 1 ? sqrtf(w->m2 / (w->count - 1)) : 0.0f;
+}
@@ -0,0 +1,47 @@
+/**
+ * File Name:   challenge.c
+ * Description: Recent challenges of the control node, to tell stale responses from wrong ones.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+#include "challenge.h"
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+// Expected responses, challenge_expected[(challenge_num - 1) % CHALLENGE_HISTORY] is the newest
+static uint32_t challenge_expected[CHALLENGE_HISTORY];
+static uint32_t challenge_num;
+// The challenge task issues, the MQTT task checks
+static portMUX_TYPE challenge_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+void challenge_issued(uint32_t expected)
+{
+    portENTER_CRITICAL(&challenge_lock);
+    challenge_expected[challenge_num % CHALLENGE_HISTORY] = expected;
+    challenge_num++;
+    portEXIT_CRITICAL(&challenge_lock);
+}
+
+challenge_result_t challenge_check(uint32_t response)
+{
+    challenge_result_t result = challenge_mismatch;
+    uint32_t kept;
+
+    portENTER_CRITICAL(&challenge_lock);
+    kept = challenge_num < CHALLENGE_HISTORY ? challenge_num : CHALLENGE_HISTORY;
+    // Newest first
+    for(uint32_t i = 1; i <= kept && result == challenge_mismatch; i++)
+    {
+        if(challenge_expected[(challenge_num - i) % CHALLENGE_HISTORY] == response)
+            result = i == 1 ? challenge_match : challenge_stale;
+    }
+    portEXIT_CRITICAL(&challenge_lock);
+    return result;
+}
@@ -1,27 +1,160 @@
+#include <stdlib.h>
 #include "console.h"
 #include "serial.h"
 #include "wifi.h"
 #include "os.h"
+#include "host.h"
+
+extern host_t host;
 
 /**********************************************************/
 static void _help(int argc, char **argv);
 static void _wifi_info(int argc, char **argv);
 static void _reboot(int argc, char **argv);
 static void _show_mem(int argc, char**argv);
+static void _sensor_stats(int argc, char **argv);
+static void _oled_stats(int argc, char **argv);
+static void _i2c_stats(int argc, char **argv);
+static void _i2c_profile(int argc, char **argv);
+static void _tasks(int argc, char **argv);
+static void _queues(int argc, char **argv);
+static void _mqtt_stats(int argc, char **argv);
+static void _latency(int argc, char **argv);
+static void _metrics(int argc, char **argv);
+static void _outbox(int argc, char **argv);
 
-static cmd_entry cmd_list[] = \
+static const cmd_entry cmd_list[] = \
 {
-    { "help", "Print help info", _help},
+    { "help", "Print help info, help <cmd> for one command", _help},
     { "wifi_info", "Show Wi-Fi information", _wifi_info},
     { "reboot", "Reboot", _reboot},
     { "show_mem", "Show system available heap size.", _show_mem},
+    { "sensor_stats", "Show sensor acquisition latency per resolution.", _sensor_stats},
+    { "oled_stats", "Show OLED flush and swap counters.", _oled_stats},
+    { "i2c_stats", "Show I2C bus wait/hold times and utilisation, i2c_stats [port]", _i2c_stats},
+    { "i2c_profile", "Show I2C devices, clock and error counters, i2c_profile [port]", _i2c_profile},
+    { "tasks", "Show task CPU share and stack high-water marks, tasks [ms]", _tasks},
+    { "queues", "Show queue depths.", _queues},
+    { "mqtt_stats", "Show MQTT receive and publish counters.", _mqtt_stats},
+    { "latency", "Dump latency histograms, latency [sensor|i2c|oled|mqtt]", _latency},
+    { "metrics", "Show the metrics registry, metrics [interval ms] also sets the publish interval", _metrics},
+    { "outbox", "Show the publish backpressure state and counters.", _outbox},
     //add more
 };
 
+// Registered commands in registration order, and bucket -> index into console_cmds + 1, 0 marks
+// an empty bucket
+static const cmd_entry *console_cmds[CMD_NUM_MAX];
+static int console_cmd_num;
+static uint8_t console_cmd_index[CMD_HASH_BUCKETS];
+static portMUX_TYPE console_cmd_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t _cmd_hash(const char *name)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    while (*name) {
+        h = (h ^ (uint8_t)*name++) * 16777619u;
+    }
+    return h & (CMD_HASH_BUCKETS - 1);
+}
+
+static const cmd_entry *_cmd_find(const char *name)
+{
+    uint32_t b = _cmd_hash(name);
+    while (console_cmd_index[b] != 0) {
+        const cmd_entry *cmd = console_cmds[console_cmd_index[b] - 1];
+        if (strcmp(cmd->name, name) == 0) {
+            return cmd;
+        }
+        b = (b + 1) & (CMD_HASH_BUCKETS - 1);
+    }
+    return NULL;
+}
+
+int console_register_cmd(const cmd_entry *cmd)
+{
+    uint32_t b;
+
+    if (cmd == NULL || cmd->name == NULL || cmd->function == NULL) {
+        LOG_ERROR("Invalid cmd");
+        return -1;
+    }
+
+    portENTER_CRITICAL(&console_cmd_lock);
+    if (console_cmd_num == CMD_NUM_MAX || _cmd_find(cmd->name) != NULL) {
+        portEXIT_CRITICAL(&console_cmd_lock);
+        LOG_ERROR("Can not register cmd %s: table full or name taken", cmd->name);
+        return -1;
+    }
+    console_cmds[console_cmd_num] = cmd;
+    b = _cmd_hash(cmd->name);
+    while (console_cmd_index[b] != 0) {
+        b = (b + 1) & (CMD_HASH_BUCKETS - 1);
+    }
+    // The bucket is set last, a lookup running meanwhile sees the command complete or not at all
+    console_cmd_index[b] = ++console_cmd_num;
+    portEXIT_CRITICAL(&console_cmd_lock);
+    return 0;
+}
+
+/*
+ * Split buf in place into words separated by spaces. Double quotes group words, e.g.
+ * cmd "two words". Returns the word count, -1 if there are more than CMD_ARGC_MAX.
+ */
+static int _console_tokenize(char *buf, char **argv)
+{
+    int argc = 0;
+
+    while (*buf) {
+        char *out;
+
+        while (*buf == ' ') {
+            buf++;
+        }
+        if (*buf == '\0') {
+            break;
+        }
+        if (argc == CMD_ARGC_MAX) {
+            return -1;
+        }
+        argv[argc++] = out = buf;
+        bool quoted = false;
+        while (*buf && (quoted || *buf != ' ')) {
+            if (*buf == '"') {
+                quoted = !quoted;
+                buf++;
+                continue;
+            }
+            *out++ = *buf++;
+        }
+        if (*buf) {
+            buf++;
+        }
+        *out = '\0';
+    }
+    return argc;
+}
+
+// Port given as the first argument, I2C_NUM_0 if there is none
+static int _arg_port(int argc, char **argv)
+{
+    return argc > 1 ? atoi(argv[1]) : I2C_NUM_0;
+}
+
 static void _help(int argc, char **argv)
 {
-    for (int i = 0; i < (sizeof(cmd_list)/sizeof(cmd_entry)); i++) {
-        LOG_PRINTF("%-30s %s", cmd_list[i].name, cmd_list[i].help ? cmd_list[i].help : "");
+    if (argc > 1) {
+        const cmd_entry *cmd = _cmd_find(argv[1]);
+        if (cmd == NULL) {
+            LOG_ERROR("cmd not found!");
+            return;
+        }
+        LOG_PRINTF("%-30s %s", cmd->name, cmd->help ? cmd->help : "");
+        return;
+    }
+    for (int i = 0; i < console_cmd_num; i++) {
+        LOG_PRINTF("%-30s %s", console_cmds[i]->name, console_cmds[i]->help ? console_cmds[i]->help : "");
 	}
 }
 
@@ -56,34 +189,304 @@ static void _show_mem(int argc, char **argv)
     LOG_PRINTF("Free heap size: %u bytes", esp_get_free_heap_size());
 }
 
-static int _console_recv(console_t* console)
+static void _sensor_stats(int argc, char **argv)
+{
+    htu21_print_latency(&host.htu21);
+}
+
+static void _oled_stats(int argc, char **argv)
+{
+    const ssd1306_stats_t *s = SSD1306_GetStats();
+
+    LOG_PRINTF("Frames flushed: %u, skipped: %u", s->frames, s->frames_skipped);
+    LOG_PRINTF("Bytes last frame: %u, total: %u", s->bytes_last, s->bytes_total);
+    LOG_PRINTF("Frame time last: %u us, max: %u us, avg: %u us", s->frame_us_last, s->frame_us_max,
+        s->frames ? (uint32_t)(s->frame_us_total / s->frames) : 0);
+    LOG_PRINTF("Swaps: %u, dropped: %u", s->swaps, s->frames_dropped);
+    LOG_PRINTF("Swap latency last: %u us, max: %u us", s->swap_us_last, s->swap_us_max);
+}
+
+static void _i2c_stats(int argc, char **argv)
+{
+    i2c_bus_print_stats(_arg_port(argc, argv));
+}
+
+static void _i2c_profile(int argc, char **argv)
+{
+    i2c_scan_print(_arg_port(argc, argv));
+}
+
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+static TaskStatus_t *_task_snapshot(UBaseType_t *n, uint32_t *total)
 {
-	uint8_t c = 0;
-	uint32_t bytes = 0;
-	
-	while(1) {
-        int ret = serial_read(console->uart_num, &c, 1, WAIT_FOREVER);
-		if (1 == ret) {
-            if ('\r' == c) {
+    // Room for a few tasks created while we look
+    UBaseType_t size = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *tasks = malloc(size * sizeof(TaskStatus_t));
+
+    if (tasks != NULL) {
+        *n = uxTaskGetSystemState(tasks, size, total);
+    }
+    return tasks;
+}
+#endif
+
+static void _tasks(int argc, char **argv)
+{
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+    uint32_t ms = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+    UBaseType_t n0 = 0, n1 = 0;
+    uint32_t total0 = 0, total1 = 0;
+    TaskStatus_t *t0, *t1;
+
+    // CPU share over an interval, two snapshots ms apart
+    t0 = _task_snapshot(&n0, &total0);
+    vTaskDelay(MS2TICK(ms));
+    t1 = _task_snapshot(&n1, &total1);
+    if (t0 == NULL || t1 == NULL) {
+        LOG_ERROR("Not enough memory for %u tasks", uxTaskGetNumberOfTasks());
+        free(t0);
+        free(t1);
+        return;
+    }
+
+    LOG_PRINTF("%-16s %4s %6s %10s", "Task", "Prio", "CPU", "Stack free");
+    for (UBaseType_t i = 0; i < n1; i++) {
+        uint32_t run = t1[i].ulRunTimeCounter;
+        // Tasks created between the snapshots count from zero
+        for (UBaseType_t j = 0; j < n0; j++) {
+            if (t0[j].xTaskNumber == t1[i].xTaskNumber) {
+                run -= t0[j].ulRunTimeCounter;
                 break;
-            }else {
-                //visiable? cut empty head
-                if(c > 31 && c < 127 && !(bytes == 0 && c == ' ')) {
-                    console->cmd_buf[bytes++] = c;
-                }
-                if (bytes >= CMD_SIZE_MAX) {
-                    LOG_ERROR("Invalid cmd: overlength-strings");
-                    return -1;
-                }
             }
-		} else if(-1 == ret) {
+        }
+        LOG_PRINTF("%-16s %4u %5u%% %10u", t1[i].pcTaskName, t1[i].uxCurrentPriority,
+            total1 != total0 ? (uint32_t)((uint64_t)run * 100 / (total1 - total0)) : 0,
+            t1[i].usStackHighWaterMark);
+    }
+    free(t0);
+    free(t1);
+#else
+    LOG_PRINTF("Task statistics need configUSE_TRACE_FACILITY and configGENERATE_RUN_TIME_STATS");
+#endif
+}
+
+static void _queues(int argc, char **argv)
+{
+    static const char *prio_names[i2c_bus_prio_num] = { "high", "normal", "low" };
+
+    if (host.htu21.msg_queue != NULL) {
+        LOG_PRINTF("%-20s %u/1", "sensor samples", uxQueueMessagesWaiting(host.htu21.msg_queue));
+    }
+    for (int p = 0; p < i2c_bus_prio_num; p++) {
+        int depth = i2c_bus_queue_depth(I2C_NUM_0, p);
+        if (depth >= 0) {
+            LOG_PRINTF("i2c0 %-15s %d/%d", prio_names[p], depth, I2C_BUS_QUEUE_LEN);
+        }
+    }
+    LOG_PRINTF("%-20s %u/%u", "publisher ring", host.publisher.count, PUBLISHER_RING_SIZE);
+    LOG_PRINTF("%-20s %u", "offline queue", sfq_store_pending(&host.sfq));
+}
+
+static void _mqtt_stats(int argc, char **argv)
+{
+    const publisher_stats_t *s = &host.publisher.stats;
+
+    LOG_PRINTF("Connected: %s", host.mqtt_connected ? "yes" : "no");
+    LOG_PRINTF("Received routed: %u, unrouted: %u, reassembled: %u, dropped: %u", mqtt_rx_stats.routed,
+        mqtt_rx_stats.unrouted, mqtt_rx_stats.reassembled, mqtt_rx_stats.dropped);
+    LOG_PRINTF("Published messages: %u, samples: %u, bytes: %u, dropped: %u", s->messages, s->samples,
+        s->bytes, s->dropped);
+    LOG_PRINTF("Flush latency last: %u ms, max: %u ms", s->flush_latency_ms, s->flush_latency_max_ms);
+    for (int i = 0; i < MQTT_CONN_NUM; i++) {
+        const mqtt_conn_stats_t *c = &mqtt_conn_stats[i];
+
+        LOG_PRINTF("%s connection: %u connects, %u sessions resumed, connect %u ms (max %u), SUBACK %u ms, "
+            "outage %u ms", c->name, c->connects, c->resumed, c->connect_ms, c->connect_max_ms, c->suback_ms,
+            c->outage_ms);
+    }
+}
+
+static void _latency(int argc, char **argv)
+{
+    bool all = argc < 2;
+
+    if (all || strcmp(argv[1], "sensor") == 0) {
+        htu21_print_latency(&host.htu21);
+    }
+    if (all || strcmp(argv[1], "i2c") == 0) {
+        i2c_bus_print_stats(I2C_NUM_0);
+    }
+    if (all || strcmp(argv[1], "oled") == 0) {
+        _oled_stats(0, NULL);
+    }
+    if (all || strcmp(argv[1], "mqtt") == 0) {
+        puback_print();
+    }
+}
+
+static void _console_echo_flush(console_t* console)
+{
+    if (console->echo_len > 0) {
+        serial_write(console->uart_num, (const unsigned char *)console->echo_buf, console->echo_len);
+        console->echo_len = 0;
+    }
+}
+
+static void _console_echo(console_t* console, const char *s, int n)
+{
+    if (!console->echo) {
+        return;
+    }
+    if (console->echo_len + n > CONSOLE_ECHO_SIZE) {
+        _console_echo_flush(console);
+    }
+    memcpy(&console->echo_buf[console->echo_len], s, n);
+    console->echo_len += n;
+}
+
+/*
+ * Refill rx_buf with everything the driver holds, waiting for an event when it holds nothing.
+ * The driver raises UART_DATA for bursts and UART_PATTERN_DET at each '\r', so a typed key or a
+ * whole pasted line costs one wake up.
+ */
+static void _console_fill(console_t* console)
+{
+    uart_event_t event;
+    int len;
+
+    console->rx_pos = console->rx_len = 0;
+    while (1) {
+        len = serial_buffered(console->uart_num);
+        if (len > 0) {
+            len = serial_read(console->uart_num, console->rx_buf, len < CONSOLE_RX_CHUNK ? len : CONSOLE_RX_CHUNK, 0);
+            if (len > 0) {
+                console->rx_len = len;
+                return;
+            }
+        }
+
+        if (console->uart_queue == NULL) {
+            len = serial_read(console->uart_num, console->rx_buf, 1, WAIT_FOREVER);
+            if (len == 1) {
+                console->rx_len = len;
+                return;
+            }
             LOG_ERROR("Invalid cmd: UART read ERROR");
+            continue;
+        }
+
+        if (pdTRUE != xQueueReceive(console->uart_queue, &event, portMAX_DELAY)) {
+            continue;
+        }
+        switch (event.type) {
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                LOG_ERROR("Invalid cmd: UART input overflow");
+                serial_flush_input(console->uart_num);
+                console->cmd_len = 0;
+                break;
+            case UART_PATTERN_DET:
+                // Reads keep the driver's line end positions up to date, only keep its queue short
+                uart_pattern_pop_pos(console->uart_num);
+                break;
+            default:
+                break;
         }
     }
+}
 
-    console->cmd_buf[bytes] = '\0';
+static void _metrics(int argc, char **argv)
+{
+    if (argc > 1) {
+        metrics_set_interval(strtoul(argv[1], NULL, 10));
+    }
+    metrics_print();
+}
 
-    return bytes;
+static void _outbox(int argc, char **argv)
+{
+    outbox_print();
+}
+
+/*
+ * Edit a line until '\r': backspace/DEL removes the last character, Ctrl-U the whole line and
+ * Ctrl-C drops it. Escape sequences such as the arrow keys are skipped. Returns the line length.
+ */
+static int _console_recv(console_t* console)
+{
+    while (1) {
+        uint8_t c;
+
+        if (console->rx_pos == console->rx_len) {
+            _console_echo_flush(console);
+            _console_fill(console);
+            continue;
+        }
+        c = console->rx_buf[console->rx_pos++];
+
+        if (console->esc) {
+            // ESC [ parameters final byte, or ESC and one byte
+            if (console->esc == 1 && c == '[') {
+                console->esc = 2;
+            } else if (console->esc == 1 || (c >= 0x40 && c <= 0x7E)) {
+                console->esc = 0;
+            }
+            continue;
+        }
+
+        switch (c) {
+            case '\r': {
+                int bytes = console->cmd_len;
+
+                console->cmd_buf[bytes] = '\0';
+                console->cmd_len = 0;
+                _console_echo(console, "\r\n", 2);
+                _console_echo_flush(console);
+                if (console->overlong) {
+                    console->overlong = false;
+                    console->cmd_buf[0] = '\0';
+                    LOG_ERROR("Invalid cmd: overlength-strings");
+                    return -1;
+                }
+                return bytes;
+            }
+            case '\n':
+                // Second half of a CRLF line end
+                break;
+            case 0x08:
+            case 0x7F:
+                if (console->cmd_len > 0) {
+                    console->cmd_len--;
+                    _console_echo(console, "\b \b", 3);
+                }
+                break;
+            case 0x15:
+                while (console->cmd_len > 0) {
+                    console->cmd_len--;
+                    _console_echo(console, "\b \b", 3);
+                }
+                break;
+            case 0x03:
+                console->cmd_len = 0;
+                console->overlong = false;
+                _console_echo(console, "^C\r\n", 4);
+                break;
+            case 0x1B:
+                console->esc = 1;
+                break;
+            default:
+                //visible only
+                if (c > 31 && c < 127) {
+                    if (console->cmd_len >= CMD_SIZE_MAX - 1) {
+                        console->overlong = true;
+                        break;
+                    }
+                    console->cmd_buf[console->cmd_len++] = c;
+                    _console_echo(console, console->state == CONSOLE_PWD_REQUIRED ? "*" : (const char *)&c, 1);
+                }
+                break;
+        }
+    }
 }
 
 static bool _console_verify_pwd(const char* buf)
@@ -101,30 +504,38 @@ static bool _console_verify_pwd(const char* buf)
     return true;
 }
 
-static void _console_execute(const char* buf)
+static void _console_execute(char* buf)
 {
-    //find cmd
-    int i = 0;
+    char *argv[CMD_ARGC_MAX + 1];
+    const cmd_entry *cmd;
+    int argc;
 
-    if((!buf) || (strlen(buf) == 0)) {
+    if(!buf) {
         LOG_ERROR("cmd is NULL!");
         return;
     }
-
-    while (i < (sizeof(cmd_list)/sizeof(cmd_entry))) {
-        if (cmd_list[i].name != NULL && strcmp(cmd_list[i].name, buf) == 0) {
-            //enter
-            LOG_PRINTF("%s>>", cmd_list[i].name);
-            cmd_list[i].function(0, NULL);
-            LOG_PRINTF("\r\n");
-            return;
-        }
-        i++;
+    argc = _console_tokenize(buf, argv);
+    if(argc == 0) {
+        LOG_ERROR("cmd is NULL!");
+        return;
+    }
+    if(argc < 0) {
+        LOG_ERROR("Invalid cmd: more than %d arguments", CMD_ARGC_MAX - 1);
+        return;
     }
+    argv[argc] = NULL;
 
-    LOG_ERROR("cmd not found!");
+    //find cmd
+    cmd = _cmd_find(argv[0]);
+    if (cmd == NULL) {
+        LOG_ERROR("cmd not found!");
+        return;
+    }
 
-    return;
+    //enter
+    LOG_PRINTF("%s>>", cmd->name);
+    cmd->function(argc, argv);
+    LOG_PRINTF("\r\n");
 }
 
 static void console_main(void* arg)
@@ -151,8 +562,9 @@ static void console_main(void* arg)
 
             //input mode
             case CONSOLE_ACTIVE:
-                _console_recv(console);
-                _console_execute(console->cmd_buf);
+                if (_console_recv(console) > 0) {
+                    _console_execute(console->cmd_buf);
+                }
                 break;
 
             default:
@@ -175,8 +587,20 @@ void console_deinit(console_t* console)
 
 int console_init(console_t *console, int uart_num)
 {
+    static bool builtins_registered;
+
+    if(!builtins_registered) {
+        for (int i = 0; i < (sizeof(cmd_list)/sizeof(cmd_entry)); i++) {
+            console_register_cmd(&cmd_list[i]);
+        }
+        builtins_registered = true;
+    }
+
     if(console != NULL) {
+        // echo is set by the caller before init
+        bool echo = console->echo;
         memset(console, 0, sizeof(console_t));
+        console->echo = echo;
     }
     else {
         LOG_ERROR("Console is NULL, init failed!");
@@ -184,8 +608,8 @@ int console_init(console_t *console, int uart_num)
     }
 
     console->state = CONSOLE_PWD_REQUIRED;
-    console->echo = false;
     console->uart_num = uart_num;
+    console->uart_queue = serial_get_event_queue(uart_num);
     memset(console->cmd_buf, 0, CMD_SIZE_MAX);
     console->cmd_buf_mutex = xSemaphoreCreateMutex();
     if(!console->cmd_buf_mutex)
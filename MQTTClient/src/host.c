@@ -2,6 +2,27 @@
 #include "log.h"
 #include "esp_sntp.h"
 
+// The sensor's serial number is CRC protected, a good read means the bus is clean
+static bool host_check_htu21(i2c_port_t num, uint8_t addr)
+{
+  uint64_t serial_number;
+  return htu21_read_serial_number(&serial_number) == htu21_status_ok;
+}
+
+// Devices the board may have on I2C_NUM_0
+static const i2c_scan_dev_t host_i2c_devices[] = {
+  { HTU21_ADDR, "htu21", HTU21_I2C_MAX_HZ, host_check_htu21 },
+  { SSD1306_I2C_ADDRESS >> 1, "ssd1306", SSD1306_I2C_MAX_HZ, NULL },
+};
+
+// Every sensor sample feeds the publish window and, if it shows differently, the display
+static void host_on_sample(void* ctx, const htu21_data_t* data)
+{
+  host_t* host = (host_t*)ctx;
+  aggregator_add(&host->aggregator, data);
+  ssd1306_notify_env(&host->ssd1306, data);
+}
+
 void init_host(host_t* host)
 {
   wifi_init_sta(host->wifi_creds.Wifi_SSID, host->wifi_creds.Wifi_Pass);
@@ -11,14 +32,39 @@ void init_host(host_t* host)
   sntp_setservername(0, "pool.ntp.org");
   sntp_init();
 
+  // Samples taken while offline are kept in flash until they can be sent
+  if(0 != sfq_store_open(&host->sfq, SFQ_PARTITION_LABEL))
+  {
+    LOG_ERROR("Store-and-forward queue unavailable, offline samples will be lost");
+  }
+
   // Setup I2C for OLED and Env Sensor
   if(0 != i2c_init(I2C_NUM_0))
   {
       LOG_PRINTF("Failed to Initialize I2C for screen");
   }
+  // The sensor and the screen share the bus, sensor reads go first
+  if(0 != i2c_bus_start(I2C_NUM_0))
+  {
+      LOG_ERROR("Failed to start the I2C bus arbiter");
+  }
 
   // Setup Env Sensor
   htu21_init();
+  // Nothing else uses the bus yet, find the devices and the fastest clock they all run at
+  if(0 != i2c_scan_bringup(I2C_NUM_0, host_i2c_devices, sizeof(host_i2c_devices) / sizeof(host_i2c_devices[0])))
+  {
+      LOG_ERROR("I2C bring-up failed, keeping the default clock");
+  }
+  host->htu21.sample_period_ms = HTU21_SAMPLE_PERIOD_MS;
+  host->htu21.resolution = HTU21_RESOLUTION;
+  // Every sample goes through the aggregator, the publisher sends one summary per window
+  if(0 != aggregator_init(&host->aggregator, AGGREGATOR_FILTER))
+  {
+    LOG_ERROR("Failed to initialize the sample aggregator");
+  }
+  host->htu21.on_sample = host_on_sample;
+  host->htu21.on_sample_ctx = host;
   host->htu21.msg_queue = xQueueCreate(1, sizeof(htu21_data_t));
   if(host->htu21.msg_queue == NULL)
   {
@@ -0,0 +1,76 @@
+/**
+ * File Name: 	htu21_fixed.c
+ * Description: Integer math for the htu21d conversions and derived values.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "htu21_fixed.h"
+
+/***************************************************************************************************/
+/* Private Data Types */
+/***************************************************************************************************/
+#define LOG2_LUT_BITS					5
+#define LOG10_2_Q30						323228497	// log10(2) * 2^30
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+// log2(1 + i/32) in Q16
+static const uint32_t log2_lut[(1 << LOG2_LUT_BITS) + 1] = {
+	0, 2909, 5732, 8473, 11136, 13727, 16248, 18704, 21098, 23433, 25711, 27936, 30109, 32234,
+	34312, 36346, 38336, 40286, 42196, 44068, 45904, 47705, 49472, 51207, 52911, 54584, 56229,
+	57845, 59434, 60997, 62534, 64047, 65536
+};
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int32_t htu21_fixed_temperature(uint16_t adc)
+{
+	return (int32_t)(((uint32_t)adc * HTU21_FIXED_TEMPERATURE_MUL + (1UL << 15)) >> 16) + HTU21_FIXED_TEMPERATURE_ADD;
+}
+int32_t htu21_fixed_humidity(uint16_t adc)
+{
+	return (int32_t)(((uint32_t)adc * HTU21_FIXED_HUMIDITY_MUL + (1UL << 15)) >> 16) + HTU21_FIXED_HUMIDITY_ADD;
+}
+int32_t htu21_fixed_fahrenheit(int32_t centi_c)
+{
+	return centi_c * 9 / 5 + 3200;
+}
+int32_t htu21_fixed_compensated_humidity(int32_t centi_c, int32_t centi_rh)
+{
+	// RH + (25 - T) * -0.15
+	return centi_rh + (centi_c - 2500) * 3 / 20;
+}
+int32_t htu21_fixed_log10(uint32_t x)
+{
+	uint32_t n, m, i, frac;
+	int32_t log2_q16;
+
+	n = 31 - __builtin_clz(x);
+	m = x << (31 - n);									// Mantissa in [1,2), Q31
+	i = (m >> (31 - LOG2_LUT_BITS)) & ((1 << LOG2_LUT_BITS) - 1);
+	frac = (m >> (31 - LOG2_LUT_BITS - 16)) & 0xFFFF;	// Position between table entries, Q16
+
+	log2_q16 = (int32_t)(n << 16) + log2_lut[i] + (int32_t)(((log2_lut[i + 1] - log2_lut[i]) * frac) >> 16);
+	return (int32_t)(((int64_t)log2_q16 * LOG10_2_Q30) >> 30);
+}
+int32_t htu21_fixed_dew_point(int32_t centi_c, int32_t centi_rh)
+{
+	int32_t log_rh, b_over_tc, den;
+
+	if( centi_rh < 1 )
+		centi_rh = 1;
+	if( centi_rh > 10000 )
+		centi_rh = 10000;
+
+	// log10(RH / 100) = log10(centi-RH) - 4
+	log_rh = htu21_fixed_log10((uint32_t)centi_rh) - (4 << 16);
+	// B / (T + C), both sides in hundredths so the scale cancels
+	b_over_tc = (int32_t)(((int64_t)HTU21_FIXED_CONSTANT_B << 16) / (centi_c + HTU21_FIXED_CONSTANT_C));
+
+	den = log_rh - b_over_tc;
+	return (int32_t)(-((int64_t)HTU21_FIXED_CONSTANT_B << 16) / den) - HTU21_FIXED_CONSTANT_C;
+}
@@ -7,14 +7,25 @@
 /* Include Files */
 /***************************************************************************************************/
 #include "htu21d.h"
-#include "driver/i2c.h"
+#include "i2c.h"
+#include "esp_timer.h"
+#include "htu21_fixed.h"
+#include "metrics.h"
 /***************************************************************************************************/
 /* Private Data Types */
 /***************************************************************************************************/
+// Conversion times are in us, round up to whole ticks for the blocking reads
+#define HTU21_CONVERSION_TICKS(us)		((TickType_t)(((us) / 1000 + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS))
 
 /***************************************************************************************************/
 /* Private Variables(static) */
 /***************************************************************************************************/
+// Sensor reads go ahead of display traffic on the shared bus
+static i2c_dev_t htu21_dev;
+
+static metrics_t *htu21_metric_reads;
+static metrics_t *htu21_metric_errors;
+static metrics_t *htu21_metric_crc_errors;
 
 /***************************************************************************************************/
 /* Public Variable Definitions */
@@ -25,8 +36,9 @@ htu21_i2c_master_mode_t i2c_master_mode;
 /***************************************************************************************************/
 /* Private Function Prototypes(static) */
 /***************************************************************************************************/
+static htu21_status_t htu21_status_from_i2c(i2c_status_t);
 static htu21_status_t htu21_write_command(uint8_t);
-static htu21_status_t htu21_write_command_no_stop(uint8_t);
+static htu21_status_t htu21_read_hold(uint8_t, uint16_t*);
 /**
  * @brief Reads the HTU21 user register.
  *
@@ -42,6 +54,11 @@ static htu21_status_t htu21_write_user_register(uint8_t );
 static htu21_status_t htu21_temperature_conversion_and_read_adc( uint16_t *);
 static htu21_status_t htu21_humidity_conversion_and_read_adc( uint16_t *);
 static htu21_status_t htu21_crc_check( uint16_t, uint8_t);
+static void htu21_timer_callback(void*);
+static void htu21_schedule_next_sample(htu21_t*);
+static void htu21_wait_conversion(htu21_t*, uint32_t);
+static bool htu21_poll_again(htu21_t*, htu21_status_t);
+static void htu21_acquisition_done(htu21_t*, bool);
 
 /***************************************************************************************************/
 /* Public Function Definitions */
@@ -49,22 +66,14 @@ static htu21_status_t htu21_crc_check( uint16_t, uint8_t);
 void htu21_init(void)
 {
     i2c_master_mode = htu21_i2c_no_hold;
+    htu21_metric_reads = metrics_register("sens_ok", metrics_counter);
+    htu21_metric_errors = metrics_register("sens_err", metrics_counter);
+    htu21_metric_crc_errors = metrics_register("sens_crc", metrics_counter);
+    i2c_dev_init(&htu21_dev, I2C_NUM_0, HTU21_ADDR, i2c_bus_prio_high, HTU21_I2C_TIMEOUT_MS, "htu21");
 }
 bool htu21_is_connected(void)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_WRITE, true);
-    uint8_t data = 0;
-    i2c_master_write(cmd, &data, sizeof(data), true);
-    i2c_master_stop(cmd);
-    esp_err_t status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-    if(status != ESP_OK)
-    {
-        return false;
-    }
-    return true;
+    return i2c_dev_probe(&htu21_dev) == i2c_status_ok;
 }
 htu21_status_t htu21_reset(void)
 {
@@ -87,7 +96,6 @@ void htu21_set_i2c_master_mode(htu21_i2c_master_mode_t mode)
 htu21_status_t htu21_read_serial_number(uint64_t* serial_number)
 {
 	htu21_status_t status;
-	esp_err_t i2c_status;
 	uint8_t cmd_data[2];
 	uint8_t rcv_data[14];
 	uint8_t i;
@@ -97,51 +105,18 @@ htu21_status_t htu21_read_serial_number(uint64_t* serial_number)
 	cmd_data[1] = HTU21_READ_SERIAL_FIRST_8BYTES_COMMAND&0xFF;
 		
 	/* Do the transfer */
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, cmd_data, 2, true);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-
-    cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_NACK);
-    i2c_master_read(cmd, rcv_data, 8, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-
-
-	if( i2c_status == ESP_FAIL )
-		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
+	status = htu21_status_from_i2c(i2c_dev_write_read(&htu21_dev, cmd_data, 2, rcv_data, 8));
+	if( status != htu21_status_ok )
+		return status;
 
 	// Read the last 6 bytes
 	cmd_data[0] = (HTU21_READ_SERIAL_LAST_6BYTES_COMMAND>>8)&0xFF;
 	cmd_data[1] = HTU21_READ_SERIAL_LAST_6BYTES_COMMAND&0xFF;
 
 	/* Do the transfer */
-	cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, cmd_data, 2, true);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-
-    cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_NACK);
-    i2c_master_read(cmd, &rcv_data[8], 6, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-
-	if( i2c_status == ESP_FAIL )
-		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
+	status = htu21_status_from_i2c(i2c_dev_write_read(&htu21_dev, cmd_data, 2, &rcv_data[8], 6));
+	if( status != htu21_status_ok )
+		return status;
 	
 	for( i=0 ; i<8 ; i+=2 ) {
 		status = htu21_crc_check(rcv_data[i],rcv_data[i+1]);
@@ -208,74 +183,157 @@ htu21_status_t htu21_set_resolution(htu21_resolution_t res)
 htu21_status_t htu21_read_temperature_and_relative_humidity(float* temperature, float* humidity)
 {
 	htu21_status_t status;
-	uint16_t adc = 0;
+	uint16_t temperature_adc = 0, humidity_adc = 0;
 	
-	status = htu21_temperature_conversion_and_read_adc(&adc);
+	status = htu21_read_adc(&temperature_adc, &humidity_adc);
 	if( status != htu21_status_ok)
 		return status;
 	
 	// Perform conversion function
-	*temperature = (float)adc * TEMPERATURE_COEFF_MUL / (1UL<<16) + TEMPERATURE_COEFF_ADD;
-
-	status = htu21_humidity_conversion_and_read_adc( &adc);
+	*temperature = htu21_temperature_from_adc(temperature_adc);
+	*humidity = htu21_humidity_from_adc(humidity_adc);
+	
+	return status;
+}
+htu21_status_t htu21_read_adc(uint16_t* temperature_adc, uint16_t* humidity_adc)
+{
+	htu21_status_t status, crc_status;
+	uint8_t buffer[3];
+	
+	if( i2c_master_mode == htu21_i2c_hold) {
+		status = htu21_temperature_conversion_and_read_adc(temperature_adc);
+		if( status != htu21_status_ok)
+			return status;
+		return htu21_humidity_conversion_and_read_adc(humidity_adc);
+	}
+	
+	status = htu21_start_temperature_conversion();
+	if( status != htu21_status_ok)
+		return status;
+	vTaskDelay(HTU21_CONVERSION_TICKS(htu21_temperature_conversion_time));
+	status = htu21_read_conversion_raw(buffer);
 	if( status != htu21_status_ok)
 		return status;
 	
-	// Perform conversion function
-	*humidity = (float)adc * HUMIDITY_COEFF_MUL / (1UL<<16) + HUMIDITY_COEFF_ADD;
+	// Start the humidity conversion first, the temperature result is checked while it runs
+	status = htu21_start_humidity_conversion();
+	crc_status = htu21_decode_conversion(buffer, temperature_adc);
+	if( status != htu21_status_ok)
+		return status;
+	if( crc_status != htu21_status_ok)
+		return crc_status;
 	
+	vTaskDelay(HTU21_CONVERSION_TICKS(htu21_humidity_conversion_time));
+	return htu21_read_conversion(humidity_adc);
+}
+htu21_status_t htu21_start_temperature_conversion(void)
+{
+	return htu21_write_command(HTU21_READ_TEMPERATURE_WO_HOLD_COMMAND);
+}
+htu21_status_t htu21_start_humidity_conversion(void)
+{
+	return htu21_write_command(HTU21_READ_HUMIDITY_WO_HOLD_COMMAND);
+}
+htu21_status_t htu21_read_conversion(uint16_t* adc)
+{
+	htu21_status_t status;
+	uint8_t buffer[3];
+	
+	status = htu21_read_conversion_raw(buffer);
+	if( status != htu21_status_ok)
+		return status;
+	
+	return htu21_decode_conversion(buffer, adc);
+}
+htu21_status_t htu21_read_conversion_raw(uint8_t* buffer)
+{
+	buffer[0] = 0;
+	buffer[1] = 0;
+	buffer[2] = 0;
+	
+	return htu21_status_from_i2c(i2c_dev_read(&htu21_dev, buffer, 3));
+}
+htu21_status_t htu21_decode_conversion(const uint8_t* buffer, uint16_t* adc)
+{
+	htu21_status_t status;
+	uint16_t _adc;
+	uint8_t crc;
+	
+	_adc = (buffer[0] << 8) | buffer[1];
+	crc = buffer[2];
+	
+	// compute CRC
+	status = htu21_crc_check(_adc,crc);
+	if( status != htu21_status_ok)
+		return status;
+	
+	*adc = _adc;
+
 	return status;
 }
+void htu21_print_latency(const htu21_t* htu21)
+{
+	static const char* names[HTU21_RESOLUTION_NUM] = {
+		[htu21_resolution_t_14b_rh_12b] = "T14b/RH12b",
+		[htu21_resolution_t_12b_rh_8b] = "T12b/RH8b",
+		[htu21_resolution_t_13b_rh_10b] = "T13b/RH10b",
+		[htu21_resolution_t_11b_rh_11b] = "T11b/RH11b",
+	};
+	
+	LOG_PRINTF("%-12s %8s %8s %8s %8s %6s %6s", "resolution", "samples", "min_us", "avg_us", "max_us", "polls", "errors");
+	for(int i = 0; i < HTU21_RESOLUTION_NUM; i++)
+	{
+		const htu21_latency_t* l = &htu21->latency[i];
+		if(l->samples == 0 && l->errors == 0)
+			continue;
+		// The worst acquisition seen bounds the fastest sample period this resolution can keep
+		LOG_PRINTF("%-12s %8u %8u %8u %8u %6u %6u", names[i], l->samples, l->min_us,
+			l->samples ? (uint32_t)(l->total_us / l->samples) : 0, l->max_us, l->polls, l->errors);
+	}
+}
+float htu21_temperature_from_adc(uint16_t adc)
+{
+	return (float)adc * TEMPERATURE_COEFF_MUL / (1UL<<16) + TEMPERATURE_COEFF_ADD;
+}
+float htu21_humidity_from_adc(uint16_t adc)
+{
+	return (float)adc * HUMIDITY_COEFF_MUL / (1UL<<16) + HUMIDITY_COEFF_ADD;
+}
 float htu21_compute_compensated_humidity(float temperature,float relative_humidity)
 {
 	return ( relative_humidity + (25 - temperature) * HTU21_TEMPERATURE_COEFFICIENT);
 }
 float htu21_compute_dew_point(float temperature,float relative_humidity)
 {
-	double partial_pressure;
-	double dew_point;
-	
-	// Missing power of 10
-	partial_pressure = pow( 10, HTU21_CONSTANT_A - HTU21_CONSTANT_B / (temperature + HTU21_CONSTANT_C) );
-	
-	dew_point =  - HTU21_CONSTANT_B / (log10( relative_humidity * partial_pressure / 100) - HTU21_CONSTANT_A) - HTU21_CONSTANT_C;
-	
-	return (float)dew_point;
+	// No double precision FPU, the table driven integer version is within 0.02 degC
+	return htu21_fixed_dew_point((int32_t)lrintf(temperature * 100), (int32_t)lrintf(relative_humidity * 100)) / 100.0f;
 }
 /***************************************************************************************************/
 /* Private Function Definitions */
 /***************************************************************************************************/
-htu21_status_t htu21_write_command(uint8_t command)
+htu21_status_t htu21_status_from_i2c(i2c_status_t i2c_status)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, &command, sizeof(command), true);
-    i2c_master_stop(cmd);
-    esp_err_t i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-
-	if( i2c_status == ESP_FAIL )
+	if( i2c_status == i2c_status_ok )
+		return htu21_status_ok;
+	if( i2c_status == i2c_status_nack )
 		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
-	
-	return htu21_status_ok;
+	return htu21_status_i2c_transfer_error;
+}
+htu21_status_t htu21_write_command(uint8_t command)
+{
+	return htu21_status_from_i2c(i2c_dev_write(&htu21_dev, &command, sizeof(command)));
 }
-htu21_status_t htu21_write_command_no_stop(uint8_t command)
+htu21_status_t htu21_read_hold(uint8_t command, uint16_t *adc)
 {
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, &command, sizeof(command), true);
-    esp_err_t i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-	if( i2c_status == ESP_FAIL )
-		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
+	htu21_status_t status;
+	uint8_t buffer[3] = {0, 0, 0};
 	
-	return htu21_status_ok;
+	// The sensor stretches the clock until the result is ready, all in one transaction
+	status = htu21_status_from_i2c(i2c_dev_write_read(&htu21_dev, &command, sizeof(command), buffer, 3));
+	if( status != htu21_status_ok)
+		return status;
+	
+	return htu21_decode_conversion(buffer, adc);
 }
 htu21_status_t htu21_crc_check(uint16_t value, uint8_t crc)
 {
@@ -297,30 +355,20 @@ htu21_status_t htu21_crc_check(uint16_t value, uint8_t crc)
 	}
 	if( result == crc )
 		return 	htu21_status_ok;
-	else
-		return htu21_status_crc_error;
+	
+	metrics_inc(htu21_metric_crc_errors);
+	return htu21_status_crc_error;
 }
 htu21_status_t htu21_read_user_register(uint8_t *value)
 {
 	htu21_status_t status;
-	esp_err_t i2c_status;
-	// Send the Read Register Command
-	status = htu21_write_command(HTU21_READ_USER_REG_COMMAND);
-
+	uint8_t command = HTU21_READ_USER_REG_COMMAND;
+	uint8_t buff[1];
+	
+	// Send the Read Register Command, then read it back after a repeated start
+	status = htu21_status_from_i2c(i2c_dev_write_read(&htu21_dev, &command, sizeof(command), buff, 1));
 	if( status != htu21_status_ok )
 		return status;
-	uint8_t buff[1];
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_NACK);
-    i2c_master_read(cmd, buff, 1, I2C_MASTER_NACK);
-    i2c_master_stop(cmd);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-	if( i2c_status == ESP_FAIL )
-		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
 
 	*value = buff[0];
 	
@@ -329,7 +377,6 @@ htu21_status_t htu21_read_user_register(uint8_t *value)
 htu21_status_t htu21_write_user_register(uint8_t value)
 {
 	htu21_status_t status;
-	esp_err_t i2c_status;
 	uint8_t reg;
 	uint8_t data[2];
 	
@@ -345,139 +392,186 @@ htu21_status_t htu21_write_user_register(uint8_t value)
 	data[0] = HTU21_WRITE_USER_REG_COMMAND;
 	data[1] = reg; 
 
-	i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, data, 2, true);
-    i2c_master_stop(cmd);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-
-	if( i2c_status == ESP_FAIL )
-		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
-		
-	return htu21_status_ok;
+	return htu21_status_from_i2c(i2c_dev_write(&htu21_dev, data, 2));
 }
 htu21_status_t htu21_temperature_conversion_and_read_adc(uint16_t *adc)
 {
 	htu21_status_t status = htu21_status_ok;
-	esp_err_t i2c_status;
-	uint16_t _adc;
-	uint8_t buffer[3];
-	uint8_t crc;
 	
-	buffer[0] = 0;
-	buffer[1] = 0;
-	buffer[2] = 0;
+	if( i2c_master_mode == htu21_i2c_hold)
+		return htu21_read_hold(HTU21_READ_TEMPERATURE_W_HOLD_COMMAND, adc);
 	
-	if( i2c_master_mode == htu21_i2c_hold) {
-		status = htu21_write_command_no_stop(HTU21_READ_TEMPERATURE_W_HOLD_COMMAND);
-	}
-	else {
-		status = htu21_write_command(HTU21_READ_TEMPERATURE_WO_HOLD_COMMAND);
-		vTaskDelay(50 / portTICK_RATE_MS);
-	}
-	if( status != htu21_status_ok)
-		return status;
-		
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_NACK);
-    i2c_master_read(cmd, buffer, 3, I2C_MASTER_LAST_NACK);
-    i2c_master_stop(cmd);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-	
-	if( i2c_status == ESP_FAIL )
-		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
-
-	_adc = (buffer[0] << 8) | buffer[1];
-	crc = buffer[2];
-	
-	// compute CRC
-	status = htu21_crc_check(_adc,crc);
+	status = htu21_start_temperature_conversion();
+	vTaskDelay(HTU21_CONVERSION_TICKS(htu21_temperature_conversion_time));
 	if( status != htu21_status_ok)
 		return status;
 	
-	*adc = _adc;
-
-	return status;
+	return htu21_read_conversion(adc);
 }
 htu21_status_t htu21_humidity_conversion_and_read_adc( uint16_t *adc)
 {
 	htu21_status_t status = htu21_status_ok;
-	esp_err_t i2c_status;
-	uint16_t _adc;
-	uint8_t buffer[3];
-	uint8_t crc;
 	
-	buffer[0] = 0;
-	buffer[1] = 0;
-	buffer[2] = 0;
+	if( i2c_master_mode == htu21_i2c_hold)
+		return htu21_read_hold(HTU21_READ_HUMIDITY_W_HOLD_COMMAND, adc);
 	
-	if( i2c_master_mode == htu21_i2c_hold) {
-		status = htu21_write_command_no_stop(HTU21_READ_HUMIDITY_W_HOLD_COMMAND);
-	}
-	else {
-		status = htu21_write_command(HTU21_READ_HUMIDITY_WO_HOLD_COMMAND);
-		vTaskDelay(50 / portTICK_RATE_MS);
-	}
+	status = htu21_start_humidity_conversion();
+	vTaskDelay(HTU21_CONVERSION_TICKS(htu21_humidity_conversion_time));
 	if( status != htu21_status_ok)
 		return status;
-		
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (HTU21_ADDR << 1) | I2C_MASTER_READ, I2C_MASTER_NACK);
-    i2c_master_read(cmd, buffer, 3, I2C_MASTER_LAST_NACK);
-    i2c_master_stop(cmd);
-    i2c_status = i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-
-	if( i2c_status == ESP_FAIL )
-		return htu21_status_no_i2c_acknowledge;
-	if( i2c_status != ESP_OK)
-		return htu21_status_i2c_transfer_error;
-
-	_adc = (buffer[0] << 8) | buffer[1];
-	crc = buffer[2];
 	
-	// compute CRC
-	status = htu21_crc_check(_adc,crc);
-	if( status != htu21_status_ok)
-		return status;
+	return htu21_read_conversion(adc);
+}
+void htu21_timer_callback(void* arg)
+{
+	htu21_t* htu21 = (htu21_t*)arg;
 	
-	*adc = _adc;
-
-	return status;
+	// Runs in the esp_timer task, the I2C work is left to the sensor task
+	xTaskNotifyGive(htu21->thread);
+}
+void htu21_schedule_next_sample(htu21_t* htu21)
+{
+	int64_t now = esp_timer_get_time();
+	
+	// Samples are placed on a fixed grid so the rate does not drift with the time spent on the bus
+	htu21->next_sample_us += (int64_t)htu21->sample_period_ms * 1000;
+	if( htu21->next_sample_us < now )
+		htu21->next_sample_us = now;
+	
+	htu21->state = htu21_state_idle;
+	esp_timer_start_once(htu21->timer, htu21->next_sample_us - now);
+}
+void htu21_wait_conversion(htu21_t* htu21, uint32_t conversion_time)
+{
+	// First read attempt before the datasheet maximum, the sensor NACKs until it is done
+	htu21->poll_deadline_us = esp_timer_get_time() + (int64_t)conversion_time * HTU21_POLL_TIMEOUT_PERCENT / 100;
+	esp_timer_start_once(htu21->timer, (uint64_t)conversion_time * HTU21_POLL_FIRST_PERCENT / 100);
+}
+bool htu21_poll_again(htu21_t* htu21, htu21_status_t status)
+{
+	if( status != htu21_status_no_i2c_acknowledge || esp_timer_get_time() >= htu21->poll_deadline_us )
+		return false;
+	
+	htu21->latency[htu21->resolution].polls++;
+	esp_timer_start_once(htu21->timer, HTU21_POLL_INTERVAL_US);
+	return true;
+}
+void htu21_acquisition_done(htu21_t* htu21, bool ok)
+{
+	htu21_latency_t* l = &htu21->latency[htu21->resolution];
+	uint32_t us = (uint32_t)(esp_timer_get_time() - htu21->acquire_start_us);
+	
+	metrics_inc(ok ? htu21_metric_reads : htu21_metric_errors);
+	if( ok ) {
+		l->samples++;
+		l->last_us = us;
+		l->total_us += us;
+		if( l->min_us == 0 || us < l->min_us )
+			l->min_us = us;
+		if( us > l->max_us )
+			l->max_us = us;
+	}
+	else {
+		l->errors++;
+	}
+	htu21_schedule_next_sample(htu21);
 }
 void htu21_main(void* arg)
 {
 	htu21_t* htu21 = (htu21_t*)arg;
+	htu21_status_t status;
+	uint8_t buffer[3];
 	htu21_data_t data = 
 	{
 		.temperature = 0,
-		.humidity = 0
+		.humidity = 0,
+		.temperature_adc = 0,
+		.humidity_adc = 0
+	};
+	const esp_timer_create_args_t timer_args = 
+	{
+		.callback = htu21_timer_callback,
+		.arg = htu21,
+		.name = "htu21"
 	};
+	
+	htu21->thread = xTaskGetCurrentTaskHandle();
+	if( htu21->sample_period_ms == 0 )
+		htu21->sample_period_ms = HTU21_SAMPLE_PERIOD_MS;
+	if(ESP_OK != esp_timer_create(&timer_args, &htu21->timer))
+	{
+		LOG_ERROR("Failed to create the sensor timer");
+		vTaskDelete(NULL);
+	}
+	
 	htu21_init();
-	htu21_set_resolution(htu21_resolution_t_13b_rh_10b);
+	if( htu21->resolution >= HTU21_RESOLUTION_NUM )
+		htu21->resolution = HTU21_RESOLUTION;
+	htu21_set_resolution(htu21->resolution);
 	if(NULL == htu21->msg_queue)
 	{
 		LOG_ERROR("Queue is null");
 	}
 	
+	htu21->state = htu21_state_idle;
+	htu21->next_sample_us = esp_timer_get_time();
 	while(1)
 	{
-		// Read temperature and humidity
-		htu21_read_temperature_and_relative_humidity((&data.temperature), &(data.humidity));
-		// Add to Queue
-		data.temperature = data.temperature*(9.0/5.0)+32.0;
-		xQueueOverwrite(htu21->msg_queue, &data);
-		vTaskDelay(10); // sleep for half a second
+		switch(htu21->state)
+		{
+		case htu21_state_idle:
+			// Issue the temperature conversion and release the bus while the sensor works
+			htu21->acquire_start_us = esp_timer_get_time();
+			if(htu21_status_ok == htu21_start_temperature_conversion())
+			{
+				htu21->state = htu21_state_temperature;
+				htu21_wait_conversion(htu21, htu21_temperature_conversion_time);
+			}
+			else
+			{
+				htu21_acquisition_done(htu21, false);
+			}
+			break;
+		case htu21_state_temperature:
+			status = htu21_read_conversion_raw(buffer);
+			if(htu21_poll_again(htu21, status))
+				break;
+			// Start the humidity conversion before checking the temperature result
+			if(status == htu21_status_ok)
+				status = htu21_start_humidity_conversion();
+			if(status == htu21_status_ok)
+				status = htu21_decode_conversion(buffer, &data.temperature_adc);
+			if(status == htu21_status_ok)
+			{
+				data.temperature = htu21_fixed_fahrenheit(htu21_fixed_temperature(data.temperature_adc)) / 100.0f;
+				htu21->state = htu21_state_humidity;
+				htu21_wait_conversion(htu21, htu21_humidity_conversion_time);
+			}
+			else
+			{
+				htu21_acquisition_done(htu21, false);
+			}
+			break;
+		case htu21_state_humidity:
+			status = htu21_read_conversion_raw(buffer);
+			if(htu21_poll_again(htu21, status))
+				break;
+			if(status == htu21_status_ok)
+				status = htu21_decode_conversion(buffer, &data.humidity_adc);
+			if(status == htu21_status_ok)
+			{
+				data.humidity = htu21_fixed_humidity(data.humidity_adc) / 100.0f;
+				// Add to Queue
+				xQueueOverwrite(htu21->msg_queue, &data);
+				if(htu21->on_sample)
+					htu21->on_sample(htu21->on_sample_ctx, &data);
+			}
+			htu21_acquisition_done(htu21, status == htu21_status_ok);
+			break;
+		}
+		// Sleep until the timer reports the conversion done or the next sample due
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 	}
 	vTaskDelete(NULL);
 	return (function_cb_t)(0);
-}
\ No newline at end of file
+}
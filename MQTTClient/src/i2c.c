@@ -1,38 +1,61 @@
 #include "i2c.h"
 #include "log.h"
+#include "metrics.h"
+
+// Configuration each port was installed with, kept so the clock can be changed later
+static i2c_config_t i2c_port_config[I2C_NUM_MAX];
+static bool i2c_port_ready[I2C_NUM_MAX];
+
+// Results of device transactions, NACKs apart as the sensor NACKs while converting
+static metrics_t *i2c_metric_nacks;
+static metrics_t *i2c_metric_timeouts;
+static metrics_t *i2c_metric_errors;
+
+static i2c_status_t i2c_dev_status(esp_err_t err)
+{
+    i2c_status_t status = i2c_status_from_esp(err);
+
+    switch (status)
+    {
+    case i2c_status_ok:
+        break;
+    case i2c_status_nack:
+        metrics_inc(i2c_metric_nacks);
+        break;
+    case i2c_status_timeout:
+        metrics_inc(i2c_metric_timeouts);
+        break;
+    default:
+        metrics_inc(i2c_metric_errors);
+        break;
+    }
+    return status;
+}
 
 int i2c_init(int num)
 {
+    i2c_config_t i2c_config;
+
+    i2c_metric_nacks = metrics_register("i2c_nack", metrics_counter);
+    i2c_metric_timeouts = metrics_register("i2c_tmo", metrics_counter);
+    i2c_metric_errors = metrics_register("i2c_err", metrics_counter);
+
     switch (num)
     {
     case I2C_NUM_0:
-    {
-        i2c_config_t i2c_config = {
+        i2c_config = (i2c_config_t){
             .mode = I2C_MODE_MASTER,
             .sda_io_num = GPIO_NUM_21,
             .scl_io_num = GPIO_NUM_22,
             .scl_pullup_en = false,
             .sda_pullup_en = false,
             .master = {
-                .clk_speed = 100e3,
+                .clk_speed = I2C_DEFAULT_CLK_HZ,
             },
         };
-        if(ESP_OK != i2c_param_config(num, &i2c_config))
-        {
-            LOG_ERROR("Failed to configure i2c driver.");
-            return -1;
-        }
-        if(ESP_OK != i2c_driver_install(num, I2C_MODE_MASTER, 0, 0, 0))
-        {
-            LOG_ERROR("Failed to install i2c driver.");
-            return -1;
-        }
-    }
         break;
     case I2C_NUM_1:
-    {
-        i2c_config_t i2c_config = 
-        {
+        i2c_config = (i2c_config_t){
             .mode 				= I2C_MODE_MASTER,
             .sda_io_num			= GPIO_NUM_4,
             .sda_pullup_en		= GPIO_PULLUP_ENABLE,
@@ -40,45 +63,190 @@ int i2c_init(int num)
             .scl_pullup_en		= GPIO_PULLUP_ENABLE,
             .master.clk_speed	= 400000,
         };
-        if(ESP_OK != i2c_param_config(num, &i2c_config))
-        {
-            LOG_ERROR("Failed to configure i2c driver.");
-            return -1;
-        }
-        if(ESP_OK != i2c_driver_install(num, I2C_MODE_MASTER, 0, 0, 0))
-        {
-            LOG_ERROR("Failed to install i2c driver.");
-            return -1;
-        }
-    }
         break;
-    
     default:
-        break;
+        return 0;
     }
+
+    if(ESP_OK != i2c_param_config(num, &i2c_config))
+    {
+        LOG_ERROR("Failed to configure i2c driver.");
+        return -1;
+    }
+    if(ESP_OK != i2c_driver_install(num, I2C_MODE_MASTER, 0, 0, 0))
+    {
+        LOG_ERROR("Failed to install i2c driver.");
+        return -1;
+    }
+    i2c_port_config[num] = i2c_config;
+    i2c_port_ready[num] = true;
     return 0;
 }
 
+int i2c_set_clock(int num, uint32_t clk_hz)
+{
+    i2c_config_t i2c_config;
+
+    if(num < 0 || num >= I2C_NUM_MAX || !i2c_port_ready[num])
+        return -1;
+    i2c_config = i2c_port_config[num];
+    i2c_config.master.clk_speed = clk_hz;
+    if(ESP_OK != i2c_param_config(num, &i2c_config))
+    {
+        LOG_ERROR("Failed to set i2c%d clock to %u Hz.", num, clk_hz);
+        return -1;
+    }
+    i2c_port_config[num] = i2c_config;
+    return 0;
+}
+
+uint32_t i2c_get_clock(int num)
+{
+    if(num < 0 || num >= I2C_NUM_MAX || !i2c_port_ready[num])
+        return 0;
+    return i2c_port_config[num].master.clk_speed;
+}
+
 int i2c_read(int num, uint8_t addr, unsigned char *buf, int len, int timeout)
 {
+    uint8_t link[I2C_LINK_RECOMMENDED_SIZE(1)];
     esp_err_t i2c_status;
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
+    i2c_cmd_handle_t cmd;
+
+    if(len <= 0)
+        return -1;
+    cmd = i2c_cmd_link_create_static(link, sizeof(link));
     i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, I2C_MASTER_NACK);
-    i2c_master_read(cmd, buf, 3, I2C_MASTER_LAST_NACK);
+    i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, buf, len, I2C_MASTER_LAST_NACK);
     i2c_master_stop(cmd);
-    i2c_status = i2c_master_cmd_begin(num, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-    return i2c_status;
+    i2c_status = i2c_master_cmd_begin(num, cmd, pdMS_TO_TICKS(timeout));
+    i2c_cmd_link_delete_static(cmd);
+    return i2c_status == ESP_OK ? 0 : -1;
 }
 
-void i2c_write(int num, uint8_t addr, const unsigned char *buf, int len)
+int i2c_write(int num, uint8_t addr, const unsigned char *buf, int len, int timeout)
 {
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
+    uint8_t link[I2C_LINK_RECOMMENDED_SIZE(1)];
+    esp_err_t i2c_status;
+    i2c_cmd_handle_t cmd;
+
+    cmd = i2c_cmd_link_create_static(link, sizeof(link));
     i2c_master_start(cmd);
     i2c_master_write_byte(cmd, (addr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, &buf, len, true);
+    if(len > 0)
+        i2c_master_write(cmd, (uint8_t *)buf, len, true);
+    i2c_master_stop(cmd);
+    i2c_status = i2c_master_cmd_begin(num, cmd, pdMS_TO_TICKS(timeout));
+    i2c_cmd_link_delete_static(cmd);
+    return i2c_status == ESP_OK ? 0 : -1;
+}
+
+int i2c_delete(int num)
+{
+    if(ESP_OK != i2c_driver_delete(num))
+    {
+        LOG_ERROR("Failed to delete i2c driver.");
+        return -1;
+    }
+    return 0;
+}
+
+i2c_status_t i2c_status_from_esp(esp_err_t err)
+{
+    switch (err)
+    {
+    case ESP_OK:
+        return i2c_status_ok;
+    case ESP_FAIL:              // The driver reports a missing ACK as ESP_FAIL
+        return i2c_status_nack;
+    case ESP_ERR_TIMEOUT:
+        return i2c_status_timeout;
+    case ESP_ERR_NO_MEM:        // From the arbiter, its queue is full
+        return i2c_status_busy;
+    default:
+        return i2c_status_error;
+    }
+}
+
+int i2c_dev_init(i2c_dev_t *dev, i2c_port_t num, uint8_t addr, i2c_bus_prio_t prio, uint32_t timeout_ms,
+    const char *name)
+{
+    dev->addr = addr;
+    dev->timeout = pdMS_TO_TICKS(timeout_ms) > 0 ? pdMS_TO_TICKS(timeout_ms) : 1;
+    return i2c_bus_client_init(&dev->client, num, prio, name);
+}
+
+i2c_status_t i2c_dev_probe(i2c_dev_t *dev)
+{
+    return i2c_dev_write(dev, NULL, 0);
+}
+
+i2c_status_t i2c_dev_write(i2c_dev_t *dev, const uint8_t *buf, size_t len)
+{
+    esp_err_t i2c_status;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(dev->link, sizeof(dev->link));
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (dev->addr << 1) | I2C_MASTER_WRITE, true);
+    if(len > 0)
+        i2c_master_write(cmd, (uint8_t *)buf, len, true);
     i2c_master_stop(cmd);
-    i2c_master_cmd_begin(num, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-}
\ No newline at end of file
+    i2c_status = i2c_bus_transfer(&dev->client, cmd, dev->timeout);
+    i2c_cmd_link_delete_static(cmd);
+    return i2c_dev_status(i2c_status);
+}
+
+i2c_status_t i2c_dev_write_prefixed(i2c_dev_t *dev, uint8_t prefix, const uint8_t *buf, size_t len)
+{
+    esp_err_t i2c_status;
+    i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(dev->link, sizeof(dev->link));
+
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (dev->addr << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write_byte(cmd, prefix, true);
+    if(len > 0)
+        i2c_master_write(cmd, (uint8_t *)buf, len, true);
+    i2c_master_stop(cmd);
+    i2c_status = i2c_bus_transfer(&dev->client, cmd, dev->timeout);
+    i2c_cmd_link_delete_static(cmd);
+    return i2c_dev_status(i2c_status);
+}
+
+i2c_status_t i2c_dev_read(i2c_dev_t *dev, uint8_t *buf, size_t len)
+{
+    esp_err_t i2c_status;
+    i2c_cmd_handle_t cmd;
+
+    if(len == 0)
+        return i2c_status_error;
+    cmd = i2c_cmd_link_create_static(dev->link, sizeof(dev->link));
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (dev->addr << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, buf, len, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(cmd);
+    i2c_status = i2c_bus_transfer(&dev->client, cmd, dev->timeout);
+    i2c_cmd_link_delete_static(cmd);
+    return i2c_dev_status(i2c_status);
+}
+
+i2c_status_t i2c_dev_write_read(i2c_dev_t *dev, const uint8_t *wbuf, size_t wlen, uint8_t *rbuf, size_t rlen)
+{
+    esp_err_t i2c_status;
+    i2c_cmd_handle_t cmd;
+
+    if(rlen == 0)
+        return i2c_status_error;
+    cmd = i2c_cmd_link_create_static(dev->link, sizeof(dev->link));
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (dev->addr << 1) | I2C_MASTER_WRITE, true);
+    if(wlen > 0)
+        i2c_master_write(cmd, (uint8_t *)wbuf, wlen, true);
+    i2c_master_start(cmd);
+    i2c_master_write_byte(cmd, (dev->addr << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(cmd, rbuf, rlen, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(cmd);
+    i2c_status = i2c_bus_transfer(&dev->client, cmd, dev->timeout);
+    i2c_cmd_link_delete_static(cmd);
+    return i2c_dev_status(i2c_status);
+}
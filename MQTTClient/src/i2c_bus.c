@@ -0,0 +1,342 @@
+/**
+ * File Name:   i2c_bus.c
+ * Description: Prioritised arbiter for an I2C port shared by several drivers.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "i2c_bus.h"
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+static i2c_bus_t i2c_buses[I2C_NUM_MAX];
+static bool i2c_bus_running[I2C_NUM_MAX];
+// Request state changes between a caller giving up and the bus task starting the request
+static portMUX_TYPE i2c_bus_req_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static void i2c_bus_main(void *arg);
+static void i2c_bus_run(i2c_bus_t *bus);
+static void i2c_bus_sync_done(void *ctx, esp_err_t status);
+static uint8_t i2c_bus_bucket(uint32_t us);
+static void i2c_bus_account(i2c_bus_t *bus, i2c_bus_client_t *client, int64_t start_us, uint32_t wait_us,
+    uint32_t hold_us, esp_err_t status);
+static void i2c_bus_print_hist(const char *label, const uint32_t *hist, int n);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int i2c_bus_start(i2c_port_t num)
+{
+    i2c_bus_t *bus;
+
+    if(num < 0 || num >= I2C_NUM_MAX)
+    {
+        LOG_ERROR("Invalid i2c port %d", num);
+        return -1;
+    }
+    if(i2c_bus_running[num])
+        return 0;
+
+    bus = &i2c_buses[num];
+    memset(bus, 0, sizeof(i2c_bus_t));
+    bus->num = num;
+    for(int p = 0; p < i2c_bus_prio_num; p++)
+    {
+        bus->queue[p] = xQueueCreate(I2C_BUS_QUEUE_LEN, sizeof(i2c_bus_req_t *));
+        if(bus->queue[p] == NULL)
+        {
+            LOG_ERROR("Failed to create the i2c bus queues");
+            return -1;
+        }
+    }
+    bus->pending = xSemaphoreCreateCounting(I2C_BUS_QUEUE_LEN * i2c_bus_prio_num, 0);
+    bus->lock = xSemaphoreCreateMutex();
+    if(bus->pending == NULL || bus->lock == NULL)
+    {
+        LOG_ERROR("Failed to create the i2c bus semaphores");
+        return -1;
+    }
+    bus->start_us = bus->window_start_us = esp_timer_get_time();
+
+    if(pdPASS != xTaskCreate(i2c_bus_main, "i2c_bus", I2C_BUS_TASK_STACK, bus, I2C_BUS_TASK_PRIORITY,
+        &bus->thread))
+    {
+        LOG_ERROR("Failed to create the i2c bus task");
+        return -1;
+    }
+    i2c_bus_running[num] = true;
+    return 0;
+}
+
+int i2c_bus_client_init(i2c_bus_client_t *client, i2c_port_t num, i2c_bus_prio_t prio, const char *name)
+{
+    // Drivers may init more than once, e.g. htu21_init from the host and the sensor task, a client
+    // is linked into the list only once
+    if(client->bus != NULL)
+        return 0;
+    memset(client, 0, sizeof(i2c_bus_client_t));
+    client->name = name;
+    client->num = num;
+    client->prio = prio < i2c_bus_prio_num ? prio : i2c_bus_prio_low;
+
+    if(num < 0 || num >= I2C_NUM_MAX || !i2c_bus_running[num])
+    {
+        LOG_ERROR("No arbiter on i2c port %d, %s uses the bus directly", num, name);
+        return -1;
+    }
+    client->done = xSemaphoreCreateBinary();
+    if(client->done == NULL)
+    {
+        LOG_ERROR("Failed to create the i2c client semaphore");
+        return -1;
+    }
+
+    client->bus = &i2c_buses[num];
+    xSemaphoreTake(client->bus->lock, portMAX_DELAY);
+    client->next = client->bus->clients;
+    client->bus->clients = client;
+    xSemaphoreGive(client->bus->lock);
+    return 0;
+}
+
+int i2c_bus_submit(i2c_bus_req_t *req)
+{
+    i2c_bus_t *bus = req->client->bus;
+
+    if(bus == NULL)
+        return -1;
+    req->submit_us = esp_timer_get_time();
+    req->state = i2c_bus_req_queued;
+    if(pdTRUE != xQueueSend(bus->queue[req->client->prio], &req, 0))
+    {
+        req->state = i2c_bus_req_idle;
+        return -1;
+    }
+    xSemaphoreGive(bus->pending);
+    return 0;
+}
+
+esp_err_t i2c_bus_transfer(i2c_bus_client_t *client, i2c_cmd_handle_t cmd, TickType_t timeout)
+{
+    i2c_bus_req_t *req = &client->sync;
+    bool queued = false;
+
+    if(client->bus == NULL)
+        return i2c_master_cmd_begin(client->num, cmd, timeout);
+
+    // A request that timed out may still be in the queue, it carries this one instead
+    portENTER_CRITICAL(&i2c_bus_req_lock);
+    if(req->state == i2c_bus_req_cancelled)
+    {
+        req->cmd = cmd;
+        req->timeout = timeout;
+        req->submit_us = esp_timer_get_time();
+        req->state = i2c_bus_req_queued;
+        queued = true;
+    }
+    portEXIT_CRITICAL(&i2c_bus_req_lock);
+
+    if(!queued)
+    {
+        req->client = client;
+        req->cmd = cmd;
+        req->timeout = timeout;
+        req->done = i2c_bus_sync_done;
+        req->ctx = client;
+        if(0 != i2c_bus_submit(req))
+            return ESP_ERR_NO_MEM;
+    }
+
+    if(pdTRUE != xSemaphoreTake(client->done, timeout))
+    {
+        // Not started yet: cancel it, cmd and the caller's buffers are no longer used
+        portENTER_CRITICAL(&i2c_bus_req_lock);
+        queued = req->state == i2c_bus_req_queued;
+        if(queued)
+            req->state = i2c_bus_req_cancelled;
+        portEXIT_CRITICAL(&i2c_bus_req_lock);
+        if(queued)
+        {
+            client->timeouts++;
+            return ESP_ERR_TIMEOUT;
+        }
+        // Already on the bus, it ends within its bus timeout
+        xSemaphoreTake(client->done, portMAX_DELAY);
+    }
+    return client->sync_status;
+}
+
+int i2c_bus_queue_depth(i2c_port_t num, i2c_bus_prio_t prio)
+{
+    if(num < 0 || num >= I2C_NUM_MAX || !i2c_bus_running[num] || prio >= i2c_bus_prio_num)
+        return -1;
+    return (int)uxQueueMessagesWaiting(i2c_buses[num].queue[prio]);
+}
+
+int i2c_bus_set_monitor(i2c_port_t num, i2c_bus_monitor_t monitor, void *ctx)
+{
+    i2c_bus_t *bus;
+
+    if(num < 0 || num >= I2C_NUM_MAX || !i2c_bus_running[num])
+        return -1;
+    bus = &i2c_buses[num];
+    // The bus task reads both between transactions, clear the monitor while the context changes
+    bus->monitor = NULL;
+    bus->monitor_ctx = ctx;
+    bus->monitor = monitor;
+    return 0;
+}
+
+void i2c_bus_print_stats(i2c_port_t num)
+{
+    i2c_bus_t *bus = &i2c_buses[num];
+    uint64_t elapsed;
+
+    if(num < 0 || num >= I2C_NUM_MAX || !i2c_bus_running[num])
+    {
+        LOG_PRINTF("No arbiter on i2c port %d", num);
+        return;
+    }
+
+    LOG_PRINTF("Wait/hold buckets start at %u us and double, the last is open ended", I2C_BUS_HIST_BASE_US);
+    elapsed = esp_timer_get_time() - bus->start_us;
+    LOG_PRINTF("i2c%d busy %u of %u ms (%u%%)", num, (uint32_t)(bus->busy_us_total / 1000), (uint32_t)(elapsed / 1000),
+        elapsed ? (uint32_t)(bus->busy_us_total * 100 / elapsed) : 0);
+    i2c_bus_print_hist("  utilisation, windows per 10%:", bus->util_hist, I2C_BUS_UTIL_BUCKETS);
+
+    xSemaphoreTake(bus->lock, portMAX_DELAY);
+    for(i2c_bus_client_t *c = bus->clients; c != NULL; c = c->next)
+    {
+        LOG_PRINTF("%s (prio %d): %u transfers, %u errors, %u timeouts, wait avg %u us max %u us, hold avg %u us",
+            c->name, c->prio, c->transfers, c->errors, c->timeouts,
+            c->transfers ? (uint32_t)(c->wait_us_total / c->transfers) : 0, c->wait_us_max,
+            c->transfers ? (uint32_t)(c->hold_us_total / c->transfers) : 0);
+        i2c_bus_print_hist("  wait, per bucket:", c->wait_hist, I2C_BUS_HIST_BUCKETS);
+        i2c_bus_print_hist("  hold, per bucket:", c->hold_hist, I2C_BUS_HIST_BUCKETS);
+    }
+    xSemaphoreGive(bus->lock);
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static void i2c_bus_main(void *arg)
+{
+    i2c_bus_t *bus = (i2c_bus_t *)arg;
+
+    while(1)
+    {
+        xSemaphoreTake(bus->pending, portMAX_DELAY);
+        i2c_bus_run(bus);
+    }
+}
+
+// Run the oldest request of the highest priority waiting, once per count of bus->pending
+static void i2c_bus_run(i2c_bus_t *bus)
+{
+    i2c_bus_req_t *req = NULL;
+    i2c_bus_client_t *client;
+    i2c_bus_monitor_t monitor;
+    int64_t start_us;
+    esp_err_t status;
+    bool cancelled;
+
+    for(int p = 0; p < i2c_bus_prio_num && req == NULL; p++)
+    {
+        if(pdTRUE != xQueueReceive(bus->queue[p], &req, 0))
+            req = NULL;
+    }
+    if(req == NULL)
+        return;
+
+    // From here on its caller waits for it
+    portENTER_CRITICAL(&i2c_bus_req_lock);
+    cancelled = req->state == i2c_bus_req_cancelled;
+    req->state = cancelled ? i2c_bus_req_idle : i2c_bus_req_running;
+    portEXIT_CRITICAL(&i2c_bus_req_lock);
+    if(cancelled)
+        return;
+
+    start_us = esp_timer_get_time();
+    status = i2c_master_cmd_begin(bus->num, req->cmd, req->timeout);
+    i2c_bus_account(bus, req->client, start_us, (uint32_t)(start_us - req->submit_us),
+        (uint32_t)(esp_timer_get_time() - start_us), status);
+
+    // The request may be reused or gone once the callback ran
+    client = req->client;
+    req->state = i2c_bus_req_idle;
+    if(req->done != NULL)
+        req->done(req->ctx, status);
+    monitor = bus->monitor;
+    if(monitor != NULL)
+        monitor(bus->monitor_ctx, client, status);
+}
+
+static void i2c_bus_sync_done(void *ctx, esp_err_t status)
+{
+    i2c_bus_client_t *client = (i2c_bus_client_t *)ctx;
+
+    client->sync_status = status;
+    xSemaphoreGive(client->done);
+}
+
+static uint8_t i2c_bus_bucket(uint32_t us)
+{
+    uint8_t b = 0;
+    uint32_t limit = I2C_BUS_HIST_BASE_US;
+
+    while(b < I2C_BUS_HIST_BUCKETS - 1 && us >= limit)
+    {
+        b++;
+        limit <<= 1;
+    }
+    return b;
+}
+
+static void i2c_bus_account(i2c_bus_t *bus, i2c_bus_client_t *client, int64_t start_us, uint32_t wait_us,
+    uint32_t hold_us, esp_err_t status)
+{
+    const int64_t window_us = (int64_t)I2C_BUS_UTIL_WINDOW_MS * 1000;
+    uint32_t pct;
+
+    client->transfers++;
+    if(status != ESP_OK)
+        client->errors++;
+    client->wait_us_total += wait_us;
+    client->hold_us_total += hold_us;
+    if(wait_us > client->wait_us_max)
+        client->wait_us_max = wait_us;
+    client->wait_hist[i2c_bus_bucket(wait_us)]++;
+    client->hold_hist[i2c_bus_bucket(hold_us)]++;
+
+    // Close the window this transfer is past, then count the idle ones in between
+    if(start_us - bus->window_start_us >= window_us)
+    {
+        pct = (uint32_t)((uint64_t)bus->window_busy_us * 100 / window_us);
+        bus->util_hist[pct >= 100 ? I2C_BUS_UTIL_BUCKETS - 1 : pct / 10]++;
+        bus->window_start_us += window_us;
+        bus->util_hist[0] += (uint32_t)((start_us - bus->window_start_us) / window_us);
+        bus->window_start_us += (start_us - bus->window_start_us) / window_us * window_us;
+        bus->window_busy_us = 0;
+    }
+    bus->window_busy_us += hold_us;
+    bus->busy_us_total += hold_us;
+}
+
+static void i2c_bus_print_hist(const char *label, const uint32_t *hist, int n)
+{
+    char line[128];
+    int len = snprintf(line, sizeof(line), "%s", label);
+
+    for(int i = 0; i < n && len < (int)sizeof(line); i++)
+        len += snprintf(&line[len], sizeof(line) - len, " %u", hist[i]);
+    LOG_PRINTF("%s", line);
+}
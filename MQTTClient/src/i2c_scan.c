@@ -0,0 +1,223 @@
+/**
+ * File Name:   i2c_scan.c
+ * Description: Bring-up of an I2C port: device scan, clock selection and runtime fallback.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <string.h>
+#include "i2c_scan.h"
+
+/***************************************************************************************************/
+/* Private Data Types */
+/***************************************************************************************************/
+// Reserved addresses at both ends of the 7 bit range are not probed
+#define I2C_SCAN_FIRST_ADDR                 0x08
+#define I2C_SCAN_LAST_ADDR                  0x77
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+// Clock steps, slowest first
+static const uint32_t i2c_scan_rates[] = { 100000, 200000, 400000, 800000, 1000000 };
+#define I2C_SCAN_RATES_NUM                  (sizeof(i2c_scan_rates) / sizeof(i2c_scan_rates[0]))
+
+static i2c_scan_profile_t i2c_scan_profiles[I2C_NUM_MAX];
+static bool i2c_scan_ready[I2C_NUM_MAX];
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static bool i2c_scan_probe(i2c_port_t num, uint8_t addr);
+static const i2c_scan_dev_t *i2c_scan_lookup(const i2c_scan_dev_t *devs, size_t n, uint8_t addr);
+static uint32_t i2c_scan_test(i2c_scan_profile_t *profile, uint32_t clk_hz);
+static void i2c_scan_monitor(void *ctx, const i2c_bus_client_t *client, esp_err_t status);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int i2c_scan_bringup(i2c_port_t num, const i2c_scan_dev_t *devs, size_t n)
+{
+    i2c_scan_profile_t *profile;
+    uint32_t start_hz, limit;
+    bool passed = false;
+
+    if(num < 0 || num >= I2C_NUM_MAX || 0 == (start_hz = i2c_get_clock(num)))
+    {
+        LOG_ERROR("i2c port %d is not initialized", num);
+        return -1;
+    }
+    profile = &i2c_scan_profiles[num];
+    memset(profile, 0, sizeof(i2c_scan_profile_t));
+    profile->num = num;
+
+    // Scan at the clock the port was installed with
+    for(uint8_t addr = I2C_SCAN_FIRST_ADDR; addr <= I2C_SCAN_LAST_ADDR; addr++)
+    {
+        i2c_scan_found_t *dev;
+
+        if(!i2c_scan_probe(num, addr))
+            continue;
+        if(profile->found == I2C_SCAN_MAX_DEVICES)
+        {
+            LOG_ERROR("More than %d devices on i2c%d, 0x%02X not recorded", I2C_SCAN_MAX_DEVICES, num, addr);
+            continue;
+        }
+        dev = &profile->devices[profile->found++];
+        dev->addr = addr;
+        dev->info = i2c_scan_lookup(devs, n, addr);
+        dev->max_hz = dev->info != NULL ? dev->info->max_hz : I2C_SCAN_UNKNOWN_MAX_HZ;
+    }
+    if(profile->found == 0)
+    {
+        LOG_ERROR("No devices on i2c%d, clock stays at %u Hz", num, start_hz);
+        return -1;
+    }
+
+    // The slowest device sets the limit, then each step up has to pass the test
+    limit = profile->devices[0].max_hz;
+    for(uint8_t i = 1; i < profile->found; i++)
+        if(profile->devices[i].max_hz < limit)
+            limit = profile->devices[i].max_hz;
+    for(uint8_t r = 0; r < I2C_SCAN_RATES_NUM && i2c_scan_rates[r] <= limit; r++)
+    {
+        if(0 != i2c_scan_test(profile, i2c_scan_rates[r]))
+            break;
+        profile->rates_passed |= 1 << r;
+        profile->rate_max = r;
+        passed = true;
+    }
+    if(!passed || 0 != i2c_set_clock(num, i2c_scan_rates[profile->rate_max]))
+    {
+        LOG_ERROR("No stable clock found on i2c%d, staying at %u Hz", num, start_hz);
+        i2c_set_clock(num, start_hz);
+        return -1;
+    }
+    profile->rate = profile->rate_max;
+    i2c_scan_ready[num] = true;
+
+    if(0 != i2c_bus_set_monitor(num, i2c_scan_monitor, profile))
+        LOG_ERROR("No arbiter on i2c%d, the clock will not fall back", num);
+    LOG_PRINTF("i2c%d: %d devices, clock %u Hz", num, profile->found, i2c_scan_rates[profile->rate]);
+    return 0;
+}
+
+bool i2c_scan_present(i2c_port_t num, uint8_t addr)
+{
+    const i2c_scan_profile_t *profile = i2c_scan_get(num);
+
+    if(profile == NULL)
+        return false;
+    for(uint8_t i = 0; i < profile->found; i++)
+        if(profile->devices[i].addr == addr)
+            return true;
+    return false;
+}
+
+const i2c_scan_profile_t *i2c_scan_get(i2c_port_t num)
+{
+    if(num < 0 || num >= I2C_NUM_MAX || !i2c_scan_ready[num])
+        return NULL;
+    return &i2c_scan_profiles[num];
+}
+
+void i2c_scan_print(i2c_port_t num)
+{
+    const i2c_scan_profile_t *profile = i2c_scan_get(num);
+
+    if(profile == NULL)
+    {
+        LOG_PRINTF("i2c%d was not brought up", num);
+        return;
+    }
+
+    LOG_PRINTF("i2c%d clock %u Hz, fastest passed %u Hz, %u fallbacks", num, i2c_scan_rates[profile->rate],
+        i2c_scan_rates[profile->rate_max], profile->fallbacks);
+    for(uint8_t i = 0; i < profile->found; i++)
+    {
+        const i2c_scan_found_t *dev = &profile->devices[i];
+        LOG_PRINTF("  0x%02X %-10s max %u Hz, %u test failures", dev->addr,
+            dev->info != NULL ? dev->info->name : "unknown", dev->max_hz, dev->test_failures);
+    }
+    LOG_PRINTF("%u transfers, %u NACKs, %u errors, %u errors in the last %u transfers", profile->transfers,
+        profile->nacks, profile->errors, profile->window_errors, profile->window_transfers);
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static bool i2c_scan_probe(i2c_port_t num, uint8_t addr)
+{
+    return 0 == i2c_write(num, addr, NULL, 0, I2C_SCAN_PROBE_TIMEOUT_MS);
+}
+
+static const i2c_scan_dev_t *i2c_scan_lookup(const i2c_scan_dev_t *devs, size_t n, uint8_t addr)
+{
+    for(size_t i = 0; i < n; i++)
+        if(devs[i].addr == addr)
+            return &devs[i];
+    return NULL;
+}
+
+// Number of failed probes and checks at a clock
+static uint32_t i2c_scan_test(i2c_scan_profile_t *profile, uint32_t clk_hz)
+{
+    uint32_t failures = 0;
+
+    if(0 != i2c_set_clock(profile->num, clk_hz))
+        return 1;
+    for(int round = 0; round < I2C_SCAN_TEST_ROUNDS; round++)
+    {
+        for(uint8_t i = 0; i < profile->found; i++)
+        {
+            i2c_scan_found_t *dev = &profile->devices[i];
+            bool ok = i2c_scan_probe(profile->num, dev->addr);
+
+            if(ok && dev->info != NULL && dev->info->check != NULL)
+                ok = dev->info->check(profile->num, dev->addr);
+            if(!ok)
+            {
+                dev->test_failures++;
+                failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+static void i2c_scan_monitor(void *ctx, const i2c_bus_client_t *client, esp_err_t status)
+{
+    i2c_scan_profile_t *profile = (i2c_scan_profile_t *)ctx;
+    (void)client;
+
+    profile->transfers++;
+    profile->window_transfers++;
+    if(status == ESP_FAIL)
+    {
+        profile->nacks++;
+    }
+    else if(status != ESP_OK)
+    {
+        profile->errors++;
+        profile->window_errors++;
+    }
+
+    // Runs between transactions, so the clock can change here
+    if(profile->window_errors * 100 >= I2C_SCAN_FALLBACK_PERCENT * I2C_SCAN_WINDOW_TRANSFERS)
+    {
+        if(profile->rate > 0 && 0 == i2c_set_clock(profile->num, i2c_scan_rates[profile->rate - 1]))
+        {
+            profile->rate--;
+            profile->fallbacks++;
+            LOG_ERROR("i2c%d error rate too high, clock down to %u Hz", profile->num, i2c_scan_rates[profile->rate]);
+        }
+        profile->window_transfers = 0;
+        profile->window_errors = 0;
+    }
+    else if(profile->window_transfers >= I2C_SCAN_WINDOW_TRANSFERS)
+    {
+        profile->window_transfers = 0;
+        profile->window_errors = 0;
+    }
+}
@@ -2,6 +2,7 @@
 #include "host.h"
 #include "esp_log.h"
 #include "mbedtls/md.h"
+#include <sys/time.h>
 
 const char* Wifi_SSID = "SETUP-1CCC"; 
 const char* Wifi_Pass = "center1832block"; 
@@ -9,10 +10,16 @@ const uint32_t shared_key = 0x8DEEF1;
 const size_t shared_key_len = sizeof(shared_key);
 
 
-static uint32_t last_nonce_sent = 0;
-
 int is_valid = 0;
 
+// Challenge outcomes and control-plane publishes
+static metrics_t *metric_publishes;
+static metrics_t *metric_challenge_ok;
+static metrics_t *metric_challenge_fail;
+static metrics_t *metric_verify_ok;
+static metrics_t *metric_verify_fail;
+static metrics_t *metric_verify_stale;
+
 // AWS Stuff
 #define CONFIG_AWS_IOT_MQTT_TX_BUF_LEN 100
 #define CONFIG_AWS_IOT_MQTT_RX_BUF_LEN 100
@@ -32,6 +39,13 @@ void app_main(void)
   }
   ESP_ERROR_CHECK(ret);
 
+  metric_publishes = metrics_register("mqtt_pub", metrics_counter);
+  metric_challenge_ok = metrics_register("chal_ok", metrics_counter);
+  metric_challenge_fail = metrics_register("chal_fail", metrics_counter);
+  metric_verify_ok = metrics_register("verify_ok", metrics_counter);
+  metric_verify_fail = metrics_register("verify_fail", metrics_counter);
+  metric_verify_stale = metrics_register("verify_stale", metrics_counter);
+
   host.wifi_creds.Wifi_SSID = Wifi_SSID;
   host.wifi_creds.Wifi_Pass = Wifi_Pass;
 
@@ -40,11 +54,12 @@ void app_main(void)
   mqtt_app_start(Mqtt_Broker_Url, &host);
 
   if(IS_CONTROL) xTaskCreate(challenge_task, "challenge_task", 4096, &host, 5, NULL);
+  xTaskCreate(sfq_drain_task, "sfq_drain_task", 3072, &host, 5, &host.sfq_drain_thread);
+  outbox_set_listener(host.sfq_drain_thread);
   while(1)
   {
-    if (is_valid) {
     send_env_data(&host);
-    }
+    publisher_poll(&host.publisher);
     vTaskDelay(MS2TICK(5000));
   }
 }
@@ -56,27 +71,68 @@ void on_allow_message(const char* pl) {
   if (sscanf(pl, "%03hhu:OK:%s:%hu", &node_id, ip, &port) == 3 && node_id == host.aws_mqtt_id) {
 
     is_valid = 1;
+    metrics_inc(metric_challenge_ok);
+    if (host.sfq_drain_thread) xTaskNotifyGive(host.sfq_drain_thread);
   } else if (sscanf(pl, "%03hhu:FAIL", &node_id) == 1 && node_id == host.aws_mqtt_id) {
 
     is_valid = 0;
+    metrics_inc(metric_challenge_fail);
   }
 }
 
 void send_env_data(host_t* host)
 {
-  int msg_id;
-  char buff[40];
   htu21_data_t env_data;
-  if(host->htu21.msg_queue == NULL)
+  aggregator_summary_t summary;
+
+  // Downsampled under backpressure: a window that is not admitted merges into the next one
+  if(host->mqtt_connected && is_valid && outbox_get_state() == outbox_pressure
+     && !outbox_admit(outbox_policy_downsample))
   {
-    LOG_ERROR("MSG queue does not exist cannot send enviornment data.");
+    return;
   }
 
-  xQueuePeek(host->htu21.msg_queue, &env_data, 5);
-  sprintf(buff, "{\"temperature\": %.2f, \"humidity\": %.2f}", env_data.temperature, env_data.humidity);
-  msg_id = esp_mqtt_client_publish(host->mqtt_client, "data/sensor", buff, 0, 1, 0);
+  // Summary of every sample read since the last call
+  if(0 != aggregator_take(&host->aggregator, &env_data, &summary))
+  {
+    return;
+  }
+  if(host->mqtt_connected && is_valid && outbox_get_state() != outbox_full)
+  {
+    // Buffered, the publisher sends the batch once its sample count or age limit is reached
+    publisher_push_window(&host->publisher, &env_data, &summary);
+    return;
+  }
 
-  LOG_PRINTF("Sent publish successful, msg_id=%d", msg_id);
+  // Offline, not yet validated or the outbox is full, keep the sample until the drain task can send it
+  struct timeval tv;
+  publisher_sample_t sample;
+  gettimeofday(&tv, NULL);
+  sample.timestamp = (uint32_t)tv.tv_sec;
+  sample.captured = xTaskGetTickCount();
+  sample.data = env_data;
+  sample.summary = summary;
+  if(0 != sfq_store_append(&host->sfq, &sample))
+  {
+    LOG_ERROR("Failed to store offline sample");
+  }
+}
+
+void sfq_drain_task(void *pvParameter) {
+    host_t* host = (host_t*)pvParameter;
+    while (1) {
+        // Bursts are spaced out so the backlog does not crowd out live samples
+        // Only drained while the outbox is clear, a refused burst stays in flash for the next wake-up
+        while (host->mqtt_connected && is_valid && outbox_get_state() == outbox_ok
+               && sfq_store_pending(&host->sfq) > 0) {
+            if (sfq_store_drain(&host->sfq, &host->publisher, SFQ_DRAIN_BURST) < 0) {
+                break;
+            }
+            vTaskDelay(MS2TICK(SFQ_DRAIN_INTERVAL_MS));
+        }
+        // Woken on MQTT_EVENT_CONNECTED, when the node is validated and when the outbox is ok again
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
 }
 
 uint32_t compute_nonce_xor(uint32_t nonce) {
@@ -84,13 +140,17 @@ uint32_t compute_nonce_xor(uint32_t nonce) {
 }
 
 void publish_challenge(host_t* host) {
-    last_nonce_sent = esp_random();  // Generate a random 32-bit nonce
+    uint32_t nonce = esp_random();  // Generate a random 32-bit nonce
 
     char challenge_msg[32];
 
-    sprintf(challenge_msg, "%03d:CHALLENGE:%08X", host->aws_mqtt_id, last_nonce_sent);
-    int msg_id = esp_mqtt_client_publish(host->mqtt_client, "device/challenge", challenge_msg, 0, 1, 0);
-    ESP_LOGI("CHALLENGE", "Published challenge: %s, msg_id=%d", challenge_msg, msg_id);
+    challenge_issued(compute_nonce_xor(nonce));
+    sprintf(challenge_msg, "%03d:CHALLENGE:%08X", host->aws_mqtt_id, nonce);
+    // Dropped when the outbox is full, the next interval sends a fresh nonce
+    if (outbox_publish(outbox_lane_control, "device/challenge", challenge_msg, 0, 1, outbox_policy_drop) == 0) {
+      metrics_inc(metric_publishes);
+      ESP_LOGI("CHALLENGE", "Queued challenge: %s", challenge_msg);
+    }
 
 }
 
@@ -111,11 +171,9 @@ void respond_to_challenge(host_t* host, const char* payload) {
 
         char resp_msg[64];
         sprintf(resp_msg, "%03hhu:RESPONSE:%08X", host->aws_mqtt_id, comped);
-        esp_mqtt_client_publish(
-            host->mqtt_client,
-            "device/response",
-            resp_msg, 0, 1, 0
-        );
+        if (outbox_publish(outbox_lane_control, "device/response", resp_msg, 0, 1, outbox_policy_drop) == 0) {
+            metrics_inc(metric_publishes);
+        }
     } else {
         ESP_LOGE("CHALLENGE", "Bad challenge format: %s", payload);
     }
@@ -128,18 +186,22 @@ void verify_challenge_response(const char* resp_payload, host_t* host) {
     char ip[40];
 
     if (sscanf(resp_payload, "%03hhu:RESPONSE:%08X:%s:%hu", &aws_id, &recv_comp, ip, &port) == 3) {
-        uint32_t comped_v = compute_nonce_xor(last_nonce_sent);
+        challenge_result_t result = challenge_check(recv_comp);
 
-        if (comped_v == recv_comp) {
+        if (result == challenge_stale) {
+            // Answers an older challenge, e.g. replayed after an outage, the next one decides
+            ESP_LOGW("CHALLENGE", "Ignoring stale response of %03hhu", aws_id);
+            metrics_inc(metric_verify_stale);
+        } else if (result == challenge_match) {
             char ok_msg[100];
             sprintf(ok_msg, "%03hhu:OK:%s:%hu", aws_id, ip, port);
-            esp_mqtt_client_publish(host->mqtt_client, "control/ok",
-                                    ok_msg, 0, 1, 0);
+            outbox_publish(outbox_lane_control, "control/ok", ok_msg, 0, 1, outbox_policy_drop);
+            metrics_inc(metric_verify_ok);
         } else {
             char fail_msg[100];
             sprintf(fail_msg, "%03hhu:FAIL:%s:%hu", aws_id, ip, port);
-            esp_mqtt_client_publish(host->mqtt_client, "control/fail",
-                                    fail_msg, 0, 1, 0);
+            outbox_publish(outbox_lane_control, "control/fail", fail_msg, 0, 1, outbox_policy_drop);
+            metrics_inc(metric_verify_fail);
         }
     } else {
         ESP_LOGE("CHALLENGE", "Bad response format: %s", resp_payload);
@@ -0,0 +1,219 @@
+/**
+ * File Name:   metrics.c
+ * Description: Registry of performance counters and gauges, published periodically over MQTT.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "outbox.h"
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+static metrics_t metrics_table[METRICS_MAX];
+static uint32_t metrics_num;
+// Handed out once the table is full, updates to it are harmless and it is never published
+static metrics_t metrics_overflow = { "overflow", metrics_counter, 0, NULL, 0 };
+static portMUX_TYPE metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t metrics_thread;
+static uint32_t metrics_interval_ms = METRICS_INTERVAL_MS;
+static char metrics_topic[32];
+static char metrics_payload[METRICS_PAYLOAD_MAX];
+
+// Gauges refreshed by the metrics task itself
+static metrics_t *metrics_heap_free;
+static metrics_t *metrics_heap_min;
+static metrics_t *metrics_publish_failed;
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static metrics_t *metrics_add_entry(const char *name, metrics_type_t type, const uint32_t *buckets, uint8_t n);
+static metrics_t *metrics_lookup(const char *name, uint32_t num);
+static int metrics_encode_value(char *buf, size_t size, const metrics_t *m);
+static int metrics_encode(char *buf, size_t size, uint32_t ts, uint32_t *next, uint32_t num);
+static void metrics_main(void *arg);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+metrics_t *metrics_register(const char *name, metrics_type_t type)
+{
+    return metrics_add_entry(name, type, NULL, 0);
+}
+
+metrics_t *metrics_register_hist(const char *name, const uint32_t *buckets, uint8_t n)
+{
+    return metrics_add_entry(name, metrics_histogram, buckets, n);
+}
+
+metrics_t *metrics_find(const char *name)
+{
+    return metrics_lookup(name, __atomic_load_n(&metrics_num, __ATOMIC_ACQUIRE));
+}
+
+int metrics_start(const char *device_id)
+{
+    if(metrics_thread != NULL)
+        return 0;
+
+    snprintf(metrics_topic, sizeof(metrics_topic), "%s%s", METRICS_TOPIC_PREFIX, device_id);
+    metrics_heap_free = metrics_register("heap_free", metrics_gauge);
+    metrics_heap_min = metrics_register("heap_min", metrics_gauge);
+    metrics_publish_failed = metrics_register("metrics_fail", metrics_counter);
+
+    if(pdPASS != xTaskCreate(metrics_main, "metrics", METRICS_TASK_STACK, NULL, METRICS_TASK_PRIORITY,
+        &metrics_thread))
+    {
+        LOG_ERROR("Failed to create the metrics task");
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_set_interval(uint32_t interval_ms)
+{
+    metrics_interval_ms = interval_ms > 0 ? interval_ms : 1;
+}
+
+void metrics_print(void)
+{
+    uint32_t num = __atomic_load_n(&metrics_num, __ATOMIC_ACQUIRE);
+
+    LOG_PRINTF("%u metrics, published on %s every %u ms", num, metrics_topic[0] ? metrics_topic : "(not started)",
+        metrics_interval_ms);
+    for(uint32_t i = 0; i < num; i++)
+    {
+        const metrics_t *m = &metrics_table[i];
+        char value[128];
+
+        metrics_encode_value(value, sizeof(value), m);
+        LOG_PRINTF("%-24s %-9s %s", m->name, m->type == metrics_histogram ? "histogram" :
+            m->type == metrics_gauge ? "gauge" : "counter", value);
+    }
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static metrics_t *metrics_add_entry(const char *name, metrics_type_t type, const uint32_t *buckets, uint8_t n)
+{
+    metrics_t *m;
+    uint32_t num;
+
+    portENTER_CRITICAL(&metrics_lock);
+    num = metrics_num;
+    m = metrics_lookup(name, num);
+    if(m == NULL && num < METRICS_MAX)
+    {
+        m = &metrics_table[num];
+        m->name = name;
+        m->type = type;
+        m->value = 0;
+        m->buckets = buckets;
+        m->buckets_num = n;
+        // The snapshot only reads entries below metrics_num, publish the entry complete
+        __atomic_store_n(&metrics_num, num + 1, __ATOMIC_RELEASE);
+    }
+    portEXIT_CRITICAL(&metrics_lock);
+
+    if(m == NULL)
+    {
+        LOG_ERROR("Metrics registry full, %s is not published", name);
+        m = &metrics_overflow;
+    }
+    return m;
+}
+
+static metrics_t *metrics_lookup(const char *name, uint32_t num)
+{
+    for(uint32_t i = 0; i < num; i++)
+        if(strcmp(metrics_table[i].name, name) == 0)
+            return &metrics_table[i];
+    return NULL;
+}
+
+// A number, or [b0,b1,...] for a histogram
+static int metrics_encode_value(char *buf, size_t size, const metrics_t *m)
+{
+    int len;
+
+    if(m->type != metrics_histogram)
+        return snprintf(buf, size, "%u", metrics_get(m));
+
+    len = snprintf(buf, size, "[");
+    for(uint8_t b = 0; b < m->buckets_num && len < (int)size; b++)
+        len += snprintf(&buf[len], size - len, b ? ",%u" : "%u", __atomic_load_n(&m->buckets[b], __ATOMIC_RELAXED));
+    // A result of size or more tells the caller the value did not fit
+    if(len < (int)size)
+        len += snprintf(&buf[len], size - len, "]");
+    return len;
+}
+
+// {"ts":<epoch>,"up":<s>,"<name>":<value>,...} from metrics_table[*next] on, *next is left at the
+// first metric that did not fit and starts the next part of the snapshot
+static int metrics_encode(char *buf, size_t size, uint32_t ts, uint32_t *next, uint32_t num)
+{
+    uint32_t i;
+    int len, n;
+
+    len = snprintf(buf, size, "{\"ts\":%u,\"up\":%u", ts, (uint32_t)(esp_timer_get_time() / 1000000));
+    for(i = *next; i < num; i++)
+    {
+        n = snprintf(&buf[len], size - len, ",\"%s\":", metrics_table[i].name);
+        if(n < 0 || len + n + 1 >= (int)size)
+            break;
+        n += metrics_encode_value(&buf[len + n], size - len - n, &metrics_table[i]);
+        // Room for the closing brace
+        if(n < 0 || len + n + 1 >= (int)size)
+        {
+            buf[len] = '\0';
+            break;
+        }
+        len += n;
+    }
+    // A metric too long for a payload of its own is left out rather than holding up the rest
+    if(i == *next && i < num)
+    {
+        LOG_ERROR("Metric %s does not fit in a snapshot", metrics_table[i].name);
+        i++;
+    }
+    *next = i;
+    len += snprintf(&buf[len], size - len, "}");
+    return len;
+}
+
+static void metrics_main(void *arg)
+{
+    TickType_t last = xTaskGetTickCount();
+    struct timeval tv;
+    uint32_t next, num;
+    int len;
+
+    while(1)
+    {
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(metrics_interval_ms));
+
+        metrics_set(metrics_heap_free, esp_get_free_heap_size());
+        metrics_set(metrics_heap_min, esp_get_minimum_free_heap_size());
+        // A snapshot larger than one payload goes out in parts with the same ts, receivers merge them
+        gettimeofday(&tv, NULL);
+        num = __atomic_load_n(&metrics_num, __ATOMIC_ACQUIRE);
+        next = 0;
+        while(next < num)
+        {
+            len = metrics_encode(metrics_payload, sizeof(metrics_payload), (uint32_t)tv.tv_sec, &next, num);
+            // QoS 0 and dropped under backpressure, a lost part is covered by the next snapshot
+            if(0 != outbox_publish(outbox_lane_data, metrics_topic, metrics_payload, len, 0, outbox_policy_drop))
+                metrics_inc(metrics_publish_failed);
+        }
+    }
+}
@@ -3,7 +3,101 @@
 
 const char *TAG_MQTT = "MQTT_EXAMPLE";
 const char *CLIENT_ID = "MQTT_CLIENT_" XSTR(DEV_ID);
+#if MQTT_CONTROL_CONNECTION
+const char *CONTROL_CLIENT_ID = "MQTT_CLIENT_" XSTR(DEV_ID) "_ctl";
+#endif
+
+#define MQTT_ROUTE(t, h)    { (t), sizeof(t) - 1, (h) }
+
+static void _on_challenge(void *ctx, const char *data, int len);
+static void _on_enriched_response(void *ctx, const char *data, int len);
+static void _on_verdict(void *ctx, const char *data, int len);
+
+/* Topics this node subscribes to and their handlers. Subscriptions are made from this table. */
+static const mqtt_route_t mqtt_routes[] = {
+#if IS_CONTROL
+    MQTT_ROUTE("device/response/enriched", _on_enriched_response),
+#else
+    MQTT_ROUTE("device/challenge", _on_challenge),
+    MQTT_ROUTE("control/fail", _on_verdict),
+    MQTT_ROUTE("control/ok", _on_verdict),
+#endif
+};
+#define MQTT_ROUTE_NUM      (sizeof(mqtt_routes) / sizeof(mqtt_route_t))
+
+static metrics_t *mqtt_metric_connects;
+static metrics_t *mqtt_metric_disconnects;
+static metrics_t *mqtt_metric_acks;
 
+/*
+ * Control-plane payloads are parsed with sscanf and need a terminator. They are short, so they
+ * are bounded into a fixed buffer here rather than sized by the incoming payload.
+ */
+static bool _control_msg(char *msg, const char *data, int len)
+{
+    if (len >= MQTT_CONTROL_MSG_MAX) {
+        ESP_LOGE(TAG_MQTT, "Control message too long (%d bytes)", len);
+        return false;
+    }
+    memcpy(msg, data, len);
+    msg[len] = '\0';
+    return true;
+}
+
+static void _on_challenge(void *ctx, const char *data, int len)
+{
+    char msg[MQTT_CONTROL_MSG_MAX];
+    if (_control_msg(msg, data, len)) respond_to_challenge((host_t *)ctx, msg);
+}
+
+static void _on_enriched_response(void *ctx, const char *data, int len)
+{
+    char msg[MQTT_CONTROL_MSG_MAX];
+    if (_control_msg(msg, data, len)) verify_challenge_response(msg, (host_t *)ctx);
+}
+
+static void _on_verdict(void *ctx, const char *data, int len)
+{
+    char msg[MQTT_CONTROL_MSG_MAX];
+    if (_control_msg(msg, data, len)) on_allow_message(msg);
+}
+
+
+static mqtt_conn_stats_t *_conn_stats(host_t *host, esp_mqtt_client_handle_t client)
+{
+    return client == host->mqtt_client ? &mqtt_conn_stats[0] : &mqtt_conn_stats[MQTT_CONN_NUM - 1];
+}
+
+static void _on_connected(host_t *host, esp_mqtt_event_handle_t event)
+{
+    mqtt_conn_stats_t *s = _conn_stats(host, event->client);
+
+    if (!mqtt_conn_connected(s, event->session_present)) {
+        return;
+    }
+    // Every route is control plane, subscribed on the control connection
+    if (event->client == host->mqtt_control_client) {
+        for (int r = 0; r < MQTT_ROUTE_NUM; r++) {
+            if (esp_mqtt_client_subscribe(event->client, mqtt_routes[r].topic, MQTT_CONTROL_QOS) >= 0) {
+                mqtt_conn_subscribing(s);
+            }
+        }
+    }
+}
+
+/*
+ * A new IP address usually ends an outage. Reconnect right away instead of waiting out
+ * MQTT_RECONNECT_MS, the client refuses if it is not waiting to reconnect.
+ */
+static void _on_got_ip(void *arg, esp_event_base_t base, int32_t event_id, void *event_data)
+{
+    host_t *host = (host_t *)arg;
+
+    esp_mqtt_client_reconnect(host->mqtt_client);
+#if MQTT_CONTROL_CONNECTION
+    esp_mqtt_client_reconnect(host->mqtt_control_client);
+#endif
+}
 
 void log_error_if_nonzero(const char *message, int error_code)
 {
@@ -30,61 +124,45 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
     esp_mqtt_event_handle_t event = event_data;
     esp_mqtt_client_handle_t client = event->client;
 
-    int msg_id;
-    char topic[event->topic_len + 1];
-    char data[event->data_len + 1];
-
     switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_BEFORE_CONNECT:
+        mqtt_conn_attempt(_conn_stats(host, client));
+        break;
     case MQTT_EVENT_CONNECTED:
-        ESP_LOGI(TAG_MQTT, "MQTT_EVENT_CONNECTED");
-        if (IS_CONTROL) {
-            esp_mqtt_client_subscribe(client, "device/response/enriched", 1);
-        } else {
-            esp_mqtt_client_subscribe(client, "device/challenge", 1);
-            esp_mqtt_client_subscribe(client, "control/fail", 1);
-            esp_mqtt_client_subscribe(client, "control/ok", 1);
+        ESP_LOGI(TAG_MQTT, "MQTT_EVENT_CONNECTED, session present=%d", event->session_present);
+        metrics_inc(mqtt_metric_connects);
+        _on_connected(host, event);
+        if (client == host->mqtt_client) {
+            host->mqtt_connected = true;
+            if (host->sfq_drain_thread) xTaskNotifyGive(host->sfq_drain_thread);
         }
         break;
     case MQTT_EVENT_DISCONNECTED:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_DISCONNECTED");
+        metrics_inc(mqtt_metric_disconnects);
+        mqtt_conn_disconnected(_conn_stats(host, client));
+        mqtt_rx_disconnected(client);
+        if (client == host->mqtt_client) {
+            host->mqtt_connected = false;
+        }
         break;
     case MQTT_EVENT_SUBSCRIBED:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_SUBSCRIBED, msg_id=%d", event->msg_id);
+        mqtt_conn_subscribed(_conn_stats(host, client));
         break;
     case MQTT_EVENT_UNSUBSCRIBED:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d", event->msg_id);
         break;
     case MQTT_EVENT_PUBLISHED:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        metrics_inc(mqtt_metric_acks);
+        puback_acked(client, event->msg_id);
         break;
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG_MQTT, "MQTT_EVENT_DATA");
-            
-
-        memcpy(topic, event->topic, event->topic_len);
-        topic[event->topic_len] = '\0';
-        memcpy(data, event->data, event->data_len);
-        data[event->data_len] = '\0';
-
-        ESP_LOGI("MQTT", "Received on topic=%s data=%s", topic, data);
-
-        if (strcmp(topic, "device/challenge") == 0) {
-
-           if (!IS_CONTROL) respond_to_challenge(host, data);
-        } else if (strcmp(topic, "device/response/enriched") == 0) {
-
-           if (IS_CONTROL) verify_challenge_response(data, host);
-        } else if (strcmp(topic, "control/ok") == 0) {
-
-            if (!IS_CONTROL) on_allow_message(data);
-        } else if (strcmp(topic, "control/fail") == 0) {
-           
-            if (!IS_CONTROL) on_allow_message(data);
-        } else {
-
-            printf("TOPIC=%.*s\r\n", event->topic_len, event->topic);
-            printf("DATA=%.*s\r\n", event->data_len, event->data);
-        }
+        ESP_LOGD(TAG_MQTT, "Received %d of %d bytes on topic=%.*s", event->data_len, event->total_data_len,
+            event->topic_len, event->topic);
+        mqtt_rx_data(handler_args, event);
         break;
 
     case MQTT_EVENT_ERROR:
@@ -106,16 +184,49 @@ void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event
 
 void mqtt_app_start(const char* mqtt_broker_url, host_t *host)
 {
+    mqtt_rx_init(mqtt_routes, MQTT_ROUTE_NUM);
+    mqtt_metric_connects = metrics_register("mqtt_conn", metrics_counter);
+    mqtt_metric_disconnects = metrics_register("mqtt_disc", metrics_counter);
+    mqtt_metric_acks = metrics_register("mqtt_ack", metrics_counter);
+    puback_init();
+    mqtt_conn_init();
+
     esp_mqtt_client_config_t mqtt_cfg = {
         .uri = mqtt_broker_url,
         .cert_pem = AWS_ROOT_CA,         // AWS CA
         .client_cert_pem = DEVICE_CERT,  // Device Certificate
         .client_key_pem = PRIV_KEY,       // Private key
-        .client_id = CLIENT_ID
+        .client_id = CLIENT_ID,
+        .message_retransmit_timeout = PUBACK_RETRANSMIT_MS,
+        .disable_clean_session = MQTT_PERSISTENT_SESSION,
+        .reconnect_timeout_ms = MQTT_RECONNECT_MS
     };
 
     host->mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
+#if MQTT_CONTROL_CONNECTION
+    mqtt_cfg.client_id = CONTROL_CLIENT_ID;
+    host->mqtt_control_client = esp_mqtt_client_init(&mqtt_cfg);
+#else
+    host->mqtt_control_client = host->mqtt_client;
+#endif
+    if(0 != outbox_start(host->mqtt_client, host->mqtt_control_client))
+    {
+        LOG_ERROR("Failed to start the outbox, nothing will be published");
+    }
+    if(0 != publisher_init(&host->publisher, host->mqtt_client, PUBLISHER_ENCODING))
+    {
+        LOG_ERROR("Failed to initialize the telemetry publisher");
+    }
     /* The last argument may be used to pass data to the event handler, in this example mqtt_event_handler */
     esp_mqtt_client_register_event(host->mqtt_client, ESP_EVENT_ANY_ID, mqtt_event_handler, host);
     esp_mqtt_client_start(host->mqtt_client);
+#if MQTT_CONTROL_CONNECTION
+    esp_mqtt_client_register_event(host->mqtt_control_client, ESP_EVENT_ANY_ID, mqtt_event_handler, host);
+    esp_mqtt_client_start(host->mqtt_control_client);
+#endif
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, _on_got_ip, host, NULL);
+    if(0 != metrics_start(XSTR(DEV_ID)))
+    {
+        LOG_ERROR("Metrics will not be published");
+    }
 }
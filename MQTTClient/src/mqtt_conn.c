@@ -0,0 +1,130 @@
+/**
+ * File Name:   mqtt_conn.c
+ * Description: Connect, resubscribe and outage bookkeeping of the MQTT connections.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "esp_timer.h"
+#include "metrics.h"
+#include "mqtt_conn.h"
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+// Per connection: connect, SUBACK and outage times of the last connect, resumed sessions
+static metrics_t *mqtt_conn_metric_connect_ms[MQTT_CONN_NUM];
+static metrics_t *mqtt_conn_metric_suback_ms[MQTT_CONN_NUM];
+static metrics_t *mqtt_conn_metric_outage_ms[MQTT_CONN_NUM];
+static metrics_t *mqtt_conn_metric_resumed[MQTT_CONN_NUM];
+
+/***************************************************************************************************/
+/* Public Variables */
+/***************************************************************************************************/
+mqtt_conn_stats_t mqtt_conn_stats[MQTT_CONN_NUM] = {
+    { .name = "telemetry" },
+#if MQTT_CONTROL_CONNECTION
+    { .name = "control" },
+#endif
+};
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static uint8_t mqtt_conn_bucket(uint32_t ms);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+void mqtt_conn_init(void)
+{
+    static const char *names[][5] = {
+        { "conn_ms", "suback_ms", "outage_ms", "sess_resumed", "conn_hist" },
+        { "ctl_conn_ms", "ctl_suback_ms", "ctl_outage_ms", "ctl_sess_resumed", "ctl_conn_hist" },
+    };
+
+    for(int i = 0; i < MQTT_CONN_NUM; i++)
+    {
+        mqtt_conn_metric_connect_ms[i] = metrics_register(names[i][0], metrics_gauge);
+        mqtt_conn_metric_suback_ms[i] = metrics_register(names[i][1], metrics_gauge);
+        mqtt_conn_metric_outage_ms[i] = metrics_register(names[i][2], metrics_gauge);
+        mqtt_conn_metric_resumed[i] = metrics_register(names[i][3], metrics_counter);
+        metrics_register_hist(names[i][4], mqtt_conn_stats[i].connect_hist, MQTT_CONNECT_HIST_BUCKETS);
+    }
+}
+
+void mqtt_conn_attempt(mqtt_conn_stats_t *s)
+{
+    s->attempt_us = esp_timer_get_time();
+}
+
+bool mqtt_conn_connected(mqtt_conn_stats_t *s, bool session_present)
+{
+    int i = s - mqtt_conn_stats;
+    int64_t now = esp_timer_get_time();
+
+    s->connects++;
+    s->connack_us = now;
+    if(s->attempt_us)
+    {
+        s->connect_ms = (uint32_t)((now - s->attempt_us) / 1000);
+        if(s->connect_ms > s->connect_max_ms)
+            s->connect_max_ms = s->connect_ms;
+        s->connect_hist[mqtt_conn_bucket(s->connect_ms)]++;
+        metrics_set(mqtt_conn_metric_connect_ms[i], s->connect_ms);
+    }
+    if(s->down_us)
+    {
+        s->outage_ms = (uint32_t)((now - s->down_us) / 1000);
+        s->down_us = 0;
+        metrics_set(mqtt_conn_metric_outage_ms[i], s->outage_ms);
+    }
+
+    s->subs_pending = 0;
+    if(MQTT_PERSISTENT_SESSION && session_present)
+    {
+        // The broker kept the subscriptions
+        s->resumed++;
+        s->suback_ms = 0;
+        metrics_inc(mqtt_conn_metric_resumed[i]);
+        metrics_set(mqtt_conn_metric_suback_ms[i], 0);
+        return false;
+    }
+    return true;
+}
+
+void mqtt_conn_subscribing(mqtt_conn_stats_t *s)
+{
+    s->subs_pending++;
+}
+
+void mqtt_conn_subscribed(mqtt_conn_stats_t *s)
+{
+    if(s->subs_pending > 0 && --s->subs_pending == 0)
+    {
+        s->suback_ms = (uint32_t)((esp_timer_get_time() - s->connack_us) / 1000);
+        metrics_set(mqtt_conn_metric_suback_ms[s - mqtt_conn_stats], s->suback_ms);
+    }
+}
+
+void mqtt_conn_disconnected(mqtt_conn_stats_t *s)
+{
+    s->down_us = esp_timer_get_time();
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static uint8_t mqtt_conn_bucket(uint32_t ms)
+{
+    uint8_t b = 0;
+    uint32_t limit = MQTT_CONNECT_HIST_BASE_MS;
+
+    while(b < MQTT_CONNECT_HIST_BUCKETS - 1 && ms >= limit)
+    {
+        b++;
+        limit <<= 1;
+    }
+    return b;
+}
@@ -0,0 +1,214 @@
+/**
+ * File Name:   mqtt_rx.c
+ * Description: Routing and reassembly of the messages the MQTT client receives.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "log.h"
+#include "mqtt_rx.h"
+
+/***************************************************************************************************/
+/* Private Data Types */
+/***************************************************************************************************/
+typedef struct {
+    bool in_use;
+    esp_mqtt_client_handle_t client;
+    const mqtt_route_t *route;
+    int msg_id;
+    int total_len;
+    int received;
+    char buf[MQTT_RX_BUF_LEN + 1];
+} mqtt_rx_slot_t;
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+static const mqtt_route_t *mqtt_rx_routes;
+// Bucket -> index into mqtt_rx_routes + 1, 0 marks an empty bucket
+static uint8_t mqtt_rx_route_index[MQTT_ROUTE_BUCKETS];
+static mqtt_rx_slot_t mqtt_rx_pool[MQTT_RX_POOL_SIZE];
+static portMUX_TYPE mqtt_rx_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/***************************************************************************************************/
+/* Public Variables */
+/***************************************************************************************************/
+mqtt_rx_stats_t mqtt_rx_stats;
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static uint32_t mqtt_rx_hash(const char *topic, int len);
+static const mqtt_route_t *mqtt_rx_route_find(const char *topic, int len);
+static mqtt_rx_slot_t *mqtt_rx_slot_claim(esp_mqtt_client_handle_t client, const mqtt_route_t *route, int msg_id,
+    int total_len);
+static mqtt_rx_slot_t *mqtt_rx_slot_find(esp_mqtt_client_handle_t client, int msg_id);
+static void mqtt_rx_slot_release(mqtt_rx_slot_t *slot);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+void mqtt_rx_init(const mqtt_route_t *routes, int num)
+{
+    mqtt_rx_routes = routes;
+    memset(mqtt_rx_route_index, 0, sizeof(mqtt_rx_route_index));
+    for(int i = 0; i < num; i++)
+    {
+        uint32_t b = mqtt_rx_hash(routes[i].topic, routes[i].topic_len);
+
+        while(mqtt_rx_route_index[b] != 0)
+            b = (b + 1) & (MQTT_ROUTE_BUCKETS - 1);
+        mqtt_rx_route_index[b] = i + 1;
+    }
+}
+
+void mqtt_rx_data(void *ctx, esp_mqtt_event_handle_t event)
+{
+    const mqtt_route_t *route;
+    mqtt_rx_slot_t *slot;
+
+    // Topic is only present on the first fragment
+    if(event->current_data_offset == 0)
+    {
+        route = mqtt_rx_route_find(event->topic, event->topic_len);
+        if(route == NULL)
+        {
+            mqtt_rx_stats.unrouted++;
+            return;
+        }
+        if(event->data_len == event->total_data_len)
+        {
+            // Complete in one event, hand the client's buffer straight to the handler
+            mqtt_rx_stats.routed++;
+            route->handler(ctx, event->data, event->data_len);
+            return;
+        }
+        if(event->total_data_len > MQTT_RX_BUF_LEN
+            || (slot = mqtt_rx_slot_claim(event->client, route, event->msg_id, event->total_data_len)) == NULL)
+        {
+            mqtt_rx_stats.dropped++;
+            LOG_ERROR("Dropping %d byte message on %.*s", event->total_data_len, event->topic_len, event->topic);
+            return;
+        }
+    }
+    else
+    {
+        slot = mqtt_rx_slot_find(event->client, event->msg_id);
+        // Head of this message was dropped
+        if(slot == NULL)
+            return;
+    }
+
+    if(event->current_data_offset != slot->received || slot->received + event->data_len > slot->total_len)
+    {
+        mqtt_rx_stats.dropped++;
+        mqtt_rx_slot_release(slot);
+        return;
+    }
+    memcpy(&slot->buf[slot->received], event->data, event->data_len);
+    slot->received += event->data_len;
+
+    if(slot->received == slot->total_len)
+    {
+        slot->buf[slot->received] = '\0';
+        mqtt_rx_stats.reassembled++;
+        mqtt_rx_stats.routed++;
+        slot->route->handler(ctx, slot->buf, slot->received);
+        mqtt_rx_slot_release(slot);
+    }
+}
+
+void mqtt_rx_disconnected(esp_mqtt_client_handle_t client)
+{
+    portENTER_CRITICAL(&mqtt_rx_pool_lock);
+    for(int i = 0; i < MQTT_RX_POOL_SIZE; i++)
+    {
+        if(mqtt_rx_pool[i].in_use && mqtt_rx_pool[i].client == client)
+        {
+            mqtt_rx_pool[i].in_use = false;
+            mqtt_rx_stats.dropped++;
+        }
+    }
+    portEXIT_CRITICAL(&mqtt_rx_pool_lock);
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static uint32_t mqtt_rx_hash(const char *topic, int len)
+{
+    // Length and the last two characters are enough to separate our topics
+    uint32_t h = (uint32_t)len * 31;
+
+    if(len > 0)
+        h += (uint8_t)topic[len - 1];
+    if(len > 1)
+        h = h * 31 + (uint8_t)topic[len - 2];
+    return h & (MQTT_ROUTE_BUCKETS - 1);
+}
+
+static const mqtt_route_t *mqtt_rx_route_find(const char *topic, int len)
+{
+    uint32_t b = mqtt_rx_hash(topic, len);
+
+    while(mqtt_rx_route_index[b] != 0)
+    {
+        const mqtt_route_t *r = &mqtt_rx_routes[mqtt_rx_route_index[b] - 1];
+
+        if(r->topic_len == len && memcmp(r->topic, topic, len) == 0)
+            return r;
+        b = (b + 1) & (MQTT_ROUTE_BUCKETS - 1);
+    }
+    return NULL;
+}
+
+// A client starting a new message has given up on the one it held a slot for, that slot is reused
+static mqtt_rx_slot_t *mqtt_rx_slot_claim(esp_mqtt_client_handle_t client, const mqtt_route_t *route, int msg_id,
+    int total_len)
+{
+    mqtt_rx_slot_t *slot = NULL;
+
+    portENTER_CRITICAL(&mqtt_rx_pool_lock);
+    for(int i = 0; i < MQTT_RX_POOL_SIZE; i++)
+    {
+        if(mqtt_rx_pool[i].in_use && mqtt_rx_pool[i].client == client)
+        {
+            slot = &mqtt_rx_pool[i];
+            mqtt_rx_stats.dropped++;
+            break;
+        }
+        if(!mqtt_rx_pool[i].in_use && slot == NULL)
+            slot = &mqtt_rx_pool[i];
+    }
+    if(slot != NULL)
+        slot->in_use = true;
+    portEXIT_CRITICAL(&mqtt_rx_pool_lock);
+
+    if(slot != NULL)
+    {
+        slot->client = client;
+        slot->route = route;
+        slot->msg_id = msg_id;
+        slot->total_len = total_len;
+        slot->received = 0;
+    }
+    return slot;
+}
+
+static mqtt_rx_slot_t *mqtt_rx_slot_find(esp_mqtt_client_handle_t client, int msg_id)
+{
+    for(int i = 0; i < MQTT_RX_POOL_SIZE; i++)
+        if(mqtt_rx_pool[i].in_use && mqtt_rx_pool[i].client == client && mqtt_rx_pool[i].msg_id == msg_id)
+            return &mqtt_rx_pool[i];
+    return NULL;
+}
+
+static void mqtt_rx_slot_release(mqtt_rx_slot_t *slot)
+{
+    portENTER_CRITICAL(&mqtt_rx_pool_lock);
+    slot->in_use = false;
+    portEXIT_CRITICAL(&mqtt_rx_pool_lock);
+}
@@ -22,852 +22,264 @@
  All text above, and the splash screen must be included in any redistribution *
 *******************************************************************************/
 
+#include <time.h>
 #include "oled.h"
 #include "host.h"
-
-const char Font[] = {
-0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x5F, 0x00, 0x00,
-0x00, 0x07, 0x00, 0x07, 0x00,
-0x14, 0x7F, 0x14, 0x7F, 0x14,
-0x24, 0x2A, 0x7F, 0x2A, 0x12,
-0x23, 0x13, 0x08, 0x64, 0x62,
-0x36, 0x49, 0x56, 0x20, 0x50,
-0x00, 0x08, 0x07, 0x03, 0x00,
-0x00, 0x1C, 0x22, 0x41, 0x00,
-0x00, 0x41, 0x22, 0x1C, 0x00,
-0x2A, 0x1C, 0x7F, 0x1C, 0x2A,
-0x08, 0x08, 0x3E, 0x08, 0x08,
-0x00, 0x80, 0x70, 0x30, 0x00,
-0x08, 0x08, 0x08, 0x08, 0x08,
-0x00, 0x00, 0x60, 0x60, 0x00,
-0x20, 0x10, 0x08, 0x04, 0x02,
-0x3E, 0x51, 0x49, 0x45, 0x3E,
-0x00, 0x42, 0x7F, 0x40, 0x00,
-0x72, 0x49, 0x49, 0x49, 0x46,
-0x21, 0x41, 0x49, 0x4D, 0x33,
-0x18, 0x14, 0x12, 0x7F, 0x10,
-0x27, 0x45, 0x45, 0x45, 0x39,
-0x3C, 0x4A, 0x49, 0x49, 0x31,
-0x41, 0x21, 0x11, 0x09, 0x07,
-0x36, 0x49, 0x49, 0x49, 0x36,
-0x46, 0x49, 0x49, 0x29, 0x1E,
-0x00, 0x00, 0x14, 0x00, 0x00,
-0x00, 0x40, 0x34, 0x00, 0x00,
-0x00, 0x08, 0x14, 0x22, 0x41,
-0x14, 0x14, 0x14, 0x14, 0x14,
-0x00, 0x41, 0x22, 0x14, 0x08,
-0x02, 0x01, 0x59, 0x09, 0x06,
-0x3E, 0x41, 0x5D, 0x59, 0x4E,
-0x7C, 0x12, 0x11, 0x12, 0x7C,
-0x7F, 0x49, 0x49, 0x49, 0x36,
-0x3E, 0x41, 0x41, 0x41, 0x22,
-0x7F, 0x41, 0x41, 0x41, 0x3E,
-0x7F, 0x49, 0x49, 0x49, 0x41,
-0x7F, 0x09, 0x09, 0x09, 0x01,
-0x3E, 0x41, 0x41, 0x51, 0x73,
-0x7F, 0x08, 0x08, 0x08, 0x7F,
-0x00, 0x41, 0x7F, 0x41, 0x00,
-0x20, 0x40, 0x41, 0x3F, 0x01,
-0x7F, 0x08, 0x14, 0x22, 0x41,
-0x7F, 0x40, 0x40, 0x40, 0x40,
-0x7F, 0x02, 0x1C, 0x02, 0x7F,
-0x7F, 0x04, 0x08, 0x10, 0x7F,
-0x3E, 0x41, 0x41, 0x41, 0x3E,
-0x7F, 0x09, 0x09, 0x09, 0x06,
-0x3E, 0x41, 0x51, 0x21, 0x5E,
-0x7F, 0x09, 0x19, 0x29, 0x46
-};
-const char Font2[] = {
-0x26, 0x49, 0x49, 0x49, 0x32,
-0x03, 0x01, 0x7F, 0x01, 0x03,
-0x3F, 0x40, 0x40, 0x40, 0x3F,
-0x1F, 0x20, 0x40, 0x20, 0x1F,
-0x3F, 0x40, 0x38, 0x40, 0x3F,
-0x63, 0x14, 0x08, 0x14, 0x63,
-0x03, 0x04, 0x78, 0x04, 0x03,
-0x61, 0x59, 0x49, 0x4D, 0x43,
-0x00, 0x7F, 0x41, 0x41, 0x41,
-0x02, 0x04, 0x08, 0x10, 0x20,
-0x00, 0x41, 0x41, 0x41, 0x7F,
-0x04, 0x02, 0x01, 0x02, 0x04,
-0x40, 0x40, 0x40, 0x40, 0x40,
-0x00, 0x03, 0x07, 0x08, 0x00,
-0x20, 0x54, 0x54, 0x78, 0x40,
-0x7F, 0x28, 0x44, 0x44, 0x38,
-0x38, 0x44, 0x44, 0x44, 0x28,
-0x38, 0x44, 0x44, 0x28, 0x7F,
-0x38, 0x54, 0x54, 0x54, 0x18,
-0x00, 0x08, 0x7E, 0x09, 0x02,
-0x18, 0xA4, 0xA4, 0x9C, 0x78,
-0x7F, 0x08, 0x04, 0x04, 0x78,
-0x00, 0x44, 0x7D, 0x40, 0x00,
-0x20, 0x40, 0x40, 0x3D, 0x00,
-0x7F, 0x10, 0x28, 0x44, 0x00,
-0x00, 0x41, 0x7F, 0x40, 0x00,
-0x7C, 0x04, 0x78, 0x04, 0x78,
-0x7C, 0x08, 0x04, 0x04, 0x78,
-0x38, 0x44, 0x44, 0x44, 0x38,
-0xFC, 0x18, 0x24, 0x24, 0x18,
-0x18, 0x24, 0x24, 0x18, 0xFC,
-0x7C, 0x08, 0x04, 0x04, 0x08,
-0x48, 0x54, 0x54, 0x54, 0x24,
-0x04, 0x04, 0x3F, 0x44, 0x24,
-0x3C, 0x40, 0x40, 0x20, 0x7C,
-0x1C, 0x20, 0x40, 0x20, 0x1C,
-0x3C, 0x40, 0x30, 0x40, 0x3C,
-0x44, 0x28, 0x10, 0x28, 0x44,
-0x4C, 0x90, 0x90, 0x90, 0x7C,
-0x44, 0x64, 0x54, 0x4C, 0x44,
-0x00, 0x08, 0x36, 0x41, 0x00,
-0x00, 0x00, 0x77, 0x00, 0x00,
-0x00, 0x41, 0x36, 0x08, 0x00,
-0x02, 0x01, 0x02, 0x04, 0x02
-};
-
-static uint8_t ssd1306_buffer[SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 8] = {
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
-0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x80, 0x80, 0xC0, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x80, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC, 0xF8, 0xE0, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80,
-0x80, 0x80, 0x00, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0xFF
-#if (SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH > 96*16)
-,
-0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x80, 0x80, 0x00, 0x00,
-0x80, 0xFF, 0xFF, 0x80, 0x80, 0x00, 0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x80, 0x00, 0x80, 0x80,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x00, 0x00, 0x8C, 0x8E, 0x84, 0x00, 0x00, 0x80, 0xF8,
-0xF8, 0xF8, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xE0, 0xE0, 0xC0, 0x80,
-0x00, 0xE0, 0xFC, 0xFE, 0xFF, 0xFF, 0xFF, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFF, 0xC7, 0x01, 0x01,
-0x01, 0x01, 0x83, 0xFF, 0xFF, 0x00, 0x00, 0x7C, 0xFE, 0xC7, 0x01, 0x01, 0x01, 0x01, 0x83, 0xFF,
-0xFF, 0xFF, 0x00, 0x38, 0xFE, 0xC7, 0x83, 0x01, 0x01, 0x01, 0x83, 0xC7, 0xFF, 0xFF, 0x00, 0x00,
-0x01, 0xFF, 0xFF, 0x01, 0x01, 0x00, 0xFF, 0xFF, 0x07, 0x01, 0x01, 0x01, 0x00, 0x00, 0x7F, 0xFF,
-0x80, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x7F, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x01, 0xFF,
-0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x03, 0x0F, 0x3F, 0x7F, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xE7, 0xC7, 0xC7, 0x8F,
-0x8F, 0x9F, 0xBF, 0xFF, 0xFF, 0xC3, 0xC0, 0xF0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFC, 0xFC, 0xFC,
-0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xF8, 0xF8, 0xF0, 0xF0, 0xE0, 0xC0, 0x00, 0x01, 0x03, 0x03, 0x03,
-0x03, 0x03, 0x01, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01, 0x03, 0x03, 0x03, 0x03, 0x01, 0x01,
-0x03, 0x01, 0x00, 0x00, 0x00, 0x01, 0x03, 0x03, 0x03, 0x03, 0x01, 0x01, 0x03, 0x03, 0x00, 0x00,
-0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
-0x03, 0x03, 0x03, 0x03, 0x03, 0x01, 0x00, 0x00, 0x00, 0x01, 0x03, 0x01, 0x00, 0x00, 0x00, 0x03,
-0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-#if (SSD1306_LCDHEIGHT == 64)
-,
-0x00, 0x00, 0x00, 0x80, 0xC0, 0xE0, 0xF0, 0xF9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F, 0x1F, 0x0F,
-0x87, 0xC7, 0xF7, 0xFF, 0xFF, 0x1F, 0x1F, 0x3D, 0xFC, 0xF8, 0xF8, 0xF8, 0xF8, 0x7C, 0x7D, 0xFF,
-0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 0x3F, 0x0F, 0x07, 0x00, 0x30, 0x30, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0xFE, 0xFE, 0xFC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0, 0xC0, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0xC0, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 0x7F, 0x3F, 0x1F,
-0x0F, 0x07, 0x1F, 0x7F, 0xFF, 0xFF, 0xF8, 0xF8, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE, 0xF8, 0xE0,
-0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00,
-0x00, 0xFC, 0xFE, 0xFC, 0x0C, 0x06, 0x06, 0x0E, 0xFC, 0xF8, 0x00, 0x00, 0xF0, 0xF8, 0x1C, 0x0E,
-0x06, 0x06, 0x06, 0x0C, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00, 0x00, 0x00, 0xFC,
-0xFE, 0xFC, 0x00, 0x18, 0x3C, 0x7E, 0x66, 0xE6, 0xCE, 0x84, 0x00, 0x00, 0x06, 0xFF, 0xFF, 0x06,
-0x06, 0xFC, 0xFE, 0xFC, 0x0C, 0x06, 0x06, 0x06, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00, 0xC0, 0xF8,
-0xFC, 0x4E, 0x46, 0x46, 0x46, 0x4E, 0x7C, 0x78, 0x40, 0x18, 0x3C, 0x76, 0xE6, 0xCE, 0xCC, 0x80,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x01, 0x07, 0x0F, 0x1F, 0x1F, 0x3F, 0x3F, 0x3F, 0x3F, 0x1F, 0x0F, 0x03,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00, 0x00,
-0x00, 0x0F, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00, 0x00, 0x03, 0x07, 0x0E, 0x0C,
-0x18, 0x18, 0x0C, 0x06, 0x0F, 0x0F, 0x0F, 0x00, 0x00, 0x01, 0x0F, 0x0E, 0x0C, 0x18, 0x0C, 0x0F,
-0x07, 0x01, 0x00, 0x04, 0x0E, 0x0C, 0x18, 0x0C, 0x0F, 0x07, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00,
-0x00, 0x0F, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x07,
-0x07, 0x0C, 0x0C, 0x18, 0x1C, 0x0C, 0x06, 0x06, 0x00, 0x04, 0x0E, 0x0C, 0x18, 0x0C, 0x0F, 0x07,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-#endif
+#include "esp_timer.h"
+#include "i2c.h"
+#ifdef SSD1306_EMULATOR
+#include "ssd1306_emu.h"
 #endif
-};
 
-void ssd1306_main(void* arg)
-{
-  SSD1306_Begin(SSD1306_SWITCHCAPVCC, 0x3C);
-  SSD1306_ClearDisplay();
-  SSD1306_Display();
-  host_t* host = (host_t*)arg;
-  char strftime_buf[64];
-  char data[50];
-  // previous state
-  ssd1306_screen_t prev;
-  // refresh the OLED
-  while(1)
-  {
-    struct timeval tv;
-    time_t t;
-    struct tm *info;
-    char buffer[64];
-  
-    gettimeofday(&tv, NULL);
-    t = tv.tv_sec;
+static uint8_t _i2caddr;
 
-    info = localtime(&t);
-    strftime(strftime_buf, sizeof(strftime_buf), "%a %b %d, %Y\n\r%I:%M %p", info);
-    SSD1306_DrawText(0,0,strftime_buf, 1);
-    switch (host->ssd1306.state)
-    {
-    case WELCOME:
-      SSD1306_DrawText(0,16,"Welcome",2);
-      break;
-    case ENV_INFO:
-      if(host->htu21.msg_queue != NULL)
-      {
-        htu21_data_t env_data;
-        if(host->htu21.msg_queue == NULL)
-        {
-          LOG_ERROR("MSG queue does not exist cannot display on OLED.");
-        }
-        xQueuePeek(host->htu21.msg_queue, &env_data, 5);
-        sprintf(data, "Temperature: %.2f F\n\rHumidity: %.2f%%", env_data.temperature, env_data.humidity);
-        SSD1306_DrawText(0,16,data,1);
-      }
-      else
-      {
-        LOG_ERROR("HTU21 not initialized.");
-      }
-      break;
-    default:
-      break;
-    }
-    SSD1306_Display();
-    vTaskDelay(20);
-  }
-}
+// Given by the flush task when the front buffer may be swapped again
+static SemaphoreHandle_t ssd1306_front_free;
+static TaskHandle_t ssd1306_flush_thread;
+// Task to wake with SSD1306_NOTIFY_FLUSHED after its frame was dropped
+static volatile TaskHandle_t ssd1306_presenter;
+// When the frame waiting for a swap was first presented, 0 if none is waiting
+static int64_t ssd1306_present_us;
 
-void ssd1306_command(uint8_t c)
-{
-    uint8_t control = 0x00;   // Co = 0, D/C = 0
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();     //TODO: move to wrapper in platform
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (_i2caddr << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write(cmd, &control, sizeof(control), true);
-    i2c_master_write(cmd, &c, sizeof(control), true);
-    i2c_master_stop(cmd);
-    i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-    i2c_cmd_link_delete(cmd);
-}
+static ssd1306_stats_t ssd1306_stats;
+static metrics_t *ssd1306_metric_frames;
+static metrics_t *ssd1306_metric_dropped;
 
-void SSD1306_Begin(uint8_t vccstate, uint8_t i2caddr)
-{
-  _vccstate = vccstate;
-  _i2caddr  = i2caddr;
+static void ssd1306_flush_task(void* arg);
 
-  #ifdef SSD1306_RST
-    output_low(SSD1306_RST);
-    output_drive(SSD1306_RST);
-    delay_ms(10);
-    output_high(SSD1306_RST);
-  #endif
-  
-  // Init sequence
-  ssd1306_command(SSD1306_DISPLAYOFF);                    // 0xAE
-  ssd1306_command(SSD1306_SETDISPLAYCLOCKDIV);            // 0xD5
-  ssd1306_command(0x80);                                  // the suggested ratio 0x80
-
-  ssd1306_command(SSD1306_SETMULTIPLEX);                  // 0xA8
-  ssd1306_command(SSD1306_LCDHEIGHT - 1);
-
-  ssd1306_command(SSD1306_SETDISPLAYOFFSET);              // 0xD3
-  ssd1306_command(0x0);                                   // no offset
-  ssd1306_command(SSD1306_SETSTARTLINE | 0x0);            // line #0
-  ssd1306_command(SSD1306_CHARGEPUMP);                    // 0x8D
-  if (vccstate == SSD1306_EXTERNALVCC)
-    { ssd1306_command(0x10); }
-  else
-    { ssd1306_command(0x14); }
-  ssd1306_command(SSD1306_MEMORYMODE);                    // 0x20
-  ssd1306_command(0x00);                                  // 0x0 act like ks0108
-  ssd1306_command(SSD1306_SEGREMAP | 0x1);
-  ssd1306_command(SSD1306_COMSCANDEC);
-
- #if defined SSD1306_128_32
-  ssd1306_command(SSD1306_SETCOMPINS);                    // 0xDA
-  ssd1306_command(0x02);
-  ssd1306_command(SSD1306_SETCONTRAST);                   // 0x81
-  ssd1306_command(0x8F);
-
-#elif defined SSD1306_128_64
-  ssd1306_command(SSD1306_SETCOMPINS);                    // 0xDA
-  ssd1306_command(0x12);
-  ssd1306_command(SSD1306_SETCONTRAST);                   // 0x81
-  if (vccstate == SSD1306_EXTERNALVCC)
-    { ssd1306_command(0x9F); }
-  else
-    { ssd1306_command(0xCF); }
-
-#elif defined SSD1306_96_16
-  ssd1306_command(SSD1306_SETCOMPINS);                    // 0xDA
-  ssd1306_command(0x2);   //ada x12
-  ssd1306_command(SSD1306_SETCONTRAST);                   // 0x81
-  if (vccstate == SSD1306_EXTERNALVCC)
-    { ssd1306_command(0x10); }
-  else
-    { ssd1306_command(0xAF); }
+// One device handle for command callers and one for the flush task, frames give way to commands
+// and sensor reads
+static i2c_dev_t ssd1306_cmd_dev;
+static i2c_dev_t ssd1306_flush_dev;
 
-#endif
-
-  ssd1306_command(SSD1306_SETPRECHARGE);                  // 0xd9
-  if (vccstate == SSD1306_EXTERNALVCC)
-    { ssd1306_command(0x22); }
-  else
-    { ssd1306_command(0xF1); }
-  ssd1306_command(SSD1306_SETVCOMDETECT);                 // 0xDB
-  ssd1306_command(0x40);
-  ssd1306_command(SSD1306_DISPLAYALLON_RESUME);           // 0xA4
-  ssd1306_command(SSD1306_NORMALDISPLAY);                 // 0xA6
-
-  ssd1306_command(SSD1306_DEACTIVATE_SCROLL);
-
-  ssd1306_command(SSD1306_DISPLAYON);//--turn on oled panel
-  
-  // set cursor to (0, 0)
-  x_pos = 0;
-  y_pos = 0;
-  // set text size to 1
-  text_size = 1;
-}
-
-void SSD1306_DrawPixel(uint8_t x, uint8_t y, bool color )
+static void ssd1306_minute_cb(void* arg)
 {
-  if ((x >= SSD1306_LCDWIDTH) || (y >= SSD1306_LCDHEIGHT))
-    return;
-  if (color)
-    ssd1306_buffer[x + (uint16_t)(y / 8) * SSD1306_LCDWIDTH] |=  (1 << (y & 7));
-  else
-    ssd1306_buffer[x + (uint16_t)(y / 8) * SSD1306_LCDWIDTH] &=  ~(1 << (y & 7));
+  ssd1306_t* oled = (ssd1306_t*)arg;
+  xTaskNotify(oled->thread, SSD1306_NOTIFY_MINUTE, eSetBits);
 }
 
-void SSD1306_StartScrollRight(uint8_t start, uint8_t stop)
+// Arm the clock timer for the next wall clock minute boundary
+static void ssd1306_arm_minute(ssd1306_t* oled)
 {
-  ssd1306_command(SSD1306_RIGHT_HORIZONTAL_SCROLL);
-  ssd1306_command(0X00);
-  ssd1306_command(start);
-  ssd1306_command(0X00);
-  ssd1306_command(stop);
-  ssd1306_command(0X00);
-  ssd1306_command(0XFF);
-  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  esp_timer_start_once(oled->minute_timer, (uint64_t)(60 - tv.tv_sec % 60) * 1000000 - tv.tv_usec);
 }
 
-void SSD1306_StartScrollLeft(uint8_t start, uint8_t stop)
+static void ssd1306_show_clock(void)
 {
-  ssd1306_command(SSD1306_LEFT_HORIZONTAL_SCROLL);
-  ssd1306_command(0X00);
-  ssd1306_command(start);
-  ssd1306_command(0X00);
-  ssd1306_command(stop);
-  ssd1306_command(0X00);
-  ssd1306_command(0XFF);
-  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
-}
+  struct timeval tv;
+  time_t t;
 
-void SSD1306_StartScrollDiagRight(uint8_t start, uint8_t stop)
-{
-  ssd1306_command(SSD1306_SET_VERTICAL_SCROLL_AREA);
-  ssd1306_command(0X00);
-  ssd1306_command(SSD1306_LCDHEIGHT);
-  ssd1306_command(SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL);
-  ssd1306_command(0X00);
-  ssd1306_command(start);
-  ssd1306_command(0X00);
-  ssd1306_command(stop);
-  ssd1306_command(0X01);
-  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+  gettimeofday(&tv, NULL);
+  t = tv.tv_sec;
+  ssd1306_draw_clock(localtime(&t));
 }
 
-void SSD1306_StartScrollDiagLeft(uint8_t start, uint8_t stop)
+static void ssd1306_show_body(host_t* host)
 {
-  ssd1306_command(SSD1306_SET_VERTICAL_SCROLL_AREA);
-  ssd1306_command(0X00);
-  ssd1306_command(SSD1306_LCDHEIGHT);
-  ssd1306_command(SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL);
-  ssd1306_command(0X00);
-  ssd1306_command(start);
-  ssd1306_command(0X00);
-  ssd1306_command(stop);
-  ssd1306_command(0X01);
-  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
-}
+  htu21_data_t env_data = { 0 };
+  bool env_valid = false;
 
-void SSD1306_StopScroll(void)
-{
-  ssd1306_command(SSD1306_DEACTIVATE_SCROLL);
-}
-
-void SSD1306_Dim(bool dim)
-{
-  uint8_t contrast;
-  if (dim)
-    contrast = 0; // Dimmed display
-  else {
-    if (_vccstate == SSD1306_EXTERNALVCC)
-      contrast = 0x9F;
+  if(host->ssd1306.state == ENV_INFO)
+  {
+    if(host->htu21.msg_queue != NULL)
+      env_valid = pdTRUE == xQueuePeek(host->htu21.msg_queue, &env_data, 0);
     else
-      contrast = 0xCF;
+      LOG_ERROR("HTU21 not initialized.");
   }
-  // the range of contrast to too small to be really useful
-  // it is useful to dim the display
-  ssd1306_command(SSD1306_SETCONTRAST);
-  ssd1306_command(contrast);
+  ssd1306_draw_body(host->ssd1306.state, env_valid, env_data.temperature, env_data.humidity);
 }
 
-void SSD1306_Display(void)
-{
-  ssd1306_command(SSD1306_COLUMNADDR);
-  ssd1306_command(0);   // Column start address (0 = reset)
-  ssd1306_command(SSD1306_LCDWIDTH-1); // Column end address (127 = reset)
-
-  ssd1306_command(SSD1306_PAGEADDR);
-  ssd1306_command(0); // Page start address (0 = reset)
-  #if SSD1306_LCDHEIGHT == 64
-    ssd1306_command(7); // Page end address
-  #endif
-  #if SSD1306_LCDHEIGHT == 32
-    ssd1306_command(3); // Page end address
-  #endif
-  #if SSD1306_LCDHEIGHT == 16
-    ssd1306_command(1); // Page end address
-  #endif
-  
-  for (uint16_t i = 0; i < (SSD1306_LCDWIDTH*SSD1306_LCDHEIGHT / 8); i++) {
-      // send a bunch of data in one xmission
-      i2c_cmd_handle_t cmd = i2c_cmd_link_create();   //TODO: move to wrapper in platform
-      i2c_master_start(cmd);
-      i2c_master_write_byte(cmd, _i2caddr << 1 | 0, true);
-      uint8_t command = 0x40;
-      i2c_master_write(cmd, &command, 1, true);
-      for (uint8_t x = 0; x < 16; x++) {
-        i2c_master_write(cmd, &ssd1306_buffer[i], sizeof(ssd1306_buffer[0]), true);
-        i++;
-      }
-      i--;
-      i2c_master_stop(cmd);
-      i2c_master_cmd_begin(I2C_NUM_0, cmd, portMAX_DELAY);
-      i2c_cmd_link_delete(cmd);
-    }
-}
-
-void SSD1306_ClearDisplay(void)
+void ssd1306_main(void* arg)
 {
-  for (uint16_t i = 0; i < (SSD1306_LCDWIDTH*SSD1306_LCDHEIGHT / 8); i++)
-    ssd1306_buffer[i] = 0;
-}
+  SSD1306_Begin(SSD1306_SWITCHCAPVCC, 0x3C);
+  SSD1306_ClearDisplay();
+  SSD1306_Display();
+  host_t* host = (host_t*)arg;
+  ssd1306_t* oled = &host->ssd1306;
+  const esp_timer_create_args_t timer_args = {
+    .callback = ssd1306_minute_cb,
+    .arg = oled,
+    .name = "oled_minute"
+  };
+  // previous state
+  ssd1306_screen_t prev = oled->state;
+  uint32_t events = SSD1306_NOTIFY_ALL;
 
-void SSD1306_DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, bool color )
-{
-  bool steep;
-  int8_t ystep;
-  uint8_t dx, dy;
-  int16_t err;
-  steep = abs(y1 - y0) > abs(x1 - x0);
-  if (steep) {
-    ssd1306_swap(x0, y0);
-    ssd1306_swap(x1, y1);
-  }
-  if (x0 > x1) {
-    ssd1306_swap(x0, x1);
-    ssd1306_swap(y0, y1);
+  oled->thread = xTaskGetCurrentTaskHandle();
+  if(ESP_OK != esp_timer_create(&timer_args, &oled->minute_timer))
+  {
+    LOG_ERROR("Failed to create the OLED clock timer");
   }
-  dx = x1 - x0;
-  dy = abs(y1 - y0);
-
-  err = dx / 2;
-  if (y0 < y1)
-    ystep = 1;
-  else
-    ystep = -1;
-
-  for (; x0 <= x1; x0++) {
-    if (steep) {
-      if(color) SSD1306_DrawPixel(y0, x0, true);
-      else      SSD1306_DrawPixel(y0, x0, false);
-    }
-    else {
-      if(color) SSD1306_DrawPixel(x0, y0, true);
-      else      SSD1306_DrawPixel(x0, y0, false);
+
+  // Redraw only the widgets an event affects, then sleep until the next one
+  while(1)
+  {
+    if(events & SSD1306_NOTIFY_MINUTE)
+    {
+      ssd1306_show_clock();
+      if(oled->minute_timer != NULL)
+        ssd1306_arm_minute(oled);
     }
-    err -= dy;
-    if (err < 0) {
-      y0  += ystep;
-      err += dx;
+    if((events & SSD1306_NOTIFY_STATE) || prev != oled->state
+      || ((events & SSD1306_NOTIFY_ENV) && oled->state == ENV_INFO))
+    {
+      prev = oled->state;
+      ssd1306_show_body(host);
     }
+    SSD1306_Display();
+    xTaskNotifyWait(0, SSD1306_NOTIFY_ALL, &events, portMAX_DELAY);
   }
 }
 
-void SSD1306_DrawFastHLine(uint8_t x, uint8_t y, uint8_t w, bool color )
+void ssd1306_set_state(ssd1306_t* oled, ssd1306_screen_t state)
 {
-   SSD1306_DrawLine(x, y, x + w - 1, y, color);
+  oled->state = state;
+  if(oled->thread != NULL)
+    xTaskNotify(oled->thread, SSD1306_NOTIFY_STATE, eSetBits);
 }
 
-void SSD1306_DrawFastVLine(uint8_t x, uint8_t y, uint8_t h, bool color )
+void ssd1306_notify_env(ssd1306_t* oled, const htu21_data_t* data)
 {
-  SSD1306_DrawLine(x, y, x, y + h - 1, color);
-}
+  // Compare at the precision shown (two decimals) so invisible changes do not wake the task
+  int32_t t = (int32_t)lrintf(data->temperature * 100);
+  int32_t rh = (int32_t)lrintf(data->humidity * 100);
 
-void SSD1306_FillRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, bool color )
-{
-  for (int16_t i = x; i < x + w; i++)
-    SSD1306_DrawFastVLine(i, y, h, color);
-}
-
-void SSD1306_FillScreen(bool color ) {
-  SSD1306_FillRect(0, 0, SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT, color);
+  if(t == oled->shown_temperature && rh == oled->shown_humidity)
+    return;
+  oled->shown_temperature = t;
+  oled->shown_humidity = rh;
+  if(oled->thread != NULL)
+    xTaskNotify(oled->thread, SSD1306_NOTIFY_ENV, eSetBits);
 }
 
-void SSD1306_DrawCircle(int16_t x0, int16_t y0, int16_t r)
+// One transaction on the device handle of its caller, or into the emulated panel
+void ssd1306_transfer(bool flush, uint8_t control, const uint8_t *buf, size_t len)
 {
-  int16_t f = 1 - r;
-  int16_t ddF_x = 1;
-  int16_t ddF_y = -2 * r;
-  int16_t x = 0;
-  int16_t y = r;
-
-  SSD1306_DrawPixel(x0  , y0 + r, true);
-  SSD1306_DrawPixel(x0  , y0 - r, true);
-  SSD1306_DrawPixel(x0 + r, y0, true);
-  SSD1306_DrawPixel(x0 - r, y0, true);
-
-  while (x < y) {
-    if (f >= 0) {
-      y--;
-      ddF_y += 2;
-      f += ddF_y;
-    }
-    x++;
-    ddF_x += 2;
-    f += ddF_x;
-
-    SSD1306_DrawPixel(x0 + x, y0 + y, true);
-    SSD1306_DrawPixel(x0 - x, y0 + y, true);
-    SSD1306_DrawPixel(x0 + x, y0 - y, true);
-    SSD1306_DrawPixel(x0 - x, y0 - y, true);
-    SSD1306_DrawPixel(x0 + y, y0 + x, true);
-    SSD1306_DrawPixel(x0 - y, y0 + x, true);
-    SSD1306_DrawPixel(x0 + y, y0 - x, true);
-    SSD1306_DrawPixel(x0 - y, y0 - x, true);
-  }
-
+#ifdef SSD1306_EMULATOR
+    ssd1306_emu_t *emu = ssd1306_emu_get();
+    (void)flush;
+    ssd1306_emu_begin(emu, _i2caddr);
+    ssd1306_emu_write(emu, &control, sizeof(control));
+    ssd1306_emu_write(emu, buf, len);
+    ssd1306_emu_end(emu);
+#else
+    i2c_status_t status = i2c_dev_write_prefixed(flush ? &ssd1306_flush_dev : &ssd1306_cmd_dev, control, buf, len);
+    if (status != i2c_status_ok)
+      LOG_ERROR("OLED transfer failed: %d", status);
+#endif
 }
 
-void SSD1306_DrawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername)
+void SSD1306_Begin(uint8_t vccstate, uint8_t i2caddr)
 {
-  int16_t f     = 1 - r;
-  int16_t ddF_x = 1;
-  int16_t ddF_y = -2 * r;
-  int16_t x     = 0;
-  int16_t y     = r;
-
-  while (x < y) {
-    if (f >= 0) {
-      y--;
-      ddF_y += 2;
-      f     += ddF_y;
-    }
-    x++;
-    ddF_x += 2;
-    f     += ddF_x;
-    if (cornername & 0x4) {
-      SSD1306_DrawPixel(x0 + x, y0 + y, true);
-      SSD1306_DrawPixel(x0 + y, y0 + x, true);
-    }
-    if (cornername & 0x2) {
-      SSD1306_DrawPixel(x0 + x, y0 - y, true);
-      SSD1306_DrawPixel(x0 + y, y0 - x, true);
-    }
-    if (cornername & 0x8) {
-      SSD1306_DrawPixel(x0 - y, y0 + x, true);
-      SSD1306_DrawPixel(x0 - x, y0 + y, true);
-    }
-    if (cornername & 0x1) {
-      SSD1306_DrawPixel(x0 - y, y0 - x, true);
-      SSD1306_DrawPixel(x0 - x, y0 - y, true);
-    }
-  }
-
-}
+  _i2caddr  = i2caddr;
 
-void SSD1306_FillCircle(int16_t x0, int16_t y0, int16_t r, bool color )
-{
-  SSD1306_DrawFastVLine(x0, y0 - r, 2 * r + 1, color);
-  SSD1306_FillCircleHelper(x0, y0, r, 3, 0, color);
-}
+  ssd1306_metric_frames = metrics_register("oled_frames", metrics_counter);
+  ssd1306_metric_dropped = metrics_register("oled_drop", metrics_counter);
+  if (ssd1306_cmd_dev.client.name == NULL) {
+    i2c_dev_init(&ssd1306_cmd_dev, I2C_NUM_0, i2caddr, i2c_bus_prio_normal, SSD1306_I2C_TIMEOUT_MS, "oled_cmd");
+    i2c_dev_init(&ssd1306_flush_dev, I2C_NUM_0, i2caddr, i2c_bus_prio_low, SSD1306_I2C_TIMEOUT_MS, "oled_flush");
+  }
 
-// Used to do circles and roundrects
-void SSD1306_FillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername, int16_t delta, bool color ) {
-  int16_t f     = 1 - r;
-  int16_t ddF_x = 1;
-  int16_t ddF_y = -2 * r;
-  int16_t x     = 0;
-  int16_t y     = r;
-
-  while (x < y) {
-    if (f >= 0) {
-      y--;
-      ddF_y += 2;
-      f     += ddF_y;
-    }
-    x++;
-    ddF_x += 2;
-    f     += ddF_x;
+  #ifdef SSD1306_RST
+    output_low(SSD1306_RST);
+    output_drive(SSD1306_RST);
+    delay_ms(10);
+    output_high(SSD1306_RST);
+  #endif
+  
+  ssd1306_panel_init(vccstate);
 
-    if (cornername & 0x01) {
-      SSD1306_DrawFastVLine(x0 + x, y0 - y, 2 * y + 1 + delta, color);
-      SSD1306_DrawFastVLine(x0 + y, y0 - x, 2 * x + 1 + delta, color);
+  if (ssd1306_flush_thread == NULL) {
+    ssd1306_front_free = xSemaphoreCreateBinary();
+    if (ssd1306_front_free == NULL) {
+      LOG_ERROR("Failed to create the OLED flush semaphore");
+      return;
     }
-    if (cornername & 0x02) {
-      SSD1306_DrawFastVLine(x0 - x, y0 - y, 2 * y + 1 + delta, color);
-      SSD1306_DrawFastVLine(x0 - y, y0 - x, 2 * x + 1 + delta, color);
+    xSemaphoreGive(ssd1306_front_free);
+    if (pdPASS != xTaskCreate(ssd1306_flush_task, "OLED_flush", SSD1306_FLUSH_TASK_STACK, NULL,
+        PRIORITY_DEFAULT, &ssd1306_flush_thread)) {
+      LOG_ERROR("Failed to create the OLED flush task");
     }
   }
-
 }
 
-// Draw a rectangle
-void SSD1306_DrawRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h)
-{
-  SSD1306_DrawFastHLine(x, y, w, true);
-  SSD1306_DrawFastHLine(x, y + h - 1, w, true);
-  SSD1306_DrawFastVLine(x, y, h, true);
-  SSD1306_DrawFastVLine(x + w - 1, y, h, true);
-}
-
-// Draw a rounded rectangle
-void SSD1306_DrawRoundRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t r)
-{
-  // smarter version
-  SSD1306_DrawFastHLine(x + r, y, w - 2 * r, true); // Top
-  SSD1306_DrawFastHLine(x + r, y + h - 1, w - 2 * r, true); // Bottom
-  SSD1306_DrawFastVLine(x, y + r, h - 2 * r, true); // Left
-  SSD1306_DrawFastVLine(x + w - 1, y + r, h - 2 * r, true); // Right
-  // draw four corners
-  SSD1306_DrawCircleHelper(x + r, y + r, r, 1);
-  SSD1306_DrawCircleHelper(x + w - r - 1, y + r, r, 2);
-  SSD1306_DrawCircleHelper(x + w - r - 1, y + h - r - 1, r, 4);
-  SSD1306_DrawCircleHelper(x + r, y + h - r - 1, r, 8);
-}
-
-// Fill a rounded rectangle
-void SSD1306_FillRoundRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t r, bool color )
-{
-  // smarter version
-  SSD1306_FillRect(x + r, y, w - 2 * r, h, color);
-  // draw four corners
-  SSD1306_FillCircleHelper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
-  SSD1306_FillCircleHelper(x + r        , y + r, r, 2, h - 2 * r - 1, color);
-}
-
-// Draw a triangle
-void SSD1306_DrawTriangle(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2)
-{
-  SSD1306_DrawLine(x0, y0, x1, y1, true);
-  SSD1306_DrawLine(x1, y1, x2, y2, true);
-  SSD1306_DrawLine(x2, y2, x0, y0, true);
-}
-
-// Fill a triangle
-void SSD1306_FillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, bool color )
+void SSD1306_Display(void)
 {
-  int16_t a, b, y, last;
-  // Sort coordinates by Y order (y2 >= y1 >= y0)
-  if (y0 > y1) {
-    ssd1306_swap(y0, y1); ssd1306_swap(x0, x1);
-  }
-  if (y1 > y2) {
-    ssd1306_swap(y2, y1); ssd1306_swap(x2, x1);
-  }
-  if (y0 > y1) {
-    ssd1306_swap(y0, y1); ssd1306_swap(x0, x1);
-  }
+  int64_t now = esp_timer_get_time();
+  uint32_t us;
 
-  if(y0 == y2) { // Handle awkward all-on-same-line case as its own thing
-    a = b = x0;
-    if(x1 < a)      a = x1;
-    else if(x1 > b) b = x1;
-    if(x2 < a)      a = x2;
-    else if(x2 > b) b = x2;
-    SSD1306_DrawFastHLine(a, y0, b - a + 1, color);
+  if (!ssd1306_frame_changed()) {
+    ssd1306_stats.frames_skipped++;
     return;
   }
-
-  int16_t
-  dx01 = x1 - x0,
-  dy01 = y1 - y0,
-  dx02 = x2 - x0,
-  dy02 = y2 - y0,
-  dx12 = x2 - x1,
-  dy12 = y2 - y1;
-  int32_t  sa   = 0, sb   = 0;
-
-  // For upper part of triangle, find scanline crossings for segments
-  // 0-1 and 0-2.  If y1=y2 (flat-bottomed triangle), the scanline y1
-  // is included here (and second loop will be skipped, avoiding a /0
-  // error there), otherwise scanline y1 is skipped here and handled
-  // in the second loop...which also avoids a /0 error here if y0=y1
-  // (flat-topped triangle).
-  if(y1 == y2) last = y1;   // Include y1 scanline
-  else         last = y1 - 1; // Skip it
-
-  for(y = y0; y <= last; y++) {
-    a   = x0 + sa / dy01;
-    b   = x0 + sb / dy02;
-    sa += dx01;
-    sb += dx02;
-    /* longhand:
-    a = x0 + (x1 - x0) * (y - y0) / (y1 - y0);
-    b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
-    */
-    if(a > b) ssd1306_swap(a, b);
-    SSD1306_DrawFastHLine(a, y, b - a + 1, color);
+  if (ssd1306_present_us == 0)
+    ssd1306_present_us = now;
+
+  // Set before trying so a flush finishing in between still wakes us
+  ssd1306_presenter = xTaskGetCurrentTaskHandle();
+  if (ssd1306_front_free == NULL || pdTRUE != xSemaphoreTake(ssd1306_front_free, 0)) {
+    // The changes stay in the back buffer and go out with the next swap
+    ssd1306_stats.frames_dropped++;
+    metrics_inc(ssd1306_metric_dropped);
+    return;
   }
+  ssd1306_presenter = NULL;
 
-  // For lower part of triangle, find scanline crossings for segments
-  // 0-2 and 1-2.  This loop is skipped if y1=y2.
-  sa = dx12 * (y - y1);
-  sb = dx02 * (y - y0);
-  for(; y <= y2; y++) {
-    a   = x1 + sa / dy12;
-    b   = x0 + sb / dy02;
-    sa += dx12;
-    sb += dx02;
-    /* longhand:
-    a = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
-    b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
-    */
-    if(a > b) ssd1306_swap(a, b);
-    SSD1306_DrawFastHLine(a, y, b - a + 1, color);
-  }
-}
+  // The flush task is idle, hand it the back buffer and its changes
+  ssd1306_frame_swap();
 
-// invert the display
-void SSD1306_InvertDisplay(bool i)
-{
-  if (i)
-    ssd1306_command(SSD1306_INVERTDISPLAY_);
-  else
-    ssd1306_command(SSD1306_NORMALDISPLAY);
-}
+  us = (uint32_t)(esp_timer_get_time() - ssd1306_present_us);
+  ssd1306_present_us = 0;
+  ssd1306_stats.swaps++;
+  ssd1306_stats.swap_us_last = us;
+  if (us > ssd1306_stats.swap_us_max)
+    ssd1306_stats.swap_us_max = us;
 
-void SSD1306_SetTextWrap(bool w)
-{
-  wrap = w;
+  xTaskNotifyGive(ssd1306_flush_thread);
 }
 
-void SSD1306_DrawChar(uint8_t x, uint8_t y, uint8_t c, uint8_t size)
+// Send the front buffer changes and time them, runs in the flush task
+static void ssd1306_flush(void)
 {
-  SSD1306_GotoXY(x, y);
-  SSD1306_TextSize(size);
-  SSD1306_Print(c);
-}
-
-void SSD1306_DrawText(uint8_t x, uint8_t y, char *_text, uint8_t size)
-{
-  SSD1306_GotoXY(x, y);
-  SSD1306_TextSize(size);
-  while(*_text != '\0')
-    SSD1306_Print(*_text++);
-
-}
+  int64_t t0 = esp_timer_get_time();
+  uint32_t bytes, us;
 
-// move cursor to position (x, y)
-void SSD1306_GotoXY(uint8_t x, uint8_t y)
-{
-  if((x >= SSD1306_LCDWIDTH) || (y >= SSD1306_LCDHEIGHT))
+  bytes = ssd1306_frame_flush();
+  if (bytes == 0)
     return;
-  x_pos = x;
-  y_pos = y;
-}
 
-// set text size
-void SSD1306_TextSize(uint8_t t_size)
-{
-  if(t_size < 1)
-    t_size = 1;
-  text_size = t_size;
+  us = (uint32_t)(esp_timer_get_time() - t0);
+  ssd1306_stats.frames++;
+  metrics_inc(ssd1306_metric_frames);
+  ssd1306_stats.bytes_last = bytes;
+  ssd1306_stats.bytes_total += bytes;
+  ssd1306_stats.frame_us_last = us;
+  ssd1306_stats.frame_us_total += us;
+  if (us > ssd1306_stats.frame_us_max)
+    ssd1306_stats.frame_us_max = us;
 }
 
-/* print single char
-    \a  Set cursor position to upper left (0, 0)
-    \b  Move back one position
-    \n  Go to start of current line
-    \r  Go to line below
-*/
-void SSD1306_Print(uint8_t c)
+static void ssd1306_flush_task(void* arg)
 {
-  bool _color;
-  uint8_t i, j, line;
-  
-  if (c == ' ' && x_pos == 0 && wrap)
-    return;
-  if(c == '\a') {
-    x_pos = y_pos = 0;
-    return;
-  }
-  if( (c == '\b') && (x_pos >= text_size * 6) ) {
-    x_pos -= text_size * 6;
-    return;
-  }
-  if(c == '\r') {
-    x_pos = 0;
-    return;
-  }
-  if(c == '\n') {
-    y_pos += text_size * 8;
-    if((y_pos + text_size * 7) > SSD1306_LCDHEIGHT)
-      y_pos = 0;
-    return;
-  }
-
-  if((c < ' ') || (c > '~'))
-    c = '?';
-  
-  for(i = 0; i < 5; i++ ) {
-    if(c < 'S')
-      line = Font[(c - ' ') * 5 + i];
-    else
-      line = Font2[(c - 'S') * 5 + i];
-    
-    for(j = 0; j < 7; j++, line >>= 1) {
-      if(line & 0x01)
-        _color = true;
-      else
-        _color = false;
-      if(text_size == 1) SSD1306_DrawPixel(x_pos + i, y_pos + j, _color);
-      else               SSD1306_FillRect(x_pos + (i * text_size), y_pos + (j * text_size), text_size, text_size, _color);
+  TaskHandle_t presenter;
+
+  while (1) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    ssd1306_flush();
+    xSemaphoreGive(ssd1306_front_free);
+    // A frame was dropped while we were busy, let its renderer present again
+    presenter = ssd1306_presenter;
+    if (presenter != NULL) {
+      ssd1306_presenter = NULL;
+      xTaskNotify(presenter, SSD1306_NOTIFY_FLUSHED, eSetBits);
     }
   }
+}
 
-  SSD1306_FillRect(x_pos + (5 * text_size), y_pos, text_size, 7 * text_size, false);
-  
-  x_pos += text_size * 6;
-
-  if( x_pos > (SSD1306_LCDWIDTH + text_size * 6) )
-    x_pos = SSD1306_LCDWIDTH;
-
-  if (wrap && (x_pos + (text_size * 5)) > SSD1306_LCDWIDTH)
-  {
-    x_pos = 0;
-    y_pos += text_size * 8;
-    if((y_pos + text_size * 7) > SSD1306_LCDHEIGHT)
-      y_pos = 0;
-  }
+const ssd1306_stats_t *SSD1306_GetStats(void)
+{
+  return &ssd1306_stats;
 }
 
-// end of driver code
\ No newline at end of file
@@ -0,0 +1,1168 @@
+/******************************************************************************
+ SSD1306 OLED driver for CCS PIC C compiler (SSD1306OLED.c)                   *
+ Reference: Adafruit Industries SSD1306 OLED driver and graphics library.     *
+                                                                              *
+ The driver is for I2C mode only.                                             *
+                                                                              *
+ https://simple-circuit.com/                                                   *
+                                                                              *
+*******************************************************************************
+*******************************************************************************
+ This is a library for our Monochrome OLEDs based on SSD1306 drivers          *
+                                                                              *
+  Pick one up today in the adafruit shop!                                     *
+  ------> http://www.adafruit.com/category/63_98                              *
+                                                                              *
+ Adafruit invests time and resources providing this open source code,         *
+ please support Adafruit and open-source hardware by purchasing               *
+ products from Adafruit!                                                      *
+                                                                              *
+ Written by Limor Fried/Ladyada  for Adafruit Industries.                     *
+ BSD license, check license.txt for more information                          *
+ All text above, and the splash screen must be included in any redistribution *
+*******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "oled_raster.h"
+
+const char Font[] = {
+0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x5F, 0x00, 0x00,
+0x00, 0x07, 0x00, 0x07, 0x00,
+0x14, 0x7F, 0x14, 0x7F, 0x14,
+0x24, 0x2A, 0x7F, 0x2A, 0x12,
+0x23, 0x13, 0x08, 0x64, 0x62,
+0x36, 0x49, 0x56, 0x20, 0x50,
+0x00, 0x08, 0x07, 0x03, 0x00,
+0x00, 0x1C, 0x22, 0x41, 0x00,
+0x00, 0x41, 0x22, 0x1C, 0x00,
+0x2A, 0x1C, 0x7F, 0x1C, 0x2A,
+0x08, 0x08, 0x3E, 0x08, 0x08,
+0x00, 0x80, 0x70, 0x30, 0x00,
+0x08, 0x08, 0x08, 0x08, 0x08,
+0x00, 0x00, 0x60, 0x60, 0x00,
+0x20, 0x10, 0x08, 0x04, 0x02,
+0x3E, 0x51, 0x49, 0x45, 0x3E,
+0x00, 0x42, 0x7F, 0x40, 0x00,
+0x72, 0x49, 0x49, 0x49, 0x46,
+0x21, 0x41, 0x49, 0x4D, 0x33,
+0x18, 0x14, 0x12, 0x7F, 0x10,
+0x27, 0x45, 0x45, 0x45, 0x39,
+0x3C, 0x4A, 0x49, 0x49, 0x31,
+0x41, 0x21, 0x11, 0x09, 0x07,
+0x36, 0x49, 0x49, 0x49, 0x36,
+0x46, 0x49, 0x49, 0x29, 0x1E,
+0x00, 0x00, 0x14, 0x00, 0x00,
+0x00, 0x40, 0x34, 0x00, 0x00,
+0x00, 0x08, 0x14, 0x22, 0x41,
+0x14, 0x14, 0x14, 0x14, 0x14,
+0x00, 0x41, 0x22, 0x14, 0x08,
+0x02, 0x01, 0x59, 0x09, 0x06,
+0x3E, 0x41, 0x5D, 0x59, 0x4E,
+0x7C, 0x12, 0x11, 0x12, 0x7C,
+0x7F, 0x49, 0x49, 0x49, 0x36,
+0x3E, 0x41, 0x41, 0x41, 0x22,
+0x7F, 0x41, 0x41, 0x41, 0x3E,
+0x7F, 0x49, 0x49, 0x49, 0x41,
+0x7F, 0x09, 0x09, 0x09, 0x01,
+0x3E, 0x41, 0x41, 0x51, 0x73,
+0x7F, 0x08, 0x08, 0x08, 0x7F,
+0x00, 0x41, 0x7F, 0x41, 0x00,
+0x20, 0x40, 0x41, 0x3F, 0x01,
+0x7F, 0x08, 0x14, 0x22, 0x41,
+0x7F, 0x40, 0x40, 0x40, 0x40,
+0x7F, 0x02, 0x1C, 0x02, 0x7F,
+0x7F, 0x04, 0x08, 0x10, 0x7F,
+0x3E, 0x41, 0x41, 0x41, 0x3E,
+0x7F, 0x09, 0x09, 0x09, 0x06,
+0x3E, 0x41, 0x51, 0x21, 0x5E,
+0x7F, 0x09, 0x19, 0x29, 0x46
+};
+const char Font2[] = {
+0x26, 0x49, 0x49, 0x49, 0x32,
+0x03, 0x01, 0x7F, 0x01, 0x03,
+0x3F, 0x40, 0x40, 0x40, 0x3F,
+0x1F, 0x20, 0x40, 0x20, 0x1F,
+0x3F, 0x40, 0x38, 0x40, 0x3F,
+0x63, 0x14, 0x08, 0x14, 0x63,
+0x03, 0x04, 0x78, 0x04, 0x03,
+0x61, 0x59, 0x49, 0x4D, 0x43,
+0x00, 0x7F, 0x41, 0x41, 0x41,
+0x02, 0x04, 0x08, 0x10, 0x20,
+0x00, 0x41, 0x41, 0x41, 0x7F,
+0x04, 0x02, 0x01, 0x02, 0x04,
+0x40, 0x40, 0x40, 0x40, 0x40,
+0x00, 0x03, 0x07, 0x08, 0x00,
+0x20, 0x54, 0x54, 0x78, 0x40,
+0x7F, 0x28, 0x44, 0x44, 0x38,
+0x38, 0x44, 0x44, 0x44, 0x28,
+0x38, 0x44, 0x44, 0x28, 0x7F,
+0x38, 0x54, 0x54, 0x54, 0x18,
+0x00, 0x08, 0x7E, 0x09, 0x02,
+0x18, 0xA4, 0xA4, 0x9C, 0x78,
+0x7F, 0x08, 0x04, 0x04, 0x78,
+0x00, 0x44, 0x7D, 0x40, 0x00,
+0x20, 0x40, 0x40, 0x3D, 0x00,
+0x7F, 0x10, 0x28, 0x44, 0x00,
+0x00, 0x41, 0x7F, 0x40, 0x00,
+0x7C, 0x04, 0x78, 0x04, 0x78,
+0x7C, 0x08, 0x04, 0x04, 0x78,
+0x38, 0x44, 0x44, 0x44, 0x38,
+0xFC, 0x18, 0x24, 0x24, 0x18,
+0x18, 0x24, 0x24, 0x18, 0xFC,
+0x7C, 0x08, 0x04, 0x04, 0x08,
+0x48, 0x54, 0x54, 0x54, 0x24,
+0x04, 0x04, 0x3F, 0x44, 0x24,
+0x3C, 0x40, 0x40, 0x20, 0x7C,
+0x1C, 0x20, 0x40, 0x20, 0x1C,
+0x3C, 0x40, 0x30, 0x40, 0x3C,
+0x44, 0x28, 0x10, 0x28, 0x44,
+0x4C, 0x90, 0x90, 0x90, 0x7C,
+0x44, 0x64, 0x54, 0x4C, 0x44,
+0x00, 0x08, 0x36, 0x41, 0x00,
+0x00, 0x00, 0x77, 0x00, 0x00,
+0x00, 0x41, 0x36, 0x08, 0x00,
+0x02, 0x01, 0x02, 0x04, 0x02
+};
+
+/*
+ * Front and back framebuffers. Drawing goes to the back buffer while the flush task sends the
+ * front one, SSD1306_Display swaps them. Word aligned so the span fills can work 32 bits at a time.
+ */
+static uint8_t ssd1306_frames[2][SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH / 8] __attribute__((aligned(4))) = { {
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80,
+0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x80, 0x80, 0xC0, 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x80, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC, 0xF8, 0xE0, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80,
+0x80, 0x80, 0x00, 0x80, 0x80, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0xFF
+#if (SSD1306_LCDHEIGHT * SSD1306_LCDWIDTH > 96*16)
+,
+0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x80, 0x80, 0x00, 0x00, 0x80, 0x80, 0x00, 0x00,
+0x80, 0xFF, 0xFF, 0x80, 0x80, 0x00, 0x80, 0x80, 0x00, 0x80, 0x80, 0x80, 0x80, 0x00, 0x80, 0x80,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x80, 0x80, 0x00, 0x00, 0x8C, 0x8E, 0x84, 0x00, 0x00, 0x80, 0xF8,
+0xF8, 0xF8, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xF0, 0xE0, 0xE0, 0xC0, 0x80,
+0x00, 0xE0, 0xFC, 0xFE, 0xFF, 0xFF, 0xFF, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFF, 0xC7, 0x01, 0x01,
+0x01, 0x01, 0x83, 0xFF, 0xFF, 0x00, 0x00, 0x7C, 0xFE, 0xC7, 0x01, 0x01, 0x01, 0x01, 0x83, 0xFF,
+0xFF, 0xFF, 0x00, 0x38, 0xFE, 0xC7, 0x83, 0x01, 0x01, 0x01, 0x83, 0xC7, 0xFF, 0xFF, 0x00, 0x00,
+0x01, 0xFF, 0xFF, 0x01, 0x01, 0x00, 0xFF, 0xFF, 0x07, 0x01, 0x01, 0x01, 0x00, 0x00, 0x7F, 0xFF,
+0x80, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0x7F, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x01, 0xFF,
+0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x03, 0x0F, 0x3F, 0x7F, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xE7, 0xC7, 0xC7, 0x8F,
+0x8F, 0x9F, 0xBF, 0xFF, 0xFF, 0xC3, 0xC0, 0xF0, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFC, 0xFC, 0xFC,
+0xFC, 0xFC, 0xFC, 0xFC, 0xFC, 0xF8, 0xF8, 0xF0, 0xF0, 0xE0, 0xC0, 0x00, 0x01, 0x03, 0x03, 0x03,
+0x03, 0x03, 0x01, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01, 0x03, 0x03, 0x03, 0x03, 0x01, 0x01,
+0x03, 0x01, 0x00, 0x00, 0x00, 0x01, 0x03, 0x03, 0x03, 0x03, 0x01, 0x01, 0x03, 0x03, 0x00, 0x00,
+0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x03, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+0x03, 0x03, 0x03, 0x03, 0x03, 0x01, 0x00, 0x00, 0x00, 0x01, 0x03, 0x01, 0x00, 0x00, 0x00, 0x03,
+0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+#if (SSD1306_LCDHEIGHT == 64)
+,
+0x00, 0x00, 0x00, 0x80, 0xC0, 0xE0, 0xF0, 0xF9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3F, 0x1F, 0x0F,
+0x87, 0xC7, 0xF7, 0xFF, 0xFF, 0x1F, 0x1F, 0x3D, 0xFC, 0xF8, 0xF8, 0xF8, 0xF8, 0x7C, 0x7D, 0xFF,
+0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 0x3F, 0x0F, 0x07, 0x00, 0x30, 0x30, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0xFE, 0xFE, 0xFC, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xE0, 0xC0, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0xC0, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x7F, 0x7F, 0x3F, 0x1F,
+0x0F, 0x07, 0x1F, 0x7F, 0xFF, 0xFF, 0xF8, 0xF8, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE, 0xF8, 0xE0,
+0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00,
+0x00, 0xFC, 0xFE, 0xFC, 0x0C, 0x06, 0x06, 0x0E, 0xFC, 0xF8, 0x00, 0x00, 0xF0, 0xF8, 0x1C, 0x0E,
+0x06, 0x06, 0x06, 0x0C, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00, 0x00, 0x00, 0xFC,
+0xFE, 0xFC, 0x00, 0x18, 0x3C, 0x7E, 0x66, 0xE6, 0xCE, 0x84, 0x00, 0x00, 0x06, 0xFF, 0xFF, 0x06,
+0x06, 0xFC, 0xFE, 0xFC, 0x0C, 0x06, 0x06, 0x06, 0x00, 0x00, 0xFE, 0xFE, 0x00, 0x00, 0xC0, 0xF8,
+0xFC, 0x4E, 0x46, 0x46, 0x46, 0x4E, 0x7C, 0x78, 0x40, 0x18, 0x3C, 0x76, 0xE6, 0xCE, 0xCC, 0x80,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x01, 0x07, 0x0F, 0x1F, 0x1F, 0x3F, 0x3F, 0x3F, 0x3F, 0x1F, 0x0F, 0x03,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00, 0x00,
+0x00, 0x0F, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00, 0x00, 0x03, 0x07, 0x0E, 0x0C,
+0x18, 0x18, 0x0C, 0x06, 0x0F, 0x0F, 0x0F, 0x00, 0x00, 0x01, 0x0F, 0x0E, 0x0C, 0x18, 0x0C, 0x0F,
+0x07, 0x01, 0x00, 0x04, 0x0E, 0x0C, 0x18, 0x0C, 0x0F, 0x07, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00,
+0x00, 0x0F, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F, 0x0F, 0x00, 0x00, 0x00, 0x07,
+0x07, 0x0C, 0x0C, 0x18, 0x1C, 0x0C, 0x06, 0x06, 0x00, 0x04, 0x0E, 0x0C, 0x18, 0x0C, 0x0F, 0x07,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+#endif
+#endif
+} };
+
+#define SSD1306_PAGES   (SSD1306_LCDHEIGHT / 8)
+
+static uint8_t ssd1306_back;
+#define ssd1306_buffer          (ssd1306_frames[ssd1306_back])
+#define ssd1306_front_buffer    (ssd1306_frames[ssd1306_back ^ 1])
+
+// Columns of the back buffer changed since the last swap, per page. A page is clean when start > end.
+static uint8_t ssd1306_dirty_start[SSD1306_PAGES];
+static uint8_t ssd1306_dirty_end[SSD1306_PAGES];
+// Columns of the front buffer the flush task still has to send
+static uint8_t ssd1306_flush_start[SSD1306_PAGES];
+static uint8_t ssd1306_flush_end[SSD1306_PAGES];
+// Set until the first swap after init, the panel RAM does not hold the front buffer yet
+static bool ssd1306_panel_stale;
+
+// Text cursor and settings, and the supply the panel was initialized for
+static uint8_t _vccstate, x_pos, y_pos, text_size;
+static bool wrap;
+
+// Bytes a window command plus a data transaction cost on top of the pixel data
+#define SSD1306_SPAN_OVERHEAD   12
+// Every further page of a window is its own data transaction: START, address and control byte
+#define SSD1306_PAGE_OVERHEAD   3
+
+// Glyph columns are 7 rows, scaled glyphs up to 4x fit a 32 bit column
+#define SSD1306_GLYPH_ROWS      7
+#define SSD1306_GLYPH_COLS      5
+#define SSD1306_GLYPH_NUM       ('~' - ' ' + 1)
+#define SSD1306_BLIT_MAX_SIZE   4
+
+// What a raster primitive does to the pixels it covers
+typedef enum {
+  ssd1306_op_clear = 0,
+  ssd1306_op_set,
+  ssd1306_op_invert
+} ssd1306_op_t;
+
+// Vertically scaled glyph columns for text sizes 2..SSD1306_GLYPH_CACHE_SIZE, filled on first use
+static uint32_t ssd1306_glyph_cache[SSD1306_GLYPH_CACHE_SIZE - 1][SSD1306_GLYPH_NUM][SSD1306_GLYPH_COLS];
+static bool ssd1306_glyph_cached[SSD1306_GLYPH_CACHE_SIZE - 1][SSD1306_GLYPH_NUM];
+
+static inline void ssd1306_mark_dirty(uint8_t x, uint8_t page)
+{
+  if (x < ssd1306_dirty_start[page]) ssd1306_dirty_start[page] = x;
+  if (x > ssd1306_dirty_end[page])   ssd1306_dirty_end[page] = x;
+}
+
+static inline void ssd1306_mark_dirty_range(uint8_t first, uint8_t last, uint8_t page)
+{
+  if (first < ssd1306_dirty_start[page]) ssd1306_dirty_start[page] = first;
+  if (last > ssd1306_dirty_end[page])    ssd1306_dirty_end[page] = last;
+}
+
+static void ssd1306_mark_all_dirty(void)
+{
+  for (uint8_t p = 0; p < SSD1306_PAGES; p++) {
+    ssd1306_dirty_start[p] = 0;
+    ssd1306_dirty_end[p] = SSD1306_LCDWIDTH - 1;
+  }
+}
+
+void ssd1306_draw_clock(const struct tm *info)
+{
+  char strftime_buf[64];
+
+  strftime(strftime_buf, sizeof(strftime_buf), "%a %b %d, %Y\n\r%I:%M %p", info);
+  SSD1306_DrawText(0,0,strftime_buf, 1);
+}
+
+void ssd1306_draw_body(ssd1306_screen_t state, bool env_valid, float temperature, float humidity)
+{
+  char data[50];
+
+  // Clear first so shorter text leaves nothing behind, unchanged pixels are not resent
+  SSD1306_FillRect(0, 16, SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT - 16, false);
+  switch (state)
+  {
+  case WELCOME:
+    SSD1306_DrawText(0,16,"Welcome",2);
+    break;
+  case ENV_INFO:
+    if(env_valid)
+    {
+      sprintf(data, "Temperature: %.2f F\n\rHumidity: %.2f%%", temperature, humidity);
+      SSD1306_DrawText(0,16,data,1);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+void ssd1306_command(uint8_t c)
+{
+    ssd1306_commands(&c, 1);
+}
+
+void ssd1306_commands(const uint8_t *c, uint8_t n)
+{
+    ssd1306_transfer(false, 0x00, c, n);
+}
+
+/*
+ * Send columns start..end of front buffer pages first..last in one window. Each page is its own
+ * data transaction so the arbiter can put a sensor read between two pages.
+ */
+static void ssd1306_send_window(uint8_t start, uint8_t end, uint8_t first, uint8_t last)
+{
+    const uint8_t window[] = { SSD1306_COLUMNADDR, start, end, SSD1306_PAGEADDR, first, last };
+
+    ssd1306_transfer(true, 0x00, window, sizeof(window));
+
+    // The column/page pointer carries over between transactions
+    for (uint8_t page = first; page <= last; page++) {
+      ssd1306_transfer(true, 0x40, &ssd1306_front_buffer[page * SSD1306_LCDWIDTH + start],
+        end - start + 1);
+    }
+}
+
+void ssd1306_panel_init(uint8_t vccstate)
+{
+  _vccstate = vccstate;
+
+  // Init sequence
+  ssd1306_command(SSD1306_DISPLAYOFF);                    // 0xAE
+  ssd1306_command(SSD1306_SETDISPLAYCLOCKDIV);            // 0xD5
+  ssd1306_command(0x80);                                  // the suggested ratio 0x80
+
+  ssd1306_command(SSD1306_SETMULTIPLEX);                  // 0xA8
+  ssd1306_command(SSD1306_LCDHEIGHT - 1);
+
+  ssd1306_command(SSD1306_SETDISPLAYOFFSET);              // 0xD3
+  ssd1306_command(0x0);                                   // no offset
+  ssd1306_command(SSD1306_SETSTARTLINE | 0x0);            // line #0
+  ssd1306_command(SSD1306_CHARGEPUMP);                    // 0x8D
+  if (vccstate == SSD1306_EXTERNALVCC)
+    { ssd1306_command(0x10); }
+  else
+    { ssd1306_command(0x14); }
+  ssd1306_command(SSD1306_MEMORYMODE);                    // 0x20
+  ssd1306_command(0x00);                                  // 0x0 act like ks0108
+  ssd1306_command(SSD1306_SEGREMAP | 0x1);
+  ssd1306_command(SSD1306_COMSCANDEC);
+
+ #if defined SSD1306_128_32
+  ssd1306_command(SSD1306_SETCOMPINS);                    // 0xDA
+  ssd1306_command(0x02);
+  ssd1306_command(SSD1306_SETCONTRAST);                   // 0x81
+  ssd1306_command(0x8F);
+
+#elif defined SSD1306_128_64
+  ssd1306_command(SSD1306_SETCOMPINS);                    // 0xDA
+  ssd1306_command(0x12);
+  ssd1306_command(SSD1306_SETCONTRAST);                   // 0x81
+  if (vccstate == SSD1306_EXTERNALVCC)
+    { ssd1306_command(0x9F); }
+  else
+    { ssd1306_command(0xCF); }
+
+#elif defined SSD1306_96_16
+  ssd1306_command(SSD1306_SETCOMPINS);                    // 0xDA
+  ssd1306_command(0x2);   //ada x12
+  ssd1306_command(SSD1306_SETCONTRAST);                   // 0x81
+  if (vccstate == SSD1306_EXTERNALVCC)
+    { ssd1306_command(0x10); }
+  else
+    { ssd1306_command(0xAF); }
+
+#endif
+
+  ssd1306_command(SSD1306_SETPRECHARGE);                  // 0xd9
+  if (vccstate == SSD1306_EXTERNALVCC)
+    { ssd1306_command(0x22); }
+  else
+    { ssd1306_command(0xF1); }
+  ssd1306_command(SSD1306_SETVCOMDETECT);                 // 0xDB
+  ssd1306_command(0x40);
+  ssd1306_command(SSD1306_DISPLAYALLON_RESUME);           // 0xA4
+  ssd1306_command(SSD1306_NORMALDISPLAY);                 // 0xA6
+
+  ssd1306_command(SSD1306_DEACTIVATE_SCROLL);
+
+  ssd1306_command(SSD1306_DISPLAYON);//--turn on oled panel
+  
+  // set cursor to (0, 0)
+  x_pos = 0;
+  y_pos = 0;
+  // set text size to 1
+  text_size = 1;
+
+  // Panel RAM content is unknown after init, the first flush sends everything
+  ssd1306_mark_all_dirty();
+  ssd1306_panel_stale = true;
+  for (uint8_t p = 0; p < SSD1306_PAGES; p++) {
+    ssd1306_flush_start[p] = 0xFF;
+    ssd1306_flush_end[p] = 0;
+  }
+
+}
+
+/***************************************************************************************************/
+/* Raster primitives */
+/***************************************************************************************************/
+/*
+ * Every fill goes through ssd1306_page_span(): one page row, a run of columns and the 8 bit mask
+ * of the rows it covers in that page. Full byte runs are done a 32 bit word at a time.
+ */
+static inline uint8_t ssd1306_apply(uint8_t old, uint8_t mask, ssd1306_op_t op)
+{
+  switch (op) {
+  case ssd1306_op_set:    return old | mask;
+  case ssd1306_op_clear:  return old & ~mask;
+  default:                return old ^ mask;
+  }
+}
+
+static inline uint32_t ssd1306_apply_word(uint32_t old, ssd1306_op_t op)
+{
+  switch (op) {
+  case ssd1306_op_set:    return 0xFFFFFFFF;
+  case ssd1306_op_clear:  return 0;
+  default:                return ~old;
+  }
+}
+
+static void ssd1306_page_span(uint8_t page, uint8_t x, uint8_t end, uint8_t mask, ssd1306_op_t op)
+{
+  uint8_t *row = &ssd1306_buffer[page * SSD1306_LCDWIDTH];
+  uint8_t first = SSD1306_LCDWIDTH, last = 0;
+  uint8_t i = x;
+
+  if (mask == 0xFF) {
+    for (; i < end && (i & 3); i++) {
+      uint8_t b = ssd1306_apply(row[i], mask, op);
+      if (b != row[i]) {
+        row[i] = b;
+        if (i < first) first = i;
+        last = i;
+      }
+    }
+    for (; i + 4 <= end; i += 4) {
+      uint32_t w, old;
+      memcpy(&old, __builtin_assume_aligned(&row[i], 4), 4);
+      w = ssd1306_apply_word(old, op);
+      if (w != old) {
+        memcpy(__builtin_assume_aligned(&row[i], 4), &w, 4);
+        if (i < first) first = i;
+        last = i + 3;
+      }
+    }
+  }
+  for (; i < end; i++) {
+    uint8_t b = ssd1306_apply(row[i], mask, op);
+    if (b != row[i]) {
+      row[i] = b;
+      if (i < first) first = i;
+      last = i;
+    }
+  }
+
+  // Redrawing identical content leaves nothing to send
+  if (first <= last)
+    ssd1306_mark_dirty_range(first, last, page);
+}
+
+// Apply op to the clipped rectangle, page by page
+static void ssd1306_rect_op(int16_t x, int16_t y, int16_t w, int16_t h, ssd1306_op_t op)
+{
+  int16_t x1 = x + w, y1 = y + h;
+  uint8_t page, last_page;
+
+  if (x < 0) x = 0;
+  if (y < 0) y = 0;
+  if (x1 > SSD1306_LCDWIDTH)  x1 = SSD1306_LCDWIDTH;
+  if (y1 > SSD1306_LCDHEIGHT) y1 = SSD1306_LCDHEIGHT;
+  if (x >= x1 || y >= y1)
+    return;
+
+  last_page = (y1 - 1) / 8;
+  for (page = y / 8; page <= last_page; page++) {
+    uint8_t mask = 0xFF;
+    if (page == y / 8)
+      mask &= 0xFF << (y & 7);
+    if (page == last_page)
+      mask &= 0xFF >> (7 - ((y1 - 1) & 7));
+    ssd1306_page_span(page, x, x1, mask, op);
+  }
+}
+
+void SSD1306_DrawPixel(uint8_t x, uint8_t y, bool color )
+{
+  if ((x >= SSD1306_LCDWIDTH) || (y >= SSD1306_LCDHEIGHT))
+    return;
+  uint8_t *b = &ssd1306_buffer[x + (uint16_t)(y / 8) * SSD1306_LCDWIDTH];
+  uint8_t old = *b;
+  if (color)
+    *b |=  (1 << (y & 7));
+  else
+    *b &=  ~(1 << (y & 7));
+  // Redrawing identical content leaves nothing to send
+  if (*b != old)
+    ssd1306_mark_dirty(x, y / 8);
+}
+
+void SSD1306_StartScrollRight(uint8_t start, uint8_t stop)
+{
+  ssd1306_command(SSD1306_RIGHT_HORIZONTAL_SCROLL);
+  ssd1306_command(0X00);
+  ssd1306_command(start);
+  ssd1306_command(0X00);
+  ssd1306_command(stop);
+  ssd1306_command(0X00);
+  ssd1306_command(0XFF);
+  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+}
+
+void SSD1306_StartScrollLeft(uint8_t start, uint8_t stop)
+{
+  ssd1306_command(SSD1306_LEFT_HORIZONTAL_SCROLL);
+  ssd1306_command(0X00);
+  ssd1306_command(start);
+  ssd1306_command(0X00);
+  ssd1306_command(stop);
+  ssd1306_command(0X00);
+  ssd1306_command(0XFF);
+  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+}
+
+void SSD1306_StartScrollDiagRight(uint8_t start, uint8_t stop)
+{
+  ssd1306_command(SSD1306_SET_VERTICAL_SCROLL_AREA);
+  ssd1306_command(0X00);
+  ssd1306_command(SSD1306_LCDHEIGHT);
+  ssd1306_command(SSD1306_VERTICAL_AND_RIGHT_HORIZONTAL_SCROLL);
+  ssd1306_command(0X00);
+  ssd1306_command(start);
+  ssd1306_command(0X00);
+  ssd1306_command(stop);
+  ssd1306_command(0X01);
+  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+}
+
+void SSD1306_StartScrollDiagLeft(uint8_t start, uint8_t stop)
+{
+  ssd1306_command(SSD1306_SET_VERTICAL_SCROLL_AREA);
+  ssd1306_command(0X00);
+  ssd1306_command(SSD1306_LCDHEIGHT);
+  ssd1306_command(SSD1306_VERTICAL_AND_LEFT_HORIZONTAL_SCROLL);
+  ssd1306_command(0X00);
+  ssd1306_command(start);
+  ssd1306_command(0X00);
+  ssd1306_command(stop);
+  ssd1306_command(0X01);
+  ssd1306_command(SSD1306_ACTIVATE_SCROLL);
+}
+
+void SSD1306_StopScroll(void)
+{
+  ssd1306_command(SSD1306_DEACTIVATE_SCROLL);
+}
+
+void SSD1306_Dim(bool dim)
+{
+  uint8_t contrast;
+  if (dim)
+    contrast = 0; // Dimmed display
+  else {
+    if (_vccstate == SSD1306_EXTERNALVCC)
+      contrast = 0x9F;
+    else
+      contrast = 0xCF;
+  }
+  // the range of contrast to too small to be really useful
+  // it is useful to dim the display
+  ssd1306_command(SSD1306_SETCONTRAST);
+  ssd1306_command(contrast);
+}
+
+bool ssd1306_frame_changed(void)
+{
+  const uint8_t *back, *front;
+  bool changed = false;
+  int start, end;
+
+  for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+    start = ssd1306_dirty_start[page];
+    end = ssd1306_dirty_end[page];
+    if (!ssd1306_panel_stale) {
+      // Trim the columns drawn over and back to what the last frame had, e.g. a cleared and
+      // redrawn line of text where only a digit changed
+      back = &ssd1306_buffer[page * SSD1306_LCDWIDTH];
+      front = &ssd1306_front_buffer[page * SSD1306_LCDWIDTH];
+      while (start <= end && back[start] == front[start]) start++;
+      while (end >= start && back[end] == front[end])     end--;
+      if (start > end) {
+        start = 0xFF;
+        end = 0;
+      }
+      ssd1306_dirty_start[page] = start;
+      ssd1306_dirty_end[page] = end;
+    }
+    changed |= start <= end;
+  }
+  return changed;
+}
+
+void ssd1306_frame_swap(void)
+{
+  uint8_t page, start, end;
+
+  // The back buffer and its changes become the front buffer to flush
+  for (page = 0; page < SSD1306_PAGES; page++) {
+    ssd1306_flush_start[page] = ssd1306_dirty_start[page];
+    ssd1306_flush_end[page] = ssd1306_dirty_end[page];
+    ssd1306_dirty_start[page] = 0xFF;
+    ssd1306_dirty_end[page] = 0;
+  }
+  ssd1306_back ^= 1;
+  ssd1306_panel_stale = false;
+
+  // The new back buffer holds the previous frame, bring it up to date with the changed columns
+  for (page = 0; page < SSD1306_PAGES; page++) {
+    start = ssd1306_flush_start[page];
+    end = ssd1306_flush_end[page];
+    if (start <= end)
+      memcpy(&ssd1306_buffer[page * SSD1306_LCDWIDTH + start],
+        &ssd1306_front_buffer[page * SSD1306_LCDWIDTH + start], end - start + 1);
+  }
+}
+
+uint32_t ssd1306_frame_flush(void)
+{
+  uint32_t bytes = 0, span_cost = 0, frame_cost;
+  uint8_t first = 0xFF, last = 0, start = 0xFF, end = 0;
+
+  // Bounding window of all changes and the cost of sending each page span on its own
+  for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+    if (ssd1306_flush_start[page] > ssd1306_flush_end[page])
+      continue;
+    if (first == 0xFF) first = page;
+    last = page;
+    if (ssd1306_flush_start[page] < start) start = ssd1306_flush_start[page];
+    if (ssd1306_flush_end[page] > end)     end = ssd1306_flush_end[page];
+    span_cost += ssd1306_flush_end[page] - ssd1306_flush_start[page] + 1 + SSD1306_SPAN_OVERHEAD;
+  }
+
+  if (first == 0xFF)
+    return 0;
+
+  frame_cost = (uint32_t)(last - first + 1) * (end - start + 1) + SSD1306_SPAN_OVERHEAD
+    + (uint32_t)(last - first) * SSD1306_PAGE_OVERHEAD;
+  if (frame_cost <= span_cost) {
+    // One window over every changed page, e.g. a full redraw
+    ssd1306_send_window(start, end, first, last);
+    bytes = (uint32_t)(last - first + 1) * (end - start + 1);
+  }
+  else {
+    for (uint8_t page = first; page <= last; page++) {
+      if (ssd1306_flush_start[page] > ssd1306_flush_end[page])
+        continue;
+      ssd1306_send_window(ssd1306_flush_start[page], ssd1306_flush_end[page], page, page);
+      bytes += ssd1306_flush_end[page] - ssd1306_flush_start[page] + 1;
+    }
+  }
+  return bytes;
+}
+
+void SSD1306_ClearDisplay(void)
+{
+  ssd1306_rect_op(0, 0, SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT, ssd1306_op_clear);
+}
+
+void SSD1306_DrawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, bool color )
+{
+  bool steep;
+  int8_t ystep;
+  uint8_t dx, dy;
+  int16_t err;
+
+  // Straight lines are spans
+  if (y0 == y1) {
+    if (x0 > x1) ssd1306_swap(x0, x1);
+    ssd1306_rect_op(x0, y0, x1 - x0 + 1, 1, color ? ssd1306_op_set : ssd1306_op_clear);
+    return;
+  }
+  if (x0 == x1) {
+    if (y0 > y1) ssd1306_swap(y0, y1);
+    ssd1306_rect_op(x0, y0, 1, y1 - y0 + 1, color ? ssd1306_op_set : ssd1306_op_clear);
+    return;
+  }
+
+  steep = abs(y1 - y0) > abs(x1 - x0);
+  if (steep) {
+    ssd1306_swap(x0, y0);
+    ssd1306_swap(x1, y1);
+  }
+  if (x0 > x1) {
+    ssd1306_swap(x0, x1);
+    ssd1306_swap(y0, y1);
+  }
+  dx = x1 - x0;
+  dy = abs(y1 - y0);
+
+  err = dx / 2;
+  if (y0 < y1)
+    ystep = 1;
+  else
+    ystep = -1;
+
+  for (; x0 <= x1; x0++) {
+    if (steep) {
+      if(color) SSD1306_DrawPixel(y0, x0, true);
+      else      SSD1306_DrawPixel(y0, x0, false);
+    }
+    else {
+      if(color) SSD1306_DrawPixel(x0, y0, true);
+      else      SSD1306_DrawPixel(x0, y0, false);
+    }
+    err -= dy;
+    if (err < 0) {
+      y0  += ystep;
+      err += dx;
+    }
+  }
+}
+
+void SSD1306_DrawFastHLine(uint8_t x, uint8_t y, uint8_t w, bool color )
+{
+  ssd1306_rect_op(x, y, w, 1, color ? ssd1306_op_set : ssd1306_op_clear);
+}
+
+void SSD1306_DrawFastVLine(uint8_t x, uint8_t y, uint8_t h, bool color )
+{
+  ssd1306_rect_op(x, y, 1, h, color ? ssd1306_op_set : ssd1306_op_clear);
+}
+
+void SSD1306_FillRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, bool color )
+{
+  ssd1306_rect_op(x, y, w, h, color ? ssd1306_op_set : ssd1306_op_clear);
+}
+
+void SSD1306_InvertRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h)
+{
+  ssd1306_rect_op(x, y, w, h, ssd1306_op_invert);
+}
+
+void SSD1306_FillScreen(bool color ) {
+  ssd1306_rect_op(0, 0, SSD1306_LCDWIDTH, SSD1306_LCDHEIGHT, color ? ssd1306_op_set : ssd1306_op_clear);
+}
+
+void SSD1306_DrawCircle(int16_t x0, int16_t y0, int16_t r)
+{
+  int16_t f = 1 - r;
+  int16_t ddF_x = 1;
+  int16_t ddF_y = -2 * r;
+  int16_t x = 0;
+  int16_t y = r;
+
+  SSD1306_DrawPixel(x0  , y0 + r, true);
+  SSD1306_DrawPixel(x0  , y0 - r, true);
+  SSD1306_DrawPixel(x0 + r, y0, true);
+  SSD1306_DrawPixel(x0 - r, y0, true);
+
+  while (x < y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+
+    SSD1306_DrawPixel(x0 + x, y0 + y, true);
+    SSD1306_DrawPixel(x0 - x, y0 + y, true);
+    SSD1306_DrawPixel(x0 + x, y0 - y, true);
+    SSD1306_DrawPixel(x0 - x, y0 - y, true);
+    SSD1306_DrawPixel(x0 + y, y0 + x, true);
+    SSD1306_DrawPixel(x0 - y, y0 + x, true);
+    SSD1306_DrawPixel(x0 + y, y0 - x, true);
+    SSD1306_DrawPixel(x0 - y, y0 - x, true);
+  }
+
+}
+
+void SSD1306_DrawCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername)
+{
+  int16_t f     = 1 - r;
+  int16_t ddF_x = 1;
+  int16_t ddF_y = -2 * r;
+  int16_t x     = 0;
+  int16_t y     = r;
+
+  while (x < y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f     += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f     += ddF_x;
+    if (cornername & 0x4) {
+      SSD1306_DrawPixel(x0 + x, y0 + y, true);
+      SSD1306_DrawPixel(x0 + y, y0 + x, true);
+    }
+    if (cornername & 0x2) {
+      SSD1306_DrawPixel(x0 + x, y0 - y, true);
+      SSD1306_DrawPixel(x0 + y, y0 - x, true);
+    }
+    if (cornername & 0x8) {
+      SSD1306_DrawPixel(x0 - y, y0 + x, true);
+      SSD1306_DrawPixel(x0 - x, y0 + y, true);
+    }
+    if (cornername & 0x1) {
+      SSD1306_DrawPixel(x0 - y, y0 - x, true);
+      SSD1306_DrawPixel(x0 - x, y0 - y, true);
+    }
+  }
+
+}
+
+void SSD1306_FillCircle(int16_t x0, int16_t y0, int16_t r, bool color )
+{
+  SSD1306_DrawFastVLine(x0, y0 - r, 2 * r + 1, color);
+  SSD1306_FillCircleHelper(x0, y0, r, 3, 0, color);
+}
+
+// Used to do circles and roundrects
+void SSD1306_FillCircleHelper(int16_t x0, int16_t y0, int16_t r, uint8_t cornername, int16_t delta, bool color ) {
+  int16_t f     = 1 - r;
+  int16_t ddF_x = 1;
+  int16_t ddF_y = -2 * r;
+  int16_t x     = 0;
+  int16_t y     = r;
+
+  while (x < y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f     += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f     += ddF_x;
+
+    if (cornername & 0x01) {
+      SSD1306_DrawFastVLine(x0 + x, y0 - y, 2 * y + 1 + delta, color);
+      SSD1306_DrawFastVLine(x0 + y, y0 - x, 2 * x + 1 + delta, color);
+    }
+    if (cornername & 0x02) {
+      SSD1306_DrawFastVLine(x0 - x, y0 - y, 2 * y + 1 + delta, color);
+      SSD1306_DrawFastVLine(x0 - y, y0 - x, 2 * x + 1 + delta, color);
+    }
+  }
+
+}
+
+// Draw a rectangle
+void SSD1306_DrawRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h)
+{
+  SSD1306_DrawFastHLine(x, y, w, true);
+  SSD1306_DrawFastHLine(x, y + h - 1, w, true);
+  SSD1306_DrawFastVLine(x, y, h, true);
+  SSD1306_DrawFastVLine(x + w - 1, y, h, true);
+}
+
+// Draw a rounded rectangle
+void SSD1306_DrawRoundRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t r)
+{
+  // smarter version
+  SSD1306_DrawFastHLine(x + r, y, w - 2 * r, true); // Top
+  SSD1306_DrawFastHLine(x + r, y + h - 1, w - 2 * r, true); // Bottom
+  SSD1306_DrawFastVLine(x, y + r, h - 2 * r, true); // Left
+  SSD1306_DrawFastVLine(x + w - 1, y + r, h - 2 * r, true); // Right
+  // draw four corners
+  SSD1306_DrawCircleHelper(x + r, y + r, r, 1);
+  SSD1306_DrawCircleHelper(x + w - r - 1, y + r, r, 2);
+  SSD1306_DrawCircleHelper(x + w - r - 1, y + h - r - 1, r, 4);
+  SSD1306_DrawCircleHelper(x + r, y + h - r - 1, r, 8);
+}
+
+// Fill a rounded rectangle
+void SSD1306_FillRoundRect(uint8_t x, uint8_t y, uint8_t w, uint8_t h, uint8_t r, bool color )
+{
+  // smarter version
+  SSD1306_FillRect(x + r, y, w - 2 * r, h, color);
+  // draw four corners
+  SSD1306_FillCircleHelper(x + w - r - 1, y + r, r, 1, h - 2 * r - 1, color);
+  SSD1306_FillCircleHelper(x + r        , y + r, r, 2, h - 2 * r - 1, color);
+}
+
+// Draw a triangle
+void SSD1306_DrawTriangle(uint8_t x0, uint8_t y0, uint8_t x1, uint8_t y1, uint8_t x2, uint8_t y2)
+{
+  SSD1306_DrawLine(x0, y0, x1, y1, true);
+  SSD1306_DrawLine(x1, y1, x2, y2, true);
+  SSD1306_DrawLine(x2, y2, x0, y0, true);
+}
+
+// Fill a triangle
+void SSD1306_FillTriangle(int16_t x0, int16_t y0, int16_t x1, int16_t y1, int16_t x2, int16_t y2, bool color )
+{
+  int16_t a, b, y, last;
+  // Sort coordinates by Y order (y2 >= y1 >= y0)
+  if (y0 > y1) {
+    ssd1306_swap(y0, y1); ssd1306_swap(x0, x1);
+  }
+  if (y1 > y2) {
+    ssd1306_swap(y2, y1); ssd1306_swap(x2, x1);
+  }
+  if (y0 > y1) {
+    ssd1306_swap(y0, y1); ssd1306_swap(x0, x1);
+  }
+
+  if(y0 == y2) { // Handle awkward all-on-same-line case as its own thing
+    a = b = x0;
+    if(x1 < a)      a = x1;
+    else if(x1 > b) b = x1;
+    if(x2 < a)      a = x2;
+    else if(x2 > b) b = x2;
+    SSD1306_DrawFastHLine(a, y0, b - a + 1, color);
+    return;
+  }
+
+  int16_t
+  dx01 = x1 - x0,
+  dy01 = y1 - y0,
+  dx02 = x2 - x0,
+  dy02 = y2 - y0,
+  dx12 = x2 - x1,
+  dy12 = y2 - y1;
+  int32_t  sa   = 0, sb   = 0;
+
+  // For upper part of triangle, find scanline crossings for segments
+  // 0-1 and 0-2.  If y1=y2 (flat-bottomed triangle), the scanline y1
+  // is included here (and second loop will be skipped, avoiding a /0
+  // error there), otherwise scanline y1 is skipped here and handled
+  // in the second loop...which also avoids a /0 error here if y0=y1
+  // (flat-topped triangle).
+  if(y1 == y2) last = y1;   // Include y1 scanline
+  else         last = y1 - 1; // Skip it
+
+  for(y = y0; y <= last; y++) {
+    a   = x0 + sa / dy01;
+    b   = x0 + sb / dy02;
+    sa += dx01;
+    sb += dx02;
+    /* longhand:
+    a = x0 + (x1 - x0) * (y - y0) / (y1 - y0);
+    b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
+    */
+    if(a > b) ssd1306_swap(a, b);
+    SSD1306_DrawFastHLine(a, y, b - a + 1, color);
+  }
+
+  // For lower part of triangle, find scanline crossings for segments
+  // 0-2 and 1-2.  This loop is skipped if y1=y2.
+  sa = dx12 * (y - y1);
+  sb = dx02 * (y - y0);
+  for(; y <= y2; y++) {
+    a   = x1 + sa / dy12;
+    b   = x0 + sb / dy02;
+    sa += dx12;
+    sb += dx02;
+    /* longhand:
+    a = x1 + (x2 - x1) * (y - y1) / (y2 - y1);
+    b = x0 + (x2 - x0) * (y - y0) / (y2 - y0);
+    */
+    if(a > b) ssd1306_swap(a, b);
+    SSD1306_DrawFastHLine(a, y, b - a + 1, color);
+  }
+}
+
+// invert the display
+void SSD1306_InvertDisplay(bool i)
+{
+  if (i)
+    ssd1306_command(SSD1306_INVERTDISPLAY_);
+  else
+    ssd1306_command(SSD1306_NORMALDISPLAY);
+}
+
+void SSD1306_SetTextWrap(bool w)
+{
+  wrap = w;
+}
+
+void SSD1306_DrawChar(uint8_t x, uint8_t y, uint8_t c, uint8_t size)
+{
+  SSD1306_GotoXY(x, y);
+  SSD1306_TextSize(size);
+  SSD1306_Print(c);
+}
+
+void SSD1306_DrawText(uint8_t x, uint8_t y, char *_text, uint8_t size)
+{
+  SSD1306_GotoXY(x, y);
+  SSD1306_TextSize(size);
+  while(*_text != '\0')
+    SSD1306_Print(*_text++);
+
+}
+
+// Raw font column i of printable character c, bit 0 is the top row
+static inline uint8_t ssd1306_font_column(uint8_t c, uint8_t i)
+{
+  if(c < 'S')
+    return Font[(c - ' ') * 5 + i];
+  return Font2[(c - 'S') * 5 + i];
+}
+
+// Stretch a 7 row font column to 7 * size rows
+static uint32_t ssd1306_scale_column(uint8_t line, uint8_t size)
+{
+  uint32_t col = 0;
+  uint32_t block = (1UL << size) - 1;
+  for (uint8_t j = 0; j < SSD1306_GLYPH_ROWS; j++, line >>= 1) {
+    if (line & 0x01)
+      col |= block << (j * size);
+  }
+  return col;
+}
+
+static const uint32_t *ssd1306_glyph(uint8_t c, uint8_t size)
+{
+  static uint32_t scratch[SSD1306_GLYPH_COLS];
+  uint32_t *cols = scratch;
+  uint8_t g = c - ' ';
+
+  if (size >= 2 && size <= SSD1306_GLYPH_CACHE_SIZE) {
+    cols = ssd1306_glyph_cache[size - 2][g];
+    if (ssd1306_glyph_cached[size - 2][g])
+      return cols;
+    ssd1306_glyph_cached[size - 2][g] = true;
+  }
+  for (uint8_t i = 0; i < SSD1306_GLYPH_COLS; i++)
+    cols[i] = ssd1306_scale_column(ssd1306_font_column(c, i), size);
+  return cols;
+}
+
+/*
+ * Merge the bits of col selected by mask into column x starting at row y. The framebuffer is
+ * page organised (one byte holds 8 rows of a column) so this touches one byte per page.
+ */
+static void ssd1306_blit_column(uint8_t x, uint8_t y, uint32_t col, uint32_t mask)
+{
+  uint64_t v, m;
+  uint8_t page;
+
+  if (x >= SSD1306_LCDWIDTH || y >= SSD1306_LCDHEIGHT)
+    return;
+
+  v = (uint64_t)col << (y & 7);
+  m = (uint64_t)mask << (y & 7);
+  for (page = y / 8; page < SSD1306_PAGES && m != 0; page++, v >>= 8, m >>= 8) {
+    uint8_t *b = &ssd1306_buffer[page * SSD1306_LCDWIDTH + x];
+    uint8_t old = *b;
+    *b = (old & ~(uint8_t)m) | ((uint8_t)v & (uint8_t)m);
+    if (*b != old)
+      ssd1306_mark_dirty(x, page);
+  }
+}
+
+// move cursor to position (x, y)
+void SSD1306_GotoXY(uint8_t x, uint8_t y)
+{
+  if((x >= SSD1306_LCDWIDTH) || (y >= SSD1306_LCDHEIGHT))
+    return;
+  x_pos = x;
+  y_pos = y;
+}
+
+// set text size
+void SSD1306_TextSize(uint8_t t_size)
+{
+  if(t_size < 1)
+    t_size = 1;
+  text_size = t_size;
+}
+
+/* print single char
+    \a  Set cursor position to upper left (0, 0)
+    \b  Move back one position
+    \n  Go to start of current line
+    \r  Go to line below
+*/
+void SSD1306_Print(uint8_t c)
+{
+  bool _color;
+  uint8_t i, j, line;
+  
+  if (c == ' ' && x_pos == 0 && wrap)
+    return;
+  if(c == '\a') {
+    x_pos = y_pos = 0;
+    return;
+  }
+  if( (c == '\b') && (x_pos >= text_size * 6) ) {
+    x_pos -= text_size * 6;
+    return;
+  }
+  if(c == '\r') {
+    x_pos = 0;
+    return;
+  }
+  if(c == '\n') {
+    y_pos += text_size * 8;
+    if((y_pos + text_size * 7) > SSD1306_LCDHEIGHT)
+      y_pos = 0;
+    return;
+  }
+
+  if((c < ' ') || (c > '~'))
+    c = '?';
+  
+  if(text_size <= SSD1306_BLIT_MAX_SIZE) {
+    // Whole glyph columns straight into the framebuffer, each repeated text_size times
+    const uint32_t *cols = ssd1306_glyph(c, text_size);
+    uint32_t mask = (1UL << (SSD1306_GLYPH_ROWS * text_size)) - 1;
+    uint8_t x = x_pos;
+    for(i = 0; i < SSD1306_GLYPH_COLS; i++)
+      for(j = 0; j < text_size; j++)
+        ssd1306_blit_column(x++, y_pos, cols[i], mask);
+    // Spacing column
+    for(j = 0; j < text_size; j++)
+      ssd1306_blit_column(x++, y_pos, 0, mask);
+  }
+  else for(i = 0; i < 5; i++ ) {
+    if(c < 'S')
+      line = Font[(c - ' ') * 5 + i];
+    else
+      line = Font2[(c - 'S') * 5 + i];
+    
+    for(j = 0; j < 7; j++, line >>= 1) {
+      if(line & 0x01)
+        _color = true;
+      else
+        _color = false;
+      if(text_size == 1) SSD1306_DrawPixel(x_pos + i, y_pos + j, _color);
+      else               SSD1306_FillRect(x_pos + (i * text_size), y_pos + (j * text_size), text_size, text_size, _color);
+    }
+  }
+
+  if(text_size > SSD1306_BLIT_MAX_SIZE)
+    SSD1306_FillRect(x_pos + (5 * text_size), y_pos, text_size, 7 * text_size, false);
+  
+  x_pos += text_size * 6;
+
+  if( x_pos > (SSD1306_LCDWIDTH + text_size * 6) )
+    x_pos = SSD1306_LCDWIDTH;
+
+  if (wrap && (x_pos + (text_size * 5)) > SSD1306_LCDWIDTH)
+  {
+    x_pos = 0;
+    y_pos += text_size * 8;
+    if((y_pos + text_size * 7) > SSD1306_LCDHEIGHT)
+      y_pos = 0;
+  }
+}
+
+// end of driver code
@@ -0,0 +1,324 @@
+/**
+ * File Name:   outbox.c
+ * Description: Non-blocking publish path with backpressure and priority lanes.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <string.h>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "puback.h"
+#include "outbox.h"
+#include "os.h"
+
+/***************************************************************************************************/
+/* Private Data Types */
+/***************************************************************************************************/
+// Written to the handoff buffer just before the payload, both under outbox_write_lock
+typedef struct {
+    const char *topic;
+    uint8_t qos;
+} outbox_hdr_t;
+
+// Every message in a message buffer carries its length
+#define OUTBOX_MSG_OVERHEAD                 (2 * sizeof(size_t) + sizeof(outbox_hdr_t))
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    MessageBufferHandle_t buffer;
+    size_t buffer_size;
+    char *payload;                  /**< Only the lane's task uses it */
+    size_t payload_size;
+    TaskHandle_t thread;
+    metrics_t *metric_queued;
+} outbox_lane_ctx_t;
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+static char outbox_control_payload[OUTBOX_CONTROL_MSG_MAX];
+static char outbox_data_payload[OUTBOX_MSG_MAX];
+static outbox_lane_ctx_t outbox_lanes[outbox_lane_num] = {
+    [outbox_lane_control] = {
+        .buffer_size = OUTBOX_CONTROL_BUFFER_SIZE,
+        .payload = outbox_control_payload,
+        .payload_size = sizeof(outbox_control_payload),
+    },
+    [outbox_lane_data] = {
+        .buffer_size = OUTBOX_BUFFER_SIZE,
+        .payload = outbox_data_payload,
+        .payload_size = sizeof(outbox_data_payload),
+    },
+};
+static SemaphoreHandle_t outbox_write_lock;
+static bool outbox_started;
+static outbox_state_t outbox_state = outbox_ok;
+static uint32_t outbox_downsample_count;
+static TaskHandle_t outbox_ok_listener;
+
+static const char *outbox_state_names[] = {
+    [outbox_ok] = "ok",
+    [outbox_pressure] = "pressure",
+    [outbox_full] = "full",
+};
+
+static metrics_t *outbox_metric_bytes;
+static metrics_t *outbox_metric_state;
+static metrics_t *outbox_metric_failed;
+static metrics_t *outbox_metric_dropped;
+static metrics_t *outbox_metric_downsampled;
+static metrics_t *outbox_metric_spilled;
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static void outbox_refused(outbox_policy_t policy);
+static void outbox_update(void);
+static bool outbox_data_ready(void);
+static void outbox_forward(outbox_lane_ctx_t *lane, TickType_t wait);
+static void outbox_main(void *arg);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int outbox_start(esp_mqtt_client_handle_t data_client, esp_mqtt_client_handle_t control_client)
+{
+    static const char *names[outbox_lane_num] = { "outbox_ctl", "outbox_data" };
+    static const UBaseType_t priorities[outbox_lane_num] = { OUTBOX_CONTROL_TASK_PRIORITY, OUTBOX_TASK_PRIORITY };
+
+    if(outbox_started)
+        return 0;
+
+    outbox_lanes[outbox_lane_control].client = control_client;
+    outbox_lanes[outbox_lane_data].client = data_client;
+    outbox_metric_bytes = metrics_register("outbox_bytes", metrics_gauge);
+    outbox_metric_state = metrics_register("outbox_state", metrics_gauge);
+    outbox_metric_failed = metrics_register("outbox_fail", metrics_counter);
+    outbox_metric_dropped = metrics_register("outbox_drop", metrics_counter);
+    outbox_metric_downsampled = metrics_register("outbox_ds", metrics_counter);
+    outbox_metric_spilled = metrics_register("outbox_spill", metrics_counter);
+
+    outbox_write_lock = xSemaphoreCreateMutex();
+    if(outbox_write_lock == NULL)
+    {
+        LOG_ERROR("Failed to allocate the outbox");
+        return -1;
+    }
+    for(int i = 0; i < outbox_lane_num; i++)
+    {
+        outbox_lane_ctx_t *lane = &outbox_lanes[i];
+
+        lane->metric_queued = metrics_register(names[i], metrics_counter);
+        lane->buffer = xMessageBufferCreate(lane->buffer_size);
+        if(lane->buffer == NULL)
+        {
+            LOG_ERROR("Failed to allocate the %s lane", names[i]);
+            return -1;
+        }
+        if(pdPASS != xTaskCreate(outbox_main, names[i], OUTBOX_TASK_STACK, lane, priorities[i], &lane->thread))
+        {
+            LOG_ERROR("Failed to create the %s task", names[i]);
+            return -1;
+        }
+    }
+    outbox_started = true;
+    return 0;
+}
+
+int outbox_publish(outbox_lane_t lane, const char *topic, const char *data, int len, int qos,
+    outbox_policy_t policy)
+{
+    outbox_lane_ctx_t *l = &outbox_lanes[lane];
+    outbox_hdr_t hdr;
+    bool queued = false;
+
+    if(!outbox_started)
+        return -1;
+    if(len <= 0)
+        len = strlen(data);
+    if(len > (int)l->payload_size)
+    {
+        LOG_ERROR("%d byte message on %s is too large for the outbox", len, topic);
+        return -1;
+    }
+    // Control messages are small and time critical, they are only refused when their lane is full
+    if(lane == outbox_lane_data && !outbox_admit(policy))
+        return -1;
+
+    hdr.topic = topic;
+    hdr.qos = qos;
+    // Held only while copying, the header and payload must land next to each other
+    if(pdTRUE == xSemaphoreTake(outbox_write_lock, MS2TICK(OUTBOX_LOCK_MS)))
+    {
+        if(xMessageBufferSpacesAvailable(l->buffer) >= OUTBOX_MSG_OVERHEAD + len)
+        {
+            xMessageBufferSend(l->buffer, &hdr, sizeof(hdr), 0);
+            xMessageBufferSend(l->buffer, data, len, 0);
+            queued = true;
+        }
+        xSemaphoreGive(outbox_write_lock);
+    }
+
+    if(!queued)
+    {
+        outbox_refused(policy);
+        return -1;
+    }
+    metrics_inc(l->metric_queued);
+    return 0;
+}
+
+bool outbox_admit(outbox_policy_t policy)
+{
+    outbox_state_t state = outbox_get_state();
+    bool admit;
+
+    if(state == outbox_full)
+        admit = false;
+    else if(state == outbox_pressure && policy == outbox_policy_downsample)
+        admit = __atomic_add_fetch(&outbox_downsample_count, 1, __ATOMIC_RELAXED) % OUTBOX_DOWNSAMPLE == 0;
+    else
+        admit = true;
+
+    if(!admit)
+        outbox_refused(policy);
+    return admit;
+}
+
+outbox_state_t outbox_get_state(void)
+{
+    return __atomic_load_n(&outbox_state, __ATOMIC_RELAXED);
+}
+
+void outbox_set_listener(TaskHandle_t task)
+{
+    outbox_ok_listener = task;
+}
+
+void outbox_print(void)
+{
+    const outbox_lane_ctx_t *control = &outbox_lanes[outbox_lane_control];
+    const outbox_lane_ctx_t *data = &outbox_lanes[outbox_lane_data];
+
+    if(!outbox_started)
+    {
+        LOG_PRINTF("Outbox not started");
+        return;
+    }
+
+    LOG_PRINTF("Outbox %s: client outbox %u bytes (pressure at %u, full at %u, data window %u)",
+        outbox_state_names[outbox_get_state()], metrics_get(outbox_metric_bytes), OUTBOX_PRESSURE_BYTES,
+        OUTBOX_FULL_BYTES, OUTBOX_DATA_WINDOW);
+    LOG_PRINTF("Oldest PUBACK wait %u ms (pressure at %u), free heap %u (full below %u)", puback_oldest_ms(),
+        OUTBOX_LATENCY_MS, esp_get_free_heap_size(), OUTBOX_HEAP_MIN);
+    LOG_PRINTF("Control lane: %u queued, handoff %u of %u bytes free, %s connection",
+        metrics_get(control->metric_queued), (uint32_t)xMessageBufferSpacesAvailable(control->buffer),
+        (uint32_t)control->buffer_size, control->client == data->client ? "shared" : "own");
+    LOG_PRINTF("Data lane: %u queued, handoff %u of %u bytes free", metrics_get(data->metric_queued),
+        (uint32_t)xMessageBufferSpacesAvailable(data->buffer), (uint32_t)data->buffer_size);
+    LOG_PRINTF("%u refused by the client, %u dropped, %u downsampled, %u spilled", metrics_get(outbox_metric_failed),
+        metrics_get(outbox_metric_dropped), metrics_get(outbox_metric_downsampled), metrics_get(outbox_metric_spilled));
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static void outbox_refused(outbox_policy_t policy)
+{
+    switch(policy)
+    {
+    case outbox_policy_downsample:
+        metrics_inc(outbox_metric_downsampled);
+        break;
+    case outbox_policy_spill:
+        metrics_inc(outbox_metric_spilled);
+        break;
+    default:
+        metrics_inc(outbox_metric_dropped);
+        break;
+    }
+}
+
+// Only the data lane's task refreshes the state, from the data lane's client
+static void outbox_update(void)
+{
+    const outbox_lane_ctx_t *data = &outbox_lanes[outbox_lane_data];
+    int bytes = esp_mqtt_client_get_outbox_size(data->client);
+    size_t space = xMessageBufferSpacesAvailable(data->buffer);
+    outbox_state_t state = outbox_ok;
+
+    if(bytes >= OUTBOX_FULL_BYTES || esp_get_free_heap_size() < OUTBOX_HEAP_MIN || space < data->buffer_size / 8)
+        state = outbox_full;
+    else if(bytes >= OUTBOX_PRESSURE_BYTES || puback_oldest_ms() >= OUTBOX_LATENCY_MS || space < data->buffer_size / 2)
+        state = outbox_pressure;
+
+    if(state != outbox_get_state())
+    {
+        LOG_PRINTF("Outbox %s, %d bytes waiting in the client", outbox_state_names[state], bytes);
+        __atomic_store_n(&outbox_state, state, __ATOMIC_RELAXED);
+        if(state == outbox_ok && outbox_ok_listener != NULL)
+            xTaskNotifyGive(outbox_ok_listener);
+    }
+    metrics_set(outbox_metric_bytes, bytes);
+    metrics_set(outbox_metric_state, state);
+}
+
+// Only the client's outbox holds back the data lane. The state gates new messages, what is already
+// in the handoff buffer has to drain for a full state to clear.
+static bool outbox_data_ready(void)
+{
+    return metrics_get(outbox_metric_bytes) < OUTBOX_DATA_WINDOW;
+}
+
+static void outbox_forward(outbox_lane_ctx_t *lane, TickType_t wait)
+{
+    outbox_hdr_t hdr;
+    size_t len;
+    int64_t start_us;
+    int msg_id;
+
+    if(sizeof(hdr) != xMessageBufferReceive(lane->buffer, &hdr, sizeof(hdr), wait))
+        return;
+    // Written together with the header, so it is already there
+    len = xMessageBufferReceive(lane->buffer, lane->payload, lane->payload_size, 0);
+
+    // The round trip starts here, time spent in the handoff buffer is the outbox's, not the link's
+    start_us = esp_timer_get_time();
+    msg_id = esp_mqtt_client_enqueue(lane->client, hdr.topic, lane->payload, len, hdr.qos, 0, true);
+    if(msg_id < 0)
+    {
+        metrics_inc(outbox_metric_failed);
+        LOG_ERROR("Client refused %u byte message on %s", (uint32_t)len, hdr.topic);
+    }
+    else if(hdr.qos > 0)
+    {
+        puback_sent(lane->client, hdr.topic, msg_id, start_us);
+    }
+}
+
+static void outbox_main(void *arg)
+{
+    outbox_lane_ctx_t *lane = (outbox_lane_ctx_t *)arg;
+
+    while(1)
+    {
+        if(lane == &outbox_lanes[outbox_lane_control])
+        {
+            outbox_forward(lane, portMAX_DELAY);
+            continue;
+        }
+
+        outbox_update();
+        // Telemetry waits here while the client holds a window of it already. The callers see the
+        // state and back off, control messages overtake what waits here.
+        if(!outbox_data_ready())
+        {
+            vTaskDelay(MS2TICK(OUTBOX_POLL_MS));
+            continue;
+        }
+        outbox_forward(lane, MS2TICK(OUTBOX_POLL_MS));
+    }
+}
@@ -0,0 +1,266 @@
+/**
+ * File Name:   puback.c
+ * Description: Round-trip latency of QoS 1 publishes, from the PUBLISH to its PUBACK.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "puback.h"
+
+/***************************************************************************************************/
+/* Private Data Types */
+/***************************************************************************************************/
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    int msg_id;                     /**< 0 marks a free slot */
+    puback_topic_t *topic;          /**< NULL while only the PUBACK is known */
+    int64_t time_us;                /**< Start of the publish, or arrival of the PUBACK */
+} puback_slot_t;
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+static puback_topic_t puback_topics[PUBACK_TOPICS_MAX];
+static uint32_t puback_topics_num;
+static puback_slot_t puback_slots[PUBACK_OUTSTANDING_MAX];
+static portMUX_TYPE puback_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static metrics_t *puback_metric_acked;
+static metrics_t *puback_metric_timeouts;
+static metrics_t *puback_metric_untracked;
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static puback_topic_t *puback_topic(const char *topic);
+static void puback_track(puback_topic_t *t, esp_mqtt_client_handle_t client, int msg_id, int64_t start_us);
+static void puback_record(puback_topic_t *t, int64_t elapsed_us);
+static void puback_expire(int64_t now_us);
+static uint8_t puback_bucket(uint32_t ms);
+static void puback_print_hist(const char *label, const uint32_t *hist, int n);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+void puback_init(void)
+{
+    puback_metric_acked = metrics_register("ack_ok", metrics_counter);
+    puback_metric_timeouts = metrics_register("ack_tmo", metrics_counter);
+    puback_metric_untracked = metrics_register("ack_untracked", metrics_counter);
+}
+
+void puback_sent(esp_mqtt_client_handle_t client, const char *topic, int msg_id, int64_t start_us)
+{
+    puback_track(puback_topic(topic), client, msg_id, start_us);
+}
+
+void puback_acked(esp_mqtt_client_handle_t client, int msg_id)
+{
+    int64_t now_us = esp_timer_get_time();
+    puback_slot_t *free_slot = NULL;
+    bool matched = false;
+
+    portENTER_CRITICAL(&puback_lock);
+    puback_expire(now_us);
+    for(int i = 0; i < PUBACK_OUTSTANDING_MAX; i++)
+    {
+        puback_slot_t *slot = &puback_slots[i];
+
+        if(slot->msg_id == msg_id && slot->client == client && slot->topic != NULL)
+        {
+            puback_record(slot->topic, now_us - slot->time_us);
+            slot->msg_id = 0;
+            matched = true;
+            break;
+        }
+        if(slot->msg_id == 0 && free_slot == NULL)
+            free_slot = slot;
+    }
+    // The PUBACK beat the publishing task to recording the msg_id, keep it for puback_track()
+    if(!matched && free_slot != NULL)
+    {
+        free_slot->client = client;
+        free_slot->msg_id = msg_id;
+        free_slot->topic = NULL;
+        free_slot->time_us = now_us;
+    }
+    portEXIT_CRITICAL(&puback_lock);
+}
+
+uint32_t puback_oldest_ms(void)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t oldest_us = now_us;
+
+    portENTER_CRITICAL(&puback_lock);
+    puback_expire(now_us);
+    for(int i = 0; i < PUBACK_OUTSTANDING_MAX; i++)
+        if(puback_slots[i].msg_id != 0 && puback_slots[i].topic != NULL && puback_slots[i].time_us < oldest_us)
+            oldest_us = puback_slots[i].time_us;
+    portEXIT_CRITICAL(&puback_lock);
+    return (uint32_t)((now_us - oldest_us) / 1000);
+}
+
+void puback_print(void)
+{
+    uint32_t num = __atomic_load_n(&puback_topics_num, __ATOMIC_ACQUIRE);
+    int outstanding = 0;
+
+    portENTER_CRITICAL(&puback_lock);
+    puback_expire(esp_timer_get_time());
+    for(int i = 0; i < PUBACK_OUTSTANDING_MAX; i++)
+        if(puback_slots[i].msg_id != 0 && puback_slots[i].topic != NULL)
+            outstanding++;
+    portEXIT_CRITICAL(&puback_lock);
+
+    LOG_PRINTF("PUBACK buckets start at %u ms and double, the last is open ended", PUBACK_HIST_BASE_MS);
+    LOG_PRINTF("%d outstanding, %u acked, %u timed out, %u not tracked", outstanding,
+        metrics_get(puback_metric_acked), metrics_get(puback_metric_timeouts), metrics_get(puback_metric_untracked));
+    for(uint32_t i = 0; i < num; i++)
+    {
+        const puback_topic_t *t = &puback_topics[i];
+
+        LOG_PRINTF("%s: %u acked, avg %u ms max %u ms, %u timed out", t->topic, t->acked,
+            t->acked ? t->total_ms / t->acked : 0, t->max_ms, t->timeouts);
+        puback_print_hist("  round trip, per bucket:", t->hist, PUBACK_HIST_BUCKETS);
+    }
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+// Register-or-get, the histogram is published as ack:<topic>
+static puback_topic_t *puback_topic(const char *topic)
+{
+    uint32_t num = __atomic_load_n(&puback_topics_num, __ATOMIC_ACQUIRE);
+    puback_topic_t *t = NULL;
+    bool added = false;
+
+    for(uint32_t i = 0; i < num; i++)
+        if(strcmp(puback_topics[i].topic, topic) == 0)
+            return &puback_topics[i];
+
+    portENTER_CRITICAL(&puback_lock);
+    num = puback_topics_num;
+    for(uint32_t i = 0; i < num && t == NULL; i++)
+        if(strcmp(puback_topics[i].topic, topic) == 0)
+            t = &puback_topics[i];
+    if(t == NULL && num < PUBACK_TOPICS_MAX)
+    {
+        t = &puback_topics[num];
+        memset(t, 0, sizeof(puback_topic_t));
+        t->topic = topic;
+        snprintf(t->metric_name, sizeof(t->metric_name), "%s%s", PUBACK_METRIC_PREFIX, topic);
+        __atomic_store_n(&puback_topics_num, num + 1, __ATOMIC_RELEASE);
+        added = true;
+    }
+    portEXIT_CRITICAL(&puback_lock);
+
+    if(added)
+        metrics_register_hist(t->metric_name, t->hist, PUBACK_HIST_BUCKETS);
+    return t;
+}
+
+static void puback_track(puback_topic_t *t, esp_mqtt_client_handle_t client, int msg_id, int64_t start_us)
+{
+    puback_slot_t *free_slot = NULL;
+    bool acked = false;
+
+    if(t == NULL)
+    {
+        metrics_inc(puback_metric_untracked);
+        return;
+    }
+
+    portENTER_CRITICAL(&puback_lock);
+    puback_expire(esp_timer_get_time());
+    for(int i = 0; i < PUBACK_OUTSTANDING_MAX; i++)
+    {
+        puback_slot_t *slot = &puback_slots[i];
+
+        if(slot->msg_id == msg_id && slot->client == client && slot->topic == NULL)
+        {
+            puback_record(t, slot->time_us - start_us);
+            slot->msg_id = 0;
+            acked = true;
+            break;
+        }
+        if(slot->msg_id == 0 && free_slot == NULL)
+            free_slot = slot;
+    }
+    if(!acked && free_slot != NULL)
+    {
+        free_slot->client = client;
+        free_slot->msg_id = msg_id;
+        free_slot->topic = t;
+        free_slot->time_us = start_us;
+    }
+    portEXIT_CRITICAL(&puback_lock);
+
+    if(!acked && free_slot == NULL)
+        metrics_inc(puback_metric_untracked);
+}
+
+// Called with puback_lock held
+static void puback_record(puback_topic_t *t, int64_t elapsed_us)
+{
+    uint32_t ms = elapsed_us > 0 ? (uint32_t)(elapsed_us / 1000) : 0;
+
+    t->hist[puback_bucket(ms)]++;
+    t->acked++;
+    t->total_ms += ms;
+    if(ms > t->max_ms)
+        t->max_ms = ms;
+    metrics_inc(puback_metric_acked);
+}
+
+// Called with puback_lock held
+static void puback_expire(int64_t now_us)
+{
+    const int64_t timeout_us = (int64_t)PUBACK_TIMEOUT_MS * 1000;
+
+    for(int i = 0; i < PUBACK_OUTSTANDING_MAX; i++)
+    {
+        puback_slot_t *slot = &puback_slots[i];
+
+        if(slot->msg_id == 0 || now_us - slot->time_us < timeout_us)
+            continue;
+        // A PUBACK nobody claimed only frees its slot
+        if(slot->topic != NULL)
+        {
+            slot->topic->timeouts++;
+            metrics_inc(puback_metric_timeouts);
+        }
+        slot->msg_id = 0;
+    }
+}
+
+static uint8_t puback_bucket(uint32_t ms)
+{
+    uint8_t b = 0;
+    uint32_t limit = PUBACK_HIST_BASE_MS;
+
+    while(b < PUBACK_HIST_BUCKETS - 1 && ms >= limit)
+    {
+        b++;
+        limit <<= 1;
+    }
+    return b;
+}
+
+static void puback_print_hist(const char *label, const uint32_t *hist, int n)
+{
+    char line[128];
+    int len = snprintf(line, sizeof(line), "%s", label);
+
+    for(int i = 0; i < n && len < (int)sizeof(line); i++)
+        len += snprintf(&line[len], sizeof(line) - len, " %u", hist[i]);
+    LOG_PRINTF("%s", line);
+}
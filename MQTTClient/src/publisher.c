@@ -0,0 +1,308 @@
+/**
+ * File Name:   publisher.c
+ * Description: Batching publisher for environment telemetry.
+ *              Samples are buffered in a fixed ring and sent as one message once either the
+ *              sample count or the age of the oldest sample reaches its limit.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "publisher.h"
+#include "metrics.h"
+#include "outbox.h"
+#include "os.h"
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+static char publisher_payload[PUBLISHER_PAYLOAD_MAX];
+
+static const char *publisher_topics[] = {
+    [publisher_encoding_json] = PUBLISHER_TOPIC,
+    [publisher_encoding_packed] = PUBLISHER_PACKED_TOPIC,
+};
+
+static metrics_t *publisher_metric_publishes;
+static metrics_t *publisher_metric_samples;
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static int publisher_flush_locked(publisher_t *pub);
+static int publisher_queue_locked(publisher_t *pub, const publisher_sample_t *samples, uint16_t size,
+    uint16_t head, uint16_t count);
+static int publisher_encode_json(const publisher_sample_t *samples, uint16_t size, uint16_t head, uint16_t count,
+    uint16_t *sent);
+static int publisher_encode_packed(const publisher_sample_t *samples, uint16_t size, uint16_t head,
+    uint16_t count, uint16_t *sent);
+static bool publisher_limit_reached(const publisher_t *pub, TickType_t now);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int publisher_init(publisher_t *pub, esp_mqtt_client_handle_t client, publisher_encoding_t encoding)
+{
+    if(pub == NULL)
+    {
+        LOG_ERROR("Publisher is NULL, init failed!");
+        return -1;
+    }
+
+    memset(pub, 0, sizeof(publisher_t));
+    pub->client = client;
+    pub->encoding = encoding;
+    pub->topic = publisher_topics[encoding];
+    pub->max_samples = PUBLISHER_MAX_SAMPLES;
+    pub->max_age_ms = PUBLISHER_MAX_AGE_MS;
+    publisher_metric_publishes = metrics_register("mqtt_pub", metrics_counter);
+    publisher_metric_samples = metrics_register("pub_samples", metrics_counter);
+    pub->mutex = xSemaphoreCreateMutex();
+    if(pub->mutex == NULL)
+    {
+        LOG_ERROR("Publisher mutex create failed!");
+        return -1;
+    }
+    return 0;
+}
+
+void publisher_set_limits(publisher_t *pub, uint16_t max_samples, uint32_t max_age_ms)
+{
+    if(max_samples == 0)
+        max_samples = 1;
+    if(max_samples > PUBLISHER_RING_SIZE)
+        max_samples = PUBLISHER_RING_SIZE;
+
+    xSemaphoreTake(pub->mutex, portMAX_DELAY);
+    pub->max_samples = max_samples;
+    pub->max_age_ms = max_age_ms;
+    xSemaphoreGive(pub->mutex);
+}
+
+int publisher_push(publisher_t *pub, const htu21_data_t *data)
+{
+    return publisher_push_window(pub, data, NULL);
+}
+
+int publisher_push_window(publisher_t *pub, const htu21_data_t *data, const aggregator_summary_t *summary)
+{
+    struct timeval tv;
+    publisher_sample_t sample;
+
+    gettimeofday(&tv, NULL);
+    sample.timestamp = (uint32_t)tv.tv_sec;
+    sample.captured = xTaskGetTickCount();
+    sample.data = *data;
+    if(summary != NULL)
+        sample.summary = *summary;
+    else
+        memset(&sample.summary, 0, sizeof(sample.summary));
+
+    return publisher_push_sample(pub, &sample);
+}
+
+int publisher_push_sample(publisher_t *pub, const publisher_sample_t *sample)
+{
+    int flushed = 0;
+    uint16_t tail;
+
+    xSemaphoreTake(pub->mutex, portMAX_DELAY);
+
+    if(pub->count == PUBLISHER_RING_SIZE)
+    {
+        // Ring is full (publishing kept failing), the oldest sample makes room
+        pub->head = (pub->head + 1) % PUBLISHER_RING_SIZE;
+        pub->count--;
+        pub->stats.dropped++;
+    }
+    tail = (pub->head + pub->count) % PUBLISHER_RING_SIZE;
+    pub->ring[tail] = *sample;
+    pub->count++;
+
+    if(publisher_limit_reached(pub, xTaskGetTickCount()))
+    {
+        flushed = publisher_flush_locked(pub);
+    }
+
+    xSemaphoreGive(pub->mutex);
+    return flushed;
+}
+
+int publisher_poll(publisher_t *pub)
+{
+    int flushed = 0;
+
+    xSemaphoreTake(pub->mutex, portMAX_DELAY);
+    if(publisher_limit_reached(pub, xTaskGetTickCount()))
+    {
+        flushed = publisher_flush_locked(pub);
+    }
+    xSemaphoreGive(pub->mutex);
+    return flushed;
+}
+
+int publisher_flush(publisher_t *pub)
+{
+    int flushed;
+
+    xSemaphoreTake(pub->mutex, portMAX_DELAY);
+    flushed = publisher_flush_locked(pub);
+    xSemaphoreGive(pub->mutex);
+    return flushed;
+}
+
+int publisher_send(publisher_t *pub, const publisher_sample_t *samples, uint16_t count)
+{
+    int sent;
+
+    if(count == 0)
+        return 0;
+
+    xSemaphoreTake(pub->mutex, portMAX_DELAY);
+    sent = publisher_queue_locked(pub, samples, count, 0, count);
+    xSemaphoreGive(pub->mutex);
+    return sent;
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static bool publisher_limit_reached(const publisher_t *pub, TickType_t now)
+{
+    if(pub->count == 0)
+        return false;
+    if(pub->count >= pub->max_samples)
+        return true;
+    return TICK2MS(now - pub->ring[pub->head].captured) >= pub->max_age_ms;
+}
+
+// Encoders take count samples of a ring of size samples, starting at head
+static int publisher_encode_json(const publisher_sample_t *samples, uint16_t size, uint16_t head, uint16_t count,
+    uint16_t *sent)
+{
+    int len, n;
+    uint16_t i;
+
+    *sent = 0;
+    len = snprintf(publisher_payload, sizeof(publisher_payload), "{\"samples\":[");
+    for(i = 0; i < count; i++)
+    {
+        const publisher_sample_t *s = &samples[(head + i) % size];
+        n = snprintf(&publisher_payload[len], sizeof(publisher_payload) - len,
+            "%s{\"ts\":%u,\"temperature\":%.2f,\"humidity\":%.2f",
+            i ? "," : "", s->timestamp, s->data.temperature, s->data.humidity);
+        if(n >= 0 && s->summary.samples > 0 && len + n < (int)sizeof(publisher_payload))
+        {
+            // Window statistics ride along with the means
+            const aggregator_summary_t *w = &s->summary;
+            int m = snprintf(&publisher_payload[len + n], sizeof(publisher_payload) - len - n,
+                ",\"n\":%u,\"temperature_min\":%.2f,\"temperature_max\":%.2f,\"temperature_sd\":%.2f"
+                ",\"humidity_min\":%.2f,\"humidity_max\":%.2f,\"humidity_sd\":%.2f",
+                w->samples, w->temperature.min, w->temperature.max, w->temperature.stddev,
+                w->humidity.min, w->humidity.max, w->humidity.stddev);
+            n = m < 0 ? m : n + m;
+        }
+        if(n >= 0 && len + n < (int)sizeof(publisher_payload))
+            n += snprintf(&publisher_payload[len + n], sizeof(publisher_payload) - len - n, "}");
+        // Leave room for the closing brackets, samples that do not fit go in the next batch
+        if(n < 0 || len + n + 2 >= (int)sizeof(publisher_payload))
+            break;
+        len += n;
+        (*sent)++;
+    }
+    len += snprintf(&publisher_payload[len], sizeof(publisher_payload) - len, "]}");
+    return len;
+}
+
+static int publisher_encode_packed(const publisher_sample_t *samples, uint16_t size, uint16_t head,
+    uint16_t count, uint16_t *sent)
+{
+    uint8_t *p = (uint8_t *)publisher_payload;
+    uint32_t base_ts = samples[head].timestamp;
+    uint32_t offset;
+    uint16_t i;
+
+    *sent = 0;
+    p += PUBLISHER_PACKED_HEADER_SIZE;
+    for(i = 0; i < count && i < UINT8_MAX; i++)
+    {
+        const publisher_sample_t *s = &samples[(head + i) % size];
+        if(p + PUBLISHER_PACKED_RECORD_SIZE > (uint8_t *)publisher_payload + sizeof(publisher_payload))
+            break;
+        // Records that are out of order or too far from the base time start the next batch
+        offset = s->timestamp - base_ts;
+        if(s->timestamp < base_ts || offset > UINT16_MAX)
+            break;
+        p[0] = offset & 0xFF;
+        p[1] = (offset >> 8) & 0xFF;
+        p[2] = s->data.temperature_adc & 0xFF;
+        p[3] = (s->data.temperature_adc >> 8) & 0xFF;
+        p[4] = s->data.humidity_adc & 0xFF;
+        p[5] = (s->data.humidity_adc >> 8) & 0xFF;
+        p += PUBLISHER_PACKED_RECORD_SIZE;
+        (*sent)++;
+    }
+
+    p = (uint8_t *)publisher_payload;
+    p[0] = PUBLISHER_PACKED_VERSION;
+    p[1] = (uint8_t)*sent;
+    p[2] = base_ts & 0xFF;
+    p[3] = (base_ts >> 8) & 0xFF;
+    p[4] = (base_ts >> 16) & 0xFF;
+    p[5] = (base_ts >> 24) & 0xFF;
+
+    return PUBLISHER_PACKED_HEADER_SIZE + *sent * PUBLISHER_PACKED_RECORD_SIZE;
+}
+
+static int publisher_flush_locked(publisher_t *pub)
+{
+    int sent;
+    uint32_t age_ms;
+
+    if(pub->count == 0)
+        return 0;
+
+    age_ms = TICK2MS(xTaskGetTickCount() - pub->ring[pub->head].captured);
+    // Spilled under backpressure: the samples stay buffered and the next flush retries them
+    sent = publisher_queue_locked(pub, pub->ring, PUBLISHER_RING_SIZE, pub->head, pub->count);
+    if(sent < 0)
+    {
+        LOG_ERROR("Batch not queued, %u samples kept", pub->count);
+        return -1;
+    }
+
+    pub->stats.flush_latency_ms = age_ms;
+    if(age_ms > pub->stats.flush_latency_max_ms)
+        pub->stats.flush_latency_max_ms = age_ms;
+    pub->head = (pub->head + sent) % PUBLISHER_RING_SIZE;
+    pub->count -= sent;
+    return sent;
+}
+
+// Encodes as many of the samples as fit one payload and hands them to the outbox
+static int publisher_queue_locked(publisher_t *pub, const publisher_sample_t *samples, uint16_t size,
+    uint16_t head, uint16_t count)
+{
+    int len;
+    uint16_t sent;
+
+    if(pub->encoding == publisher_encoding_packed)
+        len = publisher_encode_packed(samples, size, head, count, &sent);
+    else
+        len = publisher_encode_json(samples, size, head, count, &sent);
+
+    if(0 != outbox_publish(outbox_lane_data, pub->topic, publisher_payload, len, 1, outbox_policy_spill))
+        return -1;
+
+    pub->stats.messages++;
+    metrics_inc(publisher_metric_publishes);
+    metrics_add(publisher_metric_samples, sent);
+    pub->stats.samples += sent;
+    pub->stats.bytes += len;
+
+    LOG_PRINTF("Queued batch of %u samples (%d bytes)", sent, len);
+    return sent;
+}
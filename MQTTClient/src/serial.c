@@ -4,6 +4,8 @@
 #include "serial.h"
 #include "driver/uart.h"
 
+static QueueHandle_t serial_queues[UART_NUM_MAX];
+
 int serial_init(int num)
 {
 	switch(num) {
@@ -20,7 +22,10 @@ int serial_init(int num)
 
 			uart_param_config(num, &uart_config);
 			uart_set_pin(num, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
-			uart_driver_install(num, 1024, 1024, 0, NULL, 0);
+			uart_driver_install(num, 1024, 1024, SERIAL_EVENT_QUEUE_LEN, &serial_queues[num], 0);
+			// Wake the reader at each end of line instead of at each byte
+			uart_enable_pattern_det_baud_intr(num, SERIAL_PATTERN_CHR, 1, 1, 0, 0);
+			uart_pattern_queue_reset(num, SERIAL_PATTERN_QUEUE_LEN);
 		}
 		break;
 
@@ -50,9 +55,34 @@ int serial_read(int num, unsigned char *buf, int len, int timeout)
 	return uart_read_bytes(num, buf, len, timeout);
 }
 
+QueueHandle_t serial_get_event_queue(int num)
+{
+	if(num < 0 || num >= UART_NUM_MAX)
+		return NULL;
+	return serial_queues[num];
+}
+
+int serial_buffered(int num)
+{
+	size_t len = 0;
+
+	if(ESP_OK != uart_get_buffered_data_len(num, &len))
+		return 0;
+	return (int)len;
+}
+
+void serial_flush_input(int num)
+{
+	uart_flush_input(num);
+	if(serial_get_event_queue(num) != NULL)
+		xQueueReset(serial_queues[num]);
+}
+
 int serial_delete(int uart_num)
 {
 	uart_driver_delete(uart_num);
+	if(uart_num >= 0 && uart_num < UART_NUM_MAX)
+		serial_queues[uart_num] = NULL;
 	return 0;
 }
 
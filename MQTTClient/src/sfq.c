@@ -0,0 +1,343 @@
+/**
+ * File Name:   sfq.c
+ * Description: Flash-backed store-and-forward queue for telemetry samples.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "sfq.h"
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static uint8_t sfq_crc8(const sfq_record_t *rec);
+static bool sfq_record_ok(const sfq_record_t *rec);
+static uint32_t sfq_next(const sfq_t *sfq, uint32_t addr);
+static void sfq_reclaim_sector(sfq_t *sfq, uint32_t sector);
+
+static int sfq_file_read(sfq_flash_t *flash, uint32_t addr, void *buf, size_t len);
+static int sfq_file_write(sfq_flash_t *flash, uint32_t addr, const void *buf, size_t len);
+static int sfq_file_erase(sfq_flash_t *flash, uint32_t addr, size_t len);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int sfq_flash_file_open(sfq_flash_t *flash, const char *path, uint32_t size, uint32_t sector_size)
+{
+    FILE *f = fopen(path, "r+b");
+    long cur = -1;
+
+    if(f != NULL && fseek(f, 0, SEEK_END) == 0)
+        cur = ftell(f);
+    if(f == NULL || cur != (long)size)
+    {
+        if(f != NULL)
+            fclose(f);
+        f = fopen(path, "w+b");
+        if(f == NULL)
+        {
+            LOG_ERROR("Cannot open flash file %s", path);
+            return -1;
+        }
+        // A blank file reads like an erased partition
+        for(uint32_t i = 0; i < size; i++)
+            fputc(0xFF, f);
+        fflush(f);
+    }
+
+    flash->read = sfq_file_read;
+    flash->write = sfq_file_write;
+    flash->erase = sfq_file_erase;
+    flash->size = size;
+    flash->sector_size = sector_size;
+    flash->ctx = f;
+    return 0;
+}
+
+void sfq_flash_file_close(sfq_flash_t *flash)
+{
+    if(flash->ctx != NULL)
+        fclose((FILE *)flash->ctx);
+    flash->ctx = NULL;
+}
+
+int sfq_init(sfq_t *sfq, sfq_flash_t *flash)
+{
+    sfq_record_t rec;
+    uint32_t addr, max_seq = 0, min_seq = UINT32_MAX;
+    bool any = false;
+
+    if(sfq == NULL || flash == NULL || flash->size < 2 * flash->sector_size)
+    {
+        LOG_ERROR("Store-and-forward queue init failed!");
+        return -1;
+    }
+
+    memset(sfq, 0, sizeof(sfq_t));
+    sfq->flash = flash;
+
+    // Recover the newest record (head) and the oldest unconsumed record (tail)
+    for(addr = 0; addr < flash->size; addr += SFQ_RECORD_SIZE)
+    {
+        if(flash->read(flash, addr, &rec, sizeof(rec)) != 0)
+            return -1;
+        if(rec.state == SFQ_STATE_EMPTY || !sfq_record_ok(&rec))
+            continue;
+
+        if(!any || rec.seq > max_seq)
+        {
+            max_seq = rec.seq;
+            sfq->head = sfq_next(sfq, addr);
+        }
+        any = true;
+
+        if(rec.state == SFQ_STATE_VALID)
+        {
+            sfq->pending++;
+            if(rec.seq < min_seq)
+            {
+                min_seq = rec.seq;
+                sfq->tail = addr;
+            }
+        }
+    }
+
+    sfq->seq = any ? max_seq + 1 : 0;
+    if(sfq->pending == 0)
+        sfq->tail = sfq->head;
+
+    // Step over records left behind by an interrupted write
+    while(sfq->head % flash->sector_size != 0)
+    {
+        if(flash->read(flash, sfq->head, &rec, sizeof(rec)) != 0)
+            return -1;
+        if(rec.state == SFQ_STATE_EMPTY)
+            break;
+        sfq->head = sfq_next(sfq, sfq->head);
+    }
+
+    LOG_PRINTF("Store-and-forward queue: %u samples pending", sfq->pending);
+    return 0;
+}
+
+int sfq_append(sfq_t *sfq, const sfq_entry_t *entry)
+{
+    sfq_flash_t *flash = sfq->flash;
+    sfq_record_t rec;
+
+    if(flash == NULL)
+        return -1;
+
+    rec.state = SFQ_STATE_VALID;
+    rec.reserved = 0xFFFF;
+    rec.timestamp = entry->timestamp;
+    rec.temperature_adc = entry->temperature_adc;
+    rec.humidity_adc = entry->humidity_adc;
+
+    if(sfq->head % flash->sector_size == 0)
+    {
+        sfq_reclaim_sector(sfq, sfq->head);
+        if(flash->erase(flash, sfq->head, flash->sector_size) != 0)
+        {
+            sfq->stats.errors++;
+            return -1;
+        }
+        sfq->stats.erases++;
+    }
+
+    rec.seq = sfq->seq;
+    rec.crc = sfq_crc8(&rec);
+    if(flash->write(flash, sfq->head, &rec, sizeof(rec)) != 0)
+    {
+        sfq->stats.errors++;
+        return -1;
+    }
+
+    if(sfq->pending == 0)
+        sfq->tail = sfq->head;
+    sfq->head = sfq_next(sfq, sfq->head);
+    sfq->seq++;
+    sfq->pending++;
+    sfq->stats.appended++;
+    return 0;
+}
+
+int sfq_peek(sfq_t *sfq, sfq_entry_t *entries, uint16_t max)
+{
+    sfq_flash_t *flash = sfq->flash;
+    sfq_record_t rec;
+    uint32_t addr = sfq->tail;
+    uint32_t left = sfq->pending;
+    int n = 0;
+
+    if(flash == NULL)
+        return 0;
+
+    while(n < max && left > 0 && addr != sfq->head)
+    {
+        if(flash->read(flash, addr, &rec, sizeof(rec)) != 0)
+        {
+            sfq->stats.errors++;
+            return n ? n : -1;
+        }
+        // Only intact records count as pending, see sfq_init()
+        if(rec.state == SFQ_STATE_VALID && sfq_record_ok(&rec))
+        {
+            entries[n].timestamp = rec.timestamp;
+            entries[n].temperature_adc = rec.temperature_adc;
+            entries[n].humidity_adc = rec.humidity_adc;
+            n++;
+            left--;
+        }
+        addr = sfq_next(sfq, addr);
+    }
+    return n;
+}
+
+int sfq_consume(sfq_t *sfq, uint16_t n)
+{
+    sfq_flash_t *flash = sfq->flash;
+    sfq_record_t rec;
+    const uint8_t consumed = SFQ_STATE_CONSUMED;
+    int ret = 0;
+
+    if(flash == NULL)
+        return -1;
+
+    while(sfq->pending > 0 && sfq->tail != sfq->head)
+    {
+        if(flash->read(flash, sfq->tail, &rec, sizeof(rec)) != 0)
+        {
+            sfq->stats.errors++;
+            ret = -1;
+            break;
+        }
+
+        if(rec.state == SFQ_STATE_VALID)
+        {
+            bool ok = sfq_record_ok(&rec);
+
+            // Corrupt records up to the next good one go with the samples sfq_peek() passed over
+            if(ok && n == 0)
+                break;
+            if(flash->write(flash, sfq->tail, &consumed, sizeof(consumed)) != 0)
+                sfq->stats.errors++;
+            if(ok)
+            {
+                n--;
+                sfq->pending--;
+                sfq->stats.drained++;
+            }
+            else
+            {
+                sfq->stats.errors++;
+            }
+        }
+        sfq->tail = sfq_next(sfq, sfq->tail);
+    }
+
+    if(sfq->tail == sfq->head)
+        sfq->pending = 0;
+    return ret;
+}
+
+uint32_t sfq_pending(const sfq_t *sfq)
+{
+    return sfq->pending;
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static uint8_t sfq_crc8(const sfq_record_t *rec)
+{
+    // CRC-8 (x^8 + x^5 + x^4 + 1) over everything but the state and crc bytes
+    const uint8_t *p = (const uint8_t *)rec + 2;
+    uint8_t crc = 0;
+
+    for(size_t i = 2; i < sizeof(sfq_record_t); i++, p++)
+    {
+        crc ^= *p;
+        for(uint8_t b = 0; b < 8; b++)
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static bool sfq_record_ok(const sfq_record_t *rec)
+{
+    return (rec->state == SFQ_STATE_VALID || rec->state == SFQ_STATE_CONSUMED) && rec->crc == sfq_crc8(rec);
+}
+
+static uint32_t sfq_next(const sfq_t *sfq, uint32_t addr)
+{
+    addr += SFQ_RECORD_SIZE;
+    return (addr >= sfq->flash->size) ? 0 : addr;
+}
+
+static void sfq_reclaim_sector(sfq_t *sfq, uint32_t sector)
+{
+    sfq_flash_t *flash = sfq->flash;
+    sfq_record_t rec;
+    uint32_t end = sector + flash->sector_size;
+
+    // The ring is full when the oldest unconsumed record sits in the sector about to be erased
+    if(sfq->pending == 0 || sfq->tail < sector || sfq->tail >= end)
+        return;
+
+    for(uint32_t addr = sfq->tail; addr < end; addr += SFQ_RECORD_SIZE)
+    {
+        if(flash->read(flash, addr, &rec, sizeof(rec)) == 0 && rec.state == SFQ_STATE_VALID && sfq_record_ok(&rec)
+            && sfq->pending > 0)
+        {
+            sfq->pending--;
+            sfq->stats.overwritten++;
+        }
+    }
+    sfq->tail = (end >= flash->size) ? 0 : end;
+}
+
+static int sfq_file_read(sfq_flash_t *flash, uint32_t addr, void *buf, size_t len)
+{
+    FILE *f = (FILE *)flash->ctx;
+    if(fseek(f, addr, SEEK_SET) != 0 || fread(buf, 1, len, f) != len)
+        return -1;
+    return 0;
+}
+
+static int sfq_file_write(sfq_flash_t *flash, uint32_t addr, const void *buf, size_t len)
+{
+    FILE *f = (FILE *)flash->ctx;
+    const uint8_t *src = (const uint8_t *)buf;
+    uint8_t cur[SFQ_RECORD_SIZE];
+
+    // Like NOR flash a write can only clear bits
+    while(len > 0)
+    {
+        size_t n = len < sizeof(cur) ? len : sizeof(cur);
+        if(sfq_file_read(flash, addr, cur, n) != 0)
+            return -1;
+        for(size_t i = 0; i < n; i++)
+            cur[i] &= src[i];
+        if(fseek(f, addr, SEEK_SET) != 0 || fwrite(cur, 1, n, f) != n)
+            return -1;
+        addr += n;
+        src += n;
+        len -= n;
+    }
+    return fflush(f) == 0 ? 0 : -1;
+}
+
+static int sfq_file_erase(sfq_flash_t *flash, uint32_t addr, size_t len)
+{
+    FILE *f = (FILE *)flash->ctx;
+
+    if(fseek(f, addr, SEEK_SET) != 0)
+        return -1;
+    for(size_t i = 0; i < len; i++)
+        fputc(0xFF, f);
+    return fflush(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,147 @@
+/**
+ * File Name:   sfq_store.c
+ * Description: Store-and-forward queue of the node, in its flash partition and drained into the
+ *              publisher.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <string.h>
+#include "esp_partition.h"
+#include "htu21_fixed.h"
+#include "sfq_store.h"
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+// Only the drain task drains, under the store's mutex
+static sfq_entry_t sfq_store_entries[SFQ_DRAIN_BURST];
+static publisher_sample_t sfq_store_batch[SFQ_DRAIN_BURST];
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static int sfq_partition_read(sfq_flash_t *flash, uint32_t addr, void *buf, size_t len);
+static int sfq_partition_write(sfq_flash_t *flash, uint32_t addr, const void *buf, size_t len);
+static int sfq_partition_erase(sfq_flash_t *flash, uint32_t addr, size_t len);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+int sfq_flash_partition_open(sfq_flash_t *flash, const char *label)
+{
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+        (esp_partition_subtype_t)SFQ_PARTITION_SUBTYPE, label);
+    if(part == NULL)
+    {
+        LOG_ERROR("Store-and-forward partition '%s' not found", label);
+        return -1;
+    }
+
+    flash->read = sfq_partition_read;
+    flash->write = sfq_partition_write;
+    flash->erase = sfq_partition_erase;
+    flash->size = part->size;
+    flash->sector_size = SPI_FLASH_SEC_SIZE;
+    flash->ctx = (void *)part;
+    return 0;
+}
+
+int sfq_store_open(sfq_store_t *store, const char *label)
+{
+    if(0 != sfq_flash_partition_open(&store->flash, label))
+        return -1;
+    return sfq_store_init(store);
+}
+
+int sfq_store_init(sfq_store_t *store)
+{
+    if(0 != sfq_init(&store->queue, &store->flash))
+        return -1;
+
+    store->mutex = xSemaphoreCreateMutex();
+    if(store->mutex == NULL)
+    {
+        LOG_ERROR("Store-and-forward mutex create failed!");
+        return -1;
+    }
+    return 0;
+}
+
+int sfq_store_append(sfq_store_t *store, const publisher_sample_t *sample)
+{
+    sfq_entry_t entry;
+    int ret;
+
+    if(store->mutex == NULL)
+        return -1;
+
+    entry.timestamp = sample->timestamp;
+    entry.temperature_adc = sample->data.temperature_adc;
+    entry.humidity_adc = sample->data.humidity_adc;
+
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+    ret = sfq_append(&store->queue, &entry);
+    xSemaphoreGive(store->mutex);
+    return ret;
+}
+
+int sfq_store_drain(sfq_store_t *store, publisher_t *pub, uint16_t max)
+{
+    int n, sent;
+
+    if(store->mutex == NULL)
+        return 0;
+    if(max > SFQ_DRAIN_BURST)
+        max = SFQ_DRAIN_BURST;
+
+    xSemaphoreTake(store->mutex, portMAX_DELAY);
+
+    n = sfq_peek(&store->queue, sfq_store_entries, max);
+    for(int i = 0; i < n; i++)
+    {
+        publisher_sample_t *s = &sfq_store_batch[i];
+
+        s->timestamp = sfq_store_entries[i].timestamp;
+        s->captured = xTaskGetTickCount();
+        s->data.temperature_adc = sfq_store_entries[i].temperature_adc;
+        s->data.humidity_adc = sfq_store_entries[i].humidity_adc;
+        // Same conversions as the sensor task
+        s->data.temperature = htu21_fixed_fahrenheit(htu21_fixed_temperature(s->data.temperature_adc)) / 100.0f;
+        s->data.humidity = htu21_fixed_humidity(s->data.humidity_adc) / 100.0f;
+        // Only the means are stored, the window statistics do not survive a disconnect
+        memset(&s->summary, 0, sizeof(s->summary));
+    }
+
+    // The records stay in flash until the outbox has the batch
+    sent = n > 0 ? publisher_send(pub, sfq_store_batch, n) : n;
+    if(sent > 0 && 0 != sfq_consume(&store->queue, sent))
+        LOG_ERROR("Failed to consume %d sent samples", sent);
+
+    xSemaphoreGive(store->mutex);
+    return sent;
+}
+
+uint32_t sfq_store_pending(sfq_store_t *store)
+{
+    return sfq_pending(&store->queue);
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+static int sfq_partition_read(sfq_flash_t *flash, uint32_t addr, void *buf, size_t len)
+{
+    return esp_partition_read((const esp_partition_t *)flash->ctx, addr, buf, len) == ESP_OK ? 0 : -1;
+}
+
+static int sfq_partition_write(sfq_flash_t *flash, uint32_t addr, const void *buf, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)flash->ctx, addr, buf, len) == ESP_OK ? 0 : -1;
+}
+
+static int sfq_partition_erase(sfq_flash_t *flash, uint32_t addr, size_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t *)flash->ctx, addr, len) == ESP_OK ? 0 : -1;
+}
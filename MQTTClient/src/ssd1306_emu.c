@@ -0,0 +1,301 @@
+/**
+ * File Name:   ssd1306_emu.c
+ * Description: SSD1306 panel model fed with the driver's I2C byte stream.
+ */
+
+#ifdef SSD1306_EMULATOR
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include "ssd1306_emu.h"
+
+/***************************************************************************************************/
+/* Private Data Types */
+/***************************************************************************************************/
+// Control byte bits
+#define EMU_CONTROL_CO                      0x80
+#define EMU_CONTROL_DC                      0x40
+
+// Opcodes the decoder acts on, values from the SSD1306 datasheet
+#define EMU_MEMORYMODE                      0x20
+#define EMU_COLUMNADDR                      0x21
+#define EMU_PAGEADDR                        0x22
+#define EMU_DISPLAYALLON_RESUME             0xA4
+#define EMU_DISPLAYALLON                    0xA5
+#define EMU_NORMALDISPLAY                   0xA6
+#define EMU_INVERTDISPLAY                   0xA7
+#define EMU_DISPLAYOFF                      0xAE
+#define EMU_DISPLAYON                       0xAF
+
+/***************************************************************************************************/
+/* Private Variables(static) */
+/***************************************************************************************************/
+static ssd1306_emu_t emu_panel;
+static bool emu_panel_ready;
+
+/***************************************************************************************************/
+/* Private Function Prototypes(static) */
+/***************************************************************************************************/
+static uint8_t emu_command_length(uint8_t opcode);
+static void emu_command(ssd1306_emu_t *emu);
+static void emu_data(ssd1306_emu_t *emu, uint8_t b);
+static void emu_byte(ssd1306_emu_t *emu, uint8_t b);
+
+/***************************************************************************************************/
+/* Public Function Definitions */
+/***************************************************************************************************/
+ssd1306_emu_t *ssd1306_emu_get(void)
+{
+    if(!emu_panel_ready)
+    {
+        ssd1306_emu_reset(&emu_panel);
+        emu_panel_ready = true;
+    }
+    return &emu_panel;
+}
+
+void ssd1306_emu_reset(ssd1306_emu_t *emu)
+{
+    memset(emu, 0, sizeof(ssd1306_emu_t));
+    // Reset values from the datasheet: page addressing, full column and page ranges
+    emu->mode = 2;
+    emu->col_end = SSD1306_EMU_WIDTH - 1;
+    emu->page_end = SSD1306_EMU_PAGES - 1;
+}
+
+void ssd1306_emu_begin(ssd1306_emu_t *emu, uint8_t addr)
+{
+    (void)addr;
+    emu->in_transfer = true;
+    emu->expect_control = true;
+    emu->stats.transactions++;
+}
+
+void ssd1306_emu_write(ssd1306_emu_t *emu, const uint8_t *buf, size_t len)
+{
+    if(!emu->in_transfer)
+    {
+        LOG_ERROR("Write outside a transfer");
+        return;
+    }
+    emu->stats.bytes += len;
+    for(size_t i = 0; i < len; i++)
+        emu_byte(emu, buf[i]);
+}
+
+void ssd1306_emu_end(ssd1306_emu_t *emu)
+{
+    // A command may span transactions, the init sequence sends each argument on its own
+    emu->in_transfer = false;
+}
+
+bool ssd1306_emu_pixel(const ssd1306_emu_t *emu, uint8_t x, uint8_t y)
+{
+    bool on;
+
+    if(!emu->display_on || x >= SSD1306_EMU_WIDTH || y >= SSD1306_EMU_HEIGHT)
+        return false;
+    on = emu->all_on || (emu->ram[y / 8][x] >> (y & 7)) & 0x01;
+    return on != emu->inverted;
+}
+
+int ssd1306_emu_dump_pgm(const ssd1306_emu_t *emu, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if(f == NULL)
+    {
+        LOG_ERROR("Can not create %s", path);
+        return -1;
+    }
+
+    fprintf(f, "P5\n%d %d\n255\n", SSD1306_EMU_WIDTH, SSD1306_EMU_HEIGHT);
+    for(uint8_t y = 0; y < SSD1306_EMU_HEIGHT; y++)
+        for(uint8_t x = 0; x < SSD1306_EMU_WIDTH; x++)
+            fputc(ssd1306_emu_pixel(emu, x, y) ? 255 : 0, f);
+
+    if(fclose(f) != 0)
+    {
+        LOG_ERROR("Write to %s failed", path);
+        return -1;
+    }
+    return 0;
+}
+
+int ssd1306_emu_compare_pgm(const ssd1306_emu_t *emu, const char *path)
+{
+    int w, h, maxval, diff = 0;
+    FILE *f = fopen(path, "rb");
+    if(f == NULL)
+    {
+        LOG_ERROR("Can not open %s", path);
+        return -1;
+    }
+
+    if(fscanf(f, "P5 %d %d %d", &w, &h, &maxval) != 3 || fgetc(f) == EOF
+        || w != SSD1306_EMU_WIDTH || h != SSD1306_EMU_HEIGHT)
+    {
+        LOG_ERROR("%s is not a %dx%d PGM image", path, SSD1306_EMU_WIDTH, SSD1306_EMU_HEIGHT);
+        fclose(f);
+        return -1;
+    }
+    for(uint8_t y = 0; y < SSD1306_EMU_HEIGHT; y++)
+    {
+        for(uint8_t x = 0; x < SSD1306_EMU_WIDTH; x++)
+        {
+            int c = fgetc(f);
+            if(c == EOF)
+            {
+                LOG_ERROR("%s is truncated", path);
+                fclose(f);
+                return -1;
+            }
+            if((c > maxval / 2) != ssd1306_emu_pixel(emu, x, y))
+                diff++;
+        }
+    }
+    fclose(f);
+    return diff;
+}
+
+void ssd1306_emu_take_stats(ssd1306_emu_t *emu, ssd1306_emu_stats_t *stats)
+{
+    *stats = emu->stats;
+    memset(&emu->stats, 0, sizeof(emu->stats));
+}
+
+/***************************************************************************************************/
+/* Private Function Definitions */
+/***************************************************************************************************/
+// Total length of a command, opcode included
+static uint8_t emu_command_length(uint8_t opcode)
+{
+    switch(opcode)
+    {
+    case 0x26: case 0x27:                   // Horizontal scroll setup
+        return 7;
+    case 0x29: case 0x2A:                   // Vertical and horizontal scroll setup
+        return 6;
+    case EMU_COLUMNADDR: case EMU_PAGEADDR:
+    case 0xA3:                              // Vertical scroll area
+        return 3;
+    case EMU_MEMORYMODE:
+    case 0x81: case 0x8D: case 0xA8:        // Contrast, charge pump, multiplex
+    case 0xD3: case 0xD5: case 0xD9:        // Display offset, clock divide, precharge
+    case 0xDA: case 0xDB:                   // COM pins, VCOMH deselect level
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static void emu_command(ssd1306_emu_t *emu)
+{
+    uint8_t op = emu->cmd[0];
+
+    emu->stats.command_bytes += emu->cmd_len;
+    switch(op)
+    {
+    case EMU_MEMORYMODE:
+        emu->mode = emu->cmd[1] & 0x03;
+        break;
+    case EMU_COLUMNADDR:
+        emu->col_start = emu->cmd[1] & 0x7F;
+        emu->col_end = emu->cmd[2] & 0x7F;
+        emu->col = emu->col_start;
+        break;
+    case EMU_PAGEADDR:
+        emu->page_start = emu->cmd[1] & 0x07;
+        emu->page_end = emu->cmd[2] & 0x07;
+        emu->page = emu->page_start;
+        break;
+    case EMU_DISPLAYALLON_RESUME:
+    case EMU_DISPLAYALLON:
+        emu->all_on = op == EMU_DISPLAYALLON;
+        break;
+    case EMU_NORMALDISPLAY:
+    case EMU_INVERTDISPLAY:
+        emu->inverted = op == EMU_INVERTDISPLAY;
+        break;
+    case EMU_DISPLAYOFF:
+    case EMU_DISPLAYON:
+        emu->display_on = op == EMU_DISPLAYON;
+        break;
+    default:
+        // Page addressing mode pointer commands
+        if(op <= 0x0F)
+            emu->col = (emu->col & 0xF0) | op;
+        else if(op <= 0x1F)
+            emu->col = ((op & 0x07) << 4) | (emu->col & 0x0F);
+        else if(op >= 0xB0 && op <= 0xB7)
+            emu->page = op & 0x07;
+        // Everything else (start line, remap, scan direction, scroll on/off...) does not change RAM
+        break;
+    }
+}
+
+static void emu_data(ssd1306_emu_t *emu, uint8_t b)
+{
+    emu->stats.data_bytes++;
+    emu->ram[emu->page][emu->col] = b;
+
+    switch(emu->mode)
+    {
+    case 0:     // Horizontal: column first, then page, wrapping inside the window
+        if(emu->col < emu->col_end)
+        {
+            emu->col++;
+            break;
+        }
+        emu->col = emu->col_start;
+        emu->page = emu->page < emu->page_end ? emu->page + 1 : emu->page_start;
+        break;
+    case 1:     // Vertical: page first, then column
+        if(emu->page < emu->page_end)
+        {
+            emu->page++;
+            break;
+        }
+        emu->page = emu->page_start;
+        emu->col = emu->col < emu->col_end ? emu->col + 1 : emu->col_start;
+        break;
+    default:    // Page: column only, wrapping at the end of the row
+        emu->col = (emu->col + 1) % SSD1306_EMU_WIDTH;
+        break;
+    }
+}
+
+static void emu_byte(ssd1306_emu_t *emu, uint8_t b)
+{
+    if(emu->expect_control)
+    {
+        emu->continuation = (b & EMU_CONTROL_CO) != 0;
+        emu->data = (b & EMU_CONTROL_DC) != 0;
+        emu->expect_control = false;
+        return;
+    }
+
+    if(emu->data)
+    {
+        emu_data(emu, b);
+    }
+    else
+    {
+        if(emu->cmd_len == 0)
+            emu->cmd_need = emu_command_length(b);
+        emu->cmd[emu->cmd_len++] = b;
+        if(emu->cmd_len == emu->cmd_need)
+        {
+            emu_command(emu);
+            emu->cmd_len = 0;
+        }
+    }
+
+    // With Co set only one byte follows each control byte
+    if(emu->continuation)
+        emu->expect_control = true;
+}
+
+#endif /* SSD1306_EMULATOR */
@@ -0,0 +1,63 @@
+/**
+ * File Name:   esp_partition.h
+ * Description: Host stand-in for the partition API, for the native tests. There are no partitions,
+ *              tests put the store-and-forward queue on a file instead.
+ */
+
+// Header Guard
+#ifndef __FAKE_ESP_PARTITION_H__
+#define __FAKE_ESP_PARTITION_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+#define SPI_FLASH_SEC_SIZE                  4096
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+    esp_partition_subtype_t subtype, const char *label)
+{
+    return NULL;
+}
+
+static inline esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    return ESP_FAIL;
+}
+
+static inline esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    return ESP_FAIL;
+}
+
+static inline esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    return ESP_FAIL;
+}
+
+#endif /* __FAKE_ESP_PARTITION_H__ */
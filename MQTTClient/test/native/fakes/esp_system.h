@@ -0,0 +1,33 @@
+/**
+ * File Name:   esp_system.h
+ * Description: Host stand-in for the heap queries of esp_system, for the native tests.
+ */
+
+// Header Guard
+#ifndef __FAKE_ESP_SYSTEM_H__
+#define __FAKE_ESP_SYSTEM_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+
+/***************************************************************************************************/
+/* Fake State */
+/***************************************************************************************************/
+static uint32_t fake_heap_free FAKE_UNUSED = 128 * 1024;
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline uint32_t esp_get_free_heap_size(void)
+{
+    return fake_heap_free;
+}
+
+static inline uint32_t esp_get_minimum_free_heap_size(void)
+{
+    return fake_heap_free;
+}
+
+#endif /* __FAKE_ESP_SYSTEM_H__ */
@@ -0,0 +1,34 @@
+/**
+ * File Name:   esp_timer.h
+ * Description: Host stand-in for esp_timer, for the native tests. The clock only moves when the
+ *              test moves it.
+ */
+
+// Header Guard
+#ifndef __FAKE_ESP_TIMER_H__
+#define __FAKE_ESP_TIMER_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef struct esp_timer *esp_timer_handle_t;
+
+/***************************************************************************************************/
+/* Fake State */
+/***************************************************************************************************/
+static int64_t fake_time_us FAKE_UNUSED;
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline int64_t esp_timer_get_time(void)
+{
+    return fake_time_us;
+}
+
+#endif /* __FAKE_ESP_TIMER_H__ */
@@ -0,0 +1,69 @@
+/**
+ * File Name:   FreeRTOS.h
+ * Description: Host stand-in for the FreeRTOS types the firmware modules use, for the native tests.
+ *
+ * Every suite is a single translation unit, so the fake state lives in statics here and a test
+ * drives it directly, e.g. the tick count.
+ */
+
+// Header Guard
+#ifndef __FAKE_FREERTOS_H__
+#define __FAKE_FREERTOS_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+#define configTICK_RATE_HZ                  1000
+// Spelled like os.h so the two definitions agree
+#define portTICK_PERIOD_MS                  ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
+#define portTICK_RATE_MS                    portTICK_PERIOD_MS
+#define portMAX_DELAY                       ((TickType_t)0xFFFFFFFFUL)
+#define pdMS_TO_TICKS(ms)                   ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+#define pdTRUE                              1
+#define pdFALSE                             0
+#define pdPASS                              pdTRUE
+#define pdFAIL                              pdFALSE
+#define tskIDLE_PRIORITY                    0
+#define configMAX_PRIORITIES                25
+
+#define ESP_OK                              0
+#define ESP_FAIL                            -1
+#define IRAM_ATTR
+
+// Single threaded, critical sections have nothing to exclude
+#define portMUX_INITIALIZER_UNLOCKED        { 0 }
+#define portENTER_CRITICAL(mux)             ((void)(mux))
+#define portEXIT_CRITICAL(mux)              ((void)(mux))
+
+#define FAKE_UNUSED                         __attribute__((unused))
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void *QueueHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef int esp_err_t;
+typedef struct { int owner; } portMUX_TYPE;
+
+/***************************************************************************************************/
+/* Fake State */
+/***************************************************************************************************/
+// Returned by xTaskGetTickCount(), advanced by the test and by vTaskDelay()
+static TickType_t fake_tick_count FAKE_UNUSED;
+
+#endif /* __FAKE_FREERTOS_H__ */
@@ -0,0 +1,72 @@
+/**
+ * File Name:   message_buffer.h
+ * Description: Host stand-in for FreeRTOS message buffers, for the native tests.
+ *
+ * Keeps the accounting of the real thing: every message takes its length plus a size_t length
+ * word, and a send that does not fit stores nothing. Waits return at once.
+ */
+
+// Header Guard
+#ifndef __FAKE_MESSAGE_BUFFER_H__
+#define __FAKE_MESSAGE_BUFFER_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef struct {
+    size_t size;
+    size_t used;
+    uint8_t data[];
+} fake_message_buffer_t;
+
+typedef fake_message_buffer_t *MessageBufferHandle_t;
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline MessageBufferHandle_t xMessageBufferCreate(size_t size)
+{
+    fake_message_buffer_t *mb = calloc(1, sizeof(fake_message_buffer_t) + size);
+
+    if(mb != NULL)
+        mb->size = size;
+    return mb;
+}
+
+static inline size_t xMessageBufferSpacesAvailable(MessageBufferHandle_t mb)
+{
+    return mb->size - mb->used;
+}
+
+static inline size_t xMessageBufferSend(MessageBufferHandle_t mb, const void *data, size_t len, TickType_t wait)
+{
+    if(mb->used + sizeof(size_t) + len > mb->size)
+        return 0;
+    memcpy(&mb->data[mb->used], &len, sizeof(size_t));
+    memcpy(&mb->data[mb->used + sizeof(size_t)], data, len);
+    mb->used += sizeof(size_t) + len;
+    return len;
+}
+
+static inline size_t xMessageBufferReceive(MessageBufferHandle_t mb, void *buf, size_t size, TickType_t wait)
+{
+    size_t len;
+
+    if(mb->used == 0)
+        return 0;
+    memcpy(&len, mb->data, sizeof(size_t));
+    // Like the real buffer a message larger than the caller's buffer stays where it is
+    if(len > size)
+        return 0;
+    memcpy(buf, &mb->data[sizeof(size_t)], len);
+    mb->used -= sizeof(size_t) + len;
+    memmove(mb->data, &mb->data[sizeof(size_t) + len], mb->used);
+    return len;
+}
+
+#endif /* __FAKE_MESSAGE_BUFFER_H__ */
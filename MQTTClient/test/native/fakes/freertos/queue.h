@@ -0,0 +1,12 @@
+/**
+ * File Name:   queue.h
+ * Description: Host stand-in for the FreeRTOS queue types, for the native tests.
+ */
+
+// Header Guard
+#ifndef __FAKE_QUEUE_H__
+#define __FAKE_QUEUE_H__
+
+#include "freertos/FreeRTOS.h"
+
+#endif /* __FAKE_QUEUE_H__ */
@@ -0,0 +1,45 @@
+/**
+ * File Name:   semphr.h
+ * Description: Host stand-in for the FreeRTOS mutexes, for the native tests.
+ *
+ * The suites are single threaded, a take always succeeds. Takes and gives are counted so a test
+ * can check that a module releases what it takes.
+ */
+
+// Header Guard
+#ifndef __FAKE_SEMPHR_H__
+#define __FAKE_SEMPHR_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/***************************************************************************************************/
+/* Fake State */
+/***************************************************************************************************/
+static int fake_mutex_object FAKE_UNUSED;
+static int fake_mutex_held FAKE_UNUSED;
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return &fake_mutex_object;
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    fake_mutex_held++;
+    return pdTRUE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    fake_mutex_held--;
+    return pdTRUE;
+}
+
+#endif /* __FAKE_SEMPHR_H__ */
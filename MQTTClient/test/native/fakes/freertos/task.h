@@ -0,0 +1,69 @@
+/**
+ * File Name:   task.h
+ * Description: Host stand-in for the FreeRTOS task API, for the native tests.
+ *
+ * Tasks are never run. xTaskCreate() only remembers the last task so a test can see it was
+ * started, and delays move the fake tick count forward.
+ */
+
+// Header Guard
+#ifndef __FAKE_TASK_H__
+#define __FAKE_TASK_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+
+/***************************************************************************************************/
+/* Fake State */
+/***************************************************************************************************/
+static TaskFunction_t fake_task_fn FAKE_UNUSED;
+static void *fake_task_arg FAKE_UNUSED;
+static uint32_t fake_task_notified FAKE_UNUSED;
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+    UBaseType_t prio, TaskHandle_t *handle)
+{
+    fake_task_fn = fn;
+    fake_task_arg = arg;
+    if(handle != NULL)
+        *handle = (TaskHandle_t)fn;
+    return pdPASS;
+}
+
+static inline TickType_t xTaskGetTickCount(void)
+{
+    return fake_tick_count;
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    fake_tick_count += ticks;
+}
+
+static inline void vTaskDelayUntil(TickType_t *last, TickType_t ticks)
+{
+    *last += ticks;
+    if(fake_tick_count < *last)
+        fake_tick_count = *last;
+}
+
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    fake_task_notified++;
+    return pdPASS;
+}
+
+static inline uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    uint32_t n = fake_task_notified;
+
+    fake_task_notified = clear ? 0 : (n ? n - 1 : 0);
+    return n;
+}
+
+#endif /* __FAKE_TASK_H__ */
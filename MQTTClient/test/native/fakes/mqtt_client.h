@@ -0,0 +1,91 @@
+/**
+ * File Name:   mqtt_client.h
+ * Description: Host stand-in for the esp-mqtt client, for the native tests.
+ *
+ * Publishes are recorded instead of sent. The test sets what the client's outbox holds and
+ * whether the client refuses new messages.
+ */
+
+// Header Guard
+#ifndef __FAKE_MQTT_CLIENT_H__
+#define __FAKE_MQTT_CLIENT_H__
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include "freertos/FreeRTOS.h"
+
+/***************************************************************************************************/
+/* Public Constants */
+/***************************************************************************************************/
+#define FAKE_MQTT_PUBLISH_MAX               4096
+
+/***************************************************************************************************/
+/* Public Datatypes */
+/***************************************************************************************************/
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+// The fields of the client's event the firmware reads
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    char *data;
+    int data_len;
+    int total_data_len;
+    int current_data_offset;
+    char *topic;
+    int topic_len;
+    int msg_id;
+    int session_present;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    esp_mqtt_client_handle_t client;
+    const char *topic;
+    char data[FAKE_MQTT_PUBLISH_MAX];
+    int len;
+    int qos;
+    int msg_id;
+} fake_mqtt_publish_t;
+
+/***************************************************************************************************/
+/* Fake State */
+/***************************************************************************************************/
+static fake_mqtt_publish_t fake_mqtt_last FAKE_UNUSED;
+static int fake_mqtt_publishes FAKE_UNUSED;
+static int fake_mqtt_outbox_bytes FAKE_UNUSED;
+static bool fake_mqtt_refuse FAKE_UNUSED;
+
+/***************************************************************************************************/
+/* Public Inline Functions */
+/***************************************************************************************************/
+static inline int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+    int len, int qos, int retain, bool store)
+{
+    if(fake_mqtt_refuse || len > FAKE_MQTT_PUBLISH_MAX)
+        return -1;
+    fake_mqtt_last.client = client;
+    fake_mqtt_last.topic = topic;
+    memcpy(fake_mqtt_last.data, data, len);
+    fake_mqtt_last.len = len;
+    fake_mqtt_last.qos = qos;
+    fake_mqtt_last.msg_id = ++fake_mqtt_publishes;
+    // QoS 0 leaves the outbox once written, QoS 1 waits there for its PUBACK
+    if(qos > 0)
+        fake_mqtt_outbox_bytes += len;
+    return qos > 0 ? fake_mqtt_last.msg_id : 0;
+}
+
+static inline int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+    int len, int qos, int retain)
+{
+    return esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, true);
+}
+
+static inline int esp_mqtt_client_get_outbox_size(esp_mqtt_client_handle_t client)
+{
+    return fake_mqtt_outbox_bytes;
+}
+
+#endif /* __FAKE_MQTT_CLIENT_H__ */
@@ -0,0 +1,179 @@
+/**
+ * File Name:   test_aggregator.c
+ * Description: Sample filters and window statistics of the aggregator.
+ *
+ * The window statistics are checked against a two-pass computation in double precision over the
+ * same converted values, the filters against their definitions on the ADC codes.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include <math.h>
+#include "htu21_fixed.c"
+#include "aggregator.c"
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define TEST_CODE                           0x6000
+#define TEST_SPIKE                          0xF000
+#define TEST_SAMPLES                        50
+
+static aggregator_t agg;
+
+static void add(uint16_t temperature_adc, uint16_t humidity_adc)
+{
+    htu21_data_t data = { 0, 0, temperature_adc, humidity_adc };
+
+    aggregator_add(&agg, &data);
+}
+
+static void init(aggregator_filter_t filter)
+{
+    TEST_ASSERT_EQUAL(0, aggregator_init(&agg, filter));
+}
+
+// Fixed pseudo random codes over most of the sensor range
+static uint16_t code(uint32_t i)
+{
+    return (uint16_t)(0x4000 + (i * 2654435761u >> 16) % 0x8000);
+}
+
+void setUp(void)
+{
+    init(aggregator_filter_none);
+}
+
+void tearDown(void)
+{
+    TEST_ASSERT_EQUAL(0, fake_mutex_held);
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_median3_rejects_a_single_spike(void)
+{
+    static const uint16_t codes[] = { TEST_CODE, TEST_CODE, TEST_SPIKE, TEST_CODE, TEST_CODE };
+    htu21_data_t data;
+    aggregator_summary_t summary;
+
+    init(aggregator_filter_median3);
+    for(size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++)
+        add(codes[i], codes[i]);
+    TEST_ASSERT_EQUAL(0, aggregator_take(&agg, &data, &summary));
+
+    TEST_ASSERT_EQUAL(5, summary.samples);
+    TEST_ASSERT_EQUAL(TEST_CODE, data.temperature_adc);
+    TEST_ASSERT_EQUAL(TEST_CODE, data.humidity_adc);
+    TEST_ASSERT_TRUE(summary.temperature.max == summary.temperature.min);
+    TEST_ASSERT_TRUE(summary.temperature.stddev == 0.0f);
+
+    // Without the filter the spike shows
+    init(aggregator_filter_none);
+    for(size_t i = 0; i < sizeof(codes) / sizeof(codes[0]); i++)
+        add(codes[i], codes[i]);
+    TEST_ASSERT_EQUAL(0, aggregator_take(&agg, &data, &summary));
+    TEST_ASSERT_TRUE(summary.temperature.max > summary.temperature.min);
+}
+
+static void test_ema_converges_at_its_shift(void)
+{
+    const uint16_t from = 0x5000, to = 0x7000;
+    const double keep = 1.0 - 1.0 / (1 << AGGREGATOR_EMA_SHIFT);
+    double expected = from;
+    uint16_t out = 0;
+    int n;
+
+    init(aggregator_filter_ema);
+    add(from, from);
+    TEST_ASSERT_EQUAL(from, (agg.ema[aggregator_temperature] + 0x80) >> 8);
+
+    // Each step closes 1 / 2^AGGREGATOR_EMA_SHIFT of the gap, Q8 keeps it within a code
+    for(n = 1; n <= 64 && out != to; n++)
+    {
+        expected = to - (to - expected) * keep;
+        add(to, to);
+        out = (uint16_t)((agg.ema[aggregator_temperature] + 0x80) >> 8);
+        TEST_ASSERT_TRUE(fabs(out - expected) <= 1.0);
+    }
+    TEST_ASSERT_EQUAL(to, out);
+    // No slower than the exact filter needs to bring the gap below half a code, plus one for Q8
+    TEST_ASSERT_TRUE(n - 1 <= (int)ceil(log(0.5 / (to - from)) / log(keep)) + 1);
+}
+
+static void test_window_matches_two_pass_reference(void)
+{
+    double values[TEST_SAMPLES], sum = 0, sq = 0, min = INFINITY, max = -INFINITY, mean, stddev;
+    htu21_data_t data;
+    aggregator_summary_t summary;
+
+    for(uint32_t i = 0; i < TEST_SAMPLES; i++)
+    {
+        add(code(i), code(i + TEST_SAMPLES));
+        values[i] = aggregator_value(aggregator_temperature, code(i));
+        sum += values[i];
+        min = fmin(min, values[i]);
+        max = fmax(max, values[i]);
+    }
+    mean = sum / TEST_SAMPLES;
+    for(uint32_t i = 0; i < TEST_SAMPLES; i++)
+        sq += (values[i] - mean) * (values[i] - mean);
+    stddev = sqrt(sq / (TEST_SAMPLES - 1));
+
+    TEST_ASSERT_EQUAL(0, aggregator_take(&agg, &data, &summary));
+    TEST_ASSERT_EQUAL(TEST_SAMPLES, summary.samples);
+    TEST_ASSERT_TRUE(summary.temperature.min == (float)min);
+    TEST_ASSERT_TRUE(summary.temperature.max == (float)max);
+    TEST_ASSERT_TRUE(fabs(summary.temperature.mean - mean) < 1e-3);
+    TEST_ASSERT_TRUE(fabs(summary.temperature.stddev - stddev) < 1e-3 * stddev);
+    TEST_ASSERT_TRUE(data.temperature == summary.temperature.mean);
+}
+
+static void test_empty_window_is_refused(void)
+{
+    htu21_data_t data;
+    aggregator_summary_t summary;
+
+    TEST_ASSERT_EQUAL(-1, aggregator_take(&agg, &data, &summary));
+    add(TEST_CODE, TEST_CODE);
+    TEST_ASSERT_EQUAL(0, aggregator_take(&agg, &data, &summary));
+    TEST_ASSERT_EQUAL(1, summary.samples);
+    TEST_ASSERT_TRUE(summary.temperature.stddev == 0.0f);
+    // Taking the window started a new, empty one
+    TEST_ASSERT_EQUAL(-1, aggregator_take(&agg, &data, &summary));
+    TEST_ASSERT_EQUAL(1, agg.windows);
+}
+
+static void test_mean_code_is_rounded(void)
+{
+    htu21_data_t data;
+    aggregator_summary_t summary;
+
+    // 201 / 2 rounds half up, 301 / 3 rounds down
+    add(100, 100);
+    add(101, 100);
+    TEST_ASSERT_EQUAL(0, aggregator_take(&agg, &data, &summary));
+    TEST_ASSERT_EQUAL(101, data.temperature_adc);
+    TEST_ASSERT_EQUAL(100, data.humidity_adc);
+
+    add(100, 102);
+    add(100, 102);
+    add(101, 103);
+    TEST_ASSERT_EQUAL(0, aggregator_take(&agg, &data, &summary));
+    TEST_ASSERT_EQUAL(100, data.temperature_adc);
+    TEST_ASSERT_EQUAL(102, data.humidity_adc);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_median3_rejects_a_single_spike);
+    RUN_TEST(test_ema_converges_at_its_shift);
+    RUN_TEST(test_window_matches_two_pass_reference);
+    RUN_TEST(test_empty_window_is_refused);
+    RUN_TEST(test_mean_code_is_rounded);
+    return UNITY_END();
+}
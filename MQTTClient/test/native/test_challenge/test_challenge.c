@@ -0,0 +1,90 @@
+/**
+ * File Name:   test_challenge.c
+ * Description: Verdicts of the control node on responses to current and stale challenges.
+ *
+ * Responses are what a node sends back, compute_nonce_xor() of the nonce it was challenged with.
+ * A persistent session can hand the control node responses to challenges from before an outage
+ * once it resumes, those must not fail a valid node.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include "challenge.c"
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define TEST_KEY                            0x8DEEF1
+
+static uint32_t respond(uint32_t nonce)
+{
+    return nonce ^ TEST_KEY;
+}
+
+static void issue(uint32_t nonce)
+{
+    challenge_issued(respond(nonce));
+}
+
+void setUp(void)
+{
+    memset(challenge_expected, 0, sizeof(challenge_expected));
+    challenge_num = 0;
+}
+
+void tearDown(void)
+{
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_response_to_the_newest_challenge_passes(void)
+{
+    issue(0x11111111);
+    TEST_ASSERT_EQUAL(challenge_match, challenge_check(respond(0x11111111)));
+    TEST_ASSERT_EQUAL(challenge_mismatch, challenge_check(respond(0x22222222)));
+}
+
+static void test_nothing_passes_before_the_first_challenge(void)
+{
+    // The empty history must not match a response to nonce 0
+    TEST_ASSERT_EQUAL(challenge_mismatch, challenge_check(respond(0)));
+}
+
+static void test_resumed_session_replays_stale_responses(void)
+{
+    // Challenges keep going out while the nodes are offline
+    for(uint32_t nonce = 1; nonce <= 3; nonce++)
+        issue(nonce * 0x01010101);
+
+    // The session resumes and the broker replays the answers to the older challenges first
+    TEST_ASSERT_EQUAL(challenge_stale, challenge_check(respond(0x01010101)));
+    TEST_ASSERT_EQUAL(challenge_stale, challenge_check(respond(0x02020202)));
+    TEST_ASSERT_EQUAL(challenge_match, challenge_check(respond(0x03030303)));
+    // A wrong answer still fails
+    TEST_ASSERT_EQUAL(challenge_mismatch, challenge_check(0xDEADBEEF));
+}
+
+static void test_history_is_bounded(void)
+{
+    for(uint32_t nonce = 1; nonce <= CHALLENGE_HISTORY + 1; nonce++)
+        issue(nonce);
+
+    // The oldest fell out of the history and no longer counts as a valid answer
+    TEST_ASSERT_EQUAL(challenge_mismatch, challenge_check(respond(1)));
+    TEST_ASSERT_EQUAL(challenge_stale, challenge_check(respond(2)));
+    TEST_ASSERT_EQUAL(challenge_match, challenge_check(respond(CHALLENGE_HISTORY + 1)));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_response_to_the_newest_challenge_passes);
+    RUN_TEST(test_nothing_passes_before_the_first_challenge);
+    RUN_TEST(test_resumed_session_replays_stale_responses);
+    RUN_TEST(test_history_is_bounded);
+    return UNITY_END();
+}
@@ -0,0 +1,199 @@
+/**
+ * File Name:   test_encoding.c
+ * Description: Packed telemetry encoding against the receiver's decoder, and its cost next to JSON.
+ *
+ * decode() follows decode_packed() in AWS/verify_sensor_publish.py, so a change to the layout that
+ * the receiver would misread fails here.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include <time.h>
+#include "metrics.c"
+#include "htu21_fixed.c"
+#include "publisher.c"
+
+/***************************************************************************************************/
+/* Fakes */
+/***************************************************************************************************/
+static struct {
+    const char *topic;
+    uint8_t data[PUBLISHER_PAYLOAD_MAX];
+    int len;
+} outbox;
+
+int outbox_publish(outbox_lane_t lane, const char *topic, const char *data, int len, int qos,
+    outbox_policy_t policy)
+{
+    outbox.topic = topic;
+    memcpy(outbox.data, data, len);
+    outbox.len = len;
+    return 0;
+}
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define BENCH_ROUNDS                        20000
+
+typedef struct {
+    uint32_t ts;
+    double temperature;
+    double humidity;
+} decoded_t;
+
+static publisher_t pub;
+
+// The receiver's decode_packed()
+static int decode(const uint8_t *raw, int len, decoded_t *out, int max)
+{
+    uint32_t base_ts;
+    int count;
+
+    if(len < PUBLISHER_PACKED_HEADER_SIZE || raw[0] != PUBLISHER_PACKED_VERSION)
+        return -1;
+    count = raw[1];
+    base_ts = raw[2] | raw[3] << 8 | raw[4] << 16 | (uint32_t)raw[5] << 24;
+    if(len != PUBLISHER_PACKED_HEADER_SIZE + count * PUBLISHER_PACKED_RECORD_SIZE || count > max)
+        return -1;
+
+    for(int i = 0; i < count; i++)
+    {
+        const uint8_t *r = &raw[PUBLISHER_PACKED_HEADER_SIZE + i * PUBLISHER_PACKED_RECORD_SIZE];
+        uint16_t offset = r[0] | r[1] << 8;
+        uint16_t t_adc = r[2] | r[3] << 8;
+        uint16_t rh_adc = r[4] | r[5] << 8;
+        double temp_c = t_adc * 175.72 / 65536 - 46.85;
+
+        out[i].ts = base_ts + offset;
+        out[i].temperature = round((temp_c * 9 / 5 + 32) * 100) / 100;
+        out[i].humidity = round((rh_adc * 125.0 / 65536 - 6) * 100) / 100;
+    }
+    return count;
+}
+
+// A sample as the sensor task reports it
+static publisher_sample_t sample(uint32_t ts, uint16_t t_adc, uint16_t rh_adc)
+{
+    publisher_sample_t s;
+
+    memset(&s, 0, sizeof(s));
+    s.timestamp = ts;
+    s.data.temperature_adc = t_adc;
+    s.data.humidity_adc = rh_adc;
+    s.data.temperature = htu21_fixed_fahrenheit(htu21_fixed_temperature(t_adc)) / 100.0f;
+    s.data.humidity = htu21_fixed_humidity(rh_adc) / 100.0f;
+    return s;
+}
+
+static double elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+void setUp(void)
+{
+    memset(&outbox, 0, sizeof(outbox));
+    TEST_ASSERT_EQUAL(0, publisher_init(&pub, NULL, publisher_encoding_packed));
+    publisher_set_limits(&pub, PUBLISHER_RING_SIZE, 60000);
+}
+
+void tearDown(void)
+{
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_packed_round_trip(void)
+{
+    decoded_t out[PUBLISHER_RING_SIZE];
+    publisher_sample_t s[PUBLISHER_RING_SIZE];
+    int n;
+
+    // Codes across the sensor's range, a second apart, the last one fills the batch
+    for(int i = 0; i < PUBLISHER_RING_SIZE; i++)
+    {
+        s[i] = sample(1700000000 + i, (uint16_t)(i * 2039 + 0x0100), (uint16_t)(i * 1987 + 0x0F00));
+        n = publisher_push_sample(&pub, &s[i]);
+    }
+    TEST_ASSERT_EQUAL(PUBLISHER_RING_SIZE, n);
+    TEST_ASSERT_EQUAL_STRING(PUBLISHER_PACKED_TOPIC, outbox.topic);
+    TEST_ASSERT_EQUAL(PUBLISHER_PACKED_HEADER_SIZE + PUBLISHER_RING_SIZE * PUBLISHER_PACKED_RECORD_SIZE, outbox.len);
+
+    n = decode(outbox.data, outbox.len, out, PUBLISHER_RING_SIZE);
+    TEST_ASSERT_EQUAL(PUBLISHER_RING_SIZE, n);
+    for(int i = 0; i < n; i++)
+    {
+        // The receiver sees what the JSON path would have sent. The device rounds to 0.005 degC and
+        // truncates the Fahrenheit value to 0.01, the receiver rounds to 0.005
+        TEST_ASSERT_EQUAL_UINT32(s[i].timestamp, out[i].ts);
+        TEST_ASSERT_FLOAT_WITHIN(0.0241, s[i].data.temperature, out[i].temperature);
+        TEST_ASSERT_FLOAT_WITHIN(0.0101, s[i].data.humidity, out[i].humidity);
+    }
+}
+
+static void test_packed_batch_breaks_where_offsets_do_not_fit(void)
+{
+    decoded_t out[PUBLISHER_RING_SIZE];
+    publisher_sample_t s;
+
+    s = sample(1700000000, 0x6000, 0x7000);
+    publisher_push_sample(&pub, &s);
+    s = sample(1700000000 + UINT16_MAX, 0x6000, 0x7000);
+    publisher_push_sample(&pub, &s);
+    // Older than the batch's base time
+    s = sample(1699999999, 0x6000, 0x7000);
+    publisher_push_sample(&pub, &s);
+
+    TEST_ASSERT_EQUAL(2, publisher_flush(&pub));
+    TEST_ASSERT_EQUAL(2, decode(outbox.data, outbox.len, out, PUBLISHER_RING_SIZE));
+    TEST_ASSERT_EQUAL_UINT32(1700000000 + UINT16_MAX, out[1].ts);
+
+    TEST_ASSERT_EQUAL(1, publisher_flush(&pub));
+    TEST_ASSERT_EQUAL(1, decode(outbox.data, outbox.len, out, PUBLISHER_RING_SIZE));
+    TEST_ASSERT_EQUAL_UINT32(1699999999, out[0].ts);
+}
+
+static void test_bench_json_and_packed(void)
+{
+    static const char *names[] = { "json", "packed" };
+    char msg[160];
+    publisher_sample_t s;
+    struct timespec start;
+    uint16_t sent;
+    int len = 0;
+
+    for(int i = 0; i < PUBLISHER_MAX_SAMPLES; i++)
+    {
+        s = sample(1700000000 + i * 5, (uint16_t)(0x6000 + i * 37), (uint16_t)(0x7000 + i * 53));
+        publisher_push_sample(&pub, &s);
+    }
+
+    for(int e = publisher_encoding_json; e <= publisher_encoding_packed; e++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(int r = 0; r < BENCH_ROUNDS; r++)
+            len = e == publisher_encoding_json ?
+                publisher_encode_json(pub.ring, PUBLISHER_RING_SIZE, pub.head, pub.count, &sent) :
+                publisher_encode_packed(pub.ring, PUBLISHER_RING_SIZE, pub.head, pub.count, &sent);
+        TEST_ASSERT_EQUAL(PUBLISHER_MAX_SAMPLES, sent);
+        snprintf(msg, sizeof(msg), "%-6s %d samples: %4d bytes (%.1f per sample), %.0f ns per batch", names[e],
+            sent, len, (double)len / sent, elapsed_ns(&start) / BENCH_ROUNDS);
+        TEST_MESSAGE(msg);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_packed_round_trip);
+    RUN_TEST(test_packed_batch_breaks_where_offsets_do_not_fit);
+    RUN_TEST(test_bench_json_and_packed);
+    return UNITY_END();
+}
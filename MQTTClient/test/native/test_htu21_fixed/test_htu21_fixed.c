@@ -0,0 +1,190 @@
+/**
+ * File Name:   test_htu21_fixed.c
+ * Description: Integer HTU21 math against the double precision datasheet formulas.
+ *
+ * Every bound checked here is the one documented in htu21_fixed.h. The conversions are checked
+ * for every ADC code, the derived values over the sensor's range.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include <time.h>
+#include "htu21_fixed.c"
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define BENCH_ROUNDS                        1000000
+
+// Datasheet formulas, in the units of the fixed point results
+static double temperature_ref(uint16_t adc)
+{
+    return (adc * 175.72 / 65536 - 46.85) * 100;
+}
+
+static double humidity_ref(uint16_t adc)
+{
+    return (adc * 125.0 / 65536 - 6) * 100;
+}
+
+static double dew_point_ref(double centi_c, double centi_rh)
+{
+    double t = centi_c / 100, rh = centi_rh / 100;
+    double pp = pow(10, 8.1332 - 1762.39 / (t + 235.66));
+
+    return -(1762.39 / (log10(rh * pp / 100) - 8.1332) + 235.66) * 100;
+}
+
+static volatile int32_t sink_fixed;
+static volatile double sink_double;
+
+static double elapsed_ns(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_conversions_round_to_nearest(void)
+{
+    double worst_t = 0, worst_rh = 0;
+
+    for(uint32_t adc = 0; adc <= UINT16_MAX; adc++)
+    {
+        double et = fabs(htu21_fixed_temperature(adc) - temperature_ref(adc));
+        double erh = fabs(htu21_fixed_humidity(adc) - humidity_ref(adc));
+
+        worst_t = et > worst_t ? et : worst_t;
+        worst_rh = erh > worst_rh ? erh : worst_rh;
+    }
+    // 0.005 degC and 0.005 %RH
+    TEST_ASSERT_FLOAT_WITHIN(0.5 + 1e-9, 0, worst_t);
+    TEST_ASSERT_FLOAT_WITHIN(0.5 + 1e-9, 0, worst_rh);
+}
+
+static void test_fahrenheit_truncates(void)
+{
+    for(int32_t c = -4685; c <= 12887; c++)
+    {
+        double exact = c * 9.0 / 5.0 + 3200;
+        int32_t f = htu21_fixed_fahrenheit(c);
+
+        // Towards zero, less than 0.01 degF away
+        TEST_ASSERT_TRUE(fabs(f - exact) < 1.0);
+        TEST_ASSERT_TRUE(fabs(f - 3200) <= fabs(exact - 3200));
+    }
+}
+
+static void test_compensated_humidity(void)
+{
+    for(int32_t c = -4000; c <= 12500; c += 7)
+        for(int32_t rh = 0; rh <= 10000; rh += 97)
+        {
+            double exact = rh + (25 - c / 100.0) * -0.15 * 100;
+
+            TEST_ASSERT_FLOAT_WITHIN(1.0, exact, htu21_fixed_compensated_humidity(c, rh));
+        }
+}
+
+static void test_log10(void)
+{
+    double worst = 0;
+
+    for(uint32_t x = 1; x < (1u << 24); x += 1 + x / 512)
+    {
+        double e = fabs(htu21_fixed_log10(x) / 65536.0 - log10(x));
+        worst = e > worst ? e : worst;
+    }
+    // The table error plus the Q16 step
+    TEST_ASSERT_FLOAT_WITHIN(8e-5 + 1.0 / 65536, 0, worst);
+}
+
+static void test_dew_point_within_documented_bound(void)
+{
+    double worst = 0, e;
+    int32_t worst_c = 0, worst_rh = 0;
+    char msg[96];
+
+    for(int32_t c = -4000; c <= 12500; c += 25)
+        for(int32_t rh = 100; rh <= 10000; rh += 25)
+        {
+            e = fabs(htu21_fixed_dew_point(c, rh) - dew_point_ref(c, rh));
+            if(e > worst)
+            {
+                worst = e;
+                worst_c = c;
+                worst_rh = rh;
+            }
+        }
+
+    snprintf(msg, sizeof(msg), "dew point worst %.4f degC at %.2f degC %.2f %%RH", worst / 100,
+        worst_c / 100.0, worst_rh / 100.0);
+    TEST_MESSAGE(msg);
+    // 0.02 degC
+    TEST_ASSERT_FLOAT_WITHIN(2.0, 0, worst);
+}
+
+static void test_dew_point_clamps_humidity(void)
+{
+    TEST_ASSERT_EQUAL_INT32(htu21_fixed_dew_point(2500, 1), htu21_fixed_dew_point(2500, 0));
+    TEST_ASSERT_EQUAL_INT32(htu21_fixed_dew_point(2500, 10000), htu21_fixed_dew_point(2500, 12000));
+    // Saturated air is at its dew point
+    TEST_ASSERT_INT32_WITHIN(2, 2500, htu21_fixed_dew_point(2500, 10000));
+}
+
+static void test_bench_fixed_and_double(void)
+{
+    struct timespec start;
+    double fixed_ns, double_ns;
+    char msg[160];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        int32_t c = htu21_fixed_temperature((uint16_t)(0x4000 + (i & 0x7FFF)));
+        int32_t rh = htu21_fixed_humidity((uint16_t)(0x2000 + (i & 0x7FFF)));
+        sink_fixed = htu21_fixed_dew_point(c, rh);
+    }
+    fixed_ns = elapsed_ns(&start) / BENCH_ROUNDS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(uint32_t i = 0; i < BENCH_ROUNDS; i++)
+    {
+        double c = temperature_ref((uint16_t)(0x4000 + (i & 0x7FFF)));
+        double rh = humidity_ref((uint16_t)(0x2000 + (i & 0x7FFF)));
+        sink_double = dew_point_ref(c, rh < 1 ? 1 : rh);
+    }
+    double_ns = elapsed_ns(&start) / BENCH_ROUNDS;
+
+    // The build machine has a double precision FPU, the ESP32 does not
+    snprintf(msg, sizeof(msg), "conversions and dew point: fixed %.1f ns, double %.1f ns per sample", fixed_ns,
+        double_ns);
+    TEST_MESSAGE(msg);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_conversions_round_to_nearest);
+    RUN_TEST(test_fahrenheit_truncates);
+    RUN_TEST(test_compensated_humidity);
+    RUN_TEST(test_log10);
+    RUN_TEST(test_dew_point_within_documented_bound);
+    RUN_TEST(test_dew_point_clamps_humidity);
+    RUN_TEST(test_bench_fixed_and_double);
+    return UNITY_END();
+}
@@ -0,0 +1,185 @@
+/**
+ * File Name:   test_mqtt_conn.c
+ * Description: Reconnects of an MQTT connection: resubscribing, resumed sessions and connect times.
+ *
+ * The events are reported the way the MQTT event handler does. The client itself, and the TLS
+ * session it may resume, are not part of this; a resumed MQTT session shows as a CONNACK with the
+ * session present.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include "metrics.c"
+#include "mqtt_conn.c"
+
+/***************************************************************************************************/
+/* Fakes */
+/***************************************************************************************************/
+int outbox_publish(outbox_lane_t lane, const char *topic, const char *data, int len, int qos,
+    outbox_policy_t policy)
+{
+    return 0;
+}
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define TEST_SUBSCRIPTIONS                  3
+
+static mqtt_conn_stats_t *conn = &mqtt_conn_stats[0];
+
+static void advance_ms(uint32_t ms)
+{
+    fake_time_us += (int64_t)ms * 1000;
+}
+
+static uint32_t metric(const char *name)
+{
+    metrics_t *m = metrics_find(name);
+
+    TEST_ASSERT_NOT_NULL(m);
+    return metrics_get(m);
+}
+
+// An attempt taking connect_ms to its CONNACK, then the SUBSCRIBEs if the connection asks for them
+static bool connect(uint32_t connect_ms, bool session_present, uint32_t suback_ms)
+{
+    bool subscribe;
+
+    mqtt_conn_attempt(conn);
+    advance_ms(connect_ms);
+    subscribe = mqtt_conn_connected(conn, session_present);
+    if(subscribe)
+    {
+        for(int i = 0; i < TEST_SUBSCRIPTIONS; i++)
+            mqtt_conn_subscribing(conn);
+        advance_ms(suback_ms);
+        for(int i = 0; i < TEST_SUBSCRIPTIONS; i++)
+            mqtt_conn_subscribed(conn);
+    }
+    return subscribe;
+}
+
+void setUp(void)
+{
+    const char *name = conn->name;
+
+    fake_time_us = 1000000;
+    memset(conn, 0, sizeof(mqtt_conn_stats_t));
+    conn->name = name;
+    mqtt_conn_init();
+    for(uint32_t i = 0; i < metrics_num; i++)
+        metrics_set(&metrics_table[i], 0);
+}
+
+void tearDown(void)
+{
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_first_connect_subscribes(void)
+{
+    TEST_ASSERT_TRUE(connect(300, false, 40));
+    TEST_ASSERT_EQUAL(1, conn->connects);
+    TEST_ASSERT_EQUAL(0, conn->resumed);
+    TEST_ASSERT_EQUAL(300, conn->connect_ms);
+    TEST_ASSERT_EQUAL(40, conn->suback_ms);
+    TEST_ASSERT_EQUAL(300, metric("conn_ms"));
+    TEST_ASSERT_EQUAL(40, metric("suback_ms"));
+    // No outage before the first connect
+    TEST_ASSERT_EQUAL(0, conn->outage_ms);
+}
+
+static void test_resumed_session_skips_resubscribing(void)
+{
+    connect(300, false, 40);
+    mqtt_conn_disconnected(conn);
+    advance_ms(2000);
+
+    TEST_ASSERT_FALSE(connect(150, true, 0));
+    TEST_ASSERT_EQUAL(2, conn->connects);
+    TEST_ASSERT_EQUAL(1, conn->resumed);
+    TEST_ASSERT_EQUAL(1, metric("sess_resumed"));
+    TEST_ASSERT_EQUAL(0, conn->suback_ms);
+    TEST_ASSERT_EQUAL(0, metric("suback_ms"));
+    TEST_ASSERT_EQUAL(2150, conn->outage_ms);
+    TEST_ASSERT_EQUAL(2150, metric("outage_ms"));
+    TEST_ASSERT_EQUAL(150, conn->connect_ms);
+    TEST_ASSERT_EQUAL(300, conn->connect_max_ms);
+}
+
+static void test_lost_session_resubscribes(void)
+{
+    connect(300, false, 40);
+    mqtt_conn_disconnected(conn);
+    advance_ms(500);
+
+    // The broker dropped the session, e.g. it expired during the outage
+    TEST_ASSERT_TRUE(connect(200, false, 60));
+    TEST_ASSERT_EQUAL(0, conn->resumed);
+    TEST_ASSERT_EQUAL(60, conn->suback_ms);
+    TEST_ASSERT_EQUAL(700, conn->outage_ms);
+}
+
+static void test_suback_waits_for_every_subscription(void)
+{
+    mqtt_conn_attempt(conn);
+    advance_ms(100);
+    TEST_ASSERT_TRUE(mqtt_conn_connected(conn, false));
+    mqtt_conn_subscribing(conn);
+    mqtt_conn_subscribing(conn);
+
+    advance_ms(10);
+    mqtt_conn_subscribed(conn);
+    TEST_ASSERT_EQUAL(0, conn->suback_ms);
+    advance_ms(15);
+    mqtt_conn_subscribed(conn);
+    TEST_ASSERT_EQUAL(25, conn->suback_ms);
+
+    // A stray SUBACK, e.g. of a later SUBSCRIBE, leaves the connect time alone
+    advance_ms(100);
+    mqtt_conn_subscribed(conn);
+    TEST_ASSERT_EQUAL(25, conn->suback_ms);
+}
+
+static void test_connect_histogram_buckets(void)
+{
+    // Bucket i holds connects below MQTT_CONNECT_HIST_BASE_MS << i, the last everything above
+    static const struct {
+        uint32_t ms;
+        uint8_t bucket;
+    } cases[] = {
+        { 0, 0 },
+        { MQTT_CONNECT_HIST_BASE_MS - 1, 0 },
+        { MQTT_CONNECT_HIST_BASE_MS, 1 },
+        { 2 * MQTT_CONNECT_HIST_BASE_MS - 1, 1 },
+        { 2 * MQTT_CONNECT_HIST_BASE_MS, 2 },
+        { (MQTT_CONNECT_HIST_BASE_MS << (MQTT_CONNECT_HIST_BUCKETS - 2)) - 1, MQTT_CONNECT_HIST_BUCKETS - 2 },
+        { MQTT_CONNECT_HIST_BASE_MS << (MQTT_CONNECT_HIST_BUCKETS - 2), MQTT_CONNECT_HIST_BUCKETS - 1 },
+        { 600000, MQTT_CONNECT_HIST_BUCKETS - 1 },
+    };
+    uint32_t expected[MQTT_CONNECT_HIST_BUCKETS] = { 0 };
+
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        connect(cases[i].ms, true, 0);
+        expected[cases[i].bucket]++;
+    }
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(expected, conn->connect_hist, MQTT_CONNECT_HIST_BUCKETS);
+    TEST_ASSERT_EQUAL(600000, conn->connect_max_ms);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_first_connect_subscribes);
+    RUN_TEST(test_resumed_session_skips_resubscribing);
+    RUN_TEST(test_lost_session_resubscribes);
+    RUN_TEST(test_suback_waits_for_every_subscription);
+    RUN_TEST(test_connect_histogram_buckets);
+    return UNITY_END();
+}
@@ -0,0 +1,167 @@
+/**
+ * File Name:   test_mqtt_rx.c
+ * Description: Routing and fragment reassembly of received MQTT messages.
+ *
+ * Fragments are fed the way the client delivers them in MQTT_EVENT_DATA, a recorder stands in for
+ * the route handlers.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include "mqtt_rx.c"
+
+/***************************************************************************************************/
+/* Fakes */
+/***************************************************************************************************/
+static struct {
+    char data[MQTT_RX_BUF_LEN + 1];
+    int len;
+    int calls;
+} handled;
+
+static void record(void *ctx, const char *data, int len)
+{
+    memcpy(handled.data, data, len);
+    handled.data[len] = '\0';
+    handled.len = len;
+    handled.calls++;
+}
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define TEST_TOPIC                          "device/challenge"
+#define TEST_FRAGMENT                       100
+
+static const mqtt_route_t routes[] = {
+    { TEST_TOPIC, sizeof(TEST_TOPIC) - 1, record },
+};
+
+static esp_mqtt_client_handle_t client_a = (esp_mqtt_client_handle_t)&client_a;
+static esp_mqtt_client_handle_t client_b = (esp_mqtt_client_handle_t)&client_b;
+static char payload[MQTT_RX_BUF_LEN];
+
+// One MQTT_EVENT_DATA of a message of total bytes, the topic comes with the first fragment only
+static void fragment(esp_mqtt_client_handle_t client, int msg_id, int total, int offset, int len)
+{
+    esp_mqtt_event_t event = {
+        .client = client,
+        .data = &payload[offset],
+        .data_len = len,
+        .total_data_len = total,
+        .current_data_offset = offset,
+        .topic = offset == 0 ? TEST_TOPIC : NULL,
+        .topic_len = offset == 0 ? sizeof(TEST_TOPIC) - 1 : 0,
+        .msg_id = msg_id,
+    };
+
+    mqtt_rx_data(NULL, &event);
+}
+
+static void message(esp_mqtt_client_handle_t client, int msg_id, int total)
+{
+    for(int offset = 0; offset < total; offset += TEST_FRAGMENT)
+        fragment(client, msg_id, total, offset, total - offset < TEST_FRAGMENT ? total - offset : TEST_FRAGMENT);
+}
+
+static int slots_in_use(void)
+{
+    int n = 0;
+
+    for(int i = 0; i < MQTT_RX_POOL_SIZE; i++)
+        n += mqtt_rx_pool[i].in_use;
+    return n;
+}
+
+void setUp(void)
+{
+    for(int i = 0; i < (int)sizeof(payload); i++)
+        payload[i] = 'a' + i % 26;
+    memset(&handled, 0, sizeof(handled));
+    memset(&mqtt_rx_stats, 0, sizeof(mqtt_rx_stats));
+    memset(mqtt_rx_pool, 0, sizeof(mqtt_rx_pool));
+    mqtt_rx_init(routes, sizeof(routes) / sizeof(routes[0]));
+}
+
+void tearDown(void)
+{
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_fragments_are_reassembled(void)
+{
+    message(client_a, 1, 250);
+    TEST_ASSERT_EQUAL(1, handled.calls);
+    TEST_ASSERT_EQUAL(250, handled.len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, handled.data, 250);
+    TEST_ASSERT_EQUAL(1, mqtt_rx_stats.reassembled);
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+}
+
+static void test_unrouted_message_is_only_counted(void)
+{
+    esp_mqtt_event_t event = {
+        .client = client_a, .data = payload, .data_len = 10, .total_data_len = 10,
+        .topic = "other/topic", .topic_len = 11, .msg_id = 1,
+    };
+
+    mqtt_rx_data(NULL, &event);
+    TEST_ASSERT_EQUAL(1, mqtt_rx_stats.unrouted);
+    TEST_ASSERT_EQUAL(0, handled.calls);
+}
+
+static void test_disconnect_frees_the_slots_of_its_client(void)
+{
+    // Both connections drop in the middle of a message, the whole pool is held
+    fragment(client_a, 1, 300, 0, TEST_FRAGMENT);
+    fragment(client_b, 2, 300, 0, TEST_FRAGMENT);
+    TEST_ASSERT_EQUAL(MQTT_RX_POOL_SIZE, slots_in_use());
+
+    mqtt_rx_disconnected(client_a);
+    TEST_ASSERT_EQUAL(MQTT_RX_POOL_SIZE - 1, slots_in_use());
+    mqtt_rx_disconnected(client_b);
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+    TEST_ASSERT_EQUAL(2, mqtt_rx_stats.dropped);
+
+    // After the reconnect fragmented messages get through again
+    message(client_a, 3, 300);
+    TEST_ASSERT_EQUAL(1, handled.calls);
+    TEST_ASSERT_EQUAL(300, handled.len);
+
+    // A late fragment of a message cut off by the disconnect is ignored
+    fragment(client_b, 2, 300, TEST_FRAGMENT, TEST_FRAGMENT);
+    TEST_ASSERT_EQUAL(1, handled.calls);
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+}
+
+static void test_new_message_takes_over_the_slot_of_its_client(void)
+{
+    // The first message never completes, its client moves on to the next one
+    fragment(client_a, 1, 300, 0, TEST_FRAGMENT);
+    message(client_a, 2, 250);
+    TEST_ASSERT_EQUAL(1, handled.calls);
+    TEST_ASSERT_EQUAL(250, handled.len);
+    TEST_ASSERT_EQUAL(1, mqtt_rx_stats.dropped);
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+
+    // Repeated cut off messages hold one slot at most, another client still finds room
+    for(int i = 0; i < 2 * MQTT_RX_POOL_SIZE; i++)
+        fragment(client_a, 10 + i, 300, 0, TEST_FRAGMENT);
+    TEST_ASSERT_EQUAL(1, slots_in_use());
+    message(client_b, 20, 300);
+    TEST_ASSERT_EQUAL(2, handled.calls);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_fragments_are_reassembled);
+    RUN_TEST(test_unrouted_message_is_only_counted);
+    RUN_TEST(test_disconnect_frees_the_slots_of_its_client);
+    RUN_TEST(test_new_message_takes_over_the_slot_of_its_client);
+    return UNITY_END();
+}
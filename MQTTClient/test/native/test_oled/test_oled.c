@@ -0,0 +1,261 @@
+/**
+ * File Name:   test_oled.c
+ * Description: Screens rendered through the flush protocol into the panel emulator.
+ *
+ * Each frame is checked twice: the panel RAM must match the front buffer it was flushed from, and
+ * what the panel shows must match the golden image in golden/. Set OLED_GOLDEN_UPDATE=1 to write
+ * the golden images instead of comparing, after checking a change on the real panel.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#define SSD1306_EMULATOR
+#include <unity.h>
+#include <stdlib.h>
+#include <time.h>
+#include "oled_raster.c"
+#include "ssd1306_emu.c"
+
+/***************************************************************************************************/
+/* Fakes */
+/***************************************************************************************************/
+#define TEST_I2C_ADDRESS                    0x3C
+
+static ssd1306_emu_t *emu;
+
+void ssd1306_transfer(bool flush, uint8_t control, const uint8_t *buf, size_t len)
+{
+    ssd1306_emu_begin(emu, TEST_I2C_ADDRESS);
+    ssd1306_emu_write(emu, &control, sizeof(control));
+    ssd1306_emu_write(emu, buf, len);
+    ssd1306_emu_end(emu);
+}
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define GOLDEN_DIR                          "test/native/test_oled/golden/"
+#define FULL_FRAME_BYTES                    (SSD1306_LCDWIDTH * SSD1306_PAGES)
+#define BENCH_CHARS                         200000
+
+// Sat Oct 17, 2026 02:05 PM
+static const struct tm clock_time = {
+    .tm_year = 126, .tm_mon = 9, .tm_mday = 17, .tm_wday = 6, .tm_hour = 14, .tm_min = 5
+};
+
+// Swap and flush like SSD1306_Display and the flush task, then check what the panel got
+static ssd1306_emu_stats_t present(const char *name)
+{
+    ssd1306_emu_stats_t stats;
+    char path[96], msg[128];
+
+    ssd1306_emu_take_stats(emu, &stats);
+    TEST_ASSERT_TRUE(ssd1306_frame_changed());
+    ssd1306_frame_swap();
+    TEST_ASSERT_TRUE(ssd1306_frame_flush() > 0);
+    ssd1306_emu_take_stats(emu, &stats);
+
+    TEST_ASSERT_EQUAL_MEMORY(ssd1306_front_buffer, emu->ram, FULL_FRAME_BYTES);
+    snprintf(path, sizeof(path), GOLDEN_DIR "%s.pgm", name);
+    if(getenv("OLED_GOLDEN_UPDATE") != NULL)
+        TEST_ASSERT_EQUAL(0, ssd1306_emu_dump_pgm(emu, path));
+    else
+        TEST_ASSERT_EQUAL_MESSAGE(0, ssd1306_emu_compare_pgm(emu, path), path);
+
+    snprintf(msg, sizeof(msg), "%-16s %2u transactions, %4u bytes on the bus (%4u display RAM)", name,
+        (unsigned)stats.transactions, (unsigned)stats.bytes, (unsigned)stats.data_bytes);
+    TEST_MESSAGE(msg);
+    return stats;
+}
+
+/*
+ * Text rendering as SSD1306_Print did it before the glyph blit: every glyph bit is a DrawPixel, or
+ * a FillRect of size x size from text size 2 on. Kept here as the reference the blit is checked and
+ * measured against.
+ */
+static void ref_print(uint8_t c)
+{
+    uint8_t i, j, line;
+
+    if(c == ' ' && x_pos == 0 && wrap)
+        return;
+    if((c < ' ') || (c > '~'))
+        c = '?';
+
+    for(i = 0; i < 5; i++)
+    {
+        line = c < 'S' ? Font[(c - ' ') * 5 + i] : Font2[(c - 'S') * 5 + i];
+        for(j = 0; j < 7; j++, line >>= 1)
+        {
+            if(text_size == 1)
+                SSD1306_DrawPixel(x_pos + i, y_pos + j, line & 0x01);
+            else
+                SSD1306_FillRect(x_pos + (i * text_size), y_pos + (j * text_size), text_size, text_size,
+                    line & 0x01);
+        }
+    }
+    SSD1306_FillRect(x_pos + (5 * text_size), y_pos, text_size, 7 * text_size, false);
+
+    x_pos += text_size * 6;
+    if(x_pos > (SSD1306_LCDWIDTH + text_size * 6))
+        x_pos = SSD1306_LCDWIDTH;
+    if(wrap && (x_pos + (text_size * 5)) > SSD1306_LCDWIDTH)
+    {
+        x_pos = 0;
+        y_pos += text_size * 8;
+        if((y_pos + text_size * 7) > SSD1306_LCDHEIGHT)
+            y_pos = 0;
+    }
+}
+
+static void ref_draw_text(uint8_t x, uint8_t y, char *text, uint8_t size)
+{
+    SSD1306_GotoXY(x, y);
+    SSD1306_TextSize(size);
+    while(*text != '\0')
+        ref_print(*text++);
+}
+
+typedef void (*draw_text_t)(uint8_t x, uint8_t y, char *text, uint8_t size);
+
+// Characters per second drawing line over and over at the given size
+static double bench_text(draw_text_t draw, char *line, size_t len, uint8_t size)
+{
+    struct timespec start, now;
+    uint32_t chars;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(chars = 0; chars < BENCH_CHARS; chars += len)
+    {
+        // Alternate the first glyph so every pass changes pixels
+        line[0] = (chars / len) & 1 ? 't' : 'T';
+        draw(0, 0, line, size);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return chars / ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+void setUp(void)
+{
+    emu = ssd1306_emu_get();
+    ssd1306_emu_reset(emu);
+    // Power on: the panel RAM is unknown, the first frame sends all of it
+    ssd1306_panel_init(SSD1306_SWITCHCAPVCC);
+    SSD1306_ClearDisplay();
+}
+
+void tearDown(void)
+{
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_boot_frame_sends_everything(void)
+{
+    ssd1306_emu_stats_t stats = present("boot");
+
+    TEST_ASSERT_EQUAL(FULL_FRAME_BYTES, stats.data_bytes);
+    TEST_ASSERT_TRUE(emu->display_on);
+    TEST_ASSERT_FALSE(ssd1306_frame_changed());
+}
+
+static void test_welcome(void)
+{
+    ssd1306_draw_clock(&clock_time);
+    ssd1306_draw_body(WELCOME, false, 0, 0);
+    present("welcome");
+}
+
+static void test_ip_info(void)
+{
+    ssd1306_draw_clock(&clock_time);
+    ssd1306_draw_body(IP_INFO, false, 0, 0);
+    present("ip_info");
+}
+
+static void test_env_info(void)
+{
+    ssd1306_draw_clock(&clock_time);
+    ssd1306_draw_body(WELCOME, false, 0, 0);
+    present("welcome");
+
+    // Switching screens only sends the body
+    ssd1306_draw_body(ENV_INFO, true, 72.35f, 45.10f);
+    present("env_info");
+}
+
+static void test_env_update_sends_only_the_change(void)
+{
+    ssd1306_emu_stats_t stats;
+
+    ssd1306_draw_clock(&clock_time);
+    ssd1306_draw_body(ENV_INFO, true, 72.35f, 45.10f);
+    present("env_info");
+
+    // Same reading drawn again: nothing changed, nothing to present
+    ssd1306_draw_body(ENV_INFO, true, 72.35f, 45.10f);
+    TEST_ASSERT_FALSE(ssd1306_frame_changed());
+
+    ssd1306_draw_body(ENV_INFO, true, 72.41f, 45.10f);
+    stats = present("env_info_update");
+    // A few digits of the temperature line
+    TEST_ASSERT_TRUE(stats.data_bytes < SSD1306_LCDWIDTH);
+
+    ssd1306_draw_body(ENV_INFO, true, 72.35f, 45.10f);
+    present("env_info");
+}
+
+static void test_env_info_without_reading(void)
+{
+    ssd1306_draw_clock(&clock_time);
+    ssd1306_draw_body(ENV_INFO, true, 72.35f, 45.10f);
+    present("env_info");
+
+    // The previous body is cleared, only the clock stays
+    ssd1306_draw_body(ENV_INFO, false, 0, 0);
+    present("ip_info");
+}
+
+static void test_bench_text(void)
+{
+    // Size 2 glyphs come from the cache, 1, 3 and 4 are scaled per character and 5 is drawn as a
+    // rectangle per pixel by both paths
+    static const uint8_t sizes[] = { 1, 2, 3, 4, 5 };
+    static char line[] = "Temperature: 72.35 F";
+    static uint8_t ref[FULL_FRAME_BYTES];
+    double blit, per_bit;
+    char msg[96];
+
+    for(uint8_t i = 0; i < sizeof(sizes); i++)
+    {
+        // Both paths draw the same pixels, y 3 is off the page grid
+        SSD1306_ClearDisplay();
+        ref_draw_text(0, 3, line, sizes[i]);
+        memcpy(ref, ssd1306_buffer, sizeof(ref));
+        SSD1306_ClearDisplay();
+        SSD1306_DrawText(0, 3, line, sizes[i]);
+        TEST_ASSERT_EQUAL_MEMORY(ref, ssd1306_buffer, sizeof(ref));
+
+        per_bit = bench_text(ref_draw_text, line, sizeof(line) - 1, sizes[i]);
+        blit = bench_text(SSD1306_DrawText, line, sizeof(line) - 1, sizes[i]);
+        snprintf(msg, sizeof(msg), "text size %u: %9.0f chars/s blit, %9.0f chars/s per bit, %5.1fx",
+            sizes[i], blit, per_bit, blit / per_bit);
+        TEST_MESSAGE(msg);
+    }
+    TEST_ASSERT_TRUE(ssd1306_frame_changed());
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_boot_frame_sends_everything);
+    RUN_TEST(test_welcome);
+    RUN_TEST(test_ip_info);
+    RUN_TEST(test_env_info);
+    RUN_TEST(test_env_update_sends_only_the_change);
+    RUN_TEST(test_env_info_without_reading);
+    RUN_TEST(test_bench_text);
+    return UNITY_END();
+}
@@ -0,0 +1,162 @@
+/**
+ * File Name:   test_outbox.c
+ * Description: Backpressure state of the outbox and how the data lane drains.
+ *
+ * The lane tasks are never run, a test steps the data lane by hand the way outbox_main does:
+ * refresh the state, then forward one message if the client has room for it.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include "metrics.c"
+#include "puback.c"
+#include "outbox.c"
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define TEST_TOPIC                          "data/sensor"
+#define TEST_CONTROL_TOPIC                  "device/challenge"
+#define TEST_MSG_LEN                        200
+
+static esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t)&client;
+static TaskHandle_t listener = (TaskHandle_t)&listener;
+static outbox_lane_ctx_t *data_lane = &outbox_lanes[outbox_lane_data];
+static outbox_lane_ctx_t *control_lane = &outbox_lanes[outbox_lane_control];
+static char msg[TEST_MSG_LEN];
+
+// One pass of the data lane task, false if it had to wait
+static bool step(void)
+{
+    outbox_update();
+    if(!outbox_data_ready())
+        return false;
+    outbox_forward(data_lane, 0);
+    return true;
+}
+
+static int fill(void)
+{
+    int n = 0;
+
+    while(0 == outbox_publish(outbox_lane_data, TEST_TOPIC, msg, sizeof(msg), 0, outbox_policy_drop))
+        n++;
+    return n;
+}
+
+void setUp(void)
+{
+    memset(msg, 'x', sizeof(msg));
+    fake_mqtt_outbox_bytes = 0;
+    fake_mqtt_publishes = 0;
+    fake_task_notified = 0;
+    TEST_ASSERT_EQUAL(0, outbox_start(client, client));
+    outbox_set_listener(listener);
+    // Empty handoff buffers and an ok state, as after boot
+    for(int i = 0; i < outbox_lane_num; i++)
+        outbox_lanes[i].buffer->used = 0;
+    outbox_update();
+    TEST_ASSERT_EQUAL(outbox_ok, outbox_get_state());
+    fake_task_notified = 0;
+}
+
+void tearDown(void)
+{
+    TEST_ASSERT_EQUAL(0, fake_mutex_held);
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_full_handoff_buffer_drains_and_recovers(void)
+{
+    int queued = fill();
+
+    TEST_ASSERT_TRUE(queued > 0);
+    outbox_update();
+    TEST_ASSERT_EQUAL(outbox_full, outbox_get_state());
+    TEST_ASSERT_EQUAL(-1, outbox_publish(outbox_lane_data, TEST_TOPIC, msg, sizeof(msg), 0, outbox_policy_drop));
+
+    // Full only refuses new messages, the lane keeps handing the buffered ones to the client
+    for(int i = 0; i < queued; i++)
+        TEST_ASSERT_TRUE(step());
+    TEST_ASSERT_EQUAL(queued, fake_mqtt_publishes);
+    TEST_ASSERT_EQUAL(data_lane->buffer_size, xMessageBufferSpacesAvailable(data_lane->buffer));
+
+    outbox_update();
+    TEST_ASSERT_EQUAL(outbox_ok, outbox_get_state());
+    TEST_ASSERT_EQUAL(0, outbox_publish(outbox_lane_data, TEST_TOPIC, msg, sizeof(msg), 0, outbox_policy_drop));
+}
+
+static void test_client_window_holds_the_lane_back(void)
+{
+    fill();
+    fake_mqtt_outbox_bytes = OUTBOX_DATA_WINDOW;
+    TEST_ASSERT_FALSE(step());
+    TEST_ASSERT_EQUAL(0, fake_mqtt_publishes);
+
+    // PUBACKs free the client's outbox, the lane moves on
+    fake_mqtt_outbox_bytes = 0;
+    TEST_ASSERT_TRUE(step());
+    TEST_ASSERT_EQUAL(1, fake_mqtt_publishes);
+}
+
+static void test_listener_woken_when_ok_again(void)
+{
+    fake_mqtt_outbox_bytes = OUTBOX_PRESSURE_BYTES;
+    outbox_update();
+    TEST_ASSERT_EQUAL(outbox_pressure, outbox_get_state());
+    fake_mqtt_outbox_bytes = OUTBOX_FULL_BYTES;
+    outbox_update();
+    TEST_ASSERT_EQUAL(outbox_full, outbox_get_state());
+    TEST_ASSERT_EQUAL(0, fake_task_notified);
+
+    fake_mqtt_outbox_bytes = 0;
+    outbox_update();
+    TEST_ASSERT_EQUAL(outbox_ok, outbox_get_state());
+    TEST_ASSERT_EQUAL(1, fake_task_notified);
+
+    // Only the change is signalled
+    outbox_update();
+    TEST_ASSERT_EQUAL(1, fake_task_notified);
+}
+
+static void test_control_overtakes_held_back_telemetry(void)
+{
+    static const char response[] = "1234ABCD";
+    int queued = fill();
+
+    // The client holds more than a window of telemetry, the data lane waits and new data is refused
+    fake_mqtt_outbox_bytes = OUTBOX_FULL_BYTES;
+    TEST_ASSERT_FALSE(step());
+    TEST_ASSERT_EQUAL(outbox_full, outbox_get_state());
+    TEST_ASSERT_EQUAL(-1, outbox_publish(outbox_lane_data, TEST_TOPIC, msg, sizeof(msg), 0, outbox_policy_drop));
+
+    // The control lane is still admitted and its task hands the message over at once
+    TEST_ASSERT_EQUAL(0, outbox_publish(outbox_lane_control, TEST_CONTROL_TOPIC, response, 0, 1, outbox_policy_drop));
+    outbox_forward(control_lane, 0);
+    TEST_ASSERT_EQUAL(1, fake_mqtt_publishes);
+    TEST_ASSERT_EQUAL_STRING(TEST_CONTROL_TOPIC, fake_mqtt_last.topic);
+    TEST_ASSERT_EQUAL_MEMORY(response, fake_mqtt_last.data, sizeof(response) - 1);
+
+    // The telemetry queued before it follows once PUBACKs open the window
+    fake_mqtt_outbox_bytes = 0;
+    for(int i = 0; i < queued; i++)
+    {
+        TEST_ASSERT_TRUE(step());
+        TEST_ASSERT_EQUAL_STRING(TEST_TOPIC, fake_mqtt_last.topic);
+    }
+    TEST_ASSERT_EQUAL(queued + 1, fake_mqtt_publishes);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_full_handoff_buffer_drains_and_recovers);
+    RUN_TEST(test_client_window_holds_the_lane_back);
+    RUN_TEST(test_listener_woken_when_ok_again);
+    RUN_TEST(test_control_overtakes_held_back_telemetry);
+    return UNITY_END();
+}
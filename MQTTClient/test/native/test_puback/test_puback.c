@@ -0,0 +1,195 @@
+/**
+ * File Name:   test_puback.c
+ * Description: Round trip timing of QoS 1 publishes, from puback_sent() to the PUBACK.
+ *
+ * The clock only moves when a test moves it, so every round trip is exact. The PUBACK events and
+ * the publishing side are called in whichever order a test needs, the way the MQTT task and the
+ * outbox lanes can interleave.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include "metrics.c"
+#include "puback.c"
+
+/***************************************************************************************************/
+/* Fakes */
+/***************************************************************************************************/
+// The metrics task is never run, nothing is published
+int outbox_publish(outbox_lane_t lane, const char *topic, const char *data, int len, int qos,
+    outbox_policy_t policy)
+{
+    return 0;
+}
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define TEST_TOPIC                          "data/sensor"
+#define TEST_START_US                       1000000
+
+static esp_mqtt_client_handle_t client_a = (esp_mqtt_client_handle_t)&client_a;
+static esp_mqtt_client_handle_t client_b = (esp_mqtt_client_handle_t)&client_b;
+
+static void advance_ms(uint32_t ms)
+{
+    fake_time_us += (int64_t)ms * 1000;
+}
+
+static uint32_t metric(const char *name)
+{
+    return metrics_get(metrics_find(name));
+}
+
+static int slots_in_use(void)
+{
+    int n = 0;
+
+    for(int i = 0; i < PUBACK_OUTSTANDING_MAX; i++)
+        n += puback_slots[i].msg_id != 0;
+    return n;
+}
+
+void setUp(void)
+{
+    memset(puback_slots, 0, sizeof(puback_slots));
+    memset(puback_topics, 0, sizeof(puback_topics));
+    puback_topics_num = 0;
+    metrics_num = 0;
+    fake_time_us = TEST_START_US;
+    puback_init();
+}
+
+void tearDown(void)
+{
+    TEST_ASSERT_EQUAL(0, fake_mutex_held);
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_puback_before_sent_is_timed(void)
+{
+    int64_t start_us = fake_time_us;
+    puback_topic_t *t;
+
+    // The PUBACK arrives before the publishing task got to record the msg_id
+    advance_ms(30);
+    puback_acked(client_a, 5);
+    TEST_ASSERT_EQUAL(1, slots_in_use());
+    TEST_ASSERT_EQUAL(0, puback_oldest_ms());
+    TEST_ASSERT_EQUAL(0, metric("ack_ok"));
+
+    advance_ms(5);
+    puback_sent(client_a, TEST_TOPIC, 5, start_us);
+    t = &puback_topics[0];
+    TEST_ASSERT_EQUAL(1, t->acked);
+    TEST_ASSERT_EQUAL(30, t->max_ms);
+    TEST_ASSERT_EQUAL(1, t->hist[puback_bucket(30)]);
+    TEST_ASSERT_EQUAL(1, metric("ack_ok"));
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+}
+
+static void test_same_msg_id_on_two_clients(void)
+{
+    puback_topic_t *t;
+
+    puback_sent(client_a, TEST_TOPIC, 7, fake_time_us);
+    advance_ms(10);
+    puback_sent(client_b, TEST_TOPIC, 7, fake_time_us);
+
+    // msg_ids are per client, the PUBACK of one leaves the other outstanding
+    advance_ms(20);
+    puback_acked(client_b, 7);
+    t = &puback_topics[0];
+    TEST_ASSERT_EQUAL(1, t->acked);
+    TEST_ASSERT_EQUAL(20, t->max_ms);
+    TEST_ASSERT_EQUAL(1, slots_in_use());
+    TEST_ASSERT_EQUAL(30, puback_oldest_ms());
+
+    advance_ms(20);
+    puback_acked(client_a, 7);
+    TEST_ASSERT_EQUAL(2, t->acked);
+    TEST_ASSERT_EQUAL(50, t->max_ms);
+    TEST_ASSERT_EQUAL(70, t->total_ms);
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+}
+
+static void test_expires_after_the_timeout(void)
+{
+    puback_topic_t *t;
+
+    puback_sent(client_a, TEST_TOPIC, 1, fake_time_us);
+    t = &puback_topics[0];
+    fake_time_us += (int64_t)PUBACK_TIMEOUT_MS * 1000 - 1;
+    TEST_ASSERT_EQUAL(PUBACK_TIMEOUT_MS - 1, puback_oldest_ms());
+    TEST_ASSERT_EQUAL(0, metric("ack_tmo"));
+
+    fake_time_us++;
+    TEST_ASSERT_EQUAL(0, puback_oldest_ms());
+    TEST_ASSERT_EQUAL(1, metric("ack_tmo"));
+    TEST_ASSERT_EQUAL(1, t->timeouts);
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+
+    // The late PUBACK finds nothing to close, it waits for a publish and then expires uncounted
+    puback_acked(client_a, 1);
+    TEST_ASSERT_EQUAL(0, t->acked);
+    TEST_ASSERT_EQUAL(1, slots_in_use());
+    advance_ms(PUBACK_TIMEOUT_MS);
+    TEST_ASSERT_EQUAL(0, puback_oldest_ms());
+    TEST_ASSERT_EQUAL(1, metric("ack_tmo"));
+    TEST_ASSERT_EQUAL(0, slots_in_use());
+}
+
+static void test_exhaustion_is_counted_untracked(void)
+{
+    static char topics[PUBACK_TOPICS_MAX + 1][16];
+
+    for(int i = 1; i <= PUBACK_OUTSTANDING_MAX; i++)
+        puback_sent(client_a, TEST_TOPIC, i, fake_time_us);
+    TEST_ASSERT_EQUAL(PUBACK_OUTSTANDING_MAX, slots_in_use());
+    TEST_ASSERT_EQUAL(0, metric("ack_untracked"));
+
+    // No slot left, the publish goes out untimed
+    puback_sent(client_a, TEST_TOPIC, PUBACK_OUTSTANDING_MAX + 1, fake_time_us);
+    TEST_ASSERT_EQUAL(1, metric("ack_untracked"));
+    // Its PUBACK finds no slot either and is dropped
+    puback_acked(client_a, PUBACK_OUTSTANDING_MAX + 1);
+    TEST_ASSERT_EQUAL(0, metric("ack_ok"));
+
+    // Neither is a topic beyond PUBACK_TOPICS_MAX
+    setUp();
+    for(int i = 0; i <= PUBACK_TOPICS_MAX; i++)
+    {
+        snprintf(topics[i], sizeof(topics[i]), "data/%d", i);
+        puback_sent(client_a, topics[i], i + 1, fake_time_us);
+    }
+    TEST_ASSERT_EQUAL(PUBACK_TOPICS_MAX, puback_topics_num);
+    TEST_ASSERT_EQUAL(PUBACK_TOPICS_MAX, slots_in_use());
+    TEST_ASSERT_EQUAL(1, metric("ack_untracked"));
+}
+
+static void test_bucket_boundaries(void)
+{
+    TEST_ASSERT_EQUAL(0, puback_bucket(0));
+    for(int i = 0; i < PUBACK_HIST_BUCKETS - 1; i++)
+    {
+        TEST_ASSERT_EQUAL(i, puback_bucket((PUBACK_HIST_BASE_MS << i) - 1));
+        TEST_ASSERT_EQUAL(i + 1, puback_bucket(PUBACK_HIST_BASE_MS << i));
+    }
+    // The last bucket is open ended
+    TEST_ASSERT_EQUAL(PUBACK_HIST_BUCKETS - 1, puback_bucket(UINT32_MAX));
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_puback_before_sent_is_timed);
+    RUN_TEST(test_same_msg_id_on_two_clients);
+    RUN_TEST(test_expires_after_the_timeout);
+    RUN_TEST(test_exhaustion_is_counted_untracked);
+    RUN_TEST(test_bucket_boundaries);
+    return UNITY_END();
+}
@@ -0,0 +1,234 @@
+/**
+ * File Name:   test_publisher.c
+ * Description: Batching and flush triggers of the telemetry publisher.
+ *
+ * The publisher hands its batches to the outbox, which is replaced here by a recorder, so what a
+ * flush would put on data/sensor can be checked without a client.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include <time.h>
+#include "metrics.c"
+#include "publisher.c"
+
+/***************************************************************************************************/
+/* Fakes */
+/***************************************************************************************************/
+static struct {
+    const char *topic;
+    char data[PUBLISHER_PAYLOAD_MAX + 1];
+    int len;
+    int qos;
+    outbox_policy_t policy;
+    int calls;
+    bool refuse;
+} outbox;
+
+int outbox_publish(outbox_lane_t lane, const char *topic, const char *data, int len, int qos,
+    outbox_policy_t policy)
+{
+    outbox.calls++;
+    if(outbox.refuse)
+        return -1;
+    outbox.topic = topic;
+    memcpy(outbox.data, data, len);
+    outbox.data[len] = '\0';
+    outbox.len = len;
+    outbox.qos = qos;
+    outbox.policy = policy;
+    return 0;
+}
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+#define BENCH_SAMPLES                       100000
+#define BENCH_PERIOD_MS                     200
+#define BENCH_MAX_AGE_MS                    2000
+
+static publisher_t pub;
+
+static htu21_data_t reading(float temperature, float humidity)
+{
+    htu21_data_t data = { temperature, humidity, 0x6000, 0x7000 };
+    return data;
+}
+
+static int count(const char *haystack, const char *needle)
+{
+    int n = 0;
+
+    for(const char *p = strstr(haystack, needle); p != NULL; p = strstr(p + 1, needle))
+        n++;
+    return n;
+}
+
+void setUp(void)
+{
+    memset(&outbox, 0, sizeof(outbox));
+    fake_tick_count = 0;
+    TEST_ASSERT_EQUAL(0, publisher_init(&pub, NULL, publisher_encoding_json));
+}
+
+void tearDown(void)
+{
+    TEST_ASSERT_EQUAL(0, fake_mutex_held);
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_flush_when_the_sample_limit_is_reached(void)
+{
+    htu21_data_t data = reading(71.5f, 40.25f);
+
+    publisher_set_limits(&pub, 3, 60000);
+    TEST_ASSERT_EQUAL(0, publisher_push(&pub, &data));
+    TEST_ASSERT_EQUAL(0, publisher_push(&pub, &data));
+    TEST_ASSERT_EQUAL(0, outbox.calls);
+
+    TEST_ASSERT_EQUAL(3, publisher_push(&pub, &data));
+    TEST_ASSERT_EQUAL(1, outbox.calls);
+    TEST_ASSERT_EQUAL_STRING(PUBLISHER_TOPIC, outbox.topic);
+    TEST_ASSERT_EQUAL(1, outbox.qos);
+    TEST_ASSERT_EQUAL(outbox_policy_spill, outbox.policy);
+    TEST_ASSERT_EQUAL(3, count(outbox.data, "\"temperature\":71.50"));
+    TEST_ASSERT_EQUAL(0, pub.count);
+    TEST_ASSERT_EQUAL(1, pub.stats.messages);
+    TEST_ASSERT_EQUAL(3, pub.stats.samples);
+    TEST_ASSERT_EQUAL(outbox.len, pub.stats.bytes);
+}
+
+static void test_flush_when_the_oldest_sample_is_too_old(void)
+{
+    htu21_data_t data = reading(70.0f, 50.0f);
+
+    publisher_set_limits(&pub, PUBLISHER_RING_SIZE, 1000);
+    TEST_ASSERT_EQUAL(0, publisher_push(&pub, &data));
+    fake_tick_count = pdMS_TO_TICKS(400);
+    TEST_ASSERT_EQUAL(0, publisher_push(&pub, &data));
+
+    fake_tick_count = pdMS_TO_TICKS(999);
+    TEST_ASSERT_EQUAL(0, publisher_poll(&pub));
+    TEST_ASSERT_EQUAL(0, outbox.calls);
+
+    // The age is the oldest sample's, the newer one goes out with it
+    fake_tick_count = pdMS_TO_TICKS(1000);
+    TEST_ASSERT_EQUAL(2, publisher_poll(&pub));
+    TEST_ASSERT_EQUAL(1, outbox.calls);
+    TEST_ASSERT_EQUAL(1000, pub.stats.flush_latency_ms);
+}
+
+static void test_refused_batch_stays_buffered(void)
+{
+    htu21_data_t data = reading(70.0f, 50.0f);
+
+    publisher_set_limits(&pub, 2, 60000);
+    outbox.refuse = true;
+    TEST_ASSERT_EQUAL(0, publisher_push(&pub, &data));
+    TEST_ASSERT_EQUAL(-1, publisher_push(&pub, &data));
+    TEST_ASSERT_EQUAL(2, pub.count);
+    TEST_ASSERT_EQUAL(0, pub.stats.messages);
+
+    outbox.refuse = false;
+    TEST_ASSERT_EQUAL(2, publisher_flush(&pub));
+    TEST_ASSERT_EQUAL(2, count(outbox.data, "\"ts\":"));
+    TEST_ASSERT_EQUAL(0, pub.count);
+}
+
+static void test_full_ring_drops_the_oldest_sample(void)
+{
+    publisher_sample_t sample;
+
+    memset(&sample, 0, sizeof(sample));
+    publisher_set_limits(&pub, PUBLISHER_RING_SIZE, 60000);
+    outbox.refuse = true;
+    for(uint32_t i = 0; i < PUBLISHER_RING_SIZE + 2; i++)
+    {
+        sample.timestamp = 1000 + i;
+        publisher_push_sample(&pub, &sample);
+    }
+    TEST_ASSERT_EQUAL(PUBLISHER_RING_SIZE, pub.count);
+    TEST_ASSERT_EQUAL(2, pub.stats.dropped);
+
+    outbox.refuse = false;
+    TEST_ASSERT_EQUAL(PUBLISHER_RING_SIZE, publisher_flush(&pub));
+    TEST_ASSERT_TRUE(strstr(outbox.data, "{\"samples\":[{\"ts\":1002,") != NULL);
+}
+
+static void test_batch_larger_than_the_payload_is_split(void)
+{
+    htu21_data_t data = reading(70.0f, 50.0f);
+    aggregator_summary_t summary = { 10, { 69.5f, 70.5f, 70.0f, 0.25f }, { 49.0f, 51.0f, 50.0f, 0.5f } };
+    int first, sent;
+
+    publisher_set_limits(&pub, PUBLISHER_RING_SIZE, 60000);
+    for(int i = 0; i < PUBLISHER_RING_SIZE - 1; i++)
+        publisher_push_window(&pub, &data, &summary);
+
+    // Window statistics make a full ring larger than one payload, the rest waits for the next flush
+    first = publisher_flush(&pub);
+    TEST_ASSERT_GREATER_THAN(0, first);
+    TEST_ASSERT_LESS_THAN(PUBLISHER_RING_SIZE - 1, first);
+    TEST_ASSERT_LESS_THAN(PUBLISHER_PAYLOAD_MAX, outbox.len);
+    TEST_ASSERT_EQUAL('}', outbox.data[outbox.len - 1]);
+    TEST_ASSERT_EQUAL(first, count(outbox.data, "\"n\":10"));
+
+    for(sent = first; pub.count > 0; sent += first)
+    {
+        first = publisher_flush(&pub);
+        TEST_ASSERT_GREATER_THAN(0, first);
+        TEST_ASSERT_LESS_THAN(PUBLISHER_PAYLOAD_MAX, outbox.len);
+    }
+    TEST_ASSERT_EQUAL(PUBLISHER_RING_SIZE - 1, sent);
+    TEST_ASSERT_EQUAL(PUBLISHER_RING_SIZE - 1, pub.stats.samples);
+}
+
+static void test_bench_push_and_poll(void)
+{
+    static const char *names[] = { "json", "packed" };
+    struct timespec start, now;
+    htu21_data_t data;
+    double s;
+    char msg[128];
+
+    for(int e = publisher_encoding_json; e <= publisher_encoding_packed; e++)
+    {
+        // A sample every BENCH_PERIOD_MS, batches go out on age the way the sensor task drives them
+        TEST_ASSERT_EQUAL(0, publisher_init(&pub, NULL, e));
+        publisher_set_limits(&pub, PUBLISHER_RING_SIZE, BENCH_MAX_AGE_MS);
+        fake_tick_count = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for(uint32_t i = 0; i < BENCH_SAMPLES; i++)
+        {
+            data = reading(70.0f + (i % 100) / 10.0f, 40.0f + (i % 50) / 5.0f);
+            publisher_push(&pub, &data);
+            fake_tick_count += pdMS_TO_TICKS(BENCH_PERIOD_MS);
+            publisher_poll(&pub);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        s = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+
+        TEST_ASSERT_TRUE(pub.stats.messages > 0);
+        TEST_ASSERT_EQUAL(BENCH_SAMPLES, pub.stats.samples + pub.count);
+        snprintf(msg, sizeof(msg), "%-6s %u messages of %.1f samples: %.0f messages/s, %.1f bytes/message",
+            names[e], pub.stats.messages, (double)pub.stats.samples / pub.stats.messages,
+            pub.stats.messages / s, (double)pub.stats.bytes / pub.stats.messages);
+        TEST_MESSAGE(msg);
+    }
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_flush_when_the_sample_limit_is_reached);
+    RUN_TEST(test_flush_when_the_oldest_sample_is_too_old);
+    RUN_TEST(test_refused_batch_stays_buffered);
+    RUN_TEST(test_full_ring_drops_the_oldest_sample);
+    RUN_TEST(test_batch_larger_than_the_payload_is_split);
+    RUN_TEST(test_bench_push_and_poll);
+    return UNITY_END();
+}
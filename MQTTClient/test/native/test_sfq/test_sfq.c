@@ -0,0 +1,266 @@
+/**
+ * File Name:   test_sfq.c
+ * Description: Store-and-forward queue on the file backend, and what a drain commits.
+ *
+ * The queue runs on a temporary file with NOR semantics. The drain tests put the node's store on
+ * the same file and replace the outbox with a recorder that can refuse batches.
+ */
+
+/***************************************************************************************************/
+/* Include Files */
+/***************************************************************************************************/
+#include <unity.h>
+#include <time.h>
+#include <unistd.h>
+#include "metrics.c"
+#include "htu21_fixed.c"
+#include "publisher.c"
+#include "sfq.c"
+#include "sfq_store.c"
+
+/***************************************************************************************************/
+/* Fakes */
+/***************************************************************************************************/
+static struct {
+    char data[PUBLISHER_PAYLOAD_MAX + 1];
+    int calls;
+    bool refuse;
+} outbox;
+
+int outbox_publish(outbox_lane_t lane, const char *topic, const char *data, int len, int qos,
+    outbox_policy_t policy)
+{
+    outbox.calls++;
+    if(outbox.refuse)
+        return -1;
+    memcpy(outbox.data, data, len);
+    outbox.data[len] = '\0';
+    return 0;
+}
+
+/***************************************************************************************************/
+/* Helpers */
+/***************************************************************************************************/
+// Small sectors so the tests wrap the ring, the benchmark uses the partition's geometry
+#define TEST_SECTOR_SIZE                    256
+#define TEST_FLASH_SIZE                     (4 * TEST_SECTOR_SIZE)
+#define TEST_RECORDS_PER_SECTOR             (TEST_SECTOR_SIZE / SFQ_RECORD_SIZE)
+#define BENCH_FLASH_SIZE                    (64 * 1024)
+#define BENCH_SECTOR_SIZE                   4096
+#define BENCH_RECORDS                       (BENCH_FLASH_SIZE / SFQ_RECORD_SIZE)
+
+static char path[64];
+static sfq_flash_t flash;
+static sfq_t sfq;
+
+static sfq_entry_t entry(uint32_t i)
+{
+    sfq_entry_t e = { 1700000000 + i, (uint16_t)(0x6000 + i), (uint16_t)(0x7000 + i) };
+    return e;
+}
+
+static void append(uint32_t first, uint32_t n)
+{
+    for(uint32_t i = first; i < first + n; i++)
+    {
+        sfq_entry_t e = entry(i);
+        TEST_ASSERT_EQUAL(0, sfq_append(&sfq, &e));
+    }
+}
+
+static void reopen(uint32_t size, uint32_t sector_size)
+{
+    sfq_flash_file_close(&flash);
+    TEST_ASSERT_EQUAL(0, sfq_flash_file_open(&flash, path, size, sector_size));
+    TEST_ASSERT_EQUAL(0, sfq_init(&sfq, &flash));
+}
+
+static double elapsed_us(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e6 + (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+void setUp(void)
+{
+    int fd;
+
+    memset(&outbox, 0, sizeof(outbox));
+    snprintf(path, sizeof(path), "%s/sfq_XXXXXX", P_tmpdir);
+    fd = mkstemp(path);
+    TEST_ASSERT_TRUE(fd >= 0);
+    close(fd);
+    // The empty file is not the requested size, so it is erased
+    TEST_ASSERT_EQUAL(0, sfq_flash_file_open(&flash, path, TEST_FLASH_SIZE, TEST_SECTOR_SIZE));
+    TEST_ASSERT_EQUAL(0, sfq_init(&sfq, &flash));
+}
+
+void tearDown(void)
+{
+    sfq_flash_file_close(&flash);
+    remove(path);
+}
+
+/***************************************************************************************************/
+/* Tests */
+/***************************************************************************************************/
+static void test_peek_does_not_consume(void)
+{
+    sfq_entry_t out[8];
+
+    append(0, 5);
+    TEST_ASSERT_EQUAL(5, sfq_pending(&sfq));
+    TEST_ASSERT_EQUAL(3, sfq_peek(&sfq, out, 3));
+    TEST_ASSERT_EQUAL(3, sfq_peek(&sfq, out, 3));
+    TEST_ASSERT_EQUAL_UINT32(entry(0).timestamp, out[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT16(entry(2).humidity_adc, out[2].humidity_adc);
+    TEST_ASSERT_EQUAL(5, sfq_pending(&sfq));
+
+    TEST_ASSERT_EQUAL(0, sfq_consume(&sfq, 3));
+    TEST_ASSERT_EQUAL(2, sfq_pending(&sfq));
+    TEST_ASSERT_EQUAL(2, sfq_peek(&sfq, out, 8));
+    TEST_ASSERT_EQUAL_UINT32(entry(3).timestamp, out[0].timestamp);
+    TEST_ASSERT_EQUAL(3, sfq.stats.drained);
+}
+
+static void test_reopen_recovers_head_and_tail(void)
+{
+    sfq_entry_t out[8];
+
+    append(0, 6);
+    TEST_ASSERT_EQUAL(0, sfq_consume(&sfq, 2));
+    // Peeked but not consumed before the reboot, still there after it
+    TEST_ASSERT_EQUAL(2, sfq_peek(&sfq, out, 2));
+
+    reopen(TEST_FLASH_SIZE, TEST_SECTOR_SIZE);
+    TEST_ASSERT_EQUAL(4, sfq_pending(&sfq));
+    TEST_ASSERT_EQUAL(4, sfq_peek(&sfq, out, 8));
+    TEST_ASSERT_EQUAL_UINT32(entry(2).timestamp, out[0].timestamp);
+    TEST_ASSERT_EQUAL_UINT32(entry(5).timestamp, out[3].timestamp);
+
+    append(6, 1);
+    TEST_ASSERT_EQUAL(5, sfq_peek(&sfq, out, 8));
+    TEST_ASSERT_EQUAL_UINT32(entry(6).timestamp, out[4].timestamp);
+}
+
+static void test_full_ring_reclaims_the_oldest_sector(void)
+{
+    const uint32_t total = TEST_FLASH_SIZE / SFQ_RECORD_SIZE + 3;
+    sfq_entry_t out[1];
+
+    // The fourth record past a full ring needs the first sector back
+    append(0, total);
+    TEST_ASSERT_EQUAL(TEST_RECORDS_PER_SECTOR, sfq.stats.overwritten);
+    TEST_ASSERT_EQUAL(total - TEST_RECORDS_PER_SECTOR, sfq_pending(&sfq));
+    TEST_ASSERT_EQUAL(1, sfq_peek(&sfq, out, 1));
+    TEST_ASSERT_EQUAL_UINT32(entry(TEST_RECORDS_PER_SECTOR).timestamp, out[0].timestamp);
+    TEST_ASSERT_EQUAL(5, sfq.stats.erases);
+
+    reopen(TEST_FLASH_SIZE, TEST_SECTOR_SIZE);
+    TEST_ASSERT_EQUAL(total - TEST_RECORDS_PER_SECTOR, sfq_pending(&sfq));
+    TEST_ASSERT_EQUAL(1, sfq_peek(&sfq, out, 1));
+    TEST_ASSERT_EQUAL_UINT32(entry(TEST_RECORDS_PER_SECTOR).timestamp, out[0].timestamp);
+}
+
+static void test_corrupt_record_is_passed_over(void)
+{
+    const uint8_t flipped = 0x00;
+    sfq_entry_t out[4];
+
+    append(0, 3);
+    // Clear the bits of the second record's timestamp, its CRC no longer matches
+    TEST_ASSERT_EQUAL(0, flash.write(&flash, SFQ_RECORD_SIZE + offsetof(sfq_record_t, timestamp), &flipped, 1));
+
+    TEST_ASSERT_EQUAL(2, sfq_peek(&sfq, out, 4));
+    TEST_ASSERT_EQUAL_UINT32(entry(2).timestamp, out[1].timestamp);
+    TEST_ASSERT_EQUAL(0, sfq_consume(&sfq, 2));
+    TEST_ASSERT_EQUAL(0, sfq_pending(&sfq));
+    TEST_ASSERT_EQUAL(1, sfq.stats.errors);
+}
+
+static void test_refused_drain_keeps_the_samples(void)
+{
+    static sfq_store_t store;
+    static publisher_t pub;
+    publisher_sample_t sample;
+
+    // The store takes the queue's flash over
+    memset(&store, 0, sizeof(store));
+    store.flash = flash;
+    flash.ctx = NULL;
+    TEST_ASSERT_EQUAL(0, sfq_store_init(&store));
+    TEST_ASSERT_EQUAL(0, publisher_init(&pub, NULL, publisher_encoding_json));
+
+    memset(&sample, 0, sizeof(sample));
+    for(uint32_t i = 0; i < 5; i++)
+    {
+        sample.timestamp = entry(i).timestamp;
+        sample.data.temperature_adc = entry(i).temperature_adc;
+        sample.data.humidity_adc = entry(i).humidity_adc;
+        TEST_ASSERT_EQUAL(0, sfq_store_append(&store, &sample));
+    }
+
+    outbox.refuse = true;
+    TEST_ASSERT_EQUAL(-1, sfq_store_drain(&store, &pub, 3));
+    TEST_ASSERT_EQUAL(5, sfq_store_pending(&store));
+    // Nothing went through the publisher's ring, where it could have been dropped
+    TEST_ASSERT_EQUAL(0, pub.count);
+
+    outbox.refuse = false;
+    TEST_ASSERT_EQUAL(3, sfq_store_drain(&store, &pub, 3));
+    TEST_ASSERT_EQUAL(2, sfq_store_pending(&store));
+    TEST_ASSERT_TRUE(strstr(outbox.data, "{\"ts\":1700000000,\"temperature\":") != NULL);
+    TEST_ASSERT_TRUE(strstr(outbox.data, "{\"ts\":1700000002,") != NULL);
+    TEST_ASSERT_TRUE(strstr(outbox.data, "{\"ts\":1700000003,") == NULL);
+
+    TEST_ASSERT_EQUAL(2, sfq_store_drain(&store, &pub, SFQ_DRAIN_BURST));
+    TEST_ASSERT_EQUAL(0, sfq_store_pending(&store));
+    TEST_ASSERT_EQUAL(0, sfq_store_drain(&store, &pub, SFQ_DRAIN_BURST));
+    TEST_ASSERT_EQUAL(0, fake_mutex_held);
+
+    flash = store.flash;
+}
+
+static void test_bench_file_backend(void)
+{
+    sfq_entry_t out[SFQ_DRAIN_BURST];
+    struct timespec start;
+    double append_us, drain_us;
+    uint32_t drained = 0;
+    char msg[160];
+    int n;
+
+    reopen(BENCH_FLASH_SIZE, BENCH_SECTOR_SIZE);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    append(0, BENCH_RECORDS - 1);
+    append_us = elapsed_us(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while((n = sfq_peek(&sfq, out, SFQ_DRAIN_BURST)) > 0)
+    {
+        TEST_ASSERT_EQUAL(0, sfq_consume(&sfq, n));
+        drained += n;
+    }
+    drain_us = elapsed_us(&start);
+
+    TEST_ASSERT_EQUAL(BENCH_RECORDS - 1, drained);
+    TEST_ASSERT_EQUAL(0, sfq_pending(&sfq));
+    snprintf(msg, sizeof(msg), "%u records, %u erases: append %.2f us/record, drain in bursts of %d %.2f us/record",
+        (unsigned)drained, (unsigned)sfq.stats.erases, append_us / drained, SFQ_DRAIN_BURST, drain_us / drained);
+    TEST_MESSAGE(msg);
+}
+
+int main(void)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_peek_does_not_consume);
+    RUN_TEST(test_reopen_recovers_head_and_tail);
+    RUN_TEST(test_full_ring_reclaims_the_oldest_sector);
+    RUN_TEST(test_corrupt_record_is_passed_over);
+    RUN_TEST(test_refused_drain_keeps_the_samples);
+    RUN_TEST(test_bench_file_backend);
+    return UNITY_END();
+}